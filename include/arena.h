@@ -0,0 +1,103 @@
+#ifndef SSE_ARENA_H
+#define SSE_ARENA_H
+
+#include <stddef.h>
+#include "vec4.h"
+#include "mat4.h"
+
+/*
+ * Aligned memory for vec4_t/mat4_t arrays that doesn't go through malloc on
+ * every frame. An arena hands out blocks from one big mapping by bumping a
+ * pointer and is reset all at once, or back to a mark, at the end of a frame.
+ * A pool hands out fixed size slots, eg. one matrix per object, that can be
+ * freed individually and are reused through a free list.
+ *
+ * Every block starts on a cache line and is padded out to a whole number of
+ * cache lines, so _mm_load_ps/_mm256_load_ps on them is always safe and two
+ * blocks never share a line (eg. buffers being written by different threads)
+ */
+#define ARENA_CACHE_LINE 64
+
+enum arena_flags {
+	/*
+	 * Try to back the memory with 2MB huge pages, if there are none reserved
+	 * we fall back to asking for transparent huge pages
+	 */
+	ARENA_HUGE_PAGES = 1
+};
+struct arena {
+	char *base;
+	size_t size, offset;
+	/* Size of the mapping, size rounded up to the page size */
+	size_t mapped;
+	int flags;
+};
+/* A position in the arena to reset back to, see arena_mark */
+typedef size_t arena_mark_t;
+/*
+ * Set up an arena able to hold size bytes, returns 0 if the memory couldn't
+ * be mapped
+ */
+int arena_init(struct arena *a, size_t size, int flags);
+void arena_destroy(struct arena *a);
+/*
+ * Allocate size bytes aligned to align, which must be a power of two no
+ * bigger than the page size. Blocks are always at least cache line aligned.
+ * Returns NULL if the arena is full
+ */
+void* arena_alloc(struct arena *a, size_t size, size_t align);
+/* Get the current position of the arena, to free everything allocated after it later */
+static inline arena_mark_t arena_mark(const struct arena *a){
+	return a->offset;
+}
+/* Free everything allocated since the mark was taken */
+static inline void arena_reset_to(struct arena *a, arena_mark_t mark){
+	a->offset = mark;
+}
+/* Free everything in the arena, eg. at the end of a frame */
+static inline void arena_reset(struct arena *a){
+	a->offset = 0;
+}
+/* Get the number of bytes that can still be allocated */
+static inline size_t arena_remaining(const struct arena *a){
+	return a->size - a->offset;
+}
+static inline vec4_t* arena_alloc_vec4(struct arena *a, size_t n){
+	return arena_alloc(a, n * sizeof(vec4_t), ARENA_CACHE_LINE);
+}
+static inline mat4_t* arena_alloc_mat4(struct arena *a, size_t n){
+	return arena_alloc(a, n * sizeof(mat4_t), ARENA_CACHE_LINE);
+}
+
+/*
+ * Fixed size slots carved out of chunks mapped as needed. Freed slots go on
+ * a free list and are handed out again first, the chunks are only released
+ * by pool_destroy
+ */
+struct pool_chunk;
+struct pool {
+	size_t slot_size, slots_per_chunk;
+	int flags;
+	void *free_list;
+	struct pool_chunk *chunks;
+	/* Number of slots currently allocated */
+	size_t live;
+};
+/*
+ * Set up a pool of slots of slot_size bytes aligned to align (a power of two
+ * no bigger than the cache line), mapping slots_per_chunk slots at a time
+ */
+void pool_init(struct pool *p, size_t slot_size, size_t align, size_t slots_per_chunk, int flags);
+void pool_destroy(struct pool *p);
+/* Get a slot, returns NULL if a new chunk was needed and couldn't be mapped */
+void* pool_alloc(struct pool *p);
+void pool_free(struct pool *p, void *slot);
+/* A mat4_t is exactly one cache line so a pool of them keeps each matrix on its own line */
+static inline void mat4_pool_init(struct pool *p, int flags){
+	pool_init(p, sizeof(mat4_t), ARENA_CACHE_LINE, 1024, flags);
+}
+static inline mat4_t* mat4_pool_alloc(struct pool *p){
+	return pool_alloc(p);
+}
+
+#endif
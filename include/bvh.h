@@ -0,0 +1,204 @@
+#ifndef SSE_BVH_H
+#define SSE_BVH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "vec4.h"
+#include "ray.h"
+#include "arena.h"
+
+/*
+ * 4 wide bounding volume hierarchy (QBVH) over a triangle soup, a flat vec4_t
+ * array with 3 vertices per triangle like the ones we hand to GL.
+ *
+ * bvh_build splits the triangles top down with a binned surface area
+ * heuristic, giving each node up to 4 children by repeatedly splitting the
+ * child with the biggest area. Subtrees over BVH_PARALLEL_MIN triangles are
+ * forked off to a jobs.h pool. The leaves hold the triangles as tri4_t
+ * packs, so one ray is tested against 4 triangles at once like it's tested
+ * against the 4 child boxes of a node.
+ *
+ * Each node is one cache line: the child boxes are stored as 8 bit offsets
+ * from the node's origin, rounded outwards so the decoded boxes always
+ * contain the real ones.
+ *
+ * bvh_refit updates the boxes (and triangles) for moved vertices without
+ * changing the tree, which is much cheaper than rebuilding for meshes that
+ * only deform but the tree gets worse the more they move
+ */
+/* Child reference bits: leaves have the top bit set, then 3 bits of tri4_t count - 1 and the first tri4_t */
+#define BVH_LEAF 0x80000000u
+#define BVH_LEAF_SHIFT 28
+#define BVH_LEAF_FIRST 0x0fffffffu
+/* Unused child slots, always after the used ones */
+#define BVH_EMPTY 0xffffffffu
+/* Most triangles a leaf will hold, leaves with 4 or fewer are always made */
+#define BVH_LEAF_MAX 16
+/* Subtrees with fewer triangles than this are built on the thread that split them off */
+#define BVH_PARALLEL_MIN 4096
+/*
+ * Past this depth the builder just splits in half, which keeps the depth and
+ * so the traversal stack bounded (each level pushes at most 3 more entries)
+ */
+#define BVH_MAX_DEPTH 48
+#define BVH_STACK (3 * (BVH_MAX_DEPTH + 16) + 1)
+
+struct bvh_node {
+	float origin[3], scale[3];
+	/* Child boxes, [axis][0 for min, 1 for max][child], child box = origin + q * scale */
+	uint8_t q[3][2][4];
+	uint32_t child[4];
+} ALIGN_64;
+
+struct bvh {
+	/* The root is node 0 and children always come after their parents */
+	struct bvh_node *nodes;
+	size_t node_count;
+	tri4_t *tris;
+	size_t tri4_count, tri_count;
+	/* Bounds of each node's subtree, used when refitting */
+	aabb_t *bounds;
+	struct arena mem;
+};
+/*
+ * Build a BVH over the n triangles in verts using threads threads (including
+ * the caller). The prim of a hit is the index of the triangle. Returns 0 if
+ * the memory couldn't be allocated
+ */
+int bvh_build(struct bvh *b, const vec4_t *verts, size_t n, int threads);
+void bvh_destroy(struct bvh *b);
+/*
+ * Update the BVH for new vertex positions, verts must have the same triangles
+ * in the same order as it was built with
+ */
+void bvh_refit(struct bvh *b, const vec4_t *verts);
+/* Bounds of everything in the BVH */
+static inline aabb_t bvh_bounds(const struct bvh *b){
+	return b->bounds[0];
+}
+
+/* Expand 4 8 bit values to floats */
+static inline __m128 bvh_unpack_q(const uint8_t q[4]){
+	int32_t packed;
+	memcpy(&packed, q, sizeof(packed));
+	__m128i v = _mm_cvtsi32_si128(packed);
+#ifdef __SSE4_1__
+	v = _mm_cvtepu8_epi32(v);
+#else
+	v = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+	v = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+#endif
+	return _mm_cvtepi32_ps(v);
+}
+/*
+ * Decode the near and far planes of a node's child boxes for a ray with
+ * direction signs neg, in the form ray_slab_test4 wants
+ */
+static inline void bvh_node_planes(const struct bvh_node *n, const int neg[3], __m128 near[3], __m128 far[3]){
+	for (int i = 0; i < 3; ++i){
+		__m128 origin = _mm_set1_ps(n->origin[i]);
+		__m128 scale = _mm_set1_ps(n->scale[i]);
+		near[i] = _mm_add_ps(_mm_mul_ps(bvh_unpack_q(n->q[i][neg[i]]), scale), origin);
+		far[i] = _mm_add_ps(_mm_mul_ps(bvh_unpack_q(n->q[i][!neg[i]]), scale), origin);
+	}
+}
+/*
+ * Find the closest hit along the ray, updating hit if there's one closer than
+ * hit->t. Returns 1 if hit was updated. Children are visited nearest first and
+ * anything further than the closest hit so far is skipped
+ */
+static inline int bvh_intersect(const struct bvh *b, const ray_t *r, hit_t *hit){
+	struct {
+		uint32_t ref;
+		float t;
+	} stack[BVH_STACK];
+	__m128 o[3], inv_d[3];
+	int neg[3], found = 0, sp = 0;
+	for (int i = 0; i < 3; ++i){
+		o[i] = _mm_set1_ps(r->o.f[i]);
+		inv_d[i] = _mm_set1_ps(r->inv_d.f[i]);
+		neg[i] = r->inv_d.f[i] < 0;
+	}
+	stack[sp].ref = 0;
+	stack[sp++].t = 0;
+	while (sp){
+		--sp;
+		if (stack[sp].t > hit->t){
+			continue;
+		}
+		uint32_t ref = stack[sp].ref;
+		if (ref & BVH_LEAF){
+			const tri4_t *tris = b->tris + (ref & BVH_LEAF_FIRST);
+			size_t count = ((ref & ~BVH_LEAF) >> BVH_LEAF_SHIFT) + 1;
+			for (size_t i = 0; i < count; ++i){
+				found |= ray_intersect_tri4(r, tris + i, hit) != 0;
+			}
+			continue;
+		}
+		const struct bvh_node *n = b->nodes + ref;
+		__m128 near[3], far[3], tn;
+		bvh_node_planes(n, neg, near, far);
+		int mask = _mm_movemask_ps(ray_slab_test4(o, inv_d, near, far, _mm_set1_ps(hit->t), &tn));
+		float ALIGN_16 t_near[4];
+		_mm_store_ps(t_near, tn);
+		/* Push the children hit in order of decreasing distance, so the nearest is popped first */
+		int base = sp;
+		for (int i = 0; i < 4; ++i){
+			if (!(mask & (1 << i)) || n->child[i] == BVH_EMPTY){
+				continue;
+			}
+			int j = sp++;
+			for (; j > base && stack[j - 1].t < t_near[i]; --j){
+				stack[j] = stack[j - 1];
+			}
+			stack[j].ref = n->child[i];
+			stack[j].t = t_near[i];
+		}
+	}
+	return found;
+}
+/* Check if anything blocks the ray before t_max, eg. for shadow rays. Stops at the first hit found */
+static inline int bvh_occluded(const struct bvh *b, const ray_t *r, float t_max){
+	uint32_t stack[BVH_STACK];
+	__m128 o[3], inv_d[3];
+	int neg[3], sp = 0;
+	hit_t hit = hit_new(t_max);
+	for (int i = 0; i < 3; ++i){
+		o[i] = _mm_set1_ps(r->o.f[i]);
+		inv_d[i] = _mm_set1_ps(r->inv_d.f[i]);
+		neg[i] = r->inv_d.f[i] < 0;
+	}
+	stack[sp++] = 0;
+	while (sp){
+		uint32_t ref = stack[--sp];
+		if (ref & BVH_LEAF){
+			const tri4_t *tris = b->tris + (ref & BVH_LEAF_FIRST);
+			size_t count = ((ref & ~BVH_LEAF) >> BVH_LEAF_SHIFT) + 1;
+			for (size_t i = 0; i < count; ++i){
+				if (ray_intersect_tri4(r, tris + i, &hit)){
+					return 1;
+				}
+			}
+			continue;
+		}
+		const struct bvh_node *n = b->nodes + ref;
+		__m128 near[3], far[3], tn;
+		bvh_node_planes(n, neg, near, far);
+		int mask = _mm_movemask_ps(ray_slab_test4(o, inv_d, near, far, _mm_set1_ps(t_max), &tn));
+		for (int i = 0; i < 4; ++i){
+			if ((mask & (1 << i)) && n->child[i] != BVH_EMPTY){
+				stack[sp++] = n->child[i];
+			}
+		}
+	}
+	return 0;
+}
+/* Closest hits for n rays, see bvh_intersect */
+static inline void bvh_intersect_n(const struct bvh *b, const ray_t *rays, hit_t *hits, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		bvh_intersect(b, rays + i, hits + i);
+	}
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef SSE_DISPATCH_H
+#define SSE_DISPATCH_H
+
+#include <stddef.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "quat.h"
+#include "frustum.h"
+#include "ray.h"
+#include "raster.h"
+#include "mesh_import.h"
+#include "vertex_pack.h"
+
+/*
+ * The batched kernels are compiled once per instruction set tier and the best
+ * one the CPU supports is picked at startup. Setting the environment variable
+ * SSE_FIDDLE_TIER to one of the tier names (sse2, sse41, avx2, avx512) forces
+ * that tier instead, if the CPU supports it
+ */
+enum sse_tier {
+	SSE_TIER_SSE2,
+	SSE_TIER_SSE41,
+	/* AVX2, FMA and F16C */
+	SSE_TIER_AVX2,
+	/* AVX-512 F, VL, DQ and BW */
+	SSE_TIER_AVX512,
+	SSE_TIER_COUNT
+};
+/* Table of the kernels for some tier, see mat4.h for what most of them do */
+struct sse_kernels {
+	enum sse_tier tier;
+	const char *name;
+	void (*vec_mult_n)(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n);
+	void (*transform_points)(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n);
+	void (*transform_vectors)(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n);
+	void (*project_points)(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n);
+	void (*mult_n)(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n);
+	void (*premult_n)(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n);
+	void (*transpose_n)(const mat4_t *in, mat4_t *out, size_t n);
+	void (*inverse_n)(const mat4_t *in, mat4_t *out, float *det, size_t n);
+	void (*inverse_affine_n)(const mat4_t *in, mat4_t *out, size_t n);
+	void (*inverse_rigid_n)(const mat4_t *in, mat4_t *out, size_t n);
+	void (*normal_matrix_n)(const mat4_t *in, mat4_t *out, size_t n);
+	void (*rotate_n)(const float *d, const vec4_t *axis, mat4_t *out, size_t n);
+	void (*perspective_n)(const float *fovY, const float *aspect, const float *near,
+		const float *far, mat4_t *out, size_t n);
+	/* See quat.h */
+	void (*slerp_n)(const quat_t *a, const quat_t *b, const float *t, quat_t *out, size_t n);
+	/* See frustum.h */
+	size_t (*cull_spheres)(const frustum_t *f, const vec4_t *s, size_t n, uint32_t *visible);
+	size_t (*cull_aabbs)(const frustum_t *f, const aabb_t *boxes, size_t n, uint32_t *visible);
+	/* See ray.h */
+	void (*intersect_tris)(const tri_t *tris, size_t n_tris, const ray_t *rays, hit_t *hits, size_t n_rays);
+	/* See raster.h */
+	void (*raster_tile)(const struct raster_target *target, const struct raster_tri *tris, const uint32_t *ids,
+		size_t n, int x0, int y0, int x1, int y1, uint32_t color);
+	/* See mesh_import.h */
+	size_t (*scan_lines)(const char *text, size_t n, uint32_t *ends, size_t max);
+	size_t (*count_lines)(const char *text, size_t n);
+	/* See vertex_pack.h */
+	void (*half_n)(const vec4_t *in, uint16_t *out, size_t n);
+	void (*unhalf_n)(const uint16_t *in, vec4_t *out, size_t n);
+	void (*xform_half_n)(const mat4_t *m, const vec4_t *in, uint16_t *out, size_t n,
+		enum mat4_xform_mode mode);
+	void (*xform_oct_n)(const mat4_t *m, const vec4_t *in, int16_t *out, size_t n);
+};
+/*
+ * The installed kernel table. This is set up before main runs and always
+ * points at a valid table
+ */
+extern const struct sse_kernels *sse_kernels;
+/* Get the highest tier the CPU (and OS) supports */
+enum sse_tier sse_cpu_tier(void);
+/* Get the kernel table for a tier, or NULL if the CPU doesn't support it */
+const struct sse_kernels* sse_kernels_for_tier(enum sse_tier tier);
+/*
+ * Install the kernels for a tier, if the CPU doesn't support it the highest
+ * supported tier below it is used instead. Returns the installed table
+ */
+const struct sse_kernels* sse_dispatch_set_tier(enum sse_tier tier);
+/* Get the name of a tier, or parse one back, returns SSE_TIER_COUNT if unknown */
+const char* sse_tier_name(enum sse_tier tier);
+enum sse_tier sse_tier_from_name(const char *name);
+
+#endif
+
@@ -0,0 +1,280 @@
+#ifndef SSE_DMAT4_H
+#define SSE_DMAT4_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stddef.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "dvec4.h"
+
+/*
+ * 4x4 double precision matrix stored in column major order, the same API as
+ * mat4_t for transforms that need more than float's 24 bits, eg. model matrices
+ * of objects far from the origin. Each column is a dvec4_t so it's one __m256d
+ * with AVX and two __m128d without.
+ *
+ * For rendering, build the matrices in double and narrow them with
+ * dmat4_to_mat4_rel relative to the camera position, then use a view matrix
+ * with the camera at the origin
+ */
+struct dmat4_t {
+	dvec4_t col[4];
+} ALIGN_32;
+typedef struct dmat4_t dmat4_t;
+
+/* Create a new dmat4, the matrix will be the identity matrix */
+static inline dmat4_t dmat4_new(void){
+	dmat4_t m;
+	m.col[0] = dvec4_new(1, 0, 0, 0);
+	m.col[1] = dvec4_new(0, 1, 0, 0);
+	m.col[2] = dvec4_new(0, 0, 1, 0);
+	m.col[3] = dvec4_new(0, 0, 0, 1);
+	return m;
+}
+static inline dmat4_t dmat4_transpose(dmat4_t m){
+#ifdef __AVX__
+	__m256d t0 = _mm256_unpacklo_pd(m.col[0].v, m.col[1].v);
+	__m256d t1 = _mm256_unpackhi_pd(m.col[0].v, m.col[1].v);
+	__m256d t2 = _mm256_unpacklo_pd(m.col[2].v, m.col[3].v);
+	__m256d t3 = _mm256_unpackhi_pd(m.col[2].v, m.col[3].v);
+	m.col[0].v = _mm256_permute2f128_pd(t0, t2, 0x20);
+	m.col[1].v = _mm256_permute2f128_pd(t1, t3, 0x20);
+	m.col[2].v = _mm256_permute2f128_pd(t0, t2, 0x31);
+	m.col[3].v = _mm256_permute2f128_pd(t1, t3, 0x31);
+#else
+	dmat4_t t;
+	for (int i = 0; i < 2; ++i){
+		t.col[2 * i].h[0] = _mm_unpacklo_pd(m.col[0].h[i], m.col[1].h[i]);
+		t.col[2 * i].h[1] = _mm_unpacklo_pd(m.col[2].h[i], m.col[3].h[i]);
+		t.col[2 * i + 1].h[0] = _mm_unpackhi_pd(m.col[0].h[i], m.col[1].h[i]);
+		t.col[2 * i + 1].h[1] = _mm_unpackhi_pd(m.col[2].h[i], m.col[3].h[i]);
+	}
+	m = t;
+#endif
+	return m;
+}
+/* Create a dmat4 from 16 doubles in column major order */
+static inline dmat4_t dmat4_from_cols(const double *c){
+	dmat4_t m;
+	for (int i = 0; i < 4; ++i){
+		m.col[i] = dvec4_new(c[4 * i], c[4 * i + 1], c[4 * i + 2], c[4 * i + 3]);
+	}
+	return m;
+}
+/* Create a dmat4 from 16 doubles in row major order */
+static inline dmat4_t dmat4_from_rows(const double *r){
+	return dmat4_transpose(dmat4_from_cols(r));
+}
+/* Widen a float matrix */
+static inline dmat4_t dmat4_from_mat4(mat4_t m){
+	dmat4_t d;
+	for (int i = 0; i < 4; ++i){
+		d.col[i] = dvec4_from_vec4(m.col[i]);
+	}
+	return d;
+}
+/* Narrow to a float matrix, rounding to nearest */
+static inline mat4_t dmat4_to_mat4(dmat4_t m){
+	mat4_t f;
+	for (int i = 0; i < 4; ++i){
+		f.col[i] = dvec4_to_vec4(m.col[i]);
+	}
+	return f;
+}
+/*
+ * Narrow an affine matrix with its translation made relative to origin (which
+ * should have w = 0), eg. a model matrix relative to the camera position. The
+ * subtraction is done in double so there's no cancellation when both are big
+ */
+static inline mat4_t dmat4_to_mat4_rel(dmat4_t m, dvec4_t origin){
+	m.col[3] = dvec4_sub(m.col[3], origin);
+	return dmat4_to_mat4(m);
+}
+/* Narrow n matrices relative to origin, eg. the model matrices of every instance */
+static inline void dmat4_to_mat4_rel_n(const dmat4_t *in, dvec4_t origin, mat4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		out[i].col[0] = dvec4_to_vec4(in[i].col[0]);
+		out[i].col[1] = dvec4_to_vec4(in[i].col[1]);
+		out[i].col[2] = dvec4_to_vec4(in[i].col[2]);
+		out[i].col[3] = dvec4_to_vec4(dvec4_sub(in[i].col[3], origin));
+	}
+}
+/* Arithmetic operations */
+static inline dmat4_t dmat4_add(dmat4_t a, dmat4_t b){
+	for (int i = 0; i < 4; ++i){
+		a.col[i] = dvec4_add(a.col[i], b.col[i]);
+	}
+	return a;
+}
+static inline dmat4_t dmat4_sub(dmat4_t a, dmat4_t b){
+	for (int i = 0; i < 4; ++i){
+		a.col[i] = dvec4_sub(a.col[i], b.col[i]);
+	}
+	return a;
+}
+/* Transform v as a linear combination of the columns, like mat4_xform_v */
+static inline dvec4_t dmat4_vec_mult(const dmat4_t *m, dvec4_t v){
+	dvec4_t r = dvec4_mult(m->col[0], dvec4_splat(v, 0));
+	r = dvec4_madd(m->col[1], dvec4_splat(v, 1), r);
+	r = dvec4_madd(m->col[2], dvec4_splat(v, 2), r);
+	return dvec4_madd(m->col[3], dvec4_splat(v, 3), r);
+}
+/* Compute dst = a * b, dst may alias a or b */
+static inline void dmat4_mult_to(dmat4_t *dst, const dmat4_t *a, const dmat4_t *b){
+	dvec4_t r0 = dmat4_vec_mult(a, b->col[0]);
+	dvec4_t r1 = dmat4_vec_mult(a, b->col[1]);
+	dvec4_t r2 = dmat4_vec_mult(a, b->col[2]);
+	dvec4_t r3 = dmat4_vec_mult(a, b->col[3]);
+	dst->col[0] = r0;
+	dst->col[1] = r1;
+	dst->col[2] = r2;
+	dst->col[3] = r3;
+}
+static inline dmat4_t dmat4_mult(dmat4_t a, dmat4_t b){
+	dmat4_t c;
+	dmat4_mult_to(&c, &a, &b);
+	return c;
+}
+/* Create a translation matrix to move by the vector */
+static inline dmat4_t dmat4_translate(dvec4_t v){
+	dmat4_t m = dmat4_new();
+	m.col[3] = dvec4_new(v.d[0], v.d[1], v.d[2], 1);
+	return m;
+}
+/* Create a scaling matrix to scale the x,y,z coords by x,y,z */
+static inline dmat4_t dmat4_scale(double x, double y, double z){
+	dmat4_t m = dmat4_new();
+	m.col[0] = dvec4_new(x, 0, 0, 0);
+	m.col[1] = dvec4_new(0, y, 0, 0);
+	m.col[2] = dvec4_new(0, 0, z, 0);
+	return m;
+}
+/* Create the rotation matrix to rotate by d degrees about the vector v (v.w should be 0) */
+static inline dmat4_t dmat4_rotate(double d, dvec4_t v){
+	v = dvec4_normalize(v);
+	double s = sin(d * M_PI / 180.0), c = cos(d * M_PI / 180.0), t = 1 - c;
+	double x = v.d[0], y = v.d[1], z = v.d[2];
+	dmat4_t m = dmat4_new();
+	m.col[0] = dvec4_new(t * x * x + c, t * x * y + s * z, t * x * z - s * y, 0);
+	m.col[1] = dvec4_new(t * x * y - s * z, t * y * y + c, t * y * z + s * x, 0);
+	m.col[2] = dvec4_new(t * x * z + s * y, t * y * z - s * x, t * z * z + c, 0);
+	return m;
+}
+/*
+ * Create the look at matrix with the camera at eye, looking at center and with
+ * up as the camera's up vector. The w coord for each vector should be 0
+ */
+static inline dmat4_t dmat4_look_at(dvec4_t eye, dvec4_t center, dvec4_t up){
+	dvec4_t f = dvec4_normalize(dvec4_sub(center, eye));
+	up = dvec4_normalize(up);
+	dvec4_t s = dvec4_normalize(dvec4_cross(f, up));
+	dvec4_t u = dvec4_cross(s, f);
+	dmat4_t m;
+	m.col[0] = s;
+	m.col[1] = u;
+	m.col[2] = dvec4_scale(f, -1);
+	m.col[3] = dvec4_new(0, 0, 0, 0);
+	m = dmat4_transpose(m);
+	m.col[3] = dvec4_new(-dvec4_dot3(s, eye), -dvec4_dot3(u, eye), dvec4_dot3(f, eye), 1);
+	return m;
+}
+/* Calculate the orthographic projection matrix */
+static inline dmat4_t dmat4_ortho(double l, double r, double b, double t, double n, double f){
+	dmat4_t m = dmat4_scale(2 / (r - l), 2 / (t - b), -2 / (f - n));
+	m.col[3] = dvec4_new(-(r + l) / (r - l), -(t + b) / (t - b), -(f + n) / (f - n), 1);
+	return m;
+}
+/* Calculate the perspective matrix */
+static inline dmat4_t dmat4_perspective(double fovY, double aspect, double n, double f){
+	double p = 1 / tan(fovY * 0.5 * M_PI / 180.0);
+	dmat4_t m = dmat4_scale(p / aspect, p, (f + n) / (n - f));
+	m.col[2] = dvec4_new(0, 0, (f + n) / (n - f), -1);
+	m.col[3] = dvec4_new(0, 0, 2 * f * n / (n - f), 0);
+	return m;
+}
+/*
+ * Compute dst = inverse(m) and return the determinant of m, dst may alias m.
+ * With columns a, b, c, d the 2x2 minors are gathered into the 3-vectors
+ * s = a x b, t = c x d, u = a b.w - b a.w and v = c d.w - d c.w (using the xyz
+ * of each column), which gives |M| = s.v + t.u and each row of the inverse as
+ * a cross product and a dot product (Lengyel, Foundations of Game Engine
+ * Development vol. 1)
+ */
+static inline double dmat4_inverse_to(dmat4_t *dst, const dmat4_t *m){
+	const dvec4_t xyz = dvec4_new(1, 1, 1, 0);
+	dvec4_t a = dvec4_mult(m->col[0], xyz), b = dvec4_mult(m->col[1], xyz);
+	dvec4_t c = dvec4_mult(m->col[2], xyz), d = dvec4_mult(m->col[3], xyz);
+	dvec4_t x = dvec4_splat(m->col[0], 3), y = dvec4_splat(m->col[1], 3);
+	dvec4_t z = dvec4_splat(m->col[2], 3), w = dvec4_splat(m->col[3], 3);
+	dvec4_t s = dvec4_cross(a, b), t = dvec4_cross(c, d);
+	dvec4_t u = dvec4_sub(dvec4_mult(a, y), dvec4_mult(b, x));
+	dvec4_t v = dvec4_sub(dvec4_mult(c, w), dvec4_mult(d, z));
+	double det = dvec4_dot(s, v) + dvec4_dot(t, u);
+	dvec4_t inv_det = dvec4_set1(1 / det);
+	s = dvec4_mult(s, inv_det);
+	t = dvec4_mult(t, inv_det);
+	u = dvec4_mult(u, inv_det);
+	v = dvec4_mult(v, inv_det);
+	/* The rows of the inverse with their w left at 0, it goes in the last column after transposing */
+	dmat4_t r;
+	r.col[0] = dvec4_madd(t, y, dvec4_cross(b, v));
+	r.col[1] = dvec4_sub(dvec4_cross(v, a), dvec4_mult(t, x));
+	r.col[2] = dvec4_madd(s, w, dvec4_cross(d, u));
+	r.col[3] = dvec4_sub(dvec4_cross(u, c), dvec4_mult(s, z));
+	r = dmat4_transpose(r);
+	r.col[3] = dvec4_new(-dvec4_dot(b, t), dvec4_dot(a, t), -dvec4_dot(d, s), dvec4_dot(c, s));
+	*dst = r;
+	return det;
+}
+/* Compute the inverse of m, if det isn't NULL the determinant of m is written to it */
+static inline dmat4_t dmat4_inverse(dmat4_t m, double *det){
+	double d = dmat4_inverse_to(&m, &m);
+	if (det){
+		*det = d;
+	}
+	return m;
+}
+/*
+ * Compute the inverse of an affine m, one whose bottom row is [0, 0, 0, 1]. Only
+ * the upper 3x3 is inverted and the translation brought back through it
+ */
+static inline dmat4_t dmat4_inverse_affine(dmat4_t m){
+	dmat4_t r;
+	r.col[0] = dvec4_cross(m.col[1], m.col[2]);
+	r.col[1] = dvec4_cross(m.col[2], m.col[0]);
+	r.col[2] = dvec4_cross(m.col[0], m.col[1]);
+	r.col[3] = dvec4_new(0, 0, 0, 0);
+	dvec4_t inv_det = dvec4_set1(1 / dvec4_dot3(m.col[0], r.col[0]));
+	for (int i = 0; i < 3; ++i){
+		r.col[i] = dvec4_mult(r.col[i], inv_det);
+	}
+	r = dmat4_transpose(r);
+	dvec4_t t = dmat4_vec_mult(&r, dvec4_mult(m.col[3], dvec4_new(1, 1, 1, 0)));
+	r.col[3] = dvec4_sub(dvec4_new(0, 0, 0, 1), t);
+	return r;
+}
+/*
+ * Compute the inverse of an m made of only a rotation and translation, the
+ * transpose of the rotation with the translation brought back through it
+ */
+static inline dmat4_t dmat4_inverse_rigid(dmat4_t m){
+	dvec4_t t = dvec4_mult(m.col[3], dvec4_new(1, 1, 1, 0));
+	m.col[3] = dvec4_new(0, 0, 0, 0);
+	m = dmat4_transpose(m);
+	m.col[3] = dvec4_sub(dvec4_new(0, 0, 0, 1), dmat4_vec_mult(&m, t));
+	return m;
+}
+static inline int dmat4_eq(dmat4_t a, dmat4_t b){
+	return dvec4_eq(a.col[0], b.col[0]) && dvec4_eq(a.col[1], b.col[1])
+		&& dvec4_eq(a.col[2], b.col[2]) && dvec4_eq(a.col[3], b.col[3]);
+}
+/* Print out a matrix row by row */
+static inline void dmat4_print(dmat4_t m){
+	m = dmat4_transpose(m);
+	for (int i = 0; i < 4; ++i){
+		dvec4_print(m.col[i]);
+	}
+}
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef SSE_DVEC4_H
+#define SSE_DVEC4_H
+
+#include <emmintrin.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <math.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+#include "vec4.h"
+
+/*
+ * Double precision 4 component vector, for positions in large worlds where
+ * float runs out of bits. With AVX the vector is a single __m256d, otherwise it's
+ * held in two __m128d halves, xy and zw. Code outside this header should stick
+ * to the functions (or the d/c members) so it works with either.
+ *
+ * The usual way to render with these is camera relative: keep the world in
+ * doubles, subtract the camera position in double and only then narrow to
+ * vec4_t with dvec4_to_vec4_rel, so what's near the camera keeps its precision
+ */
+union dvec4_t {
+#ifdef __AVX__
+	__m256d v;
+#else
+	__m128d h[2];
+#endif
+	double d[4];
+	struct {
+		double x, y, z, w;
+	} c;
+} ALIGN_32;
+typedef union dvec4_t dvec4_t;
+
+static inline dvec4_t dvec4_new(double x, double y, double z, double w){
+	dvec4_t v;
+#ifdef __AVX__
+	v.v = _mm256_setr_pd(x, y, z, w);
+#else
+	v.h[0] = _mm_setr_pd(x, y);
+	v.h[1] = _mm_setr_pd(z, w);
+#endif
+	return v;
+}
+static inline dvec4_t dvec4_set1(double s){
+	return dvec4_new(s, s, s, s);
+}
+/* Widen a float vector */
+static inline dvec4_t dvec4_from_vec4(vec4_t a){
+	dvec4_t v;
+#ifdef __AVX__
+	v.v = _mm256_cvtps_pd(a.v);
+#else
+	v.h[0] = _mm_cvtps_pd(a.v);
+	v.h[1] = _mm_cvtps_pd(_mm_movehl_ps(a.v, a.v));
+#endif
+	return v;
+}
+/* Narrow to a float vector, rounding to nearest */
+static inline vec4_t dvec4_to_vec4(dvec4_t a){
+	vec4_t v;
+#ifdef __AVX__
+	v.v = _mm256_cvtpd_ps(a.v);
+#else
+	v.v = _mm_movelh_ps(_mm_cvtpd_ps(a.h[0]), _mm_cvtpd_ps(a.h[1]));
+#endif
+	return v;
+}
+/* Arithmetic operations */
+static inline dvec4_t dvec4_add(dvec4_t a, dvec4_t b){
+#ifdef __AVX__
+	a.v = _mm256_add_pd(a.v, b.v);
+#else
+	a.h[0] = _mm_add_pd(a.h[0], b.h[0]);
+	a.h[1] = _mm_add_pd(a.h[1], b.h[1]);
+#endif
+	return a;
+}
+static inline dvec4_t dvec4_sub(dvec4_t a, dvec4_t b){
+#ifdef __AVX__
+	a.v = _mm256_sub_pd(a.v, b.v);
+#else
+	a.h[0] = _mm_sub_pd(a.h[0], b.h[0]);
+	a.h[1] = _mm_sub_pd(a.h[1], b.h[1]);
+#endif
+	return a;
+}
+static inline dvec4_t dvec4_mult(dvec4_t a, dvec4_t b){
+#ifdef __AVX__
+	a.v = _mm256_mul_pd(a.v, b.v);
+#else
+	a.h[0] = _mm_mul_pd(a.h[0], b.h[0]);
+	a.h[1] = _mm_mul_pd(a.h[1], b.h[1]);
+#endif
+	return a;
+}
+static inline dvec4_t dvec4_div(dvec4_t a, dvec4_t b){
+#ifdef __AVX__
+	a.v = _mm256_div_pd(a.v, b.v);
+#else
+	a.h[0] = _mm_div_pd(a.h[0], b.h[0]);
+	a.h[1] = _mm_div_pd(a.h[1], b.h[1]);
+#endif
+	return a;
+}
+static inline dvec4_t dvec4_scale(dvec4_t a, double s){
+	return dvec4_mult(a, dvec4_set1(s));
+}
+/* Compute a * b + c, as a single fused multiply-add if the target has FMA */
+static inline dvec4_t dvec4_madd(dvec4_t a, dvec4_t b, dvec4_t c){
+#if defined(__AVX__) && defined(__FMA__)
+	a.v = _mm256_fmadd_pd(a.v, b.v, c.v);
+	return a;
+#else
+	return dvec4_add(dvec4_mult(a, b), c);
+#endif
+}
+/* Get a vector of element i of a in every element, i should be a constant in [0, 3] */
+static inline dvec4_t dvec4_splat(dvec4_t a, int i){
+#ifdef __AVX__
+	/* Broadcast the 128 bit lane holding the element, then the element within it */
+	__m256d lane = i < 2 ? _mm256_permute2f128_pd(a.v, a.v, 0x00) : _mm256_permute2f128_pd(a.v, a.v, 0x11);
+	a.v = i & 1 ? _mm256_permute_pd(lane, 0xf) : _mm256_permute_pd(lane, 0x0);
+#else
+	__m128d half = a.h[i >> 1];
+	a.h[0] = i & 1 ? _mm_unpackhi_pd(half, half) : _mm_unpacklo_pd(half, half);
+	a.h[1] = a.h[0];
+#endif
+	return a;
+}
+/* Sum the elements of a, the sum is returned in all 4 elements */
+static inline dvec4_t dvec4_hsum(dvec4_t a){
+#ifdef __AVX__
+	__m256d s = _mm256_add_pd(a.v, _mm256_permute2f128_pd(a.v, a.v, 0x01));
+	a.v = _mm256_add_pd(s, _mm256_permute_pd(s, 0x5));
+#else
+	__m128d s = _mm_add_pd(a.h[0], a.h[1]);
+	a.h[0] = _mm_add_pd(s, _mm_shuffle_pd(s, s, 1));
+	a.h[1] = a.h[0];
+#endif
+	return a;
+}
+/* Geometric operations */
+static inline double dvec4_dot(dvec4_t a, dvec4_t b){
+	return dvec4_hsum(dvec4_mult(a, b)).d[0];
+}
+/* Dot product of just the x, y and z components */
+static inline double dvec4_dot3(dvec4_t a, dvec4_t b){
+	dvec4_t m = dvec4_mult(a, b);
+	return m.d[0] + m.d[1] + m.d[2];
+}
+static inline double dvec4_len(dvec4_t a){
+	return sqrt(dvec4_dot(a, a));
+}
+static inline dvec4_t dvec4_normalize(dvec4_t a){
+	return dvec4_div(a, dvec4_set1(dvec4_len(a)));
+}
+/* The vectors are treated as 3-vectors, the w component is set to 0 */
+static inline dvec4_t dvec4_cross(dvec4_t a, dvec4_t b){
+#ifdef __AVX__
+	/*
+	 * yzx and zxy without AVX2's cross lane permutes: swap the lanes, pick
+	 * from the two and fix up the order within the upper lane
+	 */
+	__m256d sa = _mm256_permute2f128_pd(a.v, a.v, 0x01);
+	__m256d sb = _mm256_permute2f128_pd(b.v, b.v, 0x01);
+	__m256d a_yzx = _mm256_permute_pd(_mm256_shuffle_pd(a.v, sa, 0x5), 0x6);
+	__m256d b_yzx = _mm256_permute_pd(_mm256_shuffle_pd(b.v, sb, 0x5), 0x6);
+	__m256d a_zxy = _mm256_shuffle_pd(sa, a.v, 0xc);
+	__m256d b_zxy = _mm256_shuffle_pd(sb, b.v, 0xc);
+	a.v = _mm256_sub_pd(_mm256_mul_pd(a_yzx, b_zxy), _mm256_mul_pd(a_zxy, b_yzx));
+#else
+	__m128d a_yz = _mm_shuffle_pd(a.h[0], a.h[1], 1), a_xw = _mm_shuffle_pd(a.h[0], a.h[1], 2);
+	__m128d b_yz = _mm_shuffle_pd(b.h[0], b.h[1], 1), b_xw = _mm_shuffle_pd(b.h[0], b.h[1], 2);
+	__m128d a_zx = _mm_shuffle_pd(a.h[1], a.h[0], 0), a_yw = _mm_shuffle_pd(a.h[0], a.h[1], 3);
+	__m128d b_zx = _mm_shuffle_pd(b.h[1], b.h[0], 0), b_yw = _mm_shuffle_pd(b.h[0], b.h[1], 3);
+	a.h[0] = _mm_sub_pd(_mm_mul_pd(a_yz, b_zx), _mm_mul_pd(a_zx, b_yz));
+	a.h[1] = _mm_sub_pd(_mm_mul_pd(a_xw, b_yw), _mm_mul_pd(a_yw, b_xw));
+#endif
+	return a;
+}
+/* Comparisons */
+/* Returns 1 if all elements are equal, 0 if not */
+static inline int dvec4_eq(dvec4_t a, dvec4_t b){
+#ifdef __AVX__
+	return _mm256_movemask_pd(_mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ)) == 0xf;
+#else
+	return _mm_movemask_pd(_mm_and_pd(_mm_cmpeq_pd(a.h[0], b.h[0]), _mm_cmpeq_pd(a.h[1], b.h[1]))) == 3;
+#endif
+}
+
+/*
+ * Camera relative narrowing: compute a - origin in double and narrow the
+ * difference, so positions near origin keep float's full precision however far
+ * from 0 they are
+ */
+static inline vec4_t dvec4_to_vec4_rel(dvec4_t a, dvec4_t origin){
+	return dvec4_to_vec4(dvec4_sub(a, origin));
+}
+/* Narrow n vectors, in and out only need their usual alignment */
+static inline void dvec4_to_vec4_n(const dvec4_t *in, vec4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		out[i] = dvec4_to_vec4(in[i]);
+	}
+}
+/*
+ * Narrow n positions relative to origin, eg. the vertices of an object
+ * relative to the camera. The w of origin should be 0 to leave the w of each
+ * position alone
+ */
+static inline void dvec4_to_vec4_rel_n(const dvec4_t *in, dvec4_t origin, vec4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		out[i] = dvec4_to_vec4(dvec4_sub(in[i], origin));
+	}
+}
+static inline void dvec4_print(dvec4_t v){
+	printf("[%.4f, %.4f, %.4f, %.4f]\n", v.d[0], v.d[1], v.d[2], v.d[3]);
+}
+
+#endif
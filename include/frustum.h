@@ -0,0 +1,401 @@
+#ifndef SSE_FRUSTUM_H
+#define SSE_FRUSTUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vec4.h"
+#include "vec4x4.h"
+#include "mat4.h"
+#ifdef __AVX__
+#include "vec4x8.h"
+#endif
+
+/*
+ * View frustum culling. The six planes are pulled out of a combined
+ * projection * view matrix (Gribb & Hartmann) and stored as a structure of
+ * arrays so the batched tests can broadcast each plane's coefficients and test
+ * 4 (or 8 with AVX, 16 with AVX-512) bounding volumes against it at once.
+ *
+ * The tests are conservative, a volume is only rejected if it's entirely
+ * behind one of the planes. So some volumes near the corners of the frustum
+ * that are actually outside it are kept
+ */
+
+/*
+ * Plane i is a[i] x + b[i] y + c[i] z + d[i] = 0, normalized and with the
+ * normal pointing into the frustum. In order the planes are left, right,
+ * bottom, top, near and far, 6 and 7 are padding that everything is in front of
+ */
+struct frustum_t {
+	float ALIGN_32 a[8];
+	float ALIGN_32 b[8];
+	float ALIGN_32 c[8];
+	float ALIGN_32 d[8];
+};
+typedef struct frustum_t frustum_t;
+/* Axis aligned box, the w components are ignored */
+struct aabb_t {
+	vec4_t min, max;
+};
+typedef struct aabb_t aabb_t;
+
+#define FRUSTUM_PLANES 6
+
+/*
+ * Extract the frustum from a projection * view matrix, eg. from mat4_perspective
+ * or mat4_ortho times mat4_look_at, to cull in world space. Passing
+ * projection * view * model culls in the model's space instead
+ */
+static inline frustum_t frustum_from_mat4(mat4_t m){
+	frustum_t f;
+	/* The planes are sums and differences of the rows of m */
+	mat4_t r = mat4_transpose(m);
+	vec4_t p[8];
+	p[0] = vec4_add(r.col[3], r.col[0]);
+	p[1] = vec4_sub(r.col[3], r.col[0]);
+	p[2] = vec4_add(r.col[3], r.col[1]);
+	p[3] = vec4_sub(r.col[3], r.col[1]);
+	p[4] = vec4_add(r.col[3], r.col[2]);
+	p[5] = vec4_sub(r.col[3], r.col[2]);
+	p[6] = vec4_new(0, 0, 0, 1);
+	p[7] = p[6];
+	const __m128 one = _mm_set1_ps(1.f);
+	for (int i = 0; i < 8; i += 4){
+		vec4x4_t q = vec4x4_load(p + i);
+		__m128 len = _mm_sqrt_ps(vec4_madd_ps(q.x, q.x, vec4_madd_ps(q.y, q.y, _mm_mul_ps(q.z, q.z))));
+		/* The padding planes have no normal, leave them as they are */
+		__m128 zero = _mm_cmpeq_ps(len, _mm_setzero_ps());
+		len = _mm_or_ps(_mm_and_ps(zero, one), _mm_andnot_ps(zero, len));
+		__m128 inv = _mm_div_ps(one, len);
+		_mm_store_ps(f.a + i, _mm_mul_ps(q.x, inv));
+		_mm_store_ps(f.b + i, _mm_mul_ps(q.y, inv));
+		_mm_store_ps(f.c + i, _mm_mul_ps(q.z, inv));
+		_mm_store_ps(f.d + i, _mm_mul_ps(q.w, inv));
+	}
+	return f;
+}
+/* Check if the sphere with center xyz and radius w is at least partially inside the frustum */
+static inline int frustum_sphere_visible(const frustum_t *f, vec4_t s){
+	const __m128 x = _mm_shuffle_ps(s.v, s.v, _MM_SHUFFLE(0, 0, 0, 0));
+	const __m128 y = _mm_shuffle_ps(s.v, s.v, _MM_SHUFFLE(1, 1, 1, 1));
+	const __m128 z = _mm_shuffle_ps(s.v, s.v, _MM_SHUFFLE(2, 2, 2, 2));
+	const __m128 nr = _mm_sub_ps(_mm_setzero_ps(), _mm_shuffle_ps(s.v, s.v, _MM_SHUFFLE(3, 3, 3, 3)));
+	int out = 0;
+	/* All 8 planes in two goes, the padding ones always pass */
+	for (int i = 0; i < 8; i += 4){
+		__m128 dist = vec4_madd_ps(_mm_load_ps(f->a + i), x, vec4_madd_ps(_mm_load_ps(f->b + i), y,
+			vec4_madd_ps(_mm_load_ps(f->c + i), z, _mm_load_ps(f->d + i))));
+		out |= _mm_movemask_ps(_mm_cmplt_ps(dist, nr));
+	}
+	return !out;
+}
+/* Check if the box is at least partially inside the frustum */
+static inline int frustum_aabb_visible(const frustum_t *f, aabb_t b){
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 c = _mm_mul_ps(_mm_add_ps(b.min.v, b.max.v), half);
+	__m128 e = _mm_mul_ps(_mm_sub_ps(b.max.v, b.min.v), half);
+	const __m128 cx = _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 0, 0, 0));
+	const __m128 cy = _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 1, 1, 1));
+	const __m128 cz = _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 2, 2));
+	const __m128 ex = _mm_shuffle_ps(e, e, _MM_SHUFFLE(0, 0, 0, 0));
+	const __m128 ey = _mm_shuffle_ps(e, e, _MM_SHUFFLE(1, 1, 1, 1));
+	const __m128 ez = _mm_shuffle_ps(e, e, _MM_SHUFFLE(2, 2, 2, 2));
+	int out = 0;
+	for (int i = 0; i < 8; i += 4){
+		__m128 a = _mm_load_ps(f->a + i), pb = _mm_load_ps(f->b + i), pc = _mm_load_ps(f->c + i);
+		__m128 dist = vec4_madd_ps(a, cx, vec4_madd_ps(pb, cy, vec4_madd_ps(pc, cz, _mm_load_ps(f->d + i))));
+		/* Projected half size of the box onto the plane normal */
+		__m128 r = vec4_madd_ps(_mm_and_ps(a, abs_mask), ex, vec4_madd_ps(_mm_and_ps(pb, abs_mask), ey,
+			_mm_mul_ps(_mm_and_ps(pc, abs_mask), ez)));
+		out |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, r), _mm_setzero_ps()));
+	}
+	return !out;
+}
+/*
+ * Append base + j to visible for each set bit j in the first lanes bits of
+ * mask. Each index is written unconditionally and the count only advanced for
+ * visible ones, which avoids a hard to predict branch per object
+ */
+static inline size_t frustum_compact(uint32_t *visible, size_t count, uint32_t base, int mask, int lanes){
+	for (int j = 0; j < lanes; ++j){
+		visible[count] = base + j;
+		count += (mask >> j) & 1;
+	}
+	return count;
+}
+/*
+ * Same as frustum_compact for all 4 lanes, but with a table of the set lanes
+ * packed down for each mask so it's one store. This always writes 4 indices so
+ * there must be room for them past count
+ */
+static inline size_t frustum_compact4(uint32_t *visible, size_t count, uint32_t base, int mask){
+	static const uint32_t ALIGN_16 lanes[16][4] = {
+		{ 0, 0, 0, 0 }, { 0, 0, 0, 0 }, { 1, 0, 0, 0 }, { 0, 1, 0, 0 },
+		{ 2, 0, 0, 0 }, { 0, 2, 0, 0 }, { 1, 2, 0, 0 }, { 0, 1, 2, 0 },
+		{ 3, 0, 0, 0 }, { 0, 3, 0, 0 }, { 1, 3, 0, 0 }, { 0, 1, 3, 0 },
+		{ 2, 3, 0, 0 }, { 0, 2, 3, 0 }, { 1, 2, 3, 0 }, { 0, 1, 2, 3 }
+	};
+	static const uint8_t bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	__m128i idx = _mm_add_epi32(_mm_set1_epi32(base), _mm_load_si128((const __m128i*)lanes[mask]));
+	_mm_storeu_si128((__m128i*)(visible + count), idx);
+	return count + bits[mask];
+}
+/* Gather 4 boxes from b into packets of their centers and half sizes */
+static inline void frustum_load_aabb4(const aabb_t *b, vec4x4_t *c, vec4x4_t *e){
+	const __m128 half = _mm_set1_ps(0.5f);
+	__m128 mn[4], mx[4];
+	for (int j = 0; j < 4; ++j){
+		mn[j] = b[j].min.v;
+		mx[j] = b[j].max.v;
+	}
+	_MM_TRANSPOSE4_PS(mn[0], mn[1], mn[2], mn[3]);
+	_MM_TRANSPOSE4_PS(mx[0], mx[1], mx[2], mx[3]);
+	c->x = _mm_mul_ps(_mm_add_ps(mn[0], mx[0]), half);
+	c->y = _mm_mul_ps(_mm_add_ps(mn[1], mx[1]), half);
+	c->z = _mm_mul_ps(_mm_add_ps(mn[2], mx[2]), half);
+	e->x = _mm_mul_ps(_mm_sub_ps(mx[0], mn[0]), half);
+	e->y = _mm_mul_ps(_mm_sub_ps(mx[1], mn[1]), half);
+	e->z = _mm_mul_ps(_mm_sub_ps(mx[2], mn[2]), half);
+}
+#ifdef __AVX__
+static inline void frustum_load_aabb8(const aabb_t *b, vec4x8_t *c, vec4x8_t *e){
+	const __m256 half = _mm256_set1_ps(0.5f);
+	__m256 mn[4], mx[4];
+	for (int j = 0; j < 4; ++j){
+		mn[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(b[j].min.v), b[j + 4].min.v, 1);
+		mx[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(b[j].max.v), b[j + 4].max.v, 1);
+	}
+	vec4x8_transpose(&mn[0], &mn[1], &mn[2], &mn[3]);
+	vec4x8_transpose(&mx[0], &mx[1], &mx[2], &mx[3]);
+	c->x = _mm256_mul_ps(_mm256_add_ps(mn[0], mx[0]), half);
+	c->y = _mm256_mul_ps(_mm256_add_ps(mn[1], mx[1]), half);
+	c->z = _mm256_mul_ps(_mm256_add_ps(mn[2], mx[2]), half);
+	e->x = _mm256_mul_ps(_mm256_sub_ps(mx[0], mn[0]), half);
+	e->y = _mm256_mul_ps(_mm256_sub_ps(mx[1], mn[1]), half);
+	e->z = _mm256_mul_ps(_mm256_sub_ps(mx[2], mn[2]), half);
+}
+#endif
+#ifdef __AVX512F__
+/*
+ * Transpose each 128 bit lane of 4 registers holding 4 consecutive vectors
+ * each, the same as vec4x8_transpose. Lane 4k + m of the results then holds
+ * vector 4m + k, see frustum_mask16 for putting them back in order
+ */
+static inline void frustum_transpose16(__m512 *r0, __m512 *r1, __m512 *r2, __m512 *r3){
+	__m512 t0 = _mm512_unpacklo_ps(*r0, *r1);
+	__m512 t1 = _mm512_unpacklo_ps(*r2, *r3);
+	__m512 t2 = _mm512_unpackhi_ps(*r0, *r1);
+	__m512 t3 = _mm512_unpackhi_ps(*r2, *r3);
+	*r0 = _mm512_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+	*r1 = _mm512_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+	*r2 = _mm512_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	*r3 = _mm512_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+/* Put a mask from frustum_transpose16'd packets back in order, it's a 4x4 bit matrix transpose */
+static inline unsigned frustum_mask16(unsigned m){
+	unsigned t = (m ^ (m >> 3)) & 0x0a0a;
+	m ^= t ^ (t << 3);
+	t = (m ^ (m >> 6)) & 0x00cc;
+	return m ^ t ^ (t << 6);
+}
+/* frustum_compact for 16 lanes, packing the indices down in a register. Writes 16 indices */
+static inline size_t frustum_compact16(uint32_t *visible, size_t count, uint32_t base, unsigned mask){
+	const __m512i iota = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m512i idx = _mm512_maskz_compress_epi32(mask, _mm512_add_epi32(_mm512_set1_epi32(base), iota));
+	_mm512_storeu_si512(visible + count, idx);
+	mask = mask - ((mask >> 1) & 0x5555);
+	mask = (mask & 0x3333) + ((mask >> 2) & 0x3333);
+	mask = (mask + (mask >> 4)) & 0x0f0f;
+	return count + ((mask + (mask >> 8)) & 0x1f);
+}
+#endif
+/*
+ * Cull n spheres (center xyz, radius w), writing the indices of the visible
+ * ones in order to visible, which needs room for n. Returns the number visible
+ */
+static inline size_t frustum_cull_spheres(const frustum_t *f, const vec4_t *s, size_t n, uint32_t *visible){
+	size_t count = 0, i = 0;
+#ifdef __AVX512F__
+	{
+		__m512 a[FRUSTUM_PLANES], b[FRUSTUM_PLANES], c[FRUSTUM_PLANES], d[FRUSTUM_PLANES];
+		for (int k = 0; k < FRUSTUM_PLANES; ++k){
+			a[k] = _mm512_set1_ps(f->a[k]);
+			b[k] = _mm512_set1_ps(f->b[k]);
+			c[k] = _mm512_set1_ps(f->c[k]);
+			d[k] = _mm512_set1_ps(f->d[k]);
+		}
+		for (; i < (n & ~(size_t)15); i += 16){
+			__m512 x = _mm512_loadu_ps(s[i].f), y = _mm512_loadu_ps(s[i + 4].f);
+			__m512 z = _mm512_loadu_ps(s[i + 8].f), r = _mm512_loadu_ps(s[i + 12].f);
+			frustum_transpose16(&x, &y, &z, &r);
+			__m512 nr = _mm512_sub_ps(_mm512_setzero_ps(), r);
+			__mmask16 in = 0xffff;
+			for (int k = 0; k < FRUSTUM_PLANES; ++k){
+				__m512 dist = _mm512_fmadd_ps(a[k], x, _mm512_fmadd_ps(b[k], y, _mm512_fmadd_ps(c[k], z, d[k])));
+				in = _mm512_mask_cmp_ps_mask(in, dist, nr, _CMP_GE_OQ);
+			}
+			count = frustum_compact16(visible, count, i, frustum_mask16(in));
+		}
+	}
+#endif
+#ifdef __AVX__
+	{
+		__m256 a[FRUSTUM_PLANES], b[FRUSTUM_PLANES], c[FRUSTUM_PLANES], d[FRUSTUM_PLANES];
+		for (int k = 0; k < FRUSTUM_PLANES; ++k){
+			a[k] = _mm256_broadcast_ss(f->a + k);
+			b[k] = _mm256_broadcast_ss(f->b + k);
+			c[k] = _mm256_broadcast_ss(f->c + k);
+			d[k] = _mm256_broadcast_ss(f->d + k);
+		}
+		for (; i < (n & ~(size_t)7); i += 8){
+			vec4x8_t p = vec4x8_load(s + i);
+			__m256 nr = _mm256_sub_ps(_mm256_setzero_ps(), p.w);
+			__m256 in = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int k = 0; k < FRUSTUM_PLANES; ++k){
+				__m256 dist = vec4x8_madd_ps(a[k], p.x, vec4x8_madd_ps(b[k], p.y,
+					vec4x8_madd_ps(c[k], p.z, d[k])));
+				in = _mm256_and_ps(in, _mm256_cmp_ps(dist, nr, _CMP_GE_OQ));
+			}
+			int mask = _mm256_movemask_ps(in);
+			count = frustum_compact4(visible, count, i, mask & 0xf);
+			count = frustum_compact4(visible, count, i + 4, mask >> 4);
+		}
+	}
+#endif
+	__m128 a[FRUSTUM_PLANES], b[FRUSTUM_PLANES], c[FRUSTUM_PLANES], d[FRUSTUM_PLANES];
+	for (int k = 0; k < FRUSTUM_PLANES; ++k){
+		a[k] = _mm_load1_ps(f->a + k);
+		b[k] = _mm_load1_ps(f->b + k);
+		c[k] = _mm_load1_ps(f->c + k);
+		d[k] = _mm_load1_ps(f->d + k);
+	}
+	/* The last partial packet is done with the rest of it zeroed */
+	for (; i < n; i += 4){
+		size_t lanes = n - i < 4 ? n - i : 4;
+		vec4x4_t p = lanes == 4 ? vec4x4_load(s + i) : vec4x4_load_n(s + i, lanes);
+		__m128 nr = _mm_sub_ps(_mm_setzero_ps(), p.w);
+		__m128 in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int k = 0; k < FRUSTUM_PLANES; ++k){
+			__m128 dist = vec4_madd_ps(a[k], p.x, vec4_madd_ps(b[k], p.y, vec4_madd_ps(c[k], p.z, d[k])));
+			in = _mm_and_ps(in, _mm_cmpge_ps(dist, nr));
+		}
+		if (lanes == 4){
+			count = frustum_compact4(visible, count, i, _mm_movemask_ps(in));
+		}
+		else {
+			count = frustum_compact(visible, count, i, _mm_movemask_ps(in), lanes);
+		}
+	}
+	return count;
+}
+/*
+ * Cull n boxes, writing the indices of the visible ones in order to visible,
+ * which needs room for n. Returns the number visible
+ */
+static inline size_t frustum_cull_aabbs(const frustum_t *f, const aabb_t *boxes, size_t n, uint32_t *visible){
+	size_t count = 0, i = 0;
+#ifdef __AVX512F__
+	{
+		const __m512 half = _mm512_set1_ps(0.5f);
+		__m512 a[FRUSTUM_PLANES], b[FRUSTUM_PLANES], c[FRUSTUM_PLANES], d[FRUSTUM_PLANES];
+		for (int k = 0; k < FRUSTUM_PLANES; ++k){
+			a[k] = _mm512_set1_ps(f->a[k]);
+			b[k] = _mm512_set1_ps(f->b[k]);
+			c[k] = _mm512_set1_ps(f->c[k]);
+			d[k] = _mm512_set1_ps(f->d[k]);
+		}
+		for (; i < (n & ~(size_t)15); i += 16){
+			/* Each load is 2 boxes, split them into registers of 4 mins and 4 maxs */
+			__m512 mn[4], mx[4];
+			for (int j = 0; j < 4; ++j){
+				__m512 lo = _mm512_loadu_ps(boxes[i + 4 * j].min.f);
+				__m512 hi = _mm512_loadu_ps(boxes[i + 4 * j + 2].min.f);
+				mn[j] = _mm512_shuffle_f32x4(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+				mx[j] = _mm512_shuffle_f32x4(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+			}
+			frustum_transpose16(&mn[0], &mn[1], &mn[2], &mn[3]);
+			frustum_transpose16(&mx[0], &mx[1], &mx[2], &mx[3]);
+			__m512 cx = _mm512_mul_ps(_mm512_add_ps(mn[0], mx[0]), half);
+			__m512 cy = _mm512_mul_ps(_mm512_add_ps(mn[1], mx[1]), half);
+			__m512 cz = _mm512_mul_ps(_mm512_add_ps(mn[2], mx[2]), half);
+			__m512 ex = _mm512_mul_ps(_mm512_sub_ps(mx[0], mn[0]), half);
+			__m512 ey = _mm512_mul_ps(_mm512_sub_ps(mx[1], mn[1]), half);
+			__m512 ez = _mm512_mul_ps(_mm512_sub_ps(mx[2], mn[2]), half);
+			__mmask16 in = 0xffff;
+			for (int k = 0; k < FRUSTUM_PLANES; ++k){
+				__m512 dist = _mm512_fmadd_ps(a[k], cx, _mm512_fmadd_ps(b[k], cy, _mm512_fmadd_ps(c[k], cz, d[k])));
+				__m512 r = _mm512_fmadd_ps(_mm512_abs_ps(a[k]), ex, _mm512_fmadd_ps(_mm512_abs_ps(b[k]), ey,
+					_mm512_mul_ps(_mm512_abs_ps(c[k]), ez)));
+				in = _mm512_mask_cmp_ps_mask(in, _mm512_add_ps(dist, r), _mm512_setzero_ps(), _CMP_GE_OQ);
+			}
+			count = frustum_compact16(visible, count, i, frustum_mask16(in));
+		}
+	}
+#endif
+#ifdef __AVX__
+	{
+		const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		__m256 a[FRUSTUM_PLANES], b[FRUSTUM_PLANES], c[FRUSTUM_PLANES], d[FRUSTUM_PLANES];
+		for (int k = 0; k < FRUSTUM_PLANES; ++k){
+			a[k] = _mm256_broadcast_ss(f->a + k);
+			b[k] = _mm256_broadcast_ss(f->b + k);
+			c[k] = _mm256_broadcast_ss(f->c + k);
+			d[k] = _mm256_broadcast_ss(f->d + k);
+		}
+		for (; i < (n & ~(size_t)7); i += 8){
+			vec4x8_t ctr, ext;
+			frustum_load_aabb8(boxes + i, &ctr, &ext);
+			__m256 in = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int k = 0; k < FRUSTUM_PLANES; ++k){
+				__m256 dist = vec4x8_madd_ps(a[k], ctr.x, vec4x8_madd_ps(b[k], ctr.y,
+					vec4x8_madd_ps(c[k], ctr.z, d[k])));
+				__m256 r = vec4x8_madd_ps(_mm256_and_ps(a[k], abs_mask), ext.x,
+					vec4x8_madd_ps(_mm256_and_ps(b[k], abs_mask), ext.y,
+					_mm256_mul_ps(_mm256_and_ps(c[k], abs_mask), ext.z)));
+				in = _mm256_and_ps(in, _mm256_cmp_ps(_mm256_add_ps(dist, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+			}
+			int mask = _mm256_movemask_ps(in);
+			count = frustum_compact4(visible, count, i, mask & 0xf);
+			count = frustum_compact4(visible, count, i + 4, mask >> 4);
+		}
+	}
+#endif
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 a[FRUSTUM_PLANES], b[FRUSTUM_PLANES], c[FRUSTUM_PLANES], d[FRUSTUM_PLANES];
+	for (int k = 0; k < FRUSTUM_PLANES; ++k){
+		a[k] = _mm_load1_ps(f->a + k);
+		b[k] = _mm_load1_ps(f->b + k);
+		c[k] = _mm_load1_ps(f->c + k);
+		d[k] = _mm_load1_ps(f->d + k);
+	}
+	for (; i < n; i += 4){
+		size_t lanes = n - i < 4 ? n - i : 4;
+		aabb_t tail[4];
+		const aabb_t *src = boxes + i;
+		if (lanes < 4){
+			for (size_t j = 0; j < 4; ++j){
+				tail[j] = boxes[i + (j < lanes ? j : 0)];
+			}
+			src = tail;
+		}
+		vec4x4_t ctr, ext;
+		frustum_load_aabb4(src, &ctr, &ext);
+		__m128 in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int k = 0; k < FRUSTUM_PLANES; ++k){
+			__m128 dist = vec4_madd_ps(a[k], ctr.x, vec4_madd_ps(b[k], ctr.y, vec4_madd_ps(c[k], ctr.z, d[k])));
+			__m128 r = vec4_madd_ps(_mm_and_ps(a[k], abs_mask), ext.x,
+				vec4_madd_ps(_mm_and_ps(b[k], abs_mask), ext.y, _mm_mul_ps(_mm_and_ps(c[k], abs_mask), ext.z)));
+			in = _mm_and_ps(in, _mm_cmpge_ps(_mm_add_ps(dist, r), _mm_setzero_ps()));
+		}
+		if (lanes == 4){
+			count = frustum_compact4(visible, count, i, _mm_movemask_ps(in));
+		}
+		else {
+			count = frustum_compact(visible, count, i, _mm_movemask_ps(in), lanes);
+		}
+	}
+	return count;
+}
+
+#endif
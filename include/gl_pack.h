@@ -0,0 +1,206 @@
+#ifndef SSE_GL_PACK_H
+#define SSE_GL_PACK_H
+
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vec4.h"
+#include "mat4.h"
+
+/*
+ * Write vec4_t/mat4_t arrays straight into the memory layout GL reads them
+ * from, eg. a persistently mapped buffer, so per instance data can be uploaded
+ * with one buffer update instead of a glUniform call per object. There's no GL
+ * dependency here, it's all about the bytes.
+ *
+ * Each pack function writes element i at dst + i * stride, which covers tightly
+ * packed std140/std430 arrays (stride from gl_pack_array_stride), members of an
+ * array of structs in a UBO/SSBO (dst at the member's offset, stride from
+ * gl_pack_block_stride) and interleaved instanced vertex attributes (stride of
+ * the whole vertex). Matrices are written column major like GL expects unless
+ * PACK_TRANSPOSE is set, for row_major blocks.
+ *
+ * When dst and stride are 16 byte aligned the vec4 and matrix columns are written
+ * with non-temporal stores if PACK_STREAM is set or the whole write is at least
+ * MAT4_STREAM_BYTES. Write combined (mapped) buffers should always use
+ * PACK_STREAM, since reading them back or partially writing lines is slow
+ */
+enum pack_layout { PACK_STD140, PACK_STD430 };
+/* The GLSL types that can be packed */
+enum pack_type { PACK_FLOAT, PACK_VEC2, PACK_VEC3, PACK_VEC4, PACK_MAT3, PACK_MAT4 };
+enum pack_flags {
+	PACK_STREAM = 1,
+	/* Write matrices row by row, for row_major blocks */
+	PACK_TRANSPOSE = 2
+};
+/*
+ * Offsets of the members of a uniform or shader storage block (or of a struct
+ * in an array in one) as they're added, following the std140/std430 rules
+ */
+struct pack_block {
+	enum pack_layout layout;
+	size_t size, align;
+};
+
+/* Base alignment of a GLSL type, matrices are aligned like their column vectors */
+static inline size_t gl_pack_align(enum pack_type t){
+	switch (t){
+	case PACK_FLOAT:
+		return 4;
+	case PACK_VEC2:
+		return 8;
+	default:
+		return 16;
+	}
+}
+/* Bytes a single value of the type takes up, mat3 columns are padded out to vec4s */
+static inline size_t gl_pack_size(enum pack_type t){
+	static const size_t sizes[] = { 4, 8, 12, 16, 48, 64 };
+	return sizes[t];
+}
+/*
+ * Distance between the elements of an array of the type. std140 rounds array
+ * elements up to a vec4, std430 only to the type's own alignment
+ */
+static inline size_t gl_pack_array_stride(enum pack_layout l, enum pack_type t){
+	size_t align = gl_pack_align(t);
+	if (l == PACK_STD140 && align < 16){
+		align = 16;
+	}
+	return (gl_pack_size(t) + align - 1) & ~(align - 1);
+}
+static inline struct pack_block gl_pack_block_new(enum pack_layout l){
+	struct pack_block b = { l, 0, l == PACK_STD140 ? 16 : 4 };
+	return b;
+}
+/*
+ * Add a member to the block, an array of count if count isn't 0, and get its
+ * offset in the block
+ */
+static inline size_t gl_pack_block_add(struct pack_block *b, enum pack_type t, size_t count){
+	size_t align = gl_pack_align(t);
+	size_t size = gl_pack_size(t);
+	if (count){
+		size = count * gl_pack_array_stride(b->layout, t);
+		if (b->layout == PACK_STD140 && align < 16){
+			align = 16;
+		}
+	}
+	size_t offset = (b->size + align - 1) & ~(align - 1);
+	b->size = offset + size;
+	if (align > b->align){
+		b->align = align;
+	}
+	return offset;
+}
+/* Distance between the elements of an array of the block's struct, its size rounded up to its alignment */
+static inline size_t gl_pack_block_stride(const struct pack_block *b){
+	return (b->size + b->align - 1) & ~(b->align - 1);
+}
+
+/* Check if the vec4 stores can be non-temporal */
+static inline int gl_pack_streaming(const void *dst, size_t stride, size_t bytes, int flags){
+	return ((uintptr_t)dst & 15) == 0 && (stride & 15) == 0
+		&& ((flags & PACK_STREAM) || bytes >= MAT4_STREAM_BYTES);
+}
+static inline void gl_pack_store(float *dst, __m128 v, int stream){
+	if (stream){
+		_mm_stream_ps(dst, v);
+	}
+	else {
+		_mm_storeu_ps(dst, v);
+	}
+}
+/* Write the first cols columns of the matrix, transposing it first if asked to */
+static inline void gl_pack_cols(float *dst, const __m128 c[4], int cols, int flags, int stream){
+	__m128 r[4] = { c[0], c[1], c[2], c[3] };
+	if (flags & PACK_TRANSPOSE){
+		_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+	}
+	for (int i = 0; i < cols; ++i){
+		gl_pack_store(dst + 4 * i, r[i], stream);
+	}
+}
+/* Non-temporal stores are weakly ordered, make them visible before the buffer is handed to GL */
+static inline void gl_pack_done(int stream){
+	if (stream){
+		_mm_sfence();
+	}
+}
+
+static inline void gl_pack_vec4(void *dst, size_t stride, const vec4_t *v, size_t n, int flags){
+	char *out = dst;
+	int stream = gl_pack_streaming(dst, stride, n * 16, flags);
+	for (size_t i = 0; i < n; ++i){
+		gl_pack_store((float*)(out + i * stride), v[i].v, stream);
+	}
+	gl_pack_done(stream);
+}
+/* Write the xy of each vector as a vec2 */
+static inline void gl_pack_vec2(void *dst, size_t stride, const vec4_t *v, size_t n){
+	char *out = dst;
+	for (size_t i = 0; i < n; ++i){
+		memcpy(out + i * stride, v[i].f, 2 * sizeof(float));
+	}
+}
+/* Write the xyz of each vector as a vec3, the 4 bytes after each are left alone */
+static inline void gl_pack_vec3(void *dst, size_t stride, const vec4_t *v, size_t n){
+	char *out = dst;
+	for (size_t i = 0; i < n; ++i){
+		memcpy(out + i * stride, v[i].f, 3 * sizeof(float));
+	}
+}
+static inline void gl_pack_float(void *dst, size_t stride, const float *f, size_t n){
+	char *out = dst;
+	for (size_t i = 0; i < n; ++i){
+		memcpy(out + i * stride, f + i, sizeof(float));
+	}
+}
+static inline void gl_pack_mat4(void *dst, size_t stride, const mat4_t *m, size_t n, int flags){
+	char *out = dst;
+	int stream = gl_pack_streaming(dst, stride, n * 64, flags);
+	for (size_t i = 0; i < n; ++i){
+		const __m128 c[4] = { m[i].col[0].v, m[i].col[1].v, m[i].col[2].v, m[i].col[3].v };
+		gl_pack_cols((float*)(out + i * stride), c, 4, flags, stream);
+	}
+	gl_pack_done(stream);
+}
+/*
+ * Write the upper 3x3 of each matrix as a mat3, eg. normal matrices. Each
+ * column (or row with PACK_TRANSPOSE) takes up a vec4 and the padding is
+ * written as 0
+ */
+static inline void gl_pack_mat3(void *dst, size_t stride, const mat4_t *m, size_t n, int flags){
+	char *out = dst;
+	int stream = gl_pack_streaming(dst, stride, n * 48, flags);
+	const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	for (size_t i = 0; i < n; ++i){
+		/* Clearing the bottom row and the last column zeroes the padding either way */
+		const __m128 c[4] = { _mm_and_ps(m[i].col[0].v, xyz), _mm_and_ps(m[i].col[1].v, xyz),
+			_mm_and_ps(m[i].col[2].v, xyz), _mm_setzero_ps() };
+		gl_pack_cols((float*)(out + i * stride), c, 3, flags, stream);
+	}
+	gl_pack_done(stream);
+}
+/*
+ * Compute a * b[i] for each matrix and write it out, eg. the view projection
+ * times each model matrix for per instance MVPs without another pass over
+ * the matrices
+ */
+static inline void gl_pack_premult_mat4(void *dst, size_t stride, const mat4_t *a, const mat4_t *b,
+	size_t n, int flags)
+{
+	char *out = dst;
+	int stream = gl_pack_streaming(dst, stride, n * 64, flags);
+	const __m128 ac[4] = { a->col[0].v, a->col[1].v, a->col[2].v, a->col[3].v };
+	for (size_t i = 0; i < n; ++i){
+		__m128 c[4];
+		for (int j = 0; j < 4; ++j){
+			c[j] = mat4_xform_v(ac, b[i].col[j].v, MAT4_XFORM_FULL);
+		}
+		gl_pack_cols((float*)(out + i * stride), c, 4, flags, stream);
+	}
+	gl_pack_done(stream);
+}
+
+#endif
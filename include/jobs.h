@@ -0,0 +1,121 @@
+#ifndef SSE_JOBS_H
+#define SSE_JOBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "frustum.h"
+#include "ray.h"
+
+/*
+ * A work stealing thread pool. Each thread has its own deque of jobs: it
+ * pushes and pops jobs at the bottom of its own deque and when that's empty
+ * steals from the top of someone else's, so the oldest and biggest pieces of
+ * work are the ones that move between threads. Idle workers sleep until more
+ * jobs are pushed.
+ *
+ * Work is handed out with fork/join: jobs_fork pushes a job that's counted in
+ * a group and jobs_join runs jobs (its own or stolen ones) until everything in
+ * the group is done, so jobs can fork and join their own jobs. jobs_parallel_for
+ * is built on that, it splits an index range in half recursively, forking
+ * one half and running the other, until the pieces are down to the grain size.
+ *
+ * The thread that created the pool (and the pool's own jobs) can fork onto it,
+ * other threads shouldn't. Passing a NULL pool to any of the functions runs
+ * everything on the calling thread
+ */
+/* Jobs a thread can have pushed and not yet run, past this jobs_fork runs them right away */
+#define JOBS_DEQUE_SIZE 1024
+/*
+ * Bytes of each array a parallel_for chunk covers when the grain is picked
+ * from the element size, small enough to stay in L2 but big enough to amortize
+ * forking and stealing the chunk
+ */
+#define JOBS_CHUNK_BYTES (64 * 1024)
+/* Elements per chunk for an array of some type, eg. JOBS_GRAIN(mat4_t) */
+#define JOBS_GRAIN(T) jobs_grain(sizeof(T))
+
+enum jobs_flags {
+	/* Pin each worker thread to its own CPU, out of the ones the process may run on */
+	JOBS_PIN = 1
+};
+struct job_group;
+/*
+ * A job to fork, usually the first member of a struct with its arguments. It
+ * has to stay alive until the group it's forked in has been joined
+ */
+struct job {
+	void (*run)(struct job *job);
+	struct job_group *group;
+};
+/* Jobs forked together and waited for with jobs_join, zero it before use */
+struct job_group {
+	int pending;
+};
+struct jobs;
+/*
+ * Start a pool with threads threads including the caller (so threads - 1 are
+ * started), if threads is 0 or less one is used for each CPU. Returns NULL on
+ * failure
+ */
+struct jobs* jobs_create(int threads, int flags);
+void jobs_destroy(struct jobs *j);
+/* Threads working on the pool, including the creating thread */
+int jobs_thread_count(const struct jobs *j);
+/* Push a job to be run by some thread, it's counted in the group until it finishes */
+void jobs_fork(struct jobs *j, struct job_group *g, struct job *job);
+/* Run jobs until every job forked in the group has finished */
+void jobs_join(struct jobs *j, struct job_group *g);
+/*
+ * Call fn(arg, lo, hi) over chunks of [0, n) in parallel and wait for them
+ * all. Chunks have at most grain elements and about half that at least, a
+ * grain of 0 picks one for 16 byte elements. Chunk edges are multiples of 16
+ * when the grain is at least 32, so the SIMD loops in the kernels only leave
+ * remainders at the end of the whole range. Without a pool or with just one
+ * thread fn is called once for the whole range
+ */
+void jobs_parallel_for(struct jobs *j, size_t n, size_t grain,
+	void (*fn)(void *arg, size_t lo, size_t hi), void *arg);
+/* Pick a chunk size for arrays of elements of some size, see JOBS_CHUNK_BYTES */
+static inline size_t jobs_grain(size_t elem_size){
+	size_t grain = JOBS_CHUNK_BYTES / elem_size;
+	return grain ? grain : 1;
+}
+
+/*
+ * Parallel versions of the dispatched kernels in dispatch.h, they take the
+ * same arguments with the pool first and call the installed kernel on chunks
+ * of the arrays. The matrix kernels are chunked by JOBS_GRAIN(mat4_t) and the
+ * vector ones by JOBS_GRAIN(vec4_t). They stop scaling once the threads
+ * together saturate memory bandwidth, which for the vector transforms on big
+ * arrays is just a few threads. scan_lines and the vertex packing kernels are
+ * left out on purpose: mesh_import already spreads its blocks over threads and
+ * packing is bound by memory from the start, a jobs_parallel_for over the
+ * kernel does it if it's ever needed
+ */
+void jobs_vec_mult_n(struct jobs *j, const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n);
+void jobs_transform_points(struct jobs *j, const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n);
+void jobs_transform_vectors(struct jobs *j, const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n);
+void jobs_project_points(struct jobs *j, const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n);
+void jobs_mult_n(struct jobs *j, const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n);
+void jobs_premult_n(struct jobs *j, const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n);
+void jobs_transpose_n(struct jobs *j, const mat4_t *in, mat4_t *out, size_t n);
+void jobs_inverse_n(struct jobs *j, const mat4_t *in, mat4_t *out, float *det, size_t n);
+void jobs_inverse_affine_n(struct jobs *j, const mat4_t *in, mat4_t *out, size_t n);
+void jobs_inverse_rigid_n(struct jobs *j, const mat4_t *in, mat4_t *out, size_t n);
+void jobs_normal_matrix_n(struct jobs *j, const mat4_t *in, mat4_t *out, size_t n);
+void jobs_rotate_n(struct jobs *j, const float *d, const vec4_t *axis, mat4_t *out, size_t n);
+void jobs_perspective_n(struct jobs *j, const float *fovY, const float *aspect, const float *near,
+	const float *far, mat4_t *out, size_t n);
+/*
+ * The culling kernels cull each chunk into its own part of visible and then
+ * pack them down, visible needs room for n indices like for the kernels
+ */
+size_t jobs_cull_spheres(struct jobs *j, const frustum_t *f, const vec4_t *s, size_t n, uint32_t *visible);
+size_t jobs_cull_aabbs(struct jobs *j, const frustum_t *f, const aabb_t *boxes, size_t n, uint32_t *visible);
+/* The rays are split between the threads, each tested against every triangle */
+void jobs_intersect_tris(struct jobs *j, const tri_t *tris, size_t n_tris, const ray_t *rays, hit_t *hits,
+	size_t n_rays);
+
+#endif
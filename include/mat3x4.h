@@ -0,0 +1,276 @@
+#ifndef SSE_MAT3X4_H
+#define SSE_MAT3X4_H
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <stdio.h>
+#include <stddef.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "quat.h"
+
+/*
+ * Affine transform stored as the top 3 rows of the 4x4 matrix, the bottom row
+ * is always [0, 0, 0, 1] so it's left out. Each row is [a, b, c, t], the upper
+ * 3x3 part and translation. That's 48 bytes instead of 64 for mat4_t and the
+ * products skip the math on the constant row, so it's the type to use for big
+ * arrays of model matrices or skeleton poses. Only the projection needs to be
+ * a full mat4_t, see mat4_mult_mat3x4.
+ *
+ * The rows can be uploaded as is to a GLSL mat3x4 in std140/std430, where
+ * vec4(p, 1) * m gives the transformed point
+ */
+struct mat3x4_t {
+	vec4_t row[3];
+} ALIGN_16;
+typedef struct mat3x4_t mat3x4_t;
+
+/* Create a new mat3x4, the transform will be the identity */
+static inline mat3x4_t mat3x4_new(void){
+	mat3x4_t m;
+	m.row[0].v = _mm_setr_ps(1.f, 0.f, 0.f, 0.f);
+	m.row[1].v = _mm_setr_ps(0.f, 1.f, 0.f, 0.f);
+	m.row[2].v = _mm_setr_ps(0.f, 0.f, 1.f, 0.f);
+	return m;
+}
+/* Take the top 3 rows of m, its bottom row should be [0, 0, 0, 1] */
+static inline mat3x4_t mat3x4_from_mat4(mat4_t m){
+	m = mat4_transpose(m);
+	mat3x4_t a;
+	a.row[0] = m.col[0];
+	a.row[1] = m.col[1];
+	a.row[2] = m.col[2];
+	return a;
+}
+/* The columns of m as a mat4_t would hold them, the last one is the translation */
+static inline void mat3x4_columns(const mat3x4_t *m, __m128 c[4]){
+	c[0] = m->row[0].v;
+	c[1] = m->row[1].v;
+	c[2] = m->row[2].v;
+	c[3] = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+	_MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+}
+/* Promote to a full mat4_t */
+static inline mat4_t mat3x4_to_mat4(mat3x4_t m){
+	__m128 c[4];
+	mat3x4_columns(&m, c);
+	mat4_t r;
+	for (int i = 0; i < 4; ++i){
+		r.col[i].v = c[i];
+	}
+	return r;
+}
+/* Create a translation to move by the vector */
+static inline mat3x4_t mat3x4_translate(vec4_t v){
+	mat3x4_t m = mat3x4_new();
+	m.row[0].f[3] = v.c.x;
+	m.row[1].f[3] = v.c.y;
+	m.row[2].f[3] = v.c.z;
+	return m;
+}
+/* Create a scaling transform to scale the x,y,z coords by x,y,z */
+static inline mat3x4_t mat3x4_scale(float x, float y, float z){
+	mat3x4_t m;
+	m.row[0].v = _mm_setr_ps(x, 0.f, 0.f, 0.f);
+	m.row[1].v = _mm_setr_ps(0.f, y, 0.f, 0.f);
+	m.row[2].v = _mm_setr_ps(0.f, 0.f, z, 0.f);
+	return m;
+}
+/* Create the rotation by d degrees about the vector v (v.w should be 0), same as mat4_rotate */
+static inline mat3x4_t mat3x4_rotate(float d, vec4_t v){
+	return mat3x4_from_mat4(mat4_rotate(d, v));
+}
+/* Same as mat4_look_at, the view matrix is affine */
+static inline mat3x4_t mat3x4_look_at(vec4_t eye, vec4_t center, vec4_t up){
+	return mat3x4_from_mat4(mat4_look_at(eye, center, up));
+}
+/* Build the transform scaling by s, then rotating by r and then translating by t, see mat4_compose */
+static inline mat3x4_t mat3x4_compose(vec4_t t, quat_t r, vec4_t s){
+	return mat3x4_from_mat4(mat4_compose(t, r, s));
+}
+/*
+ * Compute dst = a * b. Row i of the result is a's row i times the rows of b,
+ * the w of a's row picks up b's implicit [0, 0, 0, 1] bottom row. dst may alias
+ * a or b
+ */
+static inline void mat3x4_mult_to(mat3x4_t *dst, const mat3x4_t *a, const mat3x4_t *b){
+	const __m128 w_mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+	__m128 r[3];
+	for (int i = 0; i < 3; ++i){
+		__m128 v = a->row[i].v;
+		__m128 x = _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), b->row[0].v);
+		x = vec4_madd_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), b->row[1].v, x);
+		x = vec4_madd_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), b->row[2].v, x);
+		r[i] = _mm_add_ps(x, _mm_and_ps(v, w_mask));
+	}
+	dst->row[0].v = r[0];
+	dst->row[1].v = r[1];
+	dst->row[2].v = r[2];
+}
+static inline mat3x4_t mat3x4_mult(mat3x4_t a, mat3x4_t b){
+	mat3x4_t c;
+	mat3x4_mult_to(&c, &a, &b);
+	return c;
+}
+/*
+ * Compute dst = p * m for a full matrix p, eg. the view-projection times a model
+ * transform. The first three columns of m have w = 0 so they're transformed as
+ * vectors and only the translation as a point
+ */
+static inline void mat4_mult_mat3x4_to(mat4_t *dst, const mat4_t *p, const mat3x4_t *m){
+	const __m128 c[4] = { p->col[0].v, p->col[1].v, p->col[2].v, p->col[3].v };
+	__m128 mc[4];
+	mat3x4_columns(m, mc);
+	dst->col[0].v = mat4_xform_v(c, mc[0], MAT4_XFORM_VECTOR);
+	dst->col[1].v = mat4_xform_v(c, mc[1], MAT4_XFORM_VECTOR);
+	dst->col[2].v = mat4_xform_v(c, mc[2], MAT4_XFORM_VECTOR);
+	dst->col[3].v = mat4_xform_v(c, mc[3], MAT4_XFORM_POINT);
+}
+static inline mat4_t mat4_mult_mat3x4(mat4_t p, mat3x4_t m){
+	mat4_t r;
+	mat4_mult_mat3x4_to(&r, &p, &m);
+	return r;
+}
+/* Sum the elements of each of a, b and c, returning [sum(a), sum(b), sum(c), 0] */
+static inline __m128 mat3x4_hsum3_ps(__m128 a, __m128 b, __m128 c){
+	__m128 d = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(a, b, c, d);
+	return _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+}
+/* Transform the point v, its w is taken to be 1 and the result has w = 1 */
+static inline vec4_t mat3x4_transform_point(mat3x4_t m, vec4_t v){
+	const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	const __m128 w_one = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+	__m128 p = _mm_or_ps(_mm_and_ps(v.v, xyz_mask), w_one);
+	v.v = _mm_add_ps(mat3x4_hsum3_ps(_mm_mul_ps(m.row[0].v, p), _mm_mul_ps(m.row[1].v, p),
+		_mm_mul_ps(m.row[2].v, p)), w_one);
+	return v;
+}
+/* Transform the direction v, its w is taken to be 0 and the result has w = 0 */
+static inline vec4_t mat3x4_transform_vector(mat3x4_t m, vec4_t v){
+	const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 p = _mm_and_ps(v.v, xyz_mask);
+	v.v = mat3x4_hsum3_ps(_mm_mul_ps(m.row[0].v, p), _mm_mul_ps(m.row[1].v, p), _mm_mul_ps(m.row[2].v, p));
+	return v;
+}
+/*
+ * Replace the translation of the inverse rows r with -(r * t) for the original
+ * translation t (w = 0). The w of each row in r should be 0
+ */
+static inline void mat3x4_set_inverse_translation(mat3x4_t *dst, const __m128 r[3], __m128 t){
+	__m128 nt = _mm_sub_ps(_mm_setzero_ps(),
+		mat3x4_hsum3_ps(_mm_mul_ps(r[0], t), _mm_mul_ps(r[1], t), _mm_mul_ps(r[2], t)));
+	/* Move element i of nt into the w of row i */
+	const __m128 w_mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+	dst->row[0].v = _mm_or_ps(r[0], _mm_and_ps(_mm_shuffle_ps(nt, nt, _MM_SHUFFLE(0, 0, 0, 0)), w_mask));
+	dst->row[1].v = _mm_or_ps(r[1], _mm_and_ps(_mm_shuffle_ps(nt, nt, _MM_SHUFFLE(1, 1, 1, 1)), w_mask));
+	dst->row[2].v = _mm_or_ps(r[2], _mm_and_ps(_mm_shuffle_ps(nt, nt, _MM_SHUFFLE(2, 2, 2, 2)), w_mask));
+}
+/*
+ * Compute dst = inverse(m) and return the determinant of the upper 3x3. The rows
+ * of the inverse 3x3 are the cross products of m's columns over the determinant,
+ * since the rows are what's stored there's no transpose back like in
+ * mat4_inverse_affine_to. dst may alias m
+ */
+static inline float mat3x4_inverse_to(mat3x4_t *dst, const mat3x4_t *m){
+	__m128 c[4];
+	c[0] = m->row[0].v;
+	c[1] = m->row[1].v;
+	c[2] = m->row[2].v;
+	c[3] = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+	vec4_t c0, c1, c2;
+	c0.v = c[0];
+	c1.v = c[1];
+	c2.v = c[2];
+	__m128 r[3] = { vec4_cross(c1, c2).v, vec4_cross(c2, c0).v, vec4_cross(c0, c1).v };
+	/* The w of each is 0 so this is the dot of the 3x3 part */
+	__m128 det = vec4_hsum_ps(_mm_mul_ps(c[0], r[0]));
+	__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), det);
+	r[0] = _mm_mul_ps(r[0], inv_det);
+	r[1] = _mm_mul_ps(r[1], inv_det);
+	r[2] = _mm_mul_ps(r[2], inv_det);
+	mat3x4_set_inverse_translation(dst, r, c[3]);
+	return _mm_cvtss_f32(det);
+}
+static inline mat3x4_t mat3x4_inverse(mat3x4_t m){
+	mat3x4_inverse_to(&m, &m);
+	return m;
+}
+/*
+ * Compute dst = inverse(m) for an m made of only a rotation and translation, the
+ * rows of the inverse are just the columns of the rotation. dst may alias m
+ */
+static inline void mat3x4_inverse_rigid_to(mat3x4_t *dst, const mat3x4_t *m){
+	__m128 c[4];
+	c[0] = m->row[0].v;
+	c[1] = m->row[1].v;
+	c[2] = m->row[2].v;
+	c[3] = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+	mat3x4_set_inverse_translation(dst, c, c[3]);
+}
+static inline mat3x4_t mat3x4_inverse_rigid(mat3x4_t m){
+	mat3x4_inverse_rigid_to(&m, &m);
+	return m;
+}
+/*
+ * Batched versions over n transforms, out may be the same array as in (or
+ * as a or b)
+ */
+static inline void mat3x4_mult_n(const mat3x4_t *a, const mat3x4_t *b, mat3x4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		mat3x4_mult_to(out + i, a + i, b + i);
+	}
+}
+/* Compute out[i] = a * b[i], eg. a parent transform applied to each child */
+static inline void mat3x4_premult_n(const mat3x4_t *a, const mat3x4_t *b, mat3x4_t *out, size_t n){
+	const mat3x4_t p = *a;
+	for (size_t i = 0; i < n; ++i){
+		mat3x4_mult_to(out + i, &p, b + i);
+	}
+}
+/*
+ * Compute out[i] = p * m[i], eg. the view-projection times each instance's
+ * model transform to get the full matrices for the GPU
+ */
+static inline void mat4_mult_mat3x4_n(const mat4_t *p, const mat3x4_t *m, mat4_t *out, size_t n){
+	const mat4_t a = *p;
+	for (size_t i = 0; i < n; ++i){
+		mat4_mult_mat3x4_to(out + i, &a, m + i);
+	}
+}
+static inline void mat3x4_inverse_n(const mat3x4_t *in, mat3x4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		mat3x4_inverse_to(out + i, in + i);
+	}
+}
+static inline void mat3x4_inverse_rigid_n(const mat3x4_t *in, mat3x4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		mat3x4_inverse_rigid_to(out + i, in + i);
+	}
+}
+/*
+ * Transform n points (w taken to be 1) or directions (w taken to be 0), using
+ * the batched mat4 transforms on the columns of m
+ */
+static inline void mat3x4_transform_points(const mat3x4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	const mat4_t c = mat3x4_to_mat4(*m);
+	mat4_transform_points(&c, in, out, n);
+}
+static inline void mat3x4_transform_vectors(const mat3x4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	const mat4_t c = mat3x4_to_mat4(*m);
+	mat4_transform_vectors(&c, in, out, n);
+}
+/* See if the two transforms are equal. Mostly for testing really */
+static inline int mat3x4_eq(mat3x4_t a, mat3x4_t b){
+	return vec4_eq(a.row[0], b.row[0]) && vec4_eq(a.row[1], b.row[1]) && vec4_eq(a.row[2], b.row[2]);
+}
+/* Print out the transform row by row */
+static inline void mat3x4_print(mat3x4_t m){
+	for (int i = 0; i < 3; ++i){
+		vec4_print(m.row[i]);
+	}
+}
+
+#endif
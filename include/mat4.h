@@ -4,14 +4,30 @@
 #include <xmmintrin.h>
 #include <math.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "vec4.h"
+#include "vec4x4.h"
+#include "vec4x8.h"
+#include "vec4_math.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979
 #endif
+/*
+ * Batched transforms writing at least this many bytes of output use non-temporal
+ * stores so that streaming through a big vertex buffer doesn't evict everything
+ * else from the cache. Should be around the size of the last level cache
+ */
+#ifndef MAT4_STREAM_BYTES
+#define MAT4_STREAM_BYTES (4 * 1024 * 1024)
+#endif
 
 /*
- * 4x4 matrix stored in column major order
+ * 4x4 matrix stored in column major order. When compiling with AVX or AVX-512
+ * the matrix operations and batched transforms work on two columns (or vectors)
+ * per __m256 or a whole matrix (or four vectors) per __m512, doing the same
+ * operations in the same order as the SSE versions so the results match
  */
 struct mat4_t {
 	vec4_t col[4];
@@ -19,6 +35,7 @@ struct mat4_t {
 typedef struct mat4_t mat4_t;
 /* Create a new mat4, the matrix will be the identity matrix */
 static inline mat4_t mat4_new(void){
+	SSE_TRACE_FN();
 	mat4_t m;
 	for (int i = 0; i < 4; ++i){
 		m.col[i].v = _mm_setzero_ps();
@@ -26,16 +43,36 @@ static inline mat4_t mat4_new(void){
 	}
 	return m;
 }
-static inline mat4_t mat4_transpose(mat4_t m){
+/* Compute dst = transpose(m), dst may alias m */
+static inline void mat4_transpose_to(mat4_t *dst, const mat4_t *m){
+	SSE_TRACE_FN();
+#if defined(__AVX2__)
+	/*
+	 * The unpacks leave [x0 x2 y0 y2 | x1 x3 y1 y3] so one cross lane permute
+	 * puts each pair of rows in order. AVX-512 can do it with a single permute
+	 * of the whole matrix but mat4_t is only 16 byte aligned, so most of those
+	 * loads and stores split a cache line and it measured slower than this
+	 */
+	const __m256i idx = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	__m256 c01 = _mm256_loadu_ps(m->col[0].f), c23 = _mm256_loadu_ps(m->col[2].f);
+	__m256 lo = _mm256_unpacklo_ps(c01, c23), hi = _mm256_unpackhi_ps(c01, c23);
+	_mm256_storeu_ps(dst->col[0].f, _mm256_permutevar8x32_ps(lo, idx));
+	_mm256_storeu_ps(dst->col[2].f, _mm256_permutevar8x32_ps(hi, idx));
+#else
 	__m128 tmp[4];
-	tmp[0] = _mm_unpacklo_ps(m.col[0].v, m.col[1].v);
-	tmp[1] = _mm_unpackhi_ps(m.col[0].v, m.col[1].v);
-	tmp[2] = _mm_unpacklo_ps(m.col[2].v, m.col[3].v);
-	tmp[3] = _mm_unpackhi_ps(m.col[2].v, m.col[3].v);
-	m.col[0].v = _mm_movelh_ps(tmp[0], tmp[2]);
-	m.col[1].v = _mm_movehl_ps(tmp[2], tmp[0]);
-	m.col[2].v = _mm_movelh_ps(tmp[1], tmp[3]);
-	m.col[3].v = _mm_movehl_ps(tmp[3], tmp[1]);
+	tmp[0] = _mm_unpacklo_ps(m->col[0].v, m->col[1].v);
+	tmp[1] = _mm_unpackhi_ps(m->col[0].v, m->col[1].v);
+	tmp[2] = _mm_unpacklo_ps(m->col[2].v, m->col[3].v);
+	tmp[3] = _mm_unpackhi_ps(m->col[2].v, m->col[3].v);
+	dst->col[0].v = _mm_movelh_ps(tmp[0], tmp[2]);
+	dst->col[1].v = _mm_movehl_ps(tmp[2], tmp[0]);
+	dst->col[2].v = _mm_movelh_ps(tmp[1], tmp[3]);
+	dst->col[3].v = _mm_movehl_ps(tmp[3], tmp[1]);
+#endif
+}
+static inline mat4_t mat4_transpose(mat4_t m){
+	SSE_TRACE_FN();
+	mat4_transpose_to(&m, &m);
 	return m;
 }
 /*
@@ -43,6 +80,7 @@ static inline mat4_t mat4_transpose(mat4_t m){
  * r must contain at least 16 floats and should be 16-byte aligned
  */
 static inline mat4_t mat4_from_cols(const float *c){
+	SSE_TRACE_FN();
 	mat4_t m;
 	for (int i = 0; i < 4; ++i){
 		m.col[i].v = _mm_load_ps(c + 4 * i);
@@ -54,88 +92,443 @@ static inline mat4_t mat4_from_cols(const float *c){
  * r must contain at least 16 floats and should be 16-byte aligned
  */
 static inline mat4_t mat4_from_rows(const float *r){
+	SSE_TRACE_FN();
 	/* We simply load as cols then transpose to */
 	return mat4_transpose(mat4_from_cols(r));
 }
 /* Arithmetic operations */
 static inline mat4_t mat4_add(mat4_t a, mat4_t b){
+	SSE_TRACE_FN();
 	mat4_t c;
+#if defined(__AVX512F__)
+	_mm512_storeu_ps(c.col[0].f, _mm512_add_ps(_mm512_loadu_ps(a.col[0].f), _mm512_loadu_ps(b.col[0].f)));
+#elif defined(__AVX__)
+	_mm256_storeu_ps(c.col[0].f, _mm256_add_ps(_mm256_loadu_ps(a.col[0].f), _mm256_loadu_ps(b.col[0].f)));
+	_mm256_storeu_ps(c.col[2].f, _mm256_add_ps(_mm256_loadu_ps(a.col[2].f), _mm256_loadu_ps(b.col[2].f)));
+#else
 	for (int i = 0; i < 4; ++i){
 		c.col[i] = vec4_add(a.col[i], b.col[i]);
 	}
+#endif
 	return c;
 }
 static inline mat4_t mat4_sub(mat4_t a, mat4_t b){
+	SSE_TRACE_FN();
 	mat4_t c;
+#if defined(__AVX512F__)
+	_mm512_storeu_ps(c.col[0].f, _mm512_sub_ps(_mm512_loadu_ps(a.col[0].f), _mm512_loadu_ps(b.col[0].f)));
+#elif defined(__AVX__)
+	_mm256_storeu_ps(c.col[0].f, _mm256_sub_ps(_mm256_loadu_ps(a.col[0].f), _mm256_loadu_ps(b.col[0].f)));
+	_mm256_storeu_ps(c.col[2].f, _mm256_sub_ps(_mm256_loadu_ps(a.col[2].f), _mm256_loadu_ps(b.col[2].f)));
+#else
 	for (int i = 0; i < 4; ++i){
 		c.col[i] = vec4_sub(a.col[i], b.col[i]);
 	}
+#endif
 	return c;
 }
+/*
+ * How the w component of the input is treated by the batched transforms. POINT
+ * and VECTOR take w to be 1 and 0 respectively, PROJECT transforms as a point
+ * then divides through by the resulting w
+ */
+enum mat4_xform_mode { MAT4_XFORM_FULL, MAT4_XFORM_POINT, MAT4_XFORM_VECTOR, MAT4_XFORM_PROJECT };
+/*
+ * Transform v by the matrix with columns c as a linear combination of the
+ * columns, c[0] * v.x + c[1] * v.y + c[2] * v.z + c[3] * v.w
+ */
+static inline __m128 mat4_xform_v(const __m128 *c, __m128 v, enum mat4_xform_mode mode){
+	__m128 r = _mm_mul_ps(c[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+	r = vec4_madd_ps(c[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), r);
+	r = vec4_madd_ps(c[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), r);
+	switch (mode){
+	case MAT4_XFORM_FULL:
+		r = vec4_madd_ps(c[3], _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), r);
+		break;
+	case MAT4_XFORM_POINT:
+		r = _mm_add_ps(r, c[3]);
+		break;
+	case MAT4_XFORM_PROJECT:
+		r = _mm_add_ps(r, c[3]);
+		r = _mm_div_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+		break;
+	case MAT4_XFORM_VECTOR:
+		break;
+	}
+	return r;
+}
+#ifdef __AVX__
+/*
+ * mat4_xform_v on the two vectors in the 128 bit lanes of v, the columns in c
+ * should be broadcast to both lanes
+ */
+static inline __m256 mat4_xform8(const __m256 *c, __m256 v, enum mat4_xform_mode mode){
+	__m256 r = _mm256_mul_ps(c[0], _mm256_permute_ps(v, _MM_SHUFFLE(0, 0, 0, 0)));
+	r = vec4x8_madd_ps(c[1], _mm256_permute_ps(v, _MM_SHUFFLE(1, 1, 1, 1)), r);
+	r = vec4x8_madd_ps(c[2], _mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 2, 2)), r);
+	switch (mode){
+	case MAT4_XFORM_FULL:
+		r = vec4x8_madd_ps(c[3], _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3)), r);
+		break;
+	case MAT4_XFORM_POINT:
+		r = _mm256_add_ps(r, c[3]);
+		break;
+	case MAT4_XFORM_PROJECT:
+		r = _mm256_add_ps(r, c[3]);
+		r = _mm256_div_ps(r, _mm256_permute_ps(r, _MM_SHUFFLE(3, 3, 3, 3)));
+		break;
+	case MAT4_XFORM_VECTOR:
+		break;
+	}
+	return r;
+}
+#endif
+#ifdef __AVX512F__
+/* Same as vec4x8_madd_ps, only fused when the SSE version is so the results match */
+static inline __m512 mat4_madd16(__m512 a, __m512 b, __m512 c){
+#ifdef __FMA__
+	return _mm512_fmadd_ps(a, b, c);
+#else
+	return _mm512_add_ps(_mm512_mul_ps(a, b), c);
+#endif
+}
+/*
+ * mat4_xform_v on the four vectors in the 128 bit lanes of v, the columns in
+ * c should be broadcast to all four lanes
+ */
+static inline __m512 mat4_xform16(const __m512 *c, __m512 v, enum mat4_xform_mode mode){
+	__m512 r = _mm512_mul_ps(c[0], _mm512_permute_ps(v, _MM_SHUFFLE(0, 0, 0, 0)));
+	r = mat4_madd16(c[1], _mm512_permute_ps(v, _MM_SHUFFLE(1, 1, 1, 1)), r);
+	r = mat4_madd16(c[2], _mm512_permute_ps(v, _MM_SHUFFLE(2, 2, 2, 2)), r);
+	switch (mode){
+	case MAT4_XFORM_FULL:
+		r = mat4_madd16(c[3], _mm512_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3)), r);
+		break;
+	case MAT4_XFORM_POINT:
+		r = _mm512_add_ps(r, c[3]);
+		break;
+	case MAT4_XFORM_PROJECT:
+		r = _mm512_add_ps(r, c[3]);
+		r = _mm512_div_ps(r, _mm512_permute_ps(r, _MM_SHUFFLE(3, 3, 3, 3)));
+		break;
+	case MAT4_XFORM_VECTOR:
+		break;
+	}
+	return r;
+}
+#endif
+static inline vec4_t mat4_vec_mult(mat4_t a, vec4_t b){
+	SSE_TRACE_FN();
+	b.v = mat4_xform_v(&a.col[0].v, b.v, MAT4_XFORM_FULL);
+	return b;
+}
+/*
+ * Compute dst = a * b. Each column of the result is a linear combination of the
+ * columns of a weighted by the elements of the matching column of b, so there's
+ * no transpose and no element-wise stores. dst may alias a or b
+ */
+static inline void mat4_mult_to(mat4_t *dst, const mat4_t *a, const mat4_t *b){
+	SSE_TRACE_FN();
+#if defined(__AVX512F__)
+	const __m512 c[4] = { _mm512_broadcast_f32x4(a->col[0].v), _mm512_broadcast_f32x4(a->col[1].v),
+		_mm512_broadcast_f32x4(a->col[2].v), _mm512_broadcast_f32x4(a->col[3].v) };
+	_mm512_storeu_ps(dst->col[0].f, mat4_xform16(c, _mm512_loadu_ps(b->col[0].f), MAT4_XFORM_FULL));
+#elif defined(__AVX__)
+	const __m256 c[4] = { _mm256_broadcast_ps(&a->col[0].v), _mm256_broadcast_ps(&a->col[1].v),
+		_mm256_broadcast_ps(&a->col[2].v), _mm256_broadcast_ps(&a->col[3].v) };
+	__m256 r01 = mat4_xform8(c, _mm256_loadu_ps(b->col[0].f), MAT4_XFORM_FULL);
+	__m256 r23 = mat4_xform8(c, _mm256_loadu_ps(b->col[2].f), MAT4_XFORM_FULL);
+	_mm256_storeu_ps(dst->col[0].f, r01);
+	_mm256_storeu_ps(dst->col[2].f, r23);
+#else
+	const __m128 c[4] = { a->col[0].v, a->col[1].v, a->col[2].v, a->col[3].v };
+	__m128 r0 = mat4_xform_v(c, b->col[0].v, MAT4_XFORM_FULL);
+	__m128 r1 = mat4_xform_v(c, b->col[1].v, MAT4_XFORM_FULL);
+	__m128 r2 = mat4_xform_v(c, b->col[2].v, MAT4_XFORM_FULL);
+	__m128 r3 = mat4_xform_v(c, b->col[3].v, MAT4_XFORM_FULL);
+	dst->col[0].v = r0;
+	dst->col[1].v = r1;
+	dst->col[2].v = r2;
+	dst->col[3].v = r3;
+#endif
+}
 static inline mat4_t mat4_mult(mat4_t a, mat4_t b){
+	SSE_TRACE_FN();
 	mat4_t c;
-	/* b/c we store column major transpose a to move the rows into the columns */
-	a = mat4_transpose(a);
-	/* Can we do better? */
-	for (int i = 0; i < 4; ++i){
-		for (int j = 0; j < 4; ++j){
-			c.col[i].f[j] = vec4_dot(a.col[j], b.col[i]);
-		}
-	}
+	mat4_mult_to(&c, &a, &b);
 	return c;
 }
-static inline vec4_t mat4_vec_mult(mat4_t a, vec4_t b){
-	vec4_t c;
-	a = mat4_transpose(a);
-	for (int i = 0; i < 4; ++i){
-		c.f[i] = vec4_dot(a.col[i], b);
+/* Compute out[i] = a[i] * b[i] for n pairs of matrices */
+static inline void mat4_mult_n(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	SSE_TRACE_FN();
+	for (size_t i = 0; i < n; ++i){
+		mat4_mult_to(out + i, a + i, b + i);
+	}
+}
+/*
+ * Compute out[i] = a * b[i] for n matrices, e.g. applying a shared view-projection
+ * matrix to each instance's model matrix. The columns of a are loaded once
+ */
+static inline void mat4_premult_n(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	SSE_TRACE_FN();
+#if defined(__AVX512F__)
+	const __m512 c16[4] = { _mm512_broadcast_f32x4(a->col[0].v), _mm512_broadcast_f32x4(a->col[1].v),
+		_mm512_broadcast_f32x4(a->col[2].v), _mm512_broadcast_f32x4(a->col[3].v) };
+	for (size_t i = 0; i < n; ++i){
+		_mm512_storeu_ps(out[i].col[0].f, mat4_xform16(c16, _mm512_loadu_ps(b[i].col[0].f), MAT4_XFORM_FULL));
+	}
+#elif defined(__AVX__)
+	const __m256 c8[4] = { _mm256_broadcast_ps(&a->col[0].v), _mm256_broadcast_ps(&a->col[1].v),
+		_mm256_broadcast_ps(&a->col[2].v), _mm256_broadcast_ps(&a->col[3].v) };
+	for (size_t i = 0; i < n; ++i){
+		__m256 r01 = mat4_xform8(c8, _mm256_loadu_ps(b[i].col[0].f), MAT4_XFORM_FULL);
+		__m256 r23 = mat4_xform8(c8, _mm256_loadu_ps(b[i].col[2].f), MAT4_XFORM_FULL);
+		_mm256_storeu_ps(out[i].col[0].f, r01);
+		_mm256_storeu_ps(out[i].col[2].f, r23);
+	}
+#else
+	const __m128 c[4] = { a->col[0].v, a->col[1].v, a->col[2].v, a->col[3].v };
+	for (size_t i = 0; i < n; ++i){
+		__m128 r0 = mat4_xform_v(c, b[i].col[0].v, MAT4_XFORM_FULL);
+		__m128 r1 = mat4_xform_v(c, b[i].col[1].v, MAT4_XFORM_FULL);
+		__m128 r2 = mat4_xform_v(c, b[i].col[2].v, MAT4_XFORM_FULL);
+		__m128 r3 = mat4_xform_v(c, b[i].col[3].v, MAT4_XFORM_FULL);
+		out[i].col[0].v = r0;
+		out[i].col[1].v = r1;
+		out[i].col[2].v = r2;
+		out[i].col[3].v = r3;
+	}
+#endif
+}
+/* Compute out[i] = transpose(in[i]) for n matrices, out may be the same array as in */
+static inline void mat4_transpose_n(const mat4_t *in, mat4_t *out, size_t n){
+	SSE_TRACE_FN();
+	for (size_t i = 0; i < n; ++i){
+		mat4_transpose_to(out + i, in + i);
+	}
+}
+/*
+ * Transform n vectors from in and write them to out, the matrix is loaded once and
+ * the loop is unrolled over 4 vectors. in and out only need 4-byte alignment but
+ * should not overlap unless in == out. If out is 16-byte aligned and larger than
+ * MAT4_STREAM_BYTES the results are written with non-temporal stores
+ */
+static inline void mat4_xform_n(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n,
+	enum mat4_xform_mode mode)
+{
+	SSE_TRACE_FN();
+	const __m128 c[4] = { m->col[0].v, m->col[1].v, m->col[2].v, m->col[3].v };
+	const float *src = (const float*)in;
+	float *dst = (float*)out;
+	int stream = ((uintptr_t)dst & 15) == 0 && n * sizeof(vec4_t) >= MAT4_STREAM_BYTES;
+	size_t i = 0;
+	/*
+	 * The wide loops take 4 vectors per __m512 or 2 per __m256, if streaming to
+	 * an out that isn't aligned for them the SSE loop does it all
+	 */
+#if defined(__AVX512F__)
+	if (!stream || ((uintptr_t)dst & 63) == 0){
+		const __m512 c16[4] = { _mm512_broadcast_f32x4(c[0]), _mm512_broadcast_f32x4(c[1]),
+			_mm512_broadcast_f32x4(c[2]), _mm512_broadcast_f32x4(c[3]) };
+		for (; i + 16 <= n; i += 16){
+			__m512 r0 = mat4_xform16(c16, _mm512_loadu_ps(src + 4 * i), mode);
+			__m512 r1 = mat4_xform16(c16, _mm512_loadu_ps(src + 4 * i + 16), mode);
+			__m512 r2 = mat4_xform16(c16, _mm512_loadu_ps(src + 4 * i + 32), mode);
+			__m512 r3 = mat4_xform16(c16, _mm512_loadu_ps(src + 4 * i + 48), mode);
+			if (stream){
+				_mm512_stream_ps(dst + 4 * i, r0);
+				_mm512_stream_ps(dst + 4 * i + 16, r1);
+				_mm512_stream_ps(dst + 4 * i + 32, r2);
+				_mm512_stream_ps(dst + 4 * i + 48, r3);
+			}
+			else {
+				_mm512_storeu_ps(dst + 4 * i, r0);
+				_mm512_storeu_ps(dst + 4 * i + 16, r1);
+				_mm512_storeu_ps(dst + 4 * i + 32, r2);
+				_mm512_storeu_ps(dst + 4 * i + 48, r3);
+			}
+		}
+	}
+#elif defined(__AVX__)
+	if (!stream || ((uintptr_t)dst & 31) == 0){
+		const __m256 c8[4] = { _mm256_broadcast_ps(&c[0]), _mm256_broadcast_ps(&c[1]),
+			_mm256_broadcast_ps(&c[2]), _mm256_broadcast_ps(&c[3]) };
+		for (; i + 8 <= n; i += 8){
+			__m256 r0 = mat4_xform8(c8, _mm256_loadu_ps(src + 4 * i), mode);
+			__m256 r1 = mat4_xform8(c8, _mm256_loadu_ps(src + 4 * i + 8), mode);
+			__m256 r2 = mat4_xform8(c8, _mm256_loadu_ps(src + 4 * i + 16), mode);
+			__m256 r3 = mat4_xform8(c8, _mm256_loadu_ps(src + 4 * i + 24), mode);
+			if (stream){
+				_mm256_stream_ps(dst + 4 * i, r0);
+				_mm256_stream_ps(dst + 4 * i + 8, r1);
+				_mm256_stream_ps(dst + 4 * i + 16, r2);
+				_mm256_stream_ps(dst + 4 * i + 24, r3);
+			}
+			else {
+				_mm256_storeu_ps(dst + 4 * i, r0);
+				_mm256_storeu_ps(dst + 4 * i + 8, r1);
+				_mm256_storeu_ps(dst + 4 * i + 16, r2);
+				_mm256_storeu_ps(dst + 4 * i + 24, r3);
+			}
+		}
+	}
+#endif
+	for (; i + 4 <= n; i += 4){
+		__m128 r0 = mat4_xform_v(c, _mm_loadu_ps(src + 4 * i), mode);
+		__m128 r1 = mat4_xform_v(c, _mm_loadu_ps(src + 4 * i + 4), mode);
+		__m128 r2 = mat4_xform_v(c, _mm_loadu_ps(src + 4 * i + 8), mode);
+		__m128 r3 = mat4_xform_v(c, _mm_loadu_ps(src + 4 * i + 12), mode);
+		if (stream){
+			_mm_stream_ps(dst + 4 * i, r0);
+			_mm_stream_ps(dst + 4 * i + 4, r1);
+			_mm_stream_ps(dst + 4 * i + 8, r2);
+			_mm_stream_ps(dst + 4 * i + 12, r3);
+		}
+		else {
+			_mm_storeu_ps(dst + 4 * i, r0);
+			_mm_storeu_ps(dst + 4 * i + 4, r1);
+			_mm_storeu_ps(dst + 4 * i + 8, r2);
+			_mm_storeu_ps(dst + 4 * i + 12, r3);
+		}
+	}
+	for (; i < n; ++i){
+		_mm_storeu_ps(dst + 4 * i, mat4_xform_v(c, _mm_loadu_ps(src + 4 * i), mode));
+	}
+	/* Non-temporal stores are weakly ordered, make them visible before returning */
+	if (stream){
+		_mm_sfence();
 	}
-	return c;
+}
+/* Multiply each of the n vectors in by the matrix, same as mat4_vec_mult */
+static inline void mat4_vec_mult_n(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	SSE_TRACE_FN();
+	mat4_xform_n(m, in, out, n, MAT4_XFORM_FULL);
+}
+/* Transform n points, the w component of the input is ignored and taken to be 1 */
+static inline void mat4_transform_points(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	SSE_TRACE_FN();
+	mat4_xform_n(m, in, out, n, MAT4_XFORM_POINT);
+}
+/*
+ * Transform n direction vectors, the w component of the input is ignored and
+ * taken to be 0 so translation has no effect
+ */
+static inline void mat4_transform_vectors(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	SSE_TRACE_FN();
+	mat4_xform_n(m, in, out, n, MAT4_XFORM_VECTOR);
+}
+/*
+ * Transform n points (w taken to be 1) and do the perspective divide, so the
+ * output is [x/w, y/w, z/w, 1]
+ */
+static inline void mat4_project_points(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	SSE_TRACE_FN();
+	mat4_xform_n(m, in, out, n, MAT4_XFORM_PROJECT);
 }
 /* Create a translation matrix to move by the vector */
 static inline mat4_t mat4_translate(vec4_t v){
+	SSE_TRACE_FN();
 	mat4_t m = mat4_new();
-	m.col[3].v = _mm_shuffle_ps(v.v, v.v, _MM_SHUFFLE(0, 1, 2, 3));
+	m.col[3] = v;
 	m.col[3].f[3] = 1;
 	return m;
 }
 /* Create a scaling matrix to scale the x,y,z coords by x,y,z */
 static inline mat4_t mat4_scale(float x, float y, float z){
+	SSE_TRACE_FN();
 	mat4_t m = mat4_new();
 	m.col[0].f[0] = x;
 	m.col[1].f[1] = y;
 	m.col[2].f[2] = z;
 	return m;
 }
+/*
+ * Build the rotation matrix from the sine and cosine of the angle and the normalized
+ * axis v. Column j is the rotated basis vector e_j, c * e_j + (1 - c) * v_j * v + s * (v X e_j)
+ */
+static inline mat4_t mat4_rotate_sc(__m128 s, __m128 c, vec4_t v){
+	SSE_TRACE_FN();
+	mat4_t m = mat4_new();
+	vec4_t sv;
+	sv.v = _mm_mul_ps(s, v.v);
+	__m128 vc = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.f), c), v.v);
+	__m128 vj[3] = {
+		_mm_shuffle_ps(vc, vc, _MM_SHUFFLE(0, 0, 0, 0)),
+		_mm_shuffle_ps(vc, vc, _MM_SHUFFLE(1, 1, 1, 1)),
+		_mm_shuffle_ps(vc, vc, _MM_SHUFFLE(2, 2, 2, 2))
+	};
+	for (int j = 0; j < 3; ++j){
+		__m128 col = vec4_madd_ps(vj[j], v.v, _mm_mul_ps(c, m.col[j].v));
+		m.col[j].v = _mm_add_ps(col, vec4_cross(sv, m.col[j]).v);
+	}
+	return m;
+}
 /*
  * Create the rotation matrix to rotate by d degrees about the vector v
  * (v.w should be 0)
  */
 static inline mat4_t mat4_rotate(float d, vec4_t v){
-	d = d * M_PI / 180.0;
-	float c = cosf(d);
-	float s = sinf(d);
-	v = vec4_normalize(v);
-	float ALIGN_16 cols[16] = { c + powf(v.f[0], 2.0) * (1 - c),
-		v.f[1] * v.f[0] * (1 - c) + v.f[2] * s, v.f[2] * v.f[0] * (1 - c) - v.f[1] * s, 0,
-		v.f[0] * v.f[1] * (1 - c) - v.f[2] * s, c + powf(v.f[1], 2.0) * (1 - c),
-		v.f[2] * v.f[1] * (1 - c) + v.f[0] * s, 0,
-		v.f[0] * v.f[2] * (1 - c) + v.f[1] * s, v.f[1] * v.f[2] * (1 - c) - v.f[0] * s,
-		c + powf(v.f[2], 2.0) * (1 - c), 0,
-		0, 0, 0, 1
-	};
-	return mat4_from_cols(cols);
+	SSE_TRACE_FN();
+	__m128 s, c;
+	vec4_sincos_ps(_mm_set1_ps(d * (float)(M_PI / 180.0)), &s, &c);
+	return mat4_rotate_sc(s, c, vec4_normalize(v));
+}
+/*
+ * Create n rotation matrices, out[i] rotates by d[i] degrees about axis[i]. The
+ * matrices are built 4 at a time with each lane computing one matrix
+ */
+static inline void mat4_rotate_n(const float *d, const vec4_t *axis, mat4_t *out, size_t n){
+	SSE_TRACE_FN();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4){
+		__m128 s, c;
+		vec4_sincos_ps(_mm_mul_ps(_mm_loadu_ps(d + i), _mm_set1_ps((float)(M_PI / 180.0))), &s, &c);
+		vec4x4_t v = vec4x4_normalize(vec4x4_load(axis + i));
+		__m128 t = _mm_sub_ps(_mm_set1_ps(1.f), c);
+		__m128 tx = _mm_mul_ps(t, v.x), ty = _mm_mul_ps(t, v.y);
+		__m128 txy = _mm_mul_ps(tx, v.y), txz = _mm_mul_ps(tx, v.z);
+		__m128 tyz = _mm_mul_ps(ty, v.z);
+		__m128 sx = _mm_mul_ps(s, v.x), sy = _mm_mul_ps(s, v.y), sz = _mm_mul_ps(s, v.z);
+		/* Element r_c of each of the 4 matrices, then transposed out to their columns */
+		vec4x4_t c0, c1, c2;
+		c0.x = vec4_madd_ps(tx, v.x, c);
+		c0.y = _mm_add_ps(txy, sz);
+		c0.z = _mm_sub_ps(txz, sy);
+		c0.w = _mm_setzero_ps();
+		c1.x = _mm_sub_ps(txy, sz);
+		c1.y = vec4_madd_ps(ty, v.y, c);
+		c1.z = _mm_add_ps(tyz, sx);
+		c1.w = _mm_setzero_ps();
+		c2.x = _mm_add_ps(txz, sy);
+		c2.y = _mm_sub_ps(tyz, sx);
+		c2.z = vec4_madd_ps(_mm_mul_ps(t, v.z), v.z, c);
+		c2.w = _mm_setzero_ps();
+		vec4_t cols[3][4];
+		vec4x4_store(c0, cols[0]);
+		vec4x4_store(c1, cols[1]);
+		vec4x4_store(c2, cols[2]);
+		for (int k = 0; k < 4; ++k){
+			out[i + k].col[0] = cols[0][k];
+			out[i + k].col[1] = cols[1][k];
+			out[i + k].col[2] = cols[2][k];
+			out[i + k].col[3].v = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+		}
+	}
+	for (; i < n; ++i){
+		out[i] = mat4_rotate(d[i], axis[i]);
+	}
 }
 /*
  * Create the look at matrix with the camera at eye, looking at center and with
  * up as the camera's up vector. The w coord for each vector should be 0
  */
 static inline mat4_t mat4_look_at(vec4_t eye, vec4_t center, vec4_t up){
+	SSE_TRACE_FN();
 	vec4_t f = vec4_sub(center, eye);
 	f = vec4_normalize(f);
 	up = vec4_normalize(up);
-	vec4_t s = vec4_cross(f, up);
-	vec4_t u = vec4_cross(vec4_normalize(s), f);
+	vec4_t s = vec4_normalize(vec4_cross(f, up));
+	vec4_t u = vec4_cross(s, f);
 	mat4_t m = mat4_new();
 	m.col[0] = s;
 	m.col[1] = u;
@@ -145,6 +538,7 @@ static inline mat4_t mat4_look_at(vec4_t eye, vec4_t center, vec4_t up){
 }
 /* Calculate the orthographic projection matrix */
 static inline mat4_t mat4_ortho(float l, float r, float b, float t, float n, float f){
+	SSE_TRACE_FN();
 	mat4_t m = mat4_scale(2 / (r - l), 2 / (t - b), -2 / (f - n));
 	m.col[3] = vec4_new(-(r + l) / (r - l), -(t + b) / (t - b),
 		-(f + n) / (f - n), 1);
@@ -152,15 +546,242 @@ static inline mat4_t mat4_ortho(float l, float r, float b, float t, float n, flo
 }
 /* Calculate the perspective matrix */
 static inline mat4_t mat4_perspective(float fovY, float aspect, float n, float f){
-	float p = 1.f / tan(fovY * 0.5 * M_PI / 180.0);
+	SSE_TRACE_FN();
+	__m128 s, c;
+	vec4_sincos_ps(_mm_set_ss(fovY * (float)(0.5 * M_PI / 180.0)), &s, &c);
+	/* 1 / tan(fovY / 2) */
+	float p = _mm_cvtss_f32(_mm_div_ss(c, s));
 	mat4_t m = mat4_scale(p / aspect, p, (f + n) / (n - f));
 	m.col[2].f[3] = -1;
 	m.col[3].f[2] = 2 * f * n / (n - f);
 	m.col[3].f[3] = 0;
 	return m;
 }
+/*
+ * Calculate n perspective matrices, out[i] is the perspective matrix for fovY[i],
+ * aspect[i], near[i] and far[i]. These are computed 4 at a time
+ */
+static inline void mat4_perspective_n(const float *fovY, const float *aspect, const float *near,
+	const float *far, mat4_t *out, size_t n)
+{
+	SSE_TRACE_FN();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4){
+		__m128 s, c;
+		vec4_sincos_ps(_mm_mul_ps(_mm_loadu_ps(fovY + i), _mm_set1_ps((float)(0.5 * M_PI / 180.0))),
+			&s, &c);
+		__m128 p = _mm_div_ps(c, s);
+		__m128 nr = _mm_loadu_ps(near + i);
+		__m128 fr = _mm_loadu_ps(far + i);
+		__m128 inv_nf = _mm_div_ps(_mm_set1_ps(1.f), _mm_sub_ps(nr, fr));
+		float ALIGN_16 e[4][4];
+		_mm_store_ps(e[0], _mm_div_ps(p, _mm_loadu_ps(aspect + i)));
+		_mm_store_ps(e[1], p);
+		_mm_store_ps(e[2], _mm_mul_ps(_mm_add_ps(fr, nr), inv_nf));
+		_mm_store_ps(e[3], _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.f), _mm_mul_ps(fr, nr)), inv_nf));
+		for (int k = 0; k < 4; ++k){
+			out[i + k].col[0].v = _mm_setr_ps(e[0][k], 0.f, 0.f, 0.f);
+			out[i + k].col[1].v = _mm_setr_ps(0.f, e[1][k], 0.f, 0.f);
+			out[i + k].col[2].v = _mm_setr_ps(0.f, 0.f, e[2][k], -1.f);
+			out[i + k].col[3].v = _mm_setr_ps(0.f, 0.f, e[3][k], 0.f);
+		}
+	}
+	for (; i < n; ++i){
+		out[i] = mat4_perspective(fovY[i], aspect[i], near[i], far[i]);
+	}
+}
+/*
+ * Helpers for the block inverse, each __m128 is a 2x2 matrix stored
+ * [m00, m01, m10, m11]. Computes a * b, adj(a) * b and a * adj(b)
+ */
+static inline __m128 mat2_mul_ps(__m128 a, __m128 b){
+	return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)),
+			_mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+static inline __m128 mat2_adj_mul_ps(__m128 a, __m128 b){
+	return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)),
+			_mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+static inline __m128 mat2_mul_adj_ps(__m128 a, __m128 b){
+	return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)),
+			_mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+/*
+ * Compute dst = inverse(m) and return the determinant of m. The matrix is split
+ * into 2x2 blocks [A B; C D] and the inverse built from the blocks' adjugates
+ * and determinants, which is Cramer's rule with the cofactors shared between
+ * blocks. If the determinant is 0 the result won't be finite. dst may alias m
+ */
+static inline float mat4_inverse_to(mat4_t *dst, const mat4_t *m){
+	SSE_TRACE_FN();
+	const __m128 c0 = m->col[0].v, c1 = m->col[1].v, c2 = m->col[2].v, c3 = m->col[3].v;
+	/*
+	 * The blocks are built from the columns, so this is really inverting the
+	 * transpose and gives the rows of its inverse, which are our columns
+	 */
+	__m128 a = _mm_movelh_ps(c0, c1);
+	__m128 b = _mm_movehl_ps(c1, c0);
+	__m128 c = _mm_movelh_ps(c2, c3);
+	__m128 d = _mm_movehl_ps(c3, c2);
+	/* Determinants of each block [|A|, |B|, |C|, |D|] */
+	__m128 det_sub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)),
+			_mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)),
+			_mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+	__m128 det_a = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(0, 0, 0, 0));
+	__m128 det_b = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(1, 1, 1, 1));
+	__m128 det_c = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(2, 2, 2, 2));
+	__m128 det_d = _mm_shuffle_ps(det_sub, det_sub, _MM_SHUFFLE(3, 3, 3, 3));
+
+	__m128 d_c = mat2_adj_mul_ps(d, c);
+	__m128 a_b = mat2_adj_mul_ps(a, b);
+	/* The adjugates of the blocks of the inverse, scaled by |M| */
+	__m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), mat2_mul_ps(b, d_c));
+	__m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), mat2_mul_ps(c, a_b));
+	__m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), mat2_mul_adj_ps(d, a_b));
+	__m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), mat2_mul_adj_ps(a, d_c));
+
+	/* |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C) */
+	__m128 det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+	__m128 tr = _mm_mul_ps(a_b, _mm_shuffle_ps(d_c, d_c, _MM_SHUFFLE(3, 1, 2, 0)));
+	det = _mm_sub_ps(det, vec4_hsum_ps(tr));
+
+	__m128 inv_det = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det);
+	x = _mm_mul_ps(x, inv_det);
+	y = _mm_mul_ps(y, inv_det);
+	z = _mm_mul_ps(z, inv_det);
+	w = _mm_mul_ps(w, inv_det);
+	/* Take the adjugate of each block and put them back together */
+	dst->col[0].v = _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3));
+	dst->col[1].v = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2));
+	dst->col[2].v = _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3));
+	dst->col[3].v = _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2));
+	return _mm_cvtss_f32(det);
+}
+/* Compute the inverse of m, if det isn't NULL the determinant of m is written to it */
+static inline mat4_t mat4_inverse(mat4_t m, float *det){
+	SSE_TRACE_FN();
+	float d = mat4_inverse_to(&m, &m);
+	if (det){
+		*det = d;
+	}
+	return m;
+}
+/*
+ * Compute dst = inverse(m) for an affine m, that is the bottom row is [0, 0, 0, 1]
+ * like those built from translate, rotate and scale. Only the upper 3x3 is inverted,
+ * its rows are the cross products of the columns and the translation is then
+ * brought back through it. Returns the determinant of m. dst may alias m
+ */
+static inline float mat4_inverse_affine_to(mat4_t *dst, const mat4_t *m){
+	SSE_TRACE_FN();
+	__m128 r0 = vec4_cross(m->col[1], m->col[2]).v;
+	__m128 r1 = vec4_cross(m->col[2], m->col[0]).v;
+	__m128 r2 = vec4_cross(m->col[0], m->col[1]).v;
+	__m128 r3 = _mm_setzero_ps();
+	/* The w of each row is 0 so this is the dot of the upper 3x3 part */
+	__m128 det = vec4_hsum_ps(_mm_mul_ps(m->col[0].v, r0));
+	__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), det);
+	r0 = _mm_mul_ps(r0, inv_det);
+	r1 = _mm_mul_ps(r1, inv_det);
+	r2 = _mm_mul_ps(r2, inv_det);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	const __m128 c[4] = { r0, r1, r2, r3 };
+	__m128 t = mat4_xform_v(c, m->col[3].v, MAT4_XFORM_VECTOR);
+	dst->col[0].v = r0;
+	dst->col[1].v = r1;
+	dst->col[2].v = r2;
+	dst->col[3].v = _mm_sub_ps(_mm_setr_ps(0.f, 0.f, 0.f, 1.f), t);
+	return _mm_cvtss_f32(det);
+}
+static inline mat4_t mat4_inverse_affine(mat4_t m){
+	SSE_TRACE_FN();
+	mat4_inverse_affine_to(&m, &m);
+	return m;
+}
+/*
+ * Compute dst = inverse(m) for an m made of only a rotation and translation, so the
+ * upper 3x3 is orthonormal. The inverse is just the transpose of the rotation with the
+ * translation brought back through it. dst may alias m
+ */
+static inline void mat4_inverse_rigid_to(mat4_t *dst, const mat4_t *m){
+	SSE_TRACE_FN();
+	__m128 r0 = m->col[0].v, r1 = m->col[1].v, r2 = m->col[2].v;
+	__m128 r3 = _mm_setzero_ps();
+	__m128 t = m->col[3].v;
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	const __m128 c[4] = { r0, r1, r2, r3 };
+	t = mat4_xform_v(c, t, MAT4_XFORM_VECTOR);
+	dst->col[0].v = r0;
+	dst->col[1].v = r1;
+	dst->col[2].v = r2;
+	dst->col[3].v = _mm_sub_ps(_mm_setr_ps(0.f, 0.f, 0.f, 1.f), t);
+}
+static inline mat4_t mat4_inverse_rigid(mat4_t m){
+	SSE_TRACE_FN();
+	mat4_inverse_rigid_to(&m, &m);
+	return m;
+}
+/*
+ * Compute the normal matrix for m, the inverse transpose of its upper 3x3 part.
+ * The columns of this are just the cross products of m's columns over the determinant
+ * so there's no transpose needed. The result has no translation
+ */
+static inline void mat4_normal_matrix_to(mat4_t *dst, const mat4_t *m){
+	SSE_TRACE_FN();
+	__m128 c0 = vec4_cross(m->col[1], m->col[2]).v;
+	__m128 c1 = vec4_cross(m->col[2], m->col[0]).v;
+	__m128 c2 = vec4_cross(m->col[0], m->col[1]).v;
+	__m128 det = vec4_hsum_ps(_mm_mul_ps(m->col[0].v, c0));
+	__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), det);
+	dst->col[0].v = _mm_mul_ps(c0, inv_det);
+	dst->col[1].v = _mm_mul_ps(c1, inv_det);
+	dst->col[2].v = _mm_mul_ps(c2, inv_det);
+	dst->col[3].v = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+}
+static inline mat4_t mat4_normal_matrix(mat4_t m){
+	SSE_TRACE_FN();
+	mat4_normal_matrix_to(&m, &m);
+	return m;
+}
+/*
+ * Batched versions of the inverses over n matrices, out may be the same array as
+ * in. For mat4_inverse_n the determinants are written to det if it's not NULL
+ */
+static inline void mat4_inverse_n(const mat4_t *in, mat4_t *out, float *det, size_t n){
+	SSE_TRACE_FN();
+	for (size_t i = 0; i < n; ++i){
+		float d = mat4_inverse_to(out + i, in + i);
+		if (det){
+			det[i] = d;
+		}
+	}
+}
+static inline void mat4_inverse_affine_n(const mat4_t *in, mat4_t *out, size_t n){
+	SSE_TRACE_FN();
+	for (size_t i = 0; i < n; ++i){
+		mat4_inverse_affine_to(out + i, in + i);
+	}
+}
+static inline void mat4_inverse_rigid_n(const mat4_t *in, mat4_t *out, size_t n){
+	SSE_TRACE_FN();
+	for (size_t i = 0; i < n; ++i){
+		mat4_inverse_rigid_to(out + i, in + i);
+	}
+}
+static inline void mat4_normal_matrix_n(const mat4_t *in, mat4_t *out, size_t n){
+	SSE_TRACE_FN();
+	for (size_t i = 0; i < n; ++i){
+		mat4_normal_matrix_to(out + i, in + i);
+	}
+}
 /* See if the two matrices are equal. Mostly for testing really */
 static inline int mat4_eq(mat4_t a, mat4_t b){
+	SSE_TRACE_FN();
 	return vec4_eq(a.col[0], b.col[0]) && vec4_eq(a.col[1], b.col[1])
 		&& vec4_eq(a.col[2], b.col[2]) && vec4_eq(a.col[3], b.col[3]);
 }
@@ -0,0 +1,149 @@
+#ifndef SSE_MAT4_HPP
+#define SSE_MAT4_HPP
+
+#include "mat4.h"
+#include "vec4.hpp"
+
+/*
+ * C++ wrapper for mat4_t, column major like it and converting to and from it
+ * for free. Matrix products and inverses call the mat4.h functions. A matrix
+ * times a vector expression is an expression too, the columns are multiplied
+ * in the same order as mat4_xform_v and when it's part of a sum the other terms
+ * are fused into the chain, so m * v + t is four fused multiply-adds
+ */
+namespace sse {
+
+class mat4 {
+public:
+	vec4 col[4];
+
+	mat4() = default;
+	constexpr mat4(const vec4 &c0, const vec4 &c1, const vec4 &c2, const vec4 &c3)
+		: col{ c0, c1, c2, c3 } {}
+	mat4(const mat4_t &m) : col{ m.col[0], m.col[1], m.col[2], m.col[3] } {}
+	operator mat4_t() const {
+		mat4_t m;
+		for (int i = 0; i < 4; ++i){
+			m.col[i].v = col[i].v;
+		}
+		return m;
+	}
+	static constexpr mat4 identity(){
+		return mat4(vec4(1, 0, 0, 0), vec4(0, 1, 0, 0), vec4(0, 0, 1, 0), vec4(0, 0, 0, 1));
+	}
+	static mat4 translate(const vec4 &v){
+		return mat4_translate(v);
+	}
+	static mat4 scale(float x, float y, float z){
+		return mat4_scale(x, y, z);
+	}
+	/* Rotation of d degrees about axis */
+	static mat4 rotate(float d, const vec4 &axis){
+		return mat4_rotate(d, axis);
+	}
+	static mat4 look_at(const vec4 &eye, const vec4 &center, const vec4 &up){
+		return mat4_look_at(eye, center, up);
+	}
+	static mat4 ortho(float l, float r, float b, float t, float n, float f){
+		return mat4_ortho(l, r, b, t, n, f);
+	}
+	static mat4 perspective(float fovY, float aspect, float n, float f){
+		return mat4_perspective(fovY, aspect, n, f);
+	}
+
+	/* Column c */
+	constexpr const vec4& operator[](int c) const {
+		return col[c];
+	}
+	vec4& operator[](int c){
+		return col[c];
+	}
+	/* The element at row r, column c */
+	constexpr float operator()(int r, int c) const {
+		return col[c][r];
+	}
+	mat4& operator*=(const mat4 &m){
+		mat4_t a = *this, b = m;
+		mat4_mult_to(&a, &a, &b);
+		return *this = a;
+	}
+};
+
+inline mat4 operator*(const mat4 &a, const mat4 &b){
+	mat4 r = a;
+	return r *= b;
+}
+inline mat4 operator+(const mat4 &a, const mat4 &b){
+	return mat4(a[0] + b[0], a[1] + b[1], a[2] + b[2], a[3] + b[3]);
+}
+inline mat4 operator-(const mat4 &a, const mat4 &b){
+	return mat4(a[0] - b[0], a[1] - b[1], a[2] - b[2], a[3] - b[3]);
+}
+inline bool operator==(const mat4 &a, const mat4 &b){
+	return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
+}
+inline bool operator!=(const mat4 &a, const mat4 &b){
+	return !(a == b);
+}
+inline mat4 transpose(const mat4 &m){
+	return mat4_transpose(m);
+}
+/* Inverse of m, if det isn't NULL the determinant of m is written to it */
+inline mat4 inverse(const mat4 &m, float *det = NULL){
+	return mat4_inverse(m, det);
+}
+/* The inverses for special matrices, see mat4_inverse_affine_to and mat4_inverse_rigid_to */
+inline mat4 inverse_affine(const mat4 &m){
+	return mat4_inverse_affine(m);
+}
+inline mat4 inverse_rigid(const mat4 &m){
+	return mat4_inverse_rigid(m);
+}
+inline mat4 normal_matrix(const mat4 &m){
+	return mat4_normal_matrix(m);
+}
+
+/*
+ * m * v, evaluated like mat4_xform_v. Added to or subtracted from something
+ * that becomes the start of the chain instead of being added at the end
+ */
+template <class E>
+struct mat_vec_expr : expr<mat_vec_expr<E>> {
+	static constexpr bool fusable = true;
+	mat4 m;
+	E e;
+	mat_vec_expr(const mat4 &m, const E &e) : m(m), e(e) {}
+	__m128 eval() const {
+		const __m128 c[4] = { m[0].v, m[1].v, m[2].v, m[3].v };
+		return mat4_xform_v(c, e.eval(), MAT4_XFORM_FULL);
+	}
+	__m128 add_to(__m128 acc) const {
+		__m128 v = e.eval();
+		acc = native_ops::fmadd(m[0].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), acc);
+		acc = native_ops::fmadd(m[1].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), acc);
+		acc = native_ops::fmadd(m[2].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), acc);
+		return native_ops::fmadd(m[3].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), acc);
+	}
+	__m128 sub_from(__m128 acc) const {
+		__m128 v = e.eval();
+		acc = native_ops::fnmadd(m[0].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), acc);
+		acc = native_ops::fnmadd(m[1].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), acc);
+		acc = native_ops::fnmadd(m[2].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), acc);
+		return native_ops::fnmadd(m[3].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), acc);
+	}
+	__m128 minus(__m128 c) const {
+		__m128 v = e.eval();
+		__m128 r = native_ops::fmsub(m[0].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)), c);
+		r = native_ops::fmadd(m[1].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)), r);
+		r = native_ops::fmadd(m[2].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)), r);
+		return native_ops::fmadd(m[3].v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), r);
+	}
+};
+template <class E>
+inline mat_vec_expr<E> operator*(const mat4 &m, const expr<E> &e){
+	return mat_vec_expr<E>(m, e.self());
+}
+
+}
+
+#endif
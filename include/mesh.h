@@ -0,0 +1,159 @@
+#ifndef SSE_MESH_H
+#define SSE_MESH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "vec4.h"
+
+/*
+ * Binary mesh container that's loaded by mapping it, the sections are used in
+ * place so opening a file costs a few page faults instead of reading and
+ * copying it into aligned memory. Layout (little endian):
+ *
+ *   struct mesh_header             64 bytes
+ *   struct mesh_section[MESH_MAX_SECTIONS]   section table, 32 bytes each
+ *   section data                   each starting on a 64 byte boundary
+ *
+ * Since the mapping is page aligned every section can be handed out as a
+ * const vec4_t* (or uint32_t*) that's safe for _mm_load_ps/_mm256_load_ps,
+ * and rows of positions never straddle a cache line.
+ *
+ * Each section can carry a CRC-32C of its data, checked by mesh_verify or by
+ * opening with MESH_VERIFY. That reads the whole file so it's off by default.
+ * The header and section table have their own CRC which is always checked
+ */
+#define MESH_MAGIC "SSEMESH"
+#define MESH_VERSION 1
+#define MESH_MAX_SECTIONS 16
+#define MESH_ALIGN 64
+/* Offset of the first section's data, right after the header and section table */
+#define MESH_DATA_OFFSET (sizeof(struct mesh_header) + MESH_MAX_SECTIONS * sizeof(struct mesh_section))
+
+enum mesh_section_type {
+	/* vec4_t positions, w should be 1 */
+	MESH_POSITIONS = 1,
+	/* vec4_t normals, w should be 0 */
+	MESH_NORMALS = 2,
+	/* uint32_t triangle indices into the positions (and normals), 3 per triangle */
+	MESH_INDICES = 3
+};
+enum mesh_section_flags {
+	/* The crc field holds the CRC-32C of the section's data */
+	MESH_SECTION_CRC = 1
+};
+struct mesh_header {
+	/* MESH_MAGIC, nul terminated */
+	char magic[8];
+	uint32_t version;
+	uint32_t n_sections;
+	/* Size of the whole file, to catch truncated files */
+	uint64_t file_size;
+	/* CRC-32C of the header and section table, computed with this field set to 0 */
+	uint32_t crc;
+	uint32_t reserved[9];
+};
+struct mesh_section {
+	uint32_t type;
+	uint32_t flags;
+	/* Offset of the data from the start of the file, a multiple of MESH_ALIGN */
+	uint64_t offset;
+	/* Number of elements and the size of each, the data is count * elem_size bytes */
+	uint64_t count;
+	uint32_t elem_size;
+	uint32_t crc;
+};
+
+enum mesh_open_flags {
+	/* Check the CRC of every section that has one, and that indices are in range */
+	MESH_VERIFY = 1,
+	/* Ask the kernel to start reading the whole file in (MADV_WILLNEED) */
+	MESH_WILLNEED = 2,
+	/* Fault in the whole file while mapping it (MAP_POPULATE) */
+	MESH_POPULATE = 4,
+	/* The sections will be read front to back once (MADV_SEQUENTIAL), eg. to upload them */
+	MESH_SEQUENTIAL = 8
+};
+/* A mapped mesh file */
+struct mesh_file {
+	const char *base;
+	size_t size;
+	const struct mesh_header *header;
+	const struct mesh_section *sections;
+	/* If mesh_open or mesh_verify fails this says why */
+	const char *error;
+};
+/*
+ * Map the mesh file at path and check its header, see mesh_open_flags for
+ * flags. Returns 0 on failure, with m->error set to the reason
+ */
+int mesh_open(struct mesh_file *m, const char *path, int flags);
+void mesh_close(struct mesh_file *m);
+/*
+ * Check the CRC of each section that has one and that the indices are all
+ * valid positions. Returns 0 if something's wrong, with m->error set
+ */
+int mesh_verify(struct mesh_file *m);
+/* Find the first section of some type, returns NULL if there isn't one */
+const struct mesh_section* mesh_find_section(const struct mesh_file *m, enum mesh_section_type type);
+/* Hint that a section will be needed soon so the kernel starts reading it in */
+void mesh_prefetch(const struct mesh_file *m, const struct mesh_section *s);
+/* Get a section's data, if count isn't NULL the number of elements is written to it */
+static inline const void* mesh_section_data(const struct mesh_file *m, const struct mesh_section *s,
+	size_t *count)
+{
+	if (count){
+		*count = s ? s->count : 0;
+	}
+	return s ? m->base + s->offset : NULL;
+}
+/* Typed views of the sections, NULL (with a count of 0) if the file doesn't have one */
+static inline const vec4_t* mesh_positions(const struct mesh_file *m, size_t *count){
+	return mesh_section_data(m, mesh_find_section(m, MESH_POSITIONS), count);
+}
+static inline const vec4_t* mesh_normals(const struct mesh_file *m, size_t *count){
+	return mesh_section_data(m, mesh_find_section(m, MESH_NORMALS), count);
+}
+static inline const uint32_t* mesh_indices(const struct mesh_file *m, size_t *count){
+	return mesh_section_data(m, mesh_find_section(m, MESH_INDICES), count);
+}
+/* Compute the CRC-32C (Castagnoli) of size bytes, pass the previous result as crc to continue one */
+uint32_t mesh_crc32c(uint32_t crc, const void *data, size_t size);
+
+/*
+ * Writes a mesh file a section at a time, the data for a section can be
+ * appended in as many pieces as needed so meshes bigger than memory can be
+ * written. The header is filled in by mesh_writer_close
+ */
+struct mesh_writer {
+	FILE *fp;
+	struct mesh_header header;
+	struct mesh_section sections[MESH_MAX_SECTIONS];
+	/* The section being written, or -1 */
+	int current;
+	uint64_t offset;
+	/* Set if a write failed, everything after it is skipped and close fails */
+	int failed;
+};
+/*
+ * Create the file at path for writing, returns 0 if it couldn't be created or
+ * the space for the header couldn't be written, in which case nothing is left open
+ */
+int mesh_writer_open(struct mesh_writer *w, const char *path);
+/*
+ * Start a new section of elements of elem_size bytes, with a CRC of its data if
+ * crc is set. Ends the current section. Returns 0 if there's no room for more
+ */
+int mesh_writer_begin(struct mesh_writer *w, enum mesh_section_type type, uint32_t elem_size, int crc);
+/* Append count elements to the current section */
+int mesh_writer_append(struct mesh_writer *w, const void *data, size_t count);
+/*
+ * Finish the file by writing the header and section table and close it. Returns
+ * 0 if any of the writes failed
+ */
+int mesh_writer_close(struct mesh_writer *w);
+/* Write a whole mesh in one go, normals and indices may be NULL */
+int mesh_write(const char *path, const vec4_t *positions, const vec4_t *normals, size_t n_verts,
+	const uint32_t *indices, size_t n_indices);
+
+#endif
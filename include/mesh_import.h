@@ -0,0 +1,267 @@
+#ifndef SSE_MESH_IMPORT_H
+#define SSE_MESH_IMPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <emmintrin.h>
+#if defined(__AVX2__) || defined(__AVX512BW__)
+#include <immintrin.h>
+#endif
+#include "vec4.h"
+
+/*
+ * Streaming importer for text OBJ and PLY meshes (ASCII or binary little
+ * endian PLY). The file is read a block at a time into one buffer, so memory
+ * use is bounded by the block size and files much bigger than memory can be
+ * converted to the mesh.h format with mesh_import_file.
+ *
+ * Each block is cut at its last newline, the partial line is carried over to
+ * the next one, and the block is split at newlines into parts that are parsed
+ * in parallel. A part is walked by finding its line ends 64 bytes at a time
+ * with the dispatched scan_lines kernel, then parsing each line in place with
+ * mesh_parse_float, so there's no per line copy or allocation. Each part
+ * writes vec4_t positions (w = 1) and normals (w = 0) and uint32_t triangle
+ * indices straight into its own aligned buffers, which are handed on to the
+ * sink in file order once the block is done. Polygons are split into fans
+ * of triangles.
+ *
+ * For PLY the parts need to know which element their lines belong to, so the
+ * lines of each part are counted first (with the count_lines kernel) and the
+ * counts summed to get each part's first line. Binary PLY has no lines to cut
+ * the block at and isn't costly to convert, it's read on one thread.
+ *
+ * OBJ faces only use the position index of each v/vt/vn triple, the normals
+ * are passed on in the order they're declared. That's only right for a mesh
+ * if there's one normal per position (as there is in PLY files with normals)
+ */
+/* Default bytes read and parsed at once, each line has to fit in a block */
+#define MESH_IMPORT_BLOCK (32 << 20)
+
+/*
+ * Where the imported elements go, each callback gets the next run of them in
+ * file order and returns 0 to stop the import. Indices are already offset to
+ * index all the positions seen so far, not just the ones in that call
+ */
+struct mesh_sink {
+	int (*positions)(void *user, const vec4_t *p, size_t n);
+	int (*normals)(void *user, const vec4_t *nrm, size_t n);
+	int (*indices)(void *user, const uint32_t *idx, size_t n);
+	void *user;
+};
+/*
+ * Read the OBJ or PLY file at path into the sink with threads threads
+ * (including the caller, 0 or less for one per CPU), reading block_size bytes
+ * at a time (0 for MESH_IMPORT_BLOCK). The format is picked by the file's
+ * contents. Returns 0 if the file can't be read or parsed or the sink stopped
+ * it, with the reason in *error if error isn't NULL
+ */
+int mesh_import(const char *path, const struct mesh_sink *sink, int threads, size_t block_size,
+	const char **error);
+
+/* A mesh imported into memory, the arrays are 64 byte aligned and freed with free */
+struct mesh_data {
+	vec4_t *positions, *normals;
+	uint32_t *indices;
+	size_t n_positions, n_normals, n_indices;
+	/* Bytes allocated for each array */
+	size_t positions_cap, normals_cap, indices_cap;
+};
+/*
+ * Import the file at path into d, like mesh_import. Returns 0 on failure
+ * with d left empty
+ */
+int mesh_import_data(struct mesh_data *d, const char *path, int threads, const char **error);
+void mesh_data_free(struct mesh_data *d);
+/*
+ * Convert the file at path to a mesh file at out_path in bounded memory. The
+ * positions go straight into the mesh file and the normals and indices are
+ * spooled to temporary files until the positions are done. The normals are
+ * only kept if there's one for each position
+ */
+int mesh_import_file(const char *path, const char *out_path, int threads, const char **error);
+
+/*
+ * Bit i is set if block[i] is a newline, the block must be 64 byte aligned.
+ * Aligned loads never cross a page so it's fine for the block to start
+ * before or end after the text it's being used to scan
+ */
+static inline uint64_t mesh_newline_mask(const char *block){
+#if defined(__AVX512BW__)
+	return _mm512_cmpeq_epi8_mask(_mm512_load_si512((const void*)block), _mm512_set1_epi8('\n'));
+#elif defined(__AVX2__)
+	const __m256i nl = _mm256_set1_epi8('\n');
+	uint32_t lo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)block), nl));
+	uint32_t hi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(block + 32)), nl));
+	return (uint64_t)hi << 32 | lo;
+#else
+	const __m128i nl = _mm_set1_epi8('\n');
+	uint64_t m = 0;
+	for (int i = 0; i < 4; ++i){
+		__m128i b = _mm_load_si128((const __m128i*)(block + 16 * i));
+		m |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b, nl)) << (16 * i);
+	}
+	return m;
+#endif
+}
+/*
+ * Find the newlines in the n bytes of text, writing the offset of each from
+ * text to ends until max have been found. Returns how many were written, so
+ * if it's max there may be more after ends[max - 1]. n has to be under 4GB
+ */
+static inline size_t mesh_scan_lines(const char *text, size_t n, uint32_t *ends, size_t max){
+	if (!n || !max){
+		return 0;
+	}
+	const char *end = text + n;
+	const char *block = (const char*)((uintptr_t)text & ~(uintptr_t)63);
+	uint64_t mask = mesh_newline_mask(block) & (~(uint64_t)0 << (text - block));
+	size_t found = 0;
+	for (;;){
+		int last = end - block <= 64;
+		if (last && end - block < 64){
+			mask &= ((uint64_t)1 << (end - block)) - 1;
+		}
+		for (; mask && found < max; mask &= mask - 1){
+			ends[found++] = (uint32_t)(block - text + __builtin_ctzll(mask));
+		}
+		if (last || found == max){
+			return found;
+		}
+		block += 64;
+		mask = mesh_newline_mask(block);
+	}
+}
+/*
+ * Count the newlines in n whole 64 byte aligned blocks. None of the tiers
+ * have POPCNT so rather than counting the mask bits each byte lane counts its
+ * newlines by subtracting the compare results, and the lanes are summed with
+ * psadbw before they can overflow
+ */
+static inline size_t mesh_count_newline_blocks(const char *block, size_t n){
+	size_t count = 0;
+#if defined(__AVX2__)
+	const __m256i nl = _mm256_set1_epi8('\n');
+	while (n){
+		/* Each lane gets at most 2 a block so 127 blocks can't overflow it */
+		size_t run = n < 127 ? n : 127;
+		__m256i acc = _mm256_setzero_si256();
+		for (size_t i = 0; i < run; ++i, block += 64){
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)block), nl));
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(block + 32)), nl));
+		}
+		__m256i sum = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+		__m128i s = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		count += _mm_cvtsi128_si64(_mm_add_epi64(s, _mm_unpackhi_epi64(s, s)));
+		n -= run;
+	}
+#else
+	const __m128i nl = _mm_set1_epi8('\n');
+	while (n){
+		/* Each lane gets at most 4 a block so 63 blocks can't overflow it */
+		size_t run = n < 63 ? n : 63;
+		__m128i acc = _mm_setzero_si128();
+		for (size_t i = 0; i < run; ++i, block += 64){
+			for (int j = 0; j < 4; ++j){
+				acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(block + 16 * j)), nl));
+			}
+		}
+		__m128i s = _mm_sad_epu8(acc, _mm_setzero_si128());
+		count += _mm_cvtsi128_si64(_mm_add_epi64(s, _mm_unpackhi_epi64(s, s)));
+		n -= run;
+	}
+#endif
+	return count;
+}
+/* Count the newlines in the n bytes of text */
+static inline size_t mesh_count_lines(const char *text, size_t n){
+	if (!n){
+		return 0;
+	}
+	const char *end = text + n;
+	const char *block = (const char*)((uintptr_t)text & ~(uintptr_t)63);
+	uint64_t mask = mesh_newline_mask(block) & (~(uint64_t)0 << (text - block));
+	size_t count = 0;
+	if (end - block > 64){
+		/* The first and last blocks are partial, count the ones in between without masks */
+		count = __builtin_popcountll(mask);
+		block += 64;
+		size_t whole = (end - 1 - block) / 64;
+		count += mesh_count_newline_blocks(block, whole);
+		block += whole * 64;
+		mask = mesh_newline_mask(block);
+	}
+	if (end - block < 64){
+		mask &= ((uint64_t)1 << (end - block)) - 1;
+	}
+	return count + __builtin_popcountll(mask);
+}
+/*
+ * Parse a float at *s, skipping spaces and tabs before it, and move *s past
+ * it. Returns 0 (leaving *s alone) if there isn't a number there. Numbers with
+ * up to 19 significant digits and a power of ten within 10^+-22 are built in a
+ * double from the integer digits and one multiply or divide by an exact power
+ * of ten, which is correctly rounded as a double and almost always as a
+ * float. Anything else (long or tiny numbers, inf, nan, hex) goes to strtof.
+ * The text has to end in something other than a digit, eg. a newline.
+ *
+ * Taking the digits 8 at a time with SWAR multiplies was about twice as slow
+ * as this loop, numbers in a file mostly have the same length so its branches
+ * predict well and the SWAR version's longer chain to find where the number
+ * ends holds up the next one
+ */
+static inline int mesh_parse_float(const char **s, float *out){
+	static const double pow10[23] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char *p = *s;
+	while (*p == ' ' || *p == '\t'){
+		++p;
+	}
+	const char *start = p;
+	int neg = *p == '-';
+	p += neg || *p == '+';
+	uint64_t m = 0;
+	int digits = 0, exp = 0, any = 0;
+	for (; (unsigned)(*p - '0') < 10; ++p, any = 1){
+		m = m * 10 + (*p - '0');
+		digits += m != 0;
+	}
+	if (*p == '.'){
+		for (++p; (unsigned)(*p - '0') < 10; ++p, any = 1){
+			m = m * 10 + (*p - '0');
+			digits += m != 0;
+			--exp;
+		}
+	}
+	if (any && (*p == 'e' || *p == 'E')){
+		const char *e = p + 1;
+		int eneg = *e == '-';
+		e += eneg || *e == '+';
+		int x = 0;
+		if ((unsigned)(*e - '0') < 10){
+			for (; (unsigned)(*e - '0') < 10; ++e){
+				x = x < 10000 ? x * 10 + (*e - '0') : x;
+			}
+			exp += eneg ? -x : x;
+			p = e;
+		}
+	}
+	if (!any || digits > 19 || m > (uint64_t)1 << 53 || exp < -22 || exp > 22){
+		char *e;
+		float f = strtof(start, &e);
+		if (e == start){
+			return 0;
+		}
+		*out = f;
+		*s = e;
+		return 1;
+	}
+	double d = exp < 0 ? (double)m / pow10[-exp] : (double)m * pow10[exp];
+	*out = (float)(neg ? -d : d);
+	*s = p;
+	return 1;
+}
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef SSE_QUAT_H
+#define SSE_QUAT_H
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <stddef.h>
+#include <math.h>
+#include "vec4.h"
+#include "vec4x4.h"
+#include "vec4_math.h"
+#include "mat4.h"
+#ifdef __AVX__
+#include "vec4x8.h"
+#endif
+
+/*
+ * Quaternion stored in a vec4_t as [x, y, z, w] where x, y, z is the vector
+ * part and w the scalar part. Rotations should use unit quaternions
+ */
+typedef vec4_t quat_t;
+
+/* Past this dot product slerp falls back to nlerp since sin(theta) gets tiny */
+#define QUAT_SLERP_NLERP_DOT 0.9995f
+
+/* Create a new quaternion, w is the scalar part */
+static inline quat_t quat_new(float x, float y, float z, float w){
+	return vec4_new(x, y, z, w);
+}
+static inline quat_t quat_identity(void){
+	quat_t q;
+	q.v = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+	return q;
+}
+/*
+ * Create the quaternion rotating by d degrees about the vector v, same as
+ * mat4_rotate (v.w should be 0)
+ */
+static inline quat_t quat_from_axis_angle(vec4_t v, float d){
+	__m128 s, c;
+	vec4_sincos_ps(_mm_set1_ps(d * (float)(0.5 * M_PI / 180.0)), &s, &c);
+	v = vec4_normalize(v);
+	/* [v * sin(d / 2), cos(d / 2)] */
+	__m128 xyz = _mm_mul_ps(v.v, s);
+	__m128 ww = _mm_shuffle_ps(xyz, c, _MM_SHUFFLE(0, 0, 2, 2));
+	v.v = _mm_shuffle_ps(xyz, ww, _MM_SHUFFLE(2, 0, 1, 0));
+	return v;
+}
+/*
+ * Compose the rotations, the result rotates by b then a. Each element of the
+ * Hamilton product is a.w * b plus a's vector part times shuffles of b
+ */
+static inline quat_t quat_mult(quat_t a, quat_t b){
+	const __m128 s0 = _mm_setr_ps(1.f, -1.f, 1.f, -1.f);
+	const __m128 s1 = _mm_setr_ps(1.f, 1.f, -1.f, -1.f);
+	const __m128 s2 = _mm_setr_ps(-1.f, 1.f, 1.f, -1.f);
+	__m128 r = _mm_mul_ps(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 3, 3, 3)), b.v);
+	/* a.x * [b.w, -b.z, b.y, -b.x] */
+	r = vec4_madd_ps(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(0, 0, 0, 0)),
+		_mm_mul_ps(_mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(0, 1, 2, 3)), s0), r);
+	/* a.y * [b.z, b.w, -b.x, -b.y] */
+	r = vec4_madd_ps(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 1, 1, 1)),
+		_mm_mul_ps(_mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(1, 0, 3, 2)), s1), r);
+	/* a.z * [-b.y, b.x, b.w, -b.z] */
+	r = vec4_madd_ps(_mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 2, 2, 2)),
+		_mm_mul_ps(_mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(2, 3, 0, 1)), s2), r);
+	a.v = r;
+	return a;
+}
+/* The conjugate is the inverse for unit quaternions */
+static inline quat_t quat_conjugate(quat_t q){
+	q.v = _mm_xor_ps(q.v, _mm_castsi128_ps(_mm_setr_epi32(0x80000000, 0x80000000, 0x80000000, 0)));
+	return q;
+}
+static inline float quat_dot(quat_t a, quat_t b){
+	return vec4_dot(a, b);
+}
+static inline quat_t quat_normalize(quat_t q){
+	return vec4_normalize(q);
+}
+/* Rotate the vector v by the unit quaternion q, v' = v + w * t + q.xyz X t, t = 2 * q.xyz X v */
+static inline vec4_t quat_rotate(quat_t q, vec4_t v){
+	vec4_t t = vec4_cross(q, v);
+	t.v = _mm_add_ps(t.v, t.v);
+	vec4_t r = vec4_cross(q, t);
+	r.v = _mm_add_ps(r.v, vec4_madd_ps(_mm_shuffle_ps(q.v, q.v, _MM_SHUFFLE(3, 3, 3, 3)), t.v, v.v));
+	return r;
+}
+/*
+ * Normalized linear interpolation from a to b, b is flipped if needed so we take the
+ * shortest path. Cheaper than slerp but doesn't move at a constant angular speed
+ */
+static inline quat_t quat_nlerp(quat_t a, quat_t b, float t){
+	__m128 d = vec4_dot_v(a, b);
+	const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	b.v = _mm_xor_ps(b.v, _mm_and_ps(d, sign_mask));
+	a.v = vec4_madd_ps(_mm_sub_ps(b.v, a.v), _mm_set1_ps(t), a.v);
+	return vec4_normalize_fast(a);
+}
+/* Spherical linear interpolation from a to b taking the shortest path */
+static inline quat_t quat_slerp(quat_t a, quat_t b, float t){
+	float d = quat_dot(a, b);
+	if (d < 0){
+		d = -d;
+		b.v = _mm_xor_ps(b.v, _mm_castsi128_ps(_mm_set1_epi32(0x80000000)));
+	}
+	if (d > QUAT_SLERP_NLERP_DOT){
+		return quat_nlerp(a, b, t);
+	}
+	/* Get sin(theta), sin((1 - t) theta), sin(t theta) all at once */
+	float theta = _mm_cvtss_f32(vec4_acos_ps(_mm_set_ss(d)));
+	__m128 s = vec4_sin_ps(_mm_setr_ps(theta, (1.f - t) * theta, t * theta, 0.f));
+	s = _mm_div_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(0, 0, 0, 0)));
+	a.v = _mm_mul_ps(a.v, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+	a.v = vec4_madd_ps(b.v, _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 2, 2, 2)), a.v);
+	return a;
+}
+/*
+ * Slerp n pairs of quaternions, out[i] = slerp(a[i], b[i], t[i]), e.g. sampling the
+ * keyframes bracketing each bone of a skeleton. This is done 4 at a time as a
+ * vec4x4_t, or 8 at a time as a vec4x8_t when built with AVX, using Eberly's
+ * polynomial approximation of the slerp weights ("A Fast and Accurate Algorithm
+ * for Computing SLERP"), so there's no trig or division at all. The max error
+ * against an exact slerp is about 1.2e-6, which takes all 12 terms: 8 terms
+ * would be 2e-5 for pairs 180 degrees apart.
+ *
+ * Use sse_kernels->slerp_n to get the widest version the CPU runs. bench_quat
+ * measures about 7 cycles per sample for the AVX2 kernel and 24 for SSE2, against
+ * 27 for lerping and re-orthonormalizing the matrices. So it's about 4x faster
+ * with AVX2 and barely faster with SSE2, short of the order of magnitude we were
+ * after. What's left is the 12 term polynomial for both weights
+ */
+static inline void quat_slerp_n(const quat_t *a, const quat_t *b, const float *t, quat_t *out, size_t n){
+	/*
+	 * u_i = 1 / (i (2i + 1)), v_i = i / (2i + 1), the last term is scaled to absorb the
+	 * dropped tail. Each factor (u_i t^2 - v_i)(d - 1) is split as u_i t^2 (d - 1) + v_i (1 - d)
+	 * so the v_i half is shared by both weights and it's all multiply-adds
+	 */
+	static const float u[12] = { 1.f / 3, 1.f / 10, 1.f / 21, 1.f / 36, 1.f / 55, 1.f / 78, 1.f / 105,
+		1.f / 136, 1.f / 171, 1.f / 210, 1.f / 253, 1.894f / 300 };
+	static const float v[12] = { 1.f / 3, 2.f / 5, 3.f / 7, 4.f / 9, 5.f / 11, 6.f / 13, 7.f / 15,
+		8.f / 17, 9.f / 19, 10.f / 21, 11.f / 23, 1.894f * 12 / 25 };
+	size_t i = 0;
+#ifdef __AVX__
+	{
+		const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+		const __m256 one = _mm256_set1_ps(1.f);
+		for (; i < (n & ~(size_t)7); i += 8){
+			vec4x8_t qa = vec4x8_load(a + i);
+			vec4x8_t qb = vec4x8_load(b + i);
+			__m256 tb = _mm256_loadu_ps(t + i);
+			__m256 ta = _mm256_sub_ps(one, tb);
+			__m256 d = vec4x8_dot(qa, qb);
+			/* Flip b where needed to take the shortest path */
+			__m256 flip = _mm256_and_ps(d, sign_mask);
+			__m256 omd = _mm256_sub_ps(one, _mm256_andnot_ps(sign_mask, d));
+			__m256 pa = _mm256_mul_ps(_mm256_mul_ps(ta, ta), _mm256_sub_ps(_mm256_setzero_ps(), omd));
+			__m256 pb = _mm256_mul_ps(_mm256_mul_ps(tb, tb), _mm256_sub_ps(_mm256_setzero_ps(), omd));
+			__m256 fa = one, fb = one;
+			for (int k = 11; k >= 0; --k){
+				__m256 uk = _mm256_broadcast_ss(u + k);
+				__m256 vq = _mm256_mul_ps(_mm256_broadcast_ss(v + k), omd);
+				fa = vec4x8_madd_ps(vec4x8_madd_ps(uk, pa, vq), fa, one);
+				fb = vec4x8_madd_ps(vec4x8_madd_ps(uk, pb, vq), fb, one);
+			}
+			__m256 wa = _mm256_mul_ps(ta, fa);
+			__m256 wb = _mm256_xor_ps(_mm256_mul_ps(tb, fb), flip);
+			vec4x8_store(vec4x8_add(vec4x8_scale_v(qa, wa), vec4x8_scale_v(qb, wb)), out + i);
+		}
+	}
+#endif
+	const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	const __m128 one = _mm_set1_ps(1.f);
+	for (; i < (n & ~(size_t)3); i += 4){
+		vec4x4_t qa = vec4x4_load(a + i);
+		vec4x4_t qb = vec4x4_load(b + i);
+		__m128 tb = _mm_loadu_ps(t + i);
+		__m128 ta = _mm_sub_ps(one, tb);
+		__m128 d = vec4x4_dot(qa, qb);
+		__m128 flip = _mm_and_ps(d, sign_mask);
+		__m128 omd = _mm_sub_ps(one, _mm_andnot_ps(sign_mask, d));
+		__m128 pa = _mm_mul_ps(_mm_mul_ps(ta, ta), _mm_sub_ps(_mm_setzero_ps(), omd));
+		__m128 pb = _mm_mul_ps(_mm_mul_ps(tb, tb), _mm_sub_ps(_mm_setzero_ps(), omd));
+		__m128 fa = one, fb = one;
+		for (int k = 11; k >= 0; --k){
+			__m128 uk = _mm_set1_ps(u[k]);
+			__m128 vq = _mm_mul_ps(_mm_set1_ps(v[k]), omd);
+			fa = vec4_madd_ps(vec4_madd_ps(uk, pa, vq), fa, one);
+			fb = vec4_madd_ps(vec4_madd_ps(uk, pb, vq), fb, one);
+		}
+		__m128 wa = _mm_mul_ps(ta, fa);
+		__m128 wb = _mm_xor_ps(_mm_mul_ps(tb, fb), flip);
+		vec4x4_store(vec4x4_add(vec4x4_scale_v(qa, wa), vec4x4_scale_v(qb, wb)), out + i);
+	}
+	for (; i < n; ++i){
+		out[i] = quat_slerp(a[i], b[i], t[i]);
+	}
+}
+/* Normalized lerp of n pairs of quaternions, out[i] = nlerp(a[i], b[i], t[i]) */
+static inline void quat_nlerp_n(const quat_t *a, const quat_t *b, const float *t, quat_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		out[i] = quat_nlerp(a[i], b[i], t[i]);
+	}
+}
+/* Convert the unit quaternion to a rotation matrix */
+static inline mat4_t quat_to_mat4(quat_t q){
+	const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 q2 = _mm_add_ps(q.v, q.v);
+	/* s = [2xx, 2yy, 2zz, 2ww] */
+	__m128 s = _mm_mul_ps(q.v, q2);
+	/* diag = 1 - [2yy + 2zz, 2xx + 2zz, 2xx + 2yy] */
+	__m128 diag = _mm_add_ps(_mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 0, 0, 1)),
+		_mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 1, 2, 2)));
+	diag = _mm_and_ps(_mm_sub_ps(_mm_set1_ps(1.f), diag), xyz);
+	/* p = [2xy, 2xz, 2yz], w = [2wz, 2wy, 2wx] */
+	__m128 p = _mm_mul_ps(_mm_shuffle_ps(q.v, q.v, _MM_SHUFFLE(3, 1, 0, 0)),
+		_mm_shuffle_ps(q2, q2, _MM_SHUFFLE(3, 2, 2, 1)));
+	__m128 w = _mm_mul_ps(_mm_shuffle_ps(q.v, q.v, _MM_SHUFFLE(3, 3, 3, 3)),
+		_mm_shuffle_ps(q2, q2, _MM_SHUFFLE(3, 0, 1, 2)));
+	__m128 pp = _mm_and_ps(_mm_add_ps(p, w), xyz);
+	__m128 pm = _mm_and_ps(_mm_sub_ps(p, w), xyz);
+	mat4_t m;
+	/* [diag0, pp0, pm1, 0] */
+	__m128 t = _mm_shuffle_ps(diag, pp, _MM_SHUFFLE(0, 0, 0, 0));
+	m.col[0].v = _mm_shuffle_ps(t, pm, _MM_SHUFFLE(3, 1, 2, 0));
+	/* [pm0, diag1, pp2, 0] */
+	t = _mm_shuffle_ps(pm, diag, _MM_SHUFFLE(1, 1, 0, 0));
+	m.col[1].v = _mm_shuffle_ps(t, pp, _MM_SHUFFLE(3, 2, 2, 0));
+	/* [pp1, pm2, diag2, 0] */
+	t = _mm_shuffle_ps(pp, pm, _MM_SHUFFLE(2, 2, 1, 1));
+	m.col[2].v = _mm_shuffle_ps(t, diag, _MM_SHUFFLE(3, 2, 2, 0));
+	m.col[3].v = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+	return m;
+}
+/* Convert n unit quaternions to rotation matrices, 4 at a time as a vec4x4_t */
+static inline void quat_to_mat4_n(const quat_t *q, mat4_t *out, size_t n){
+	size_t i = 0;
+	for (; i < (n & ~(size_t)3); i += 4){
+		vec4x4_t p = vec4x4_load(q + i);
+		vec4x4_t p2 = vec4x4_add(p, p);
+		__m128 xx = _mm_mul_ps(p.x, p2.x), yy = _mm_mul_ps(p.y, p2.y), zz = _mm_mul_ps(p.z, p2.z);
+		__m128 xy = _mm_mul_ps(p.x, p2.y), xz = _mm_mul_ps(p.x, p2.z), yz = _mm_mul_ps(p.y, p2.z);
+		__m128 wx = _mm_mul_ps(p.w, p2.x), wy = _mm_mul_ps(p.w, p2.y), wz = _mm_mul_ps(p.w, p2.z);
+		const __m128 one = _mm_set1_ps(1.f);
+		/* Element r_c of each of the 4 matrices, then transposed out to their columns */
+		vec4x4_t c0, c1, c2;
+		c0.x = _mm_sub_ps(one, _mm_add_ps(yy, zz));
+		c0.y = _mm_add_ps(xy, wz);
+		c0.z = _mm_sub_ps(xz, wy);
+		c0.w = _mm_setzero_ps();
+		c1.x = _mm_sub_ps(xy, wz);
+		c1.y = _mm_sub_ps(one, _mm_add_ps(xx, zz));
+		c1.z = _mm_add_ps(yz, wx);
+		c1.w = _mm_setzero_ps();
+		c2.x = _mm_add_ps(xz, wy);
+		c2.y = _mm_sub_ps(yz, wx);
+		c2.z = _mm_sub_ps(one, _mm_add_ps(xx, yy));
+		c2.w = _mm_setzero_ps();
+		vec4_t cols[3][4];
+		vec4x4_store(c0, cols[0]);
+		vec4x4_store(c1, cols[1]);
+		vec4x4_store(c2, cols[2]);
+		for (int k = 0; k < 4; ++k){
+			out[i + k].col[0] = cols[0][k];
+			out[i + k].col[1] = cols[1][k];
+			out[i + k].col[2] = cols[2][k];
+			out[i + k].col[3].v = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+		}
+	}
+	for (; i < n; ++i){
+		out[i] = quat_to_mat4(q[i]);
+	}
+}
+/* Convert the rotation in the upper 3x3 of m to a quaternion, m must be orthonormal */
+static inline quat_t mat4_to_quat(mat4_t m){
+	float m00 = m.col[0].f[0], m11 = m.col[1].f[1], m22 = m.col[2].f[2];
+	float tr = m00 + m11 + m22;
+	quat_t q;
+	/* Pick the largest of w, x, y, z to divide by for stability */
+	if (tr > 0){
+		float s = sqrtf(tr + 1.f) * 2.f;
+		q = quat_new((m.col[1].f[2] - m.col[2].f[1]) / s, (m.col[2].f[0] - m.col[0].f[2]) / s,
+			(m.col[0].f[1] - m.col[1].f[0]) / s, 0.25f * s);
+	}
+	else if (m00 > m11 && m00 > m22){
+		float s = sqrtf(1.f + m00 - m11 - m22) * 2.f;
+		q = quat_new(0.25f * s, (m.col[1].f[0] + m.col[0].f[1]) / s,
+			(m.col[2].f[0] + m.col[0].f[2]) / s, (m.col[1].f[2] - m.col[2].f[1]) / s);
+	}
+	else if (m11 > m22){
+		float s = sqrtf(1.f + m11 - m00 - m22) * 2.f;
+		q = quat_new((m.col[1].f[0] + m.col[0].f[1]) / s, 0.25f * s,
+			(m.col[2].f[1] + m.col[1].f[2]) / s, (m.col[2].f[0] - m.col[0].f[2]) / s);
+	}
+	else {
+		float s = sqrtf(1.f + m22 - m00 - m11) * 2.f;
+		q = quat_new((m.col[2].f[0] + m.col[0].f[2]) / s, (m.col[2].f[1] + m.col[1].f[2]) / s,
+			0.25f * s, (m.col[0].f[1] - m.col[1].f[0]) / s);
+	}
+	return vec4_normalize(q);
+}
+/* Build the matrix translating by t, rotating by r and scaling by s, T * R * S */
+static inline mat4_t mat4_compose(vec4_t t, quat_t r, vec4_t s){
+	mat4_t m = quat_to_mat4(r);
+	m.col[0].v = _mm_mul_ps(m.col[0].v, _mm_shuffle_ps(s.v, s.v, _MM_SHUFFLE(0, 0, 0, 0)));
+	m.col[1].v = _mm_mul_ps(m.col[1].v, _mm_shuffle_ps(s.v, s.v, _MM_SHUFFLE(1, 1, 1, 1)));
+	m.col[2].v = _mm_mul_ps(m.col[2].v, _mm_shuffle_ps(s.v, s.v, _MM_SHUFFLE(2, 2, 2, 2)));
+	m.col[3] = t;
+	m.col[3].f[3] = 1;
+	return m;
+}
+/*
+ * Decompose an affine m = T * R * S into its translation, rotation and scale.
+ * A reflection is folded into a negative x scale. The w of t and s are 0.
+ * Returns 0 if a scale is 0 so the rotation can't be found, 1 otherwise
+ */
+static inline int mat4_decompose(mat4_t m, vec4_t *t, quat_t *r, vec4_t *s){
+	const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	t->v = _mm_and_ps(m.col[3].v, xyz);
+	__m128 sx = vec4_len_v(m.col[0]);
+	__m128 sy = vec4_len_v(m.col[1]);
+	__m128 sz = vec4_len_v(m.col[2]);
+	/* A negative determinant means there's a reflection */
+	if (vec4_dot(vec4_cross(m.col[0], m.col[1]), m.col[2]) < 0){
+		sx = _mm_xor_ps(sx, _mm_castsi128_ps(_mm_set1_epi32(0x80000000)));
+	}
+	s->v = _mm_and_ps(_mm_unpacklo_ps(_mm_unpacklo_ps(sx, sz), sy), xyz);
+	if (_mm_movemask_ps(_mm_cmpeq_ps(_mm_or_ps(s->v, _mm_andnot_ps(xyz, _mm_set1_ps(1.f))),
+		_mm_setzero_ps())))
+	{
+		*r = quat_identity();
+		return 0;
+	}
+	m.col[0].v = _mm_div_ps(m.col[0].v, sx);
+	m.col[1].v = _mm_div_ps(m.col[1].v, sy);
+	m.col[2].v = _mm_div_ps(m.col[2].v, sz);
+	*r = mat4_to_quat(m);
+	return 1;
+}
+
+#endif
+
@@ -0,0 +1,307 @@
+#ifndef SSE_RASTER_H
+#define SSE_RASTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "vec4.h"
+#include "mat4.h"
+#include "frustum.h"
+
+/*
+ * A software rasterizer for drawing the same vec4_t vertex arrays and MVP
+ * matrices we give GL without a GPU, eg. for headless previews or to fill a
+ * depth buffer for occlusion culling.
+ *
+ * raster_draw transforms the vertices with the parallel vec_mult_n kernel,
+ * then 4 triangles at a time are tested against the clip planes in clip space,
+ * perspective divided and snapped to 1/16 pixel. The few triangles crossing
+ * the near plane or the guard band get clipped properly. The triangles are
+ * binned into 64x64 pixel tiles and the tiles are rasterized in parallel, one
+ * tile per job, so no two threads touch the same pixels.
+ *
+ * Within a tile each triangle is walked in 8x8 pixel blocks. The edge functions
+ * are exact integers: the value at a block's corner is worked out in 64 bits,
+ * blocks entirely outside an edge are skipped, and the pixels of the rest are
+ * tested a row at a time with SSE2 (4 pixels) or AVX2 (8 pixels), through the
+ * dispatched raster_tile kernel. Shared edges follow the top-left rule so
+ * meshes don't have gaps or double coverage. Depth is tested with GL_LESS and
+ * a triangle's pixels are drawn in the order the triangles were given.
+ *
+ * Pixel (0, 0) is the top left one, like the image files. Triangles are drawn
+ * whichever way they face
+ */
+#define RASTER_TILE 64
+#define RASTER_BLOCK 8
+#define RASTER_SUBPIXEL_BITS 4
+#define RASTER_SUBPIXEL (1 << RASTER_SUBPIXEL_BITS)
+/* Largest width or height, the guard band is sized so snapped coordinates can't overflow */
+#define RASTER_MAX_SIZE 4096
+/*
+ * Triangles reaching further outside the viewport than this (in normalized
+ * device coordinates) are clipped, anything inside is left to the tile and
+ * block bounds. It keeps snapped coordinates under 2^16 pixels
+ */
+#define RASTER_GUARD 16.f
+/* Pack a color the way raster_t stores them, RGBA bytes in memory order */
+#define RASTER_RGBA(R, G, B, A) ((uint32_t)(R) | (uint32_t)(G) << 8 | (uint32_t)(B) << 16 | (uint32_t)(A) << 24)
+
+enum raster_flags {
+	/* Only test and write depth, eg. drawing occluders */
+	RASTER_DEPTH_ONLY = 1
+};
+/* A triangle set up for drawing */
+struct raster_tri {
+	/*
+	 * Edge functions a * x + b * y + c over subpixel coordinates, positive
+	 * inside. c has the top-left rule bias folded in
+	 */
+	int32_t a[3], b[3];
+	int64_t c[3];
+	/* Depth at the center of pixel (x0, y0) and its change per pixel */
+	float z, dzdx, dzdy;
+	/* Pixels the triangle may cover, inclusive and inside the viewport */
+	int x0, y0, x1, y1;
+};
+/*
+ * The buffers being drawn to, pitch is in pixels. Rows are padded out to whole
+ * tiles and so are the columns, so a block never runs off the end of the buffers
+ */
+struct raster_target {
+	float *depth;
+	/* NULL to only draw depth */
+	uint32_t *color;
+	size_t pitch;
+};
+struct jobs;
+struct raster {
+	int width, height, tiles_x, tiles_y;
+	struct raster_target target;
+	struct jobs *jobs;
+	/* Scratch space for each draw, grown as needed */
+	vec4_t *clip;
+	struct raster_tri *tris;
+	uint8_t *state;
+	/* Setup ids in draw order, and the ids binned into each tile */
+	uint32_t *order, *bin_start, *bin_fill, *bins;
+	size_t clip_size, tris_size, state_size, order_size, bins_size;
+};
+/*
+ * Set up a width x height color and depth buffer, drawn with threads threads
+ * (including the caller). Returns 0 if the size is too big or the memory
+ * couldn't be allocated
+ */
+int raster_init(struct raster *r, int width, int height, int threads);
+void raster_destroy(struct raster *r);
+void raster_clear(struct raster *r, uint32_t color, float depth);
+/*
+ * Draw the n / 3 triangles in verts after transforming them by mvp, in a
+ * single color. Returns 0 if scratch memory couldn't be allocated
+ */
+int raster_draw(struct raster *r, const mat4_t *mvp, const vec4_t *verts, size_t n, uint32_t color, int flags);
+/*
+ * Check if any of the box could be visible over what's in the depth buffer,
+ * by testing the nearest depth of the box against the depth buffer over its
+ * bounding rectangle on screen. Boxes crossing the near plane are always
+ * visible
+ */
+int raster_aabb_visible(const struct raster *r, const mat4_t *mvp, const aabb_t *box);
+/* Write the color buffer as a binary PPM, returns 0 on failure */
+int raster_write_ppm(const struct raster *r, const char *fname);
+/*
+ * Write the depth buffer as a binary PGM, stretching the depths drawn over
+ * the gray levels with nearer being brighter. Returns 0 on failure
+ */
+int raster_write_depth_pgm(const struct raster *r, const char *fname);
+static inline uint32_t raster_pixel(const struct raster *r, int x, int y){
+	return r->target.color[y * r->target.pitch + x];
+}
+static inline float raster_depth(const struct raster *r, int x, int y){
+	return r->target.depth[y * r->target.pitch + x];
+}
+
+/*
+ * Set up a triangle from its snapped subpixel coordinates and window depths
+ * for a width x height viewport. Returns 0 if it's degenerate or misses
+ * every pixel center
+ */
+static inline int raster_setup(struct raster_tri *t, const int32_t x[3], const int32_t y[3], const float z[3],
+	int width, int height)
+{
+	int64_t area = (int64_t)(x[1] - x[0]) * (y[2] - y[0]) - (int64_t)(y[1] - y[0]) * (x[2] - x[0]);
+	if (area == 0){
+		return 0;
+	}
+	/* Wind them so the inside is positive */
+	int v[3] = { 0, 1, 2 };
+	if (area < 0){
+		v[1] = 2;
+		v[2] = 1;
+		area = -area;
+	}
+	int32_t min_x = x[0], max_x = x[0], min_y = y[0], max_y = y[0];
+	for (int i = 1; i < 3; ++i){
+		min_x = x[i] < min_x ? x[i] : min_x;
+		max_x = x[i] > max_x ? x[i] : max_x;
+		min_y = y[i] < min_y ? y[i] : min_y;
+		max_y = y[i] > max_y ? y[i] : max_y;
+	}
+	/* Pixels whose centers are within the bounds */
+	const int half = RASTER_SUBPIXEL / 2;
+	t->x0 = (min_x - half + RASTER_SUBPIXEL - 1) >> RASTER_SUBPIXEL_BITS;
+	t->x1 = (max_x - half) >> RASTER_SUBPIXEL_BITS;
+	t->y0 = (min_y - half + RASTER_SUBPIXEL - 1) >> RASTER_SUBPIXEL_BITS;
+	t->y1 = (max_y - half) >> RASTER_SUBPIXEL_BITS;
+	t->x0 = t->x0 < 0 ? 0 : t->x0;
+	t->y0 = t->y0 < 0 ? 0 : t->y0;
+	t->x1 = t->x1 >= width ? width - 1 : t->x1;
+	t->y1 = t->y1 >= height ? height - 1 : t->y1;
+	if (t->x0 > t->x1 || t->y0 > t->y1){
+		return 0;
+	}
+	/* Edge k goes from v[k] to v[k + 1], its function is the weight of the vertex opposite it */
+	double px = (double)t->x0 * RASTER_SUBPIXEL + half, py = (double)t->y0 * RASTER_SUBPIXEL + half;
+	double dzdx = 0, dzdy = 0, z0 = 0;
+	for (int k = 0; k < 3; ++k){
+		int i = v[k], j = v[(k + 1) % 3];
+		int32_t a = y[i] - y[j], b = x[j] - x[i];
+		int64_t c = -((int64_t)a * x[i] + (int64_t)b * y[i]);
+		float zk = z[v[(k + 2) % 3]];
+		dzdx += (double)a * zk;
+		dzdy += (double)b * zk;
+		z0 += ((double)a * px + (double)b * py + (double)c) * zk;
+		/* Pixels exactly on an edge belong to the triangle only for top and left edges */
+		int top_left = a > 0 || (a == 0 && b > 0);
+		t->a[k] = a;
+		t->b[k] = b;
+		t->c[k] = top_left ? c : c - 1;
+	}
+	t->z = z0 / area;
+	t->dzdx = dzdx * RASTER_SUBPIXEL / area;
+	t->dzdy = dzdy * RASTER_SUBPIXEL / area;
+	return 1;
+}
+/*
+ * Draw one 8x8 block of a triangle, with its top left pixel at (bx, by). The
+ * edge functions at the block's corner are clamped to +-2^30, which keeps the
+ * sign right for every pixel in the block since they can change by less than
+ * 2^29 across it
+ */
+static inline void raster_block(const struct raster_target *target, const struct raster_tri *t, int bx, int by,
+	uint32_t color)
+{
+	const int span = (RASTER_BLOCK - 1) * RASTER_SUBPIXEL;
+	const int64_t limit = (int64_t)1 << 30;
+	int32_t e[3];
+	int full = 1;
+	for (int k = 0; k < 3; ++k){
+		int64_t v = (int64_t)t->a[k] * (bx * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2)
+			+ (int64_t)t->b[k] * (by * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2) + t->c[k];
+		int64_t hi = v + (int64_t)(t->a[k] > 0 ? t->a[k] : 0) * span + (int64_t)(t->b[k] > 0 ? t->b[k] : 0) * span;
+		int64_t lo = v + (int64_t)(t->a[k] < 0 ? t->a[k] : 0) * span + (int64_t)(t->b[k] < 0 ? t->b[k] : 0) * span;
+		if (hi < 0){
+			return;
+		}
+		full &= lo >= 0;
+		e[k] = v > limit ? limit : v < -limit ? -limit : v;
+	}
+	float zb = t->z + t->dzdx * (float)(bx - t->x0) + t->dzdy * (float)(by - t->y0);
+	float *depth = target->depth + by * target->pitch + bx;
+	uint32_t *pixels = target->color ? target->color + by * target->pitch + bx : NULL;
+#ifdef __AVX2__
+	const __m256i step = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 zx = _mm256_mul_ps(_mm256_set1_ps(t->dzdx), _mm256_cvtepi32_ps(step));
+	const __m256i col = _mm256_set1_epi32(color);
+	__m256i ex[3];
+	for (int k = 0; k < 3; ++k){
+		ex[k] = _mm256_mullo_epi32(step, _mm256_set1_epi32(t->a[k] * RASTER_SUBPIXEL));
+	}
+	for (int dy = 0; dy < RASTER_BLOCK; ++dy){
+		__m256i inside = _mm256_set1_epi32(-1);
+		if (!full){
+			__m256i any = _mm256_setzero_si256();
+			for (int k = 0; k < 3; ++k){
+				__m256i ek = _mm256_add_epi32(ex[k], _mm256_set1_epi32(e[k] + t->b[k] * RASTER_SUBPIXEL * dy));
+				any = _mm256_or_si256(any, ek);
+			}
+			inside = _mm256_cmpgt_epi32(any, _mm256_set1_epi32(-1));
+		}
+		__m256 z = _mm256_add_ps(_mm256_set1_ps(zb + t->dzdy * (float)dy), zx);
+		float *d = depth + dy * target->pitch;
+		__m256 old = _mm256_load_ps(d);
+		__m256 pass = _mm256_and_ps(_mm256_castsi256_ps(inside), _mm256_cmp_ps(z, old, _CMP_LT_OQ));
+		if (!_mm256_movemask_ps(pass)){
+			continue;
+		}
+		_mm256_store_ps(d, _mm256_blendv_ps(old, z, pass));
+		if (pixels){
+			__m256i *p = (__m256i*)(pixels + dy * target->pitch);
+			__m256i c = _mm256_load_si256(p);
+			_mm256_store_si256(p, _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(c),
+				_mm256_castsi256_ps(col), pass)));
+		}
+	}
+#else
+	const __m128 zx[2] = { _mm_mul_ps(_mm_set1_ps(t->dzdx), _mm_setr_ps(0, 1, 2, 3)),
+		_mm_mul_ps(_mm_set1_ps(t->dzdx), _mm_setr_ps(4, 5, 6, 7)) };
+	const __m128i col = _mm_set1_epi32(color);
+	__m128i ex[3][2];
+	for (int k = 0; k < 3; ++k){
+		int32_t a = t->a[k] * RASTER_SUBPIXEL;
+		ex[k][0] = _mm_setr_epi32(0, a, 2 * a, 3 * a);
+		ex[k][1] = _mm_add_epi32(ex[k][0], _mm_set1_epi32(4 * a));
+	}
+	for (int dy = 0; dy < RASTER_BLOCK; ++dy){
+		__m128 zrow = _mm_set1_ps(zb + t->dzdy * (float)dy);
+		for (int h = 0; h < 2; ++h){
+			__m128i inside = _mm_set1_epi32(-1);
+			if (!full){
+				__m128i any = _mm_setzero_si128();
+				for (int k = 0; k < 3; ++k){
+					__m128i ek = _mm_add_epi32(ex[k][h], _mm_set1_epi32(e[k] + t->b[k] * RASTER_SUBPIXEL * dy));
+					any = _mm_or_si128(any, ek);
+				}
+				inside = _mm_cmpgt_epi32(any, _mm_set1_epi32(-1));
+			}
+			__m128 z = _mm_add_ps(zrow, zx[h]);
+			float *d = depth + dy * target->pitch + 4 * h;
+			__m128 old = _mm_load_ps(d);
+			__m128 pass = _mm_and_ps(_mm_castsi128_ps(inside), _mm_cmplt_ps(z, old));
+			if (!_mm_movemask_ps(pass)){
+				continue;
+			}
+			_mm_store_ps(d, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old)));
+			if (pixels){
+				__m128i *p = (__m128i*)(pixels + dy * target->pitch + 4 * h);
+				__m128i m = _mm_castps_si128(pass);
+				_mm_store_si128(p, _mm_or_si128(_mm_and_si128(m, col), _mm_andnot_si128(m, _mm_load_si128(p))));
+			}
+		}
+	}
+#endif
+}
+/*
+ * Draw the triangles ids[0..n) clipped to the tile with pixels [x0, x1) x [y0, y1),
+ * which is what the raster_tile kernel does
+ */
+static inline void raster_tile(const struct raster_target *target, const struct raster_tri *tris,
+	const uint32_t *ids, size_t n, int x0, int y0, int x1, int y1, uint32_t color)
+{
+	for (size_t i = 0; i < n; ++i){
+		const struct raster_tri *t = tris + ids[i];
+		int bx0 = (t->x0 > x0 ? t->x0 : x0) & ~(RASTER_BLOCK - 1);
+		int by0 = (t->y0 > y0 ? t->y0 : y0) & ~(RASTER_BLOCK - 1);
+		int bx1 = t->x1 < x1 - 1 ? t->x1 : x1 - 1;
+		int by1 = t->y1 < y1 - 1 ? t->y1 : y1 - 1;
+		for (int by = by0; by <= by1; by += RASTER_BLOCK){
+			for (int bx = bx0; bx <= bx1; bx += RASTER_BLOCK){
+				raster_block(target, t, bx, by, color);
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,484 @@
+#ifndef SSE_RAY_H
+#define SSE_RAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <float.h>
+#include "vec4.h"
+#include "vec4x4.h"
+/* For aabb_t */
+#include "frustum.h"
+#ifdef __AVX__
+#include "vec4x8.h"
+#endif
+
+/*
+ * Ray/triangle (Moller-Trumbore) and ray/box (slab) intersection, for the
+ * ray tracer. Each test comes in two forms: one ray against 4 primitives stored
+ * as a structure of arrays (tri4_t, aabb4_t), which suits incoherent rays and
+ * 4 wide BVHs, and a packet of 4 (or 8 with AVX) rays against one primitive,
+ * which suits coherent rays like camera rays. The packet forms take a mask of
+ * the active lanes and only update the hit records of those lanes.
+ *
+ * Rays hit things at t > 0 and closer than the t already in their hit record,
+ * so the hit record also holds the max distance for the ray
+ */
+
+/* prim of a hit record that hasn't hit anything */
+#define RAY_MISS 0xffffffffu
+
+/* Ray with origin o and direction d, w should be 1 for o and 0 for d */
+struct ray_t {
+	vec4_t o, d;
+	/* 1 / d for the slab tests, set up by ray_new */
+	vec4_t inv_d;
+};
+typedef struct ray_t ray_t;
+/* Hit record, u and v are the barycentric coordinates of v1 and v2 */
+struct hit_t {
+	float t, u, v;
+	uint32_t prim;
+};
+typedef struct hit_t hit_t;
+struct tri_t {
+	vec4_t v0, v1, v2;
+};
+typedef struct tri_t tri_t;
+/*
+ * 4 triangles as a structure of arrays, with the edges from v0 precomputed.
+ * The w components aren't used. Unused lanes are degenerate and never hit
+ */
+struct tri4_t {
+	vec4x4_t v0, e1, e2;
+	uint32_t ALIGN_16 prim[4];
+};
+typedef struct tri4_t tri4_t;
+/* 4 boxes as a structure of arrays, unused lanes are inside out and never hit */
+struct aabb4_t {
+	__m128 min[3], max[3];
+};
+typedef struct aabb4_t aabb4_t;
+/* Packet of 4 rays and their hit records */
+struct ray4_t {
+	vec4x4_t o, d, inv_d;
+};
+typedef struct ray4_t ray4_t;
+struct hit4_t {
+	__m128 t, u, v;
+	__m128i prim;
+};
+typedef struct hit4_t hit4_t;
+
+static inline ray_t ray_new(vec4_t o, vec4_t d){
+	ray_t r;
+	r.o = o;
+	r.d = d;
+	r.inv_d.v = _mm_div_ps(_mm_set1_ps(1.f), d.v);
+	return r;
+}
+/* A hit record for a ray that can hit things up to t_max away */
+static inline hit_t hit_new(float t_max){
+	hit_t h;
+	h.t = t_max;
+	h.u = 0;
+	h.v = 0;
+	h.prim = RAY_MISS;
+	return h;
+}
+/* Pick a where mask is set and b elsewhere */
+static inline __m128 ray_select_ps(__m128 mask, __m128 a, __m128 b){
+#ifdef __SSE4_1__
+	return _mm_blendv_ps(b, a, mask);
+#else
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+#endif
+}
+/* Mask with the first n lanes active */
+static inline __m128 ray4_active(size_t n){
+	return _mm_cmplt_ps(_mm_setr_ps(0, 1, 2, 3), _mm_set1_ps((float)n));
+}
+/*
+ * Pack n (<= 4) triangles into a tri4_t, triangle i gets the primitive id
+ * prim + i
+ */
+static inline tri4_t tri4_new(const tri_t *tris, size_t n, uint32_t prim){
+	tri4_t t;
+	vec4_t v0[4], e1[4], e2[4];
+	for (size_t i = 0; i < 4; ++i){
+		if (i < n){
+			v0[i] = tris[i].v0;
+			e1[i] = vec4_sub(tris[i].v1, tris[i].v0);
+			e2[i] = vec4_sub(tris[i].v2, tris[i].v0);
+			t.prim[i] = prim + i;
+		}
+		else {
+			v0[i].v = e1[i].v = e2[i].v = _mm_setzero_ps();
+			t.prim[i] = RAY_MISS;
+		}
+	}
+	t.v0 = vec4x4_load(v0);
+	t.e1 = vec4x4_load(e1);
+	t.e2 = vec4x4_load(e2);
+	return t;
+}
+/* Pack n (<= 4) boxes into an aabb4_t */
+static inline aabb4_t aabb4_new(const aabb_t *boxes, size_t n){
+	aabb4_t b;
+	vec4_t mn[4], mx[4];
+	for (size_t i = 0; i < 4; ++i){
+		mn[i] = i < n ? boxes[i].min : vec4_new(FLT_MAX, FLT_MAX, FLT_MAX, 0);
+		mx[i] = i < n ? boxes[i].max : vec4_new(-FLT_MAX, -FLT_MAX, -FLT_MAX, 0);
+	}
+	vec4x4_t pmn = vec4x4_load(mn);
+	vec4x4_t pmx = vec4x4_load(mx);
+	b.min[0] = pmn.x;
+	b.min[1] = pmn.y;
+	b.min[2] = pmn.z;
+	b.max[0] = pmx.x;
+	b.max[1] = pmx.y;
+	b.max[2] = pmx.z;
+	return b;
+}
+/*
+ * Moller-Trumbore for 4 rays against 4 triangles lane by lane, returns the mask
+ * of lanes that hit at 0 < t < t_max. The t, u and v of the hits are only
+ * computed if some lane hit. The bounds are checked before dividing by the
+ * determinant, so misses (most tests) never pay for the divide
+ */
+static inline __m128 ray_tri_test4(const vec4x4_t *o, const vec4x4_t *d, const vec4x4_t *v0,
+	const vec4x4_t *e1, const vec4x4_t *e2, __m128 t_max, __m128 *t, __m128 *u, __m128 *v)
+{
+	const __m128 zero = _mm_setzero_ps();
+	vec4x4_t p = vec4x4_cross(*d, *e2);
+	__m128 det = vec4x4_dot3(*e1, p);
+	vec4x4_t s = vec4x4_sub(*o, *v0);
+	vec4x4_t q = vec4x4_cross(s, *e1);
+	/* Flip everything to a positive determinant */
+	__m128 sign = _mm_and_ps(det, _mm_set1_ps(-0.f));
+	__m128 abs_det = _mm_xor_ps(det, sign);
+	__m128 us = _mm_xor_ps(vec4x4_dot3(s, p), sign);
+	__m128 vs = _mm_xor_ps(vec4x4_dot3(*d, q), sign);
+	__m128 ts = _mm_xor_ps(vec4x4_dot3(*e2, q), sign);
+	/*
+	 * A zero determinant (parallel ray or degenerate triangle) fails the t
+	 * bounds, and NaNs fail everything
+	 */
+	__m128 m = _mm_and_ps(_mm_cmpge_ps(us, zero), _mm_cmpge_ps(vs, zero));
+	m = _mm_and_ps(m, _mm_cmple_ps(_mm_add_ps(us, vs), abs_det));
+	m = _mm_and_ps(m, _mm_cmpgt_ps(ts, zero));
+	m = _mm_and_ps(m, _mm_cmplt_ps(ts, _mm_mul_ps(t_max, abs_det)));
+	if (_mm_movemask_ps(m)){
+		__m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), abs_det);
+		*t = _mm_mul_ps(ts, inv_det);
+		*u = _mm_mul_ps(us, inv_det);
+		*v = _mm_mul_ps(vs, inv_det);
+	}
+	else {
+		*t = *u = *v = zero;
+	}
+	return m;
+}
+/*
+ * Slab test for 4 rays against 4 boxes lane by lane, the near and far planes
+ * of each box are picked by the sign of the ray's direction, so inside out
+ * boxes always miss. NaNs from a ray lying on a slab's plane are ignored by
+ * the order of the min/max operands. Returns the mask of lanes whose ray enters
+ * the box before t_max, along with the entry distance (0 if it starts inside)
+ */
+static inline __m128 ray_slab_test4(const __m128 o[3], const __m128 inv_d[3], const __m128 near[3],
+	const __m128 far[3], __m128 t_max, __m128 *t_near)
+{
+	__m128 tn = _mm_setzero_ps();
+	__m128 tf = t_max;
+	for (int i = 0; i < 3; ++i){
+		tn = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(near[i], o[i]), inv_d[i]), tn);
+		tf = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(far[i], o[i]), inv_d[i]), tf);
+	}
+	/* Pad the far distance by 2 gamma(3) so rounding never misses a hit (Ize 2013) */
+	*t_near = tn;
+	return _mm_cmple_ps(tn, _mm_mul_ps(tf, _mm_set1_ps(1.0000004f)));
+}
+/*
+ * Intersect one ray with 4 triangles, keeping the closest hit in hit.
+ * Returns a 4 bit mask of the triangles hit closer than hit->t was
+ */
+static inline int ray_intersect_tri4(const ray_t *r, const tri4_t *tris, hit_t *hit){
+	vec4x4_t o = vec4x4_splat(r->o);
+	vec4x4_t d = vec4x4_splat(r->d);
+	__m128 t, u, v;
+	__m128 m = ray_tri_test4(&o, &d, &tris->v0, &tris->e1, &tris->e2, _mm_set1_ps(hit->t), &t, &u, &v);
+	int mask = _mm_movemask_ps(m);
+	if (!mask){
+		return 0;
+	}
+	/* Find the closest of the hits */
+	__m128 tm = ray_select_ps(m, t, _mm_set1_ps(INFINITY));
+	tm = _mm_min_ps(tm, _mm_shuffle_ps(tm, tm, _MM_SHUFFLE(2, 3, 0, 1)));
+	tm = _mm_min_ps(tm, _mm_shuffle_ps(tm, tm, _MM_SHUFFLE(1, 0, 3, 2)));
+	int lane = __builtin_ctz(_mm_movemask_ps(_mm_cmpeq_ps(t, tm)) & mask);
+	float ALIGN_16 us[4], vs[4];
+	_mm_store_ps(us, u);
+	_mm_store_ps(vs, v);
+	hit->t = _mm_cvtss_f32(tm);
+	hit->u = us[lane];
+	hit->v = vs[lane];
+	hit->prim = tris->prim[lane];
+	return mask;
+}
+/*
+ * Intersect one ray with 4 boxes, returns a 4 bit mask of the boxes it enters
+ * before t_max and their entry distances in t_near
+ */
+static inline int ray_intersect_aabb4(const ray_t *r, const aabb4_t *boxes, float t_max, __m128 *t_near){
+	__m128 o[3], inv_d[3], near[3], far[3];
+	for (int i = 0; i < 3; ++i){
+		o[i] = _mm_set1_ps(r->o.f[i]);
+		inv_d[i] = _mm_set1_ps(r->inv_d.f[i]);
+		/* The sign is the same for the whole register so just pick which planes to read */
+		int neg = r->inv_d.f[i] < 0;
+		near[i] = neg ? boxes->max[i] : boxes->min[i];
+		far[i] = neg ? boxes->min[i] : boxes->max[i];
+	}
+	return _mm_movemask_ps(ray_slab_test4(o, inv_d, near, far, _mm_set1_ps(t_max), t_near));
+}
+/* Gather n (<= 4) rays into a packet, unused lanes are zero */
+static inline ray4_t ray4_load_n(const ray_t *r, size_t n){
+	ray4_t p;
+	vec4_t o[4], d[4], inv_d[4];
+	for (size_t i = 0; i < 4; ++i){
+		o[i].v = i < n ? r[i].o.v : _mm_setzero_ps();
+		d[i].v = i < n ? r[i].d.v : _mm_setzero_ps();
+		inv_d[i].v = i < n ? r[i].inv_d.v : _mm_setzero_ps();
+	}
+	p.o = vec4x4_load(o);
+	p.d = vec4x4_load(d);
+	p.inv_d = vec4x4_load(inv_d);
+	return p;
+}
+/* Gather n (<= 4) hit records into a packet, unused lanes are misses at t = 0 */
+static inline hit4_t hit4_load_n(const hit_t *h, size_t n){
+	hit4_t p;
+	float ALIGN_16 t[4], u[4], v[4];
+	uint32_t ALIGN_16 prim[4];
+	for (size_t i = 0; i < 4; ++i){
+		t[i] = i < n ? h[i].t : 0;
+		u[i] = i < n ? h[i].u : 0;
+		v[i] = i < n ? h[i].v : 0;
+		prim[i] = i < n ? h[i].prim : RAY_MISS;
+	}
+	p.t = _mm_load_ps(t);
+	p.u = _mm_load_ps(u);
+	p.v = _mm_load_ps(v);
+	p.prim = _mm_load_si128((const __m128i*)prim);
+	return p;
+}
+/* Scatter the first n (<= 4) hit records of the packet out to h */
+static inline void hit4_store_n(const hit4_t *p, hit_t *h, size_t n){
+	float ALIGN_16 t[4], u[4], v[4];
+	uint32_t ALIGN_16 prim[4];
+	_mm_store_ps(t, p->t);
+	_mm_store_ps(u, p->u);
+	_mm_store_ps(v, p->v);
+	_mm_store_si128((__m128i*)prim, p->prim);
+	for (size_t i = 0; i < n; ++i){
+		h[i].t = t[i];
+		h[i].u = u[i];
+		h[i].v = v[i];
+		h[i].prim = prim[i];
+	}
+}
+/*
+ * Intersect the active lanes of a packet with one triangle, updating the hit
+ * records of the lanes that hit it closer than before. Returns the mask of those lanes
+ */
+static inline __m128 ray4_intersect_tri(const ray4_t *r, const tri_t *tri, uint32_t prim, __m128 active,
+	hit4_t *hit)
+{
+	vec4x4_t v0 = vec4x4_splat(tri->v0);
+	vec4x4_t e1 = vec4x4_splat(vec4_sub(tri->v1, tri->v0));
+	vec4x4_t e2 = vec4x4_splat(vec4_sub(tri->v2, tri->v0));
+	__m128 t, u, v;
+	__m128 m = _mm_and_ps(active, ray_tri_test4(&r->o, &r->d, &v0, &e1, &e2, hit->t, &t, &u, &v));
+	if (!_mm_movemask_ps(m)){
+		return m;
+	}
+	hit->t = ray_select_ps(m, t, hit->t);
+	hit->u = ray_select_ps(m, u, hit->u);
+	hit->v = ray_select_ps(m, v, hit->v);
+	hit->prim = _mm_castps_si128(ray_select_ps(m, _mm_castsi128_ps(_mm_set1_epi32((int)prim)),
+		_mm_castsi128_ps(hit->prim)));
+	return m;
+}
+/*
+ * Intersect the active lanes of a packet with a box, returns the mask of the
+ * lanes that enter it before their hit record's t and their entry distances in t_near
+ */
+static inline __m128 ray4_intersect_aabb(const ray4_t *r, const aabb_t *box, __m128 active, const hit4_t *hit,
+	__m128 *t_near)
+{
+	const __m128 zero = _mm_setzero_ps();
+	__m128 o[3] = { r->o.x, r->o.y, r->o.z };
+	__m128 inv_d[3] = { r->inv_d.x, r->inv_d.y, r->inv_d.z };
+	__m128 near[3], far[3];
+	for (int i = 0; i < 3; ++i){
+		__m128 neg = _mm_cmplt_ps(inv_d[i], zero);
+		__m128 mn = _mm_set1_ps(box->min.f[i]);
+		__m128 mx = _mm_set1_ps(box->max.f[i]);
+		near[i] = ray_select_ps(neg, mx, mn);
+		far[i] = ray_select_ps(neg, mn, mx);
+	}
+	return _mm_and_ps(active, ray_slab_test4(o, inv_d, near, far, hit->t, t_near));
+}
+
+#ifdef __AVX__
+/* 8 wide packets for AVX */
+struct ray8_t {
+	vec4x8_t o, d, inv_d;
+};
+typedef struct ray8_t ray8_t;
+struct hit8_t {
+	__m256 t, u, v;
+	__m256i prim;
+};
+typedef struct hit8_t hit8_t;
+
+static inline __m256 ray8_active(size_t n){
+	return _mm256_cmp_ps(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps((float)n), _CMP_LT_OQ);
+}
+static inline ray8_t ray8_load_n(const ray_t *r, size_t n){
+	ray8_t p;
+	vec4_t o[8], d[8], inv_d[8];
+	for (size_t i = 0; i < 8; ++i){
+		o[i].v = i < n ? r[i].o.v : _mm_setzero_ps();
+		d[i].v = i < n ? r[i].d.v : _mm_setzero_ps();
+		inv_d[i].v = i < n ? r[i].inv_d.v : _mm_setzero_ps();
+	}
+	p.o = vec4x8_load(o);
+	p.d = vec4x8_load(d);
+	p.inv_d = vec4x8_load(inv_d);
+	return p;
+}
+static inline hit8_t hit8_load_n(const hit_t *h, size_t n){
+	hit8_t p;
+	float ALIGN_32 t[8], u[8], v[8];
+	uint32_t ALIGN_32 prim[8];
+	for (size_t i = 0; i < 8; ++i){
+		t[i] = i < n ? h[i].t : 0;
+		u[i] = i < n ? h[i].u : 0;
+		v[i] = i < n ? h[i].v : 0;
+		prim[i] = i < n ? h[i].prim : RAY_MISS;
+	}
+	p.t = _mm256_load_ps(t);
+	p.u = _mm256_load_ps(u);
+	p.v = _mm256_load_ps(v);
+	p.prim = _mm256_load_si256((const __m256i*)prim);
+	return p;
+}
+static inline void hit8_store_n(const hit8_t *p, hit_t *h, size_t n){
+	float ALIGN_32 t[8], u[8], v[8];
+	uint32_t ALIGN_32 prim[8];
+	_mm256_store_ps(t, p->t);
+	_mm256_store_ps(u, p->u);
+	_mm256_store_ps(v, p->v);
+	_mm256_store_si256((__m256i*)prim, p->prim);
+	for (size_t i = 0; i < n; ++i){
+		h[i].t = t[i];
+		h[i].u = u[i];
+		h[i].v = v[i];
+		h[i].prim = prim[i];
+	}
+}
+/* 8 wide ray4_intersect_tri */
+static inline __m256 ray8_intersect_tri(const ray8_t *r, const tri_t *tri, uint32_t prim, __m256 active,
+	hit8_t *hit)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	vec4x8_t v0 = vec4x8_splat(tri->v0);
+	vec4x8_t e1 = vec4x8_splat(vec4_sub(tri->v1, tri->v0));
+	vec4x8_t e2 = vec4x8_splat(vec4_sub(tri->v2, tri->v0));
+	vec4x8_t p = vec4x8_cross(r->d, e2);
+	__m256 det = vec4x8_dot3(e1, p);
+	vec4x8_t s = vec4x8_sub(r->o, v0);
+	vec4x8_t q = vec4x8_cross(s, e1);
+	__m256 sign = _mm256_and_ps(det, _mm256_set1_ps(-0.f));
+	__m256 abs_det = _mm256_xor_ps(det, sign);
+	__m256 us = _mm256_xor_ps(vec4x8_dot3(s, p), sign);
+	__m256 vs = _mm256_xor_ps(vec4x8_dot3(r->d, q), sign);
+	__m256 ts = _mm256_xor_ps(vec4x8_dot3(e2, q), sign);
+	__m256 m = _mm256_and_ps(_mm256_cmp_ps(us, zero, _CMP_GE_OQ), _mm256_cmp_ps(vs, zero, _CMP_GE_OQ));
+	m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_add_ps(us, vs), abs_det, _CMP_LE_OQ));
+	m = _mm256_and_ps(m, _mm256_cmp_ps(ts, zero, _CMP_GT_OQ));
+	m = _mm256_and_ps(m, _mm256_cmp_ps(ts, _mm256_mul_ps(hit->t, abs_det), _CMP_LT_OQ));
+	m = _mm256_and_ps(m, active);
+	if (!_mm256_movemask_ps(m)){
+		return m;
+	}
+	__m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.f), abs_det);
+	__m256 t = _mm256_mul_ps(ts, inv_det);
+	__m256 u = _mm256_mul_ps(us, inv_det);
+	__m256 v = _mm256_mul_ps(vs, inv_det);
+	hit->t = _mm256_blendv_ps(hit->t, t, m);
+	hit->u = _mm256_blendv_ps(hit->u, u, m);
+	hit->v = _mm256_blendv_ps(hit->v, v, m);
+	hit->prim = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(hit->prim),
+		_mm256_castsi256_ps(_mm256_set1_epi32((int)prim)), m));
+	return m;
+}
+/* 8 wide ray4_intersect_aabb */
+static inline __m256 ray8_intersect_aabb(const ray8_t *r, const aabb_t *box, __m256 active, const hit8_t *hit,
+	__m256 *t_near)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 o[3] = { r->o.x, r->o.y, r->o.z };
+	__m256 inv_d[3] = { r->inv_d.x, r->inv_d.y, r->inv_d.z };
+	__m256 tn = zero;
+	__m256 tf = hit->t;
+	for (int i = 0; i < 3; ++i){
+		__m256 neg = _mm256_cmp_ps(inv_d[i], zero, _CMP_LT_OQ);
+		__m256 mn = _mm256_set1_ps(box->min.f[i]);
+		__m256 mx = _mm256_set1_ps(box->max.f[i]);
+		__m256 near = _mm256_blendv_ps(mn, mx, neg);
+		__m256 far = _mm256_blendv_ps(mx, mn, neg);
+		tn = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(near, o[i]), inv_d[i]), tn);
+		tf = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(far, o[i]), inv_d[i]), tf);
+	}
+	*t_near = tn;
+	return _mm256_and_ps(active, _mm256_cmp_ps(tn, _mm256_mul_ps(tf, _mm256_set1_ps(1.0000004f)), _CMP_LE_OQ));
+}
+#endif
+
+/*
+ * Find the closest hit for each of n_rays rays against a triangle soup by
+ * testing every triangle, in packets of 8 rays with AVX or 4 without. The hit
+ * records should be set up with each ray's max t (see hit_new) and prim is set
+ * to the index of the triangle hit
+ */
+static inline void ray_intersect_tris(const tri_t *tris, size_t n_tris, const ray_t *rays, hit_t *hits,
+	size_t n_rays)
+{
+#ifdef __AVX__
+	for (size_t i = 0; i < n_rays; i += 8){
+		size_t lanes = n_rays - i < 8 ? n_rays - i : 8;
+		ray8_t r = ray8_load_n(rays + i, lanes);
+		hit8_t h = hit8_load_n(hits + i, lanes);
+		__m256 active = ray8_active(lanes);
+		for (size_t j = 0; j < n_tris; ++j){
+			ray8_intersect_tri(&r, tris + j, j, active, &h);
+		}
+		hit8_store_n(&h, hits + i, lanes);
+	}
+#else
+	for (size_t i = 0; i < n_rays; i += 4){
+		size_t lanes = n_rays - i < 4 ? n_rays - i : 4;
+		ray4_t r = ray4_load_n(rays + i, lanes);
+		hit4_t h = hit4_load_n(hits + i, lanes);
+		__m128 active = ray4_active(lanes);
+		for (size_t j = 0; j < n_tris; ++j){
+			ray4_intersect_tri(&r, tris + j, j, active, &h);
+		}
+		hit4_store_n(&h, hits + i, lanes);
+	}
+#endif
+}
+
+#endif
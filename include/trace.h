@@ -0,0 +1,155 @@
+#ifndef SSE_TRACE_H
+#define SSE_TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Call counts and cycles for the vec4.h and mat4.h functions. Everything in
+ * those headers is inlined so a sampling profiler charges it to the callers,
+ * building with SSE_FIDDLE_TRACE defined (the SSE_FIDDLE_TRACE CMake option)
+ * puts an SSE_TRACE_FN at the top of each public function so the calls are
+ * counted per function instead, including the ones functions make to each
+ * other. Without it SSE_TRACE_FN is nothing and the functions below do
+ * nothing, so callers don't need to check for it.
+ *
+ * Each thread counts into its own table, which is only summed up when the
+ * stats are read. Functions are told apart by name, so the copies inlined into
+ * different files are counted together. A call costs a thread local lookup and
+ * an add. With cycles turned on it also reads the time stamp counter on entry
+ * and exit, about 20-40 cycles each, which is a lot next to a vec4_add but
+ * still says which calls dominate a frame.
+ *
+ * The counts are read while other threads may be adding to them, so a call
+ * that's in flight might be missed. Resetting should be done while the traced
+ * threads are idle (eg. between frames)
+ */
+/* Most distinct functions that can be traced, calls to any past this aren't counted */
+#define SSE_TRACE_MAX_SITES 256
+
+/* Totals for one function over all threads */
+struct sse_trace_stat {
+	const char *name;
+	uint64_t calls;
+	/* Time stamp counter ticks from entry to return, including the traced functions it calls */
+	uint64_t cycles;
+	/* The ticks not spent in other traced functions */
+	uint64_t self_cycles;
+};
+enum sse_trace_format { SSE_TRACE_TABLE, SSE_TRACE_JSON };
+
+#ifdef SSE_FIDDLE_TRACE
+#include <x86intrin.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* A traced function, its id is -1 until the first call registers it and -2 if it couldn't be */
+struct sse_trace_site {
+	const char *name;
+	int id;
+};
+struct sse_trace_counters {
+	uint64_t calls, cycles, self_cycles;
+};
+struct sse_trace_thread {
+	struct sse_trace_counters counters[SSE_TRACE_MAX_SITES];
+	/* Ticks spent in the traced calls the innermost timed call has made so far */
+	uint64_t nested;
+	struct sse_trace_thread *next;
+};
+/* An open traced call, closed when it goes out of scope */
+struct sse_trace_scope {
+	struct sse_trace_counters *counters;
+	uint64_t start, nested;
+	int timed;
+};
+extern int sse_trace_timing;
+extern __thread struct sse_trace_thread *sse_trace_tls;
+/*
+ * Register the site and the calling thread if they haven't been yet and get
+ * the thread's counters for the site, or NULL if there's no room for it
+ */
+struct sse_trace_counters* sse_trace_counters_slow(struct sse_trace_site *site);
+
+static inline struct sse_trace_scope sse_trace_begin(struct sse_trace_site *site){
+	struct sse_trace_scope s = { NULL, 0, 0, 0 };
+	int id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+	struct sse_trace_thread *t = sse_trace_tls;
+	if (id == -2){
+		return s;
+	}
+	s.counters = t && id >= 0 ? &t->counters[id] : sse_trace_counters_slow(site);
+	if (!s.counters){
+		return s;
+	}
+	t = sse_trace_tls;
+	/* Only this thread writes its counters, the atomics just keep readers from seeing torn values */
+	__atomic_store_n(&s.counters->calls, s.counters->calls + 1, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&sse_trace_timing, __ATOMIC_RELAXED)){
+		s.timed = 1;
+		s.nested = t->nested;
+		t->nested = 0;
+		s.start = __rdtsc();
+	}
+	return s;
+}
+static inline void sse_trace_end(struct sse_trace_scope *s){
+	if (!s->timed){
+		return;
+	}
+	uint64_t ticks = __rdtsc() - s->start;
+	struct sse_trace_thread *t = sse_trace_tls;
+	__atomic_store_n(&s->counters->cycles, s->counters->cycles + ticks, __ATOMIC_RELAXED);
+	__atomic_store_n(&s->counters->self_cycles, s->counters->self_cycles + ticks - t->nested, __ATOMIC_RELAXED);
+	t->nested = s->nested + ticks;
+}
+/* Count the function it's in, for the rest of its scope */
+#define SSE_TRACE_FN() \
+	static struct sse_trace_site sse_trace_site_ = { __func__, -1 }; \
+	struct sse_trace_scope sse_trace_scope_ __attribute__((cleanup(sse_trace_end))) = \
+		sse_trace_begin(&sse_trace_site_)
+
+/* Turn counting cycles on or off for all threads, it's off to start with */
+void sse_trace_set_cycles(int on);
+/* Zero the counts of every thread */
+void sse_trace_reset(void);
+/*
+ * Sum the counts of every thread for each function that's been called, most
+ * self cycles first (or most calls if there are no cycles). Writes up to max
+ * of them to out and returns how many were written
+ */
+size_t sse_trace_stats(struct sse_trace_stat *out, size_t max);
+/*
+ * Write the stats as a table or as JSON to fp, returns 0 if writing failed.
+ * Cycle columns are only in the table if there are any
+ */
+int sse_trace_write(FILE *fp, enum sse_trace_format format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#else
+
+#define SSE_TRACE_FN() ((void)0)
+
+static inline void sse_trace_set_cycles(int on){
+	(void)on;
+}
+static inline void sse_trace_reset(void){
+}
+static inline size_t sse_trace_stats(struct sse_trace_stat *out, size_t max){
+	(void)out;
+	(void)max;
+	return 0;
+}
+/* An empty table, or an empty array so JSON readers still get something to parse */
+static inline int sse_trace_write(FILE *fp, enum sse_trace_format format){
+	return format == SSE_TRACE_JSON ? fputs("[]\n", fp) >= 0 : 1;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,355 @@
+#ifndef SSE_VEC4_HPP
+#define SSE_VEC4_HPP
+
+#include "vec4.h"
+
+/*
+ * C++ wrapper for vec4_t. sse::vec4 holds just the __m128, so there's no
+ * union and no undefined behavior reading it. Components are read and written
+ * with GCC's vector subscripts, which compile to a plain movss/extractps/insertps
+ * (or nothing for x) rather than the shuffle VEC_AT does. It converts to and from
+ * vec4_t for free, so the C functions in vec4.h and mat4.h take it as is.
+ *
+ * The arithmetic operators build expression templates instead of computing
+ * anything, which are evaluated when they're assigned to a vec4. The products
+ * in a sum are fused into the running total, so a * s + b * t - c is
+ * fmadd(b, t, fmsub(a, s, c)): two FMAs, no temporaries and no separate
+ * multiplies. The fused operations come from ops<ISA>, which is specialized
+ * for each instruction set and picked at compile time. With FMA that's the
+ * real fused instructions (rounding once, so the results can differ from the
+ * C functions in the last bit), without it a multiply then an add.
+ *
+ * Expressions hold copies of their operands, so they can be kept in auto
+ * variables without dangling, but they're recomputed each time they're used
+ */
+namespace sse {
+
+/* The instruction sets the expressions can be evaluated with */
+namespace isa {
+struct sse2 {};
+struct fma {};
+#ifdef __FMA__
+typedef fma native;
+#else
+typedef sse2 native;
+#endif
+}
+/* a * b + c, a * b - c and c - a * b for an instruction set */
+template <class ISA>
+struct ops;
+template <>
+struct ops<isa::sse2> {
+	static __m128 fmadd(__m128 a, __m128 b, __m128 c){
+		return _mm_add_ps(_mm_mul_ps(a, b), c);
+	}
+	static __m128 fmsub(__m128 a, __m128 b, __m128 c){
+		return _mm_sub_ps(_mm_mul_ps(a, b), c);
+	}
+	static __m128 fnmadd(__m128 a, __m128 b, __m128 c){
+		return _mm_sub_ps(c, _mm_mul_ps(a, b));
+	}
+};
+#ifdef __FMA__
+template <>
+struct ops<isa::fma> {
+	static __m128 fmadd(__m128 a, __m128 b, __m128 c){
+		return _mm_fmadd_ps(a, b, c);
+	}
+	static __m128 fmsub(__m128 a, __m128 b, __m128 c){
+		return _mm_fmsub_ps(a, b, c);
+	}
+	static __m128 fnmadd(__m128 a, __m128 b, __m128 c){
+		return _mm_fnmadd_ps(a, b, c);
+	}
+};
+#endif
+typedef ops<isa::native> native_ops;
+
+/*
+ * Base of everything that evaluates to a vector. Each expression type E has
+ * eval() for its value, and for fusing into sums add_to(acc) for acc + E,
+ * sub_from(acc) for acc - E and minus(c) for E - c. fusable is set on the
+ * ones that do better than evaluating and then adding or subtracting
+ */
+template <class E>
+struct expr {
+	const E& self() const {
+		return static_cast<const E&>(*this);
+	}
+};
+/* Expressions that have nothing to fuse, they're just evaluated and added */
+template <class E>
+struct plain_expr : expr<E> {
+	static constexpr bool fusable = false;
+	__m128 add_to(__m128 acc) const {
+		return _mm_add_ps(acc, this->self().eval());
+	}
+	__m128 sub_from(__m128 acc) const {
+		return _mm_sub_ps(acc, this->self().eval());
+	}
+	__m128 minus(__m128 c) const {
+		return _mm_sub_ps(this->self().eval(), c);
+	}
+};
+
+class vec4 : public plain_expr<vec4> {
+public:
+	__m128 v;
+
+	vec4() = default;
+	constexpr vec4(float x, float y, float z, float w) : v{ x, y, z, w } {}
+	/* All four components set to s */
+	constexpr explicit vec4(float s) : v{ s, s, s, s } {}
+	constexpr explicit vec4(__m128 m) : v(m) {}
+	vec4(const vec4_t &c) : v(c.v) {}
+	template <class E>
+	vec4(const expr<E> &e) : v(e.self().eval()) {}
+	template <class E>
+	vec4& operator=(const expr<E> &e){
+		v = e.self().eval();
+		return *this;
+	}
+	operator vec4_t() const {
+		vec4_t c;
+		c.v = v;
+		return c;
+	}
+
+	constexpr float x() const {
+		return v[0];
+	}
+	constexpr float y() const {
+		return v[1];
+	}
+	constexpr float z() const {
+		return v[2];
+	}
+	constexpr float w() const {
+		return v[3];
+	}
+	constexpr float operator[](int i) const {
+		return v[i];
+	}
+	void set_x(float x){
+		v[0] = x;
+	}
+	void set_y(float y){
+		v[1] = y;
+	}
+	void set_z(float z){
+		v[2] = z;
+	}
+	void set_w(float w){
+		v[3] = w;
+	}
+	void set(int i, float s){
+		v[i] = s;
+	}
+
+	__m128 eval() const {
+		return v;
+	}
+	template <class E>
+	vec4& operator+=(const expr<E> &e);
+	template <class E>
+	vec4& operator-=(const expr<E> &e);
+	template <class E>
+	vec4& operator*=(const expr<E> &e);
+	template <class E>
+	vec4& operator/=(const expr<E> &e);
+	vec4& operator*=(float s);
+	vec4& operator/=(float s);
+};
+
+/* A float used in a vector expression, broadcast to all four components */
+struct scalar_expr : plain_expr<scalar_expr> {
+	float s;
+	explicit scalar_expr(float s) : s(s) {}
+	__m128 eval() const {
+		return _mm_set1_ps(s);
+	}
+};
+/* Component wise product, fused into the sum it's in */
+template <class L, class R>
+struct mul_expr : expr<mul_expr<L, R>> {
+	static constexpr bool fusable = true;
+	L l;
+	R r;
+	mul_expr(const L &l, const R &r) : l(l), r(r) {}
+	__m128 eval() const {
+		return _mm_mul_ps(l.eval(), r.eval());
+	}
+	__m128 add_to(__m128 acc) const {
+		return native_ops::fmadd(l.eval(), r.eval(), acc);
+	}
+	__m128 sub_from(__m128 acc) const {
+		return native_ops::fnmadd(l.eval(), r.eval(), acc);
+	}
+	__m128 minus(__m128 c) const {
+		return native_ops::fmsub(l.eval(), r.eval(), c);
+	}
+};
+/*
+ * Sums start from their last term if that's not a product, so the products
+ * can all be fused into it, and from the first term otherwise
+ */
+template <class L, class R>
+struct add_expr : expr<add_expr<L, R>> {
+	static constexpr bool fusable = true;
+	L l;
+	R r;
+	add_expr(const L &l, const R &r) : l(l), r(r) {}
+	__m128 eval() const {
+		return R::fusable ? r.add_to(l.eval()) : l.add_to(r.eval());
+	}
+	__m128 add_to(__m128 acc) const {
+		return r.add_to(l.add_to(acc));
+	}
+	__m128 sub_from(__m128 acc) const {
+		return r.sub_from(l.sub_from(acc));
+	}
+	__m128 minus(__m128 c) const {
+		return r.add_to(l.minus(c));
+	}
+};
+template <class L, class R>
+struct sub_expr : expr<sub_expr<L, R>> {
+	static constexpr bool fusable = true;
+	L l;
+	R r;
+	sub_expr(const L &l, const R &r) : l(l), r(r) {}
+	__m128 eval() const {
+		return R::fusable ? r.sub_from(l.eval()) : l.minus(r.eval());
+	}
+	__m128 add_to(__m128 acc) const {
+		return r.sub_from(l.add_to(acc));
+	}
+	__m128 sub_from(__m128 acc) const {
+		return r.add_to(l.sub_from(acc));
+	}
+	__m128 minus(__m128 c) const {
+		return r.sub_from(l.minus(c));
+	}
+};
+/* Negation is only an xor on its own, in a sum it flips between adding and subtracting */
+template <class E>
+struct neg_expr : expr<neg_expr<E>> {
+	static constexpr bool fusable = true;
+	E e;
+	explicit neg_expr(const E &e) : e(e) {}
+	__m128 eval() const {
+		return _mm_xor_ps(_mm_set1_ps(-0.f), e.eval());
+	}
+	__m128 add_to(__m128 acc) const {
+		return e.sub_from(acc);
+	}
+	__m128 sub_from(__m128 acc) const {
+		return e.add_to(acc);
+	}
+	__m128 minus(__m128 c) const {
+		return _mm_xor_ps(_mm_set1_ps(-0.f), e.add_to(c));
+	}
+};
+template <class L, class R>
+struct div_expr : plain_expr<div_expr<L, R>> {
+	L l;
+	R r;
+	div_expr(const L &l, const R &r) : l(l), r(r) {}
+	__m128 eval() const {
+		return _mm_div_ps(l.eval(), r.eval());
+	}
+};
+
+template <class L, class R>
+inline add_expr<L, R> operator+(const expr<L> &l, const expr<R> &r){
+	return add_expr<L, R>(l.self(), r.self());
+}
+template <class L, class R>
+inline sub_expr<L, R> operator-(const expr<L> &l, const expr<R> &r){
+	return sub_expr<L, R>(l.self(), r.self());
+}
+template <class E>
+inline neg_expr<E> operator-(const expr<E> &e){
+	return neg_expr<E>(e.self());
+}
+template <class L, class R>
+inline mul_expr<L, R> operator*(const expr<L> &l, const expr<R> &r){
+	return mul_expr<L, R>(l.self(), r.self());
+}
+template <class E>
+inline mul_expr<E, scalar_expr> operator*(const expr<E> &e, float s){
+	return mul_expr<E, scalar_expr>(e.self(), scalar_expr(s));
+}
+template <class E>
+inline mul_expr<scalar_expr, E> operator*(float s, const expr<E> &e){
+	return mul_expr<scalar_expr, E>(scalar_expr(s), e.self());
+}
+template <class L, class R>
+inline div_expr<L, R> operator/(const expr<L> &l, const expr<R> &r){
+	return div_expr<L, R>(l.self(), r.self());
+}
+template <class E>
+inline div_expr<E, scalar_expr> operator/(const expr<E> &e, float s){
+	return div_expr<E, scalar_expr>(e.self(), scalar_expr(s));
+}
+
+template <class E>
+inline vec4& vec4::operator+=(const expr<E> &e){
+	return *this = *this + e;
+}
+template <class E>
+inline vec4& vec4::operator-=(const expr<E> &e){
+	return *this = *this - e;
+}
+template <class E>
+inline vec4& vec4::operator*=(const expr<E> &e){
+	return *this = *this * e;
+}
+template <class E>
+inline vec4& vec4::operator/=(const expr<E> &e){
+	return *this = *this / e;
+}
+inline vec4& vec4::operator*=(float s){
+	return *this = *this * s;
+}
+inline vec4& vec4::operator/=(float s){
+	return *this = *this / s;
+}
+
+/* True if all four components are equal, like vec4_eq */
+template <class L, class R>
+inline bool operator==(const expr<L> &l, const expr<R> &r){
+	return _mm_movemask_ps(_mm_cmpeq_ps(l.self().eval(), r.self().eval())) == 0xf;
+}
+template <class L, class R>
+inline bool operator!=(const expr<L> &l, const expr<R> &r){
+	return !(l == r);
+}
+
+/* The vec4.h geometric functions, these evaluate their arguments */
+inline float dot(const vec4 &a, const vec4 &b){
+	return vec4_dot(a, b);
+}
+inline float length(const vec4 &a){
+	return vec4_len(a);
+}
+inline vec4 normalize(const vec4 &a){
+	return vec4_normalize(a);
+}
+inline vec4 normalize_fast(const vec4 &a){
+	return vec4_normalize_fast(a);
+}
+/* Cross product of x, y and z, w is set to 0 */
+inline vec4 cross(const vec4 &a, const vec4 &b){
+	return vec4_cross(a, b);
+}
+inline vec4 min(const vec4 &a, const vec4 &b){
+	return vec4(_mm_min_ps(a.v, b.v));
+}
+inline vec4 max(const vec4 &a, const vec4 &b){
+	return vec4(_mm_max_ps(a.v, b.v));
+}
+
+}
+
+#endif
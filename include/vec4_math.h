@@ -0,0 +1,226 @@
+#ifndef SSE_VEC4_MATH_H
+#define SSE_VEC4_MATH_H
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include "vec4.h"
+
+/*
+ * Vectorized elementary functions, each computes the function for all 4 lanes at
+ * once. The polynomials are the Cephes single precision minimax ones. Errors are
+ * the max measured against double precision libm:
+ *   sin, cos: 1.5 ulp for |x| <= pi, absolute error under 8e-8 for |x| <= 8192.
+ *     Past 8192 the range reduction starts losing precision
+ *   tan: 3 ulp for |x| < 1.5, it's sin / cos so the error grows near the poles
+ *   exp: 1 ulp including denormal results, overflows to inf past 88.72
+ *   log: 1 ulp, log(0) = -inf, negative inputs give NaN and denormal inputs are
+ *     treated as the smallest normal float
+ *   asin: 2.5 ulp, acos: 1.5 ulp, inputs outside [-1, 1] give NaN
+ * The _ps versions work on raw __m128 so they can be used on vec4x4_t lanes too
+ */
+
+/* Compute the sine and cosine of each element of x */
+static inline void vec4_sincos_ps(__m128 x, __m128 *s, __m128 *c){
+	const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	__m128 sign = _mm_and_ps(x, sign_mask);
+	x = _mm_andnot_ps(sign_mask, x);
+	/* Find which octant we're in, rounding up to an even octant */
+	__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+	j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	__m128 y = _mm_cvtepi32_ps(j);
+	/* Subtract y * pi / 4 in 3 parts to keep extra precision */
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+	/* Octants 2 and 6 swap which polynomial gives sin and cos */
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(
+		_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+	__m128 sin_sign = _mm_xor_ps(sign, _mm_castsi128_ps(
+		_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29)));
+	__m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(
+		_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 pc = vec4_madd_ps(_mm_set1_ps(2.443315711809948e-5f), z, _mm_set1_ps(-1.388731625493765e-3f));
+	pc = vec4_madd_ps(pc, z, _mm_set1_ps(4.166664568298827e-2f));
+	pc = _mm_mul_ps(_mm_mul_ps(pc, z), z);
+	pc = _mm_sub_ps(pc, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	pc = _mm_add_ps(pc, _mm_set1_ps(1.f));
+
+	__m128 ps = vec4_madd_ps(_mm_set1_ps(-1.9515295891e-4f), z, _mm_set1_ps(8.3321608736e-3f));
+	ps = vec4_madd_ps(ps, z, _mm_set1_ps(-1.6666654611e-1f));
+	ps = vec4_madd_ps(_mm_mul_ps(ps, z), x, x);
+
+	__m128 rs = _mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps));
+	__m128 rc = _mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc));
+	*s = _mm_xor_ps(rs, sin_sign);
+	*c = _mm_xor_ps(rc, cos_sign);
+}
+static inline __m128 vec4_sin_ps(__m128 x){
+	__m128 s, c;
+	vec4_sincos_ps(x, &s, &c);
+	return s;
+}
+static inline __m128 vec4_cos_ps(__m128 x){
+	__m128 s, c;
+	vec4_sincos_ps(x, &s, &c);
+	return c;
+}
+static inline __m128 vec4_tan_ps(__m128 x){
+	__m128 s, c;
+	vec4_sincos_ps(x, &s, &c);
+	return _mm_div_ps(s, c);
+}
+/* Compute e^x for each element of x */
+static inline __m128 vec4_exp_ps(__m128 x){
+	__m128 nan = _mm_cmpunord_ps(x, x);
+	/* Past these the result is 0 or inf anyway */
+	x = _mm_min_ps(x, _mm_set1_ps(89.f));
+	x = _mm_max_ps(x, _mm_set1_ps(-104.f));
+	/* e^x = 2^n * e^r, n = round(x / ln 2) */
+	__m128 fx = vec4_madd_ps(x, _mm_set1_ps(1.44269504088896341f), _mm_set1_ps(0.5f));
+	/* Floor by truncating then fixing up negative values that got rounded up */
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+	fx = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, fx), _mm_set1_ps(1.f)));
+	/* Subtract n * ln 2 in 2 parts to keep extra precision */
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440e-4f)));
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 y = vec4_madd_ps(_mm_set1_ps(1.9875691500e-4f), x, _mm_set1_ps(1.3981999507e-3f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(8.3334519073e-3f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(4.1665795894e-2f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(1.6666665459e-1f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(5.0000001201e-1f));
+	y = vec4_madd_ps(y, z, x);
+	y = _mm_add_ps(y, _mm_set1_ps(1.f));
+
+	/*
+	 * n is in [-150, 129] so 2^n is applied in two halves that are each a
+	 * normal float, letting the multiply round to inf or a denormal as needed
+	 */
+	__m128i n = _mm_cvttps_epi32(fx);
+	__m128i n_lo = _mm_srai_epi32(n, 1);
+	__m128i n_hi = _mm_sub_epi32(n, n_lo);
+	__m128 pow_lo = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n_lo, _mm_set1_epi32(127)), 23));
+	__m128 pow_hi = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n_hi, _mm_set1_epi32(127)), 23));
+	y = _mm_mul_ps(_mm_mul_ps(y, pow_lo), pow_hi);
+	return _mm_or_ps(y, nan);
+}
+/* Compute the natural log of each element of x */
+static inline __m128 vec4_log_ps(__m128 x){
+	__m128 invalid = _mm_cmpnge_ps(x, _mm_setzero_ps());
+	__m128 zero = _mm_cmpeq_ps(x, _mm_setzero_ps());
+	__m128 inf = _mm_cmpeq_ps(x, _mm_set1_ps(INFINITY));
+	/* Flush denormals to the smallest normal */
+	x = _mm_max_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x00800000)));
+	/* Split into the exponent and mantissa in [0.5, 1) */
+	__m128i xi = _mm_castps_si128(x);
+	__m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(xi, 23), _mm_set1_epi32(126)));
+	x = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(xi, _mm_set1_epi32(0x007fffff)),
+		_mm_set1_epi32(0x3f000000)));
+	/* Keep the mantissa in [sqrt(0.5), sqrt(2)) for the polynomial */
+	__m128 lt = _mm_cmplt_ps(x, _mm_set1_ps(0.707106781186547524f));
+	e = _mm_sub_ps(e, _mm_and_ps(lt, _mm_set1_ps(1.f)));
+	x = _mm_sub_ps(_mm_add_ps(x, _mm_and_ps(lt, x)), _mm_set1_ps(1.f));
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 y = vec4_madd_ps(_mm_set1_ps(7.0376836292e-2f), x, _mm_set1_ps(-1.1514610310e-1f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(1.1676998740e-1f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(-1.2420140846e-1f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(1.4249322787e-1f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(-1.6668057665e-1f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(2.0000714765e-1f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(-2.4999993993e-1f));
+	y = vec4_madd_ps(y, x, _mm_set1_ps(3.3333331174e-1f));
+	y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+	y = vec4_madd_ps(e, _mm_set1_ps(-2.12194440e-4f), y);
+	y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	x = _mm_add_ps(x, y);
+	x = vec4_madd_ps(e, _mm_set1_ps(0.693359375f), x);
+
+	x = _mm_or_ps(_mm_andnot_ps(inf, x), _mm_and_ps(inf, _mm_set1_ps(INFINITY)));
+	x = _mm_or_ps(_mm_andnot_ps(zero, x), _mm_and_ps(zero, _mm_set1_ps(-INFINITY)));
+	return _mm_or_ps(x, invalid);
+}
+/*
+ * Compute asin of |x| for x in [0, 1] split into the polynomial result p and
+ * a mask of the lanes that used the half angle identity, where asin(x) = pi/2 - 2p
+ */
+static inline __m128 vec4_asin_abs_ps(__m128 a, __m128 *big){
+	*big = _mm_cmpgt_ps(a, _mm_set1_ps(0.5f));
+	/* For |x| > 0.5 use asin(x) = pi/2 - 2 asin(sqrt((1 - x) / 2)) */
+	__m128 zb = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.f), a), _mm_set1_ps(0.5f));
+	__m128 z = _mm_or_ps(_mm_and_ps(*big, zb), _mm_andnot_ps(*big, _mm_mul_ps(a, a)));
+	__m128 x = _mm_or_ps(_mm_and_ps(*big, _mm_sqrt_ps(zb)), _mm_andnot_ps(*big, a));
+	__m128 p = vec4_madd_ps(_mm_set1_ps(4.2163199048e-2f), z, _mm_set1_ps(2.4181311049e-2f));
+	p = vec4_madd_ps(p, z, _mm_set1_ps(4.5470025998e-2f));
+	p = vec4_madd_ps(p, z, _mm_set1_ps(7.4953002686e-2f));
+	p = vec4_madd_ps(p, z, _mm_set1_ps(1.6666752422e-1f));
+	return vec4_madd_ps(_mm_mul_ps(p, z), x, x);
+}
+/* Compute the arcsine of each element of x */
+static inline __m128 vec4_asin_ps(__m128 x){
+	const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	__m128 sign = _mm_and_ps(x, sign_mask);
+	__m128 a = _mm_andnot_ps(sign_mask, x);
+	__m128 big;
+	__m128 p = vec4_asin_abs_ps(a, &big);
+	__m128 pb = _mm_sub_ps(_mm_set1_ps(1.57079632679489661923f), _mm_add_ps(p, p));
+	p = _mm_or_ps(_mm_and_ps(big, pb), _mm_andnot_ps(big, p));
+	return _mm_or_ps(_mm_xor_ps(p, sign), _mm_cmpgt_ps(a, _mm_set1_ps(1.f)));
+}
+/* Compute the arccosine of each element of x */
+static inline __m128 vec4_acos_ps(__m128 x){
+	const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	__m128 neg = _mm_cmplt_ps(x, _mm_setzero_ps());
+	__m128 a = _mm_andnot_ps(sign_mask, x);
+	__m128 big;
+	__m128 p = vec4_asin_abs_ps(a, &big);
+	/*
+	 * For |x| > 0.5, acos(|x|) = 2p directly which avoids cancellation near 1,
+	 * otherwise acos(x) = pi/2 - asin(x)
+	 */
+	__m128 two_p = _mm_add_ps(p, p);
+	__m128 rb = _mm_or_ps(_mm_and_ps(neg, _mm_sub_ps(_mm_set1_ps(3.14159265358979323846f), two_p)),
+		_mm_andnot_ps(neg, two_p));
+	__m128 rs = _mm_sub_ps(_mm_set1_ps(1.57079632679489661923f),
+		_mm_or_ps(_mm_and_ps(neg, _mm_xor_ps(p, sign_mask)), _mm_andnot_ps(neg, p)));
+	__m128 r = _mm_or_ps(_mm_and_ps(big, rb), _mm_andnot_ps(big, rs));
+	return _mm_or_ps(r, _mm_cmpgt_ps(a, _mm_set1_ps(1.f)));
+}
+/* vec4_t versions, the function is applied to each component */
+static inline void vec4_sincos(vec4_t v, vec4_t *s, vec4_t *c){
+	vec4_sincos_ps(v.v, &s->v, &c->v);
+}
+static inline vec4_t vec4_sin(vec4_t v){
+	v.v = vec4_sin_ps(v.v);
+	return v;
+}
+static inline vec4_t vec4_cos(vec4_t v){
+	v.v = vec4_cos_ps(v.v);
+	return v;
+}
+static inline vec4_t vec4_tan(vec4_t v){
+	v.v = vec4_tan_ps(v.v);
+	return v;
+}
+static inline vec4_t vec4_exp(vec4_t v){
+	v.v = vec4_exp_ps(v.v);
+	return v;
+}
+static inline vec4_t vec4_log(vec4_t v){
+	v.v = vec4_log_ps(v.v);
+	return v;
+}
+static inline vec4_t vec4_asin(vec4_t v){
+	v.v = vec4_asin_ps(v.v);
+	return v;
+}
+static inline vec4_t vec4_acos(vec4_t v){
+	v.v = vec4_acos_ps(v.v);
+	return v;
+}
+
+#endif
+
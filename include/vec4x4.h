@@ -0,0 +1,146 @@
+#ifndef SSE_VEC4X4_H
+#define SSE_VEC4X4_H
+
+#include <xmmintrin.h>
+#include <stddef.h>
+#include "vec4.h"
+
+/*
+ * Packet of 4 vectors stored as a structure of arrays, lane i of x, y, z and w
+ * holds the components of the i'th vector. Everything here works on all 4 vectors
+ * at once, so a dot or cross product is just vertical multiplies and adds with no
+ * shuffling or horizontal sums
+ */
+struct vec4x4_t {
+	__m128 x, y, z, w;
+} ALIGN_16;
+typedef struct vec4x4_t vec4x4_t;
+/* Create a packet with the vector v in each lane */
+static inline vec4x4_t vec4x4_splat(vec4_t v){
+	vec4x4_t p;
+	p.x = _mm_shuffle_ps(v.v, v.v, _MM_SHUFFLE(0, 0, 0, 0));
+	p.y = _mm_shuffle_ps(v.v, v.v, _MM_SHUFFLE(1, 1, 1, 1));
+	p.z = _mm_shuffle_ps(v.v, v.v, _MM_SHUFFLE(2, 2, 2, 2));
+	p.w = _mm_shuffle_ps(v.v, v.v, _MM_SHUFFLE(3, 3, 3, 3));
+	return p;
+}
+/* Gather 4 consecutive AoS vectors from v into a packet */
+static inline vec4x4_t vec4x4_load(const vec4_t *v){
+	vec4x4_t p;
+	p.x = v[0].v;
+	p.y = v[1].v;
+	p.z = v[2].v;
+	p.w = v[3].v;
+	_MM_TRANSPOSE4_PS(p.x, p.y, p.z, p.w);
+	return p;
+}
+/*
+ * Gather the first n (< 4) vectors from v into a packet, for the tail of an
+ * array. The unused lanes are zero
+ */
+static inline vec4x4_t vec4x4_load_n(const vec4_t *v, size_t n){
+	vec4_t tmp[4];
+	for (size_t i = 0; i < 4; ++i){
+		tmp[i].v = i < n ? v[i].v : _mm_setzero_ps();
+	}
+	return vec4x4_load(tmp);
+}
+/* Scatter the packet back out to 4 consecutive AoS vectors in v */
+static inline void vec4x4_store(vec4x4_t p, vec4_t *v){
+	_MM_TRANSPOSE4_PS(p.x, p.y, p.z, p.w);
+	v[0].v = p.x;
+	v[1].v = p.y;
+	v[2].v = p.z;
+	v[3].v = p.w;
+}
+/* Scatter only the first n (< 4) vectors of the packet out to v */
+static inline void vec4x4_store_n(vec4x4_t p, vec4_t *v, size_t n){
+	vec4_t tmp[4];
+	vec4x4_store(p, tmp);
+	for (size_t i = 0; i < n; ++i){
+		v[i] = tmp[i];
+	}
+}
+/* Arithmetic operations */
+static inline vec4x4_t vec4x4_add(vec4x4_t a, vec4x4_t b){
+	a.x = _mm_add_ps(a.x, b.x);
+	a.y = _mm_add_ps(a.y, b.y);
+	a.z = _mm_add_ps(a.z, b.z);
+	a.w = _mm_add_ps(a.w, b.w);
+	return a;
+}
+static inline vec4x4_t vec4x4_sub(vec4x4_t a, vec4x4_t b){
+	a.x = _mm_sub_ps(a.x, b.x);
+	a.y = _mm_sub_ps(a.y, b.y);
+	a.z = _mm_sub_ps(a.z, b.z);
+	a.w = _mm_sub_ps(a.w, b.w);
+	return a;
+}
+static inline vec4x4_t vec4x4_mult(vec4x4_t a, vec4x4_t b){
+	a.x = _mm_mul_ps(a.x, b.x);
+	a.y = _mm_mul_ps(a.y, b.y);
+	a.z = _mm_mul_ps(a.z, b.z);
+	a.w = _mm_mul_ps(a.w, b.w);
+	return a;
+}
+/* Scale vector i in the packet by lane i of s */
+static inline vec4x4_t vec4x4_scale_v(vec4x4_t a, __m128 s){
+	a.x = _mm_mul_ps(a.x, s);
+	a.y = _mm_mul_ps(a.y, s);
+	a.z = _mm_mul_ps(a.z, s);
+	a.w = _mm_mul_ps(a.w, s);
+	return a;
+}
+static inline vec4x4_t vec4x4_scale(vec4x4_t a, float s){
+	return vec4x4_scale_v(a, _mm_set1_ps(s));
+}
+/* Geometric operations, results for vector i are in lane i */
+static inline __m128 vec4x4_dot(vec4x4_t a, vec4x4_t b){
+	__m128 d = _mm_mul_ps(a.x, b.x);
+	d = _mm_add_ps(d, _mm_mul_ps(a.y, b.y));
+	d = _mm_add_ps(d, _mm_mul_ps(a.z, b.z));
+	return _mm_add_ps(d, _mm_mul_ps(a.w, b.w));
+}
+/* Dot product of the x, y and z components only */
+static inline __m128 vec4x4_dot3(vec4x4_t a, vec4x4_t b){
+	return vec4_madd_ps(a.x, b.x, vec4_madd_ps(a.y, b.y, _mm_mul_ps(a.z, b.z)));
+}
+static inline __m128 vec4x4_len(vec4x4_t a){
+	return _mm_sqrt_ps(vec4x4_dot(a, a));
+}
+static inline vec4x4_t vec4x4_normalize(vec4x4_t a){
+	__m128 l = vec4x4_len(a);
+	a.x = _mm_div_ps(a.x, l);
+	a.y = _mm_div_ps(a.y, l);
+	a.z = _mm_div_ps(a.z, l);
+	a.w = _mm_div_ps(a.w, l);
+	return a;
+}
+/* Like vec4_cross the vectors are treated as 3-vectors and w is set to 0 */
+static inline vec4x4_t vec4x4_cross(vec4x4_t a, vec4x4_t b){
+	vec4x4_t c;
+	c.x = _mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y));
+	c.y = _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z));
+	c.z = _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x));
+	c.w = _mm_setzero_ps();
+	return c;
+}
+/* Comparisons */
+/* Returns a 4 bit mask, bit i is set if vector i of a and b are equal */
+static inline int vec4x4_eq(vec4x4_t a, vec4x4_t b){
+	__m128 m = _mm_and_ps(_mm_cmpeq_ps(a.x, b.x), _mm_cmpeq_ps(a.y, b.y));
+	m = _mm_and_ps(m, _mm_cmpeq_ps(a.z, b.z));
+	m = _mm_and_ps(m, _mm_cmpeq_ps(a.w, b.w));
+	return _mm_movemask_ps(m);
+}
+/* Handy utility for printing packets, one vector per line */
+static inline void vec4x4_print(vec4x4_t p){
+	vec4_t v[4];
+	vec4x4_store(p, v);
+	for (int i = 0; i < 4; ++i){
+		vec4_print(v[i]);
+	}
+}
+
+#endif
+
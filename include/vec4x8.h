@@ -0,0 +1,180 @@
+#ifndef SSE_VEC4X8_H
+#define SSE_VEC4X8_H
+
+/*
+ * 8 wide version of vec4x4_t for AVX, only available when compiling with AVX
+ * enabled
+ */
+#ifdef __AVX__
+
+#include <immintrin.h>
+#include <stddef.h>
+#include "vec4.h"
+
+/*
+ * Packet of 8 vectors stored as a structure of arrays, lane i of x, y, z and w
+ * holds the components of the i'th vector
+ */
+struct vec4x8_t {
+	__m256 x, y, z, w;
+} ALIGN_32;
+typedef struct vec4x8_t vec4x8_t;
+/* Create a packet with the vector v in each lane */
+static inline vec4x8_t vec4x8_splat(vec4_t v){
+	vec4x8_t p;
+	__m256 b = _mm256_broadcast_ps(&v.v);
+	p.x = _mm256_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0));
+	p.y = _mm256_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1));
+	p.z = _mm256_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2));
+	p.w = _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3));
+	return p;
+}
+/*
+ * Transpose within each 128 bit half, so 4 registers holding vectors
+ * [a|e], [b|f], [c|g], [d|h] become the x, y, z, w components of [abcd|efgh]
+ * and back again
+ */
+static inline void vec4x8_transpose(__m256 *r0, __m256 *r1, __m256 *r2, __m256 *r3){
+	__m256 t0 = _mm256_unpacklo_ps(*r0, *r1);
+	__m256 t1 = _mm256_unpacklo_ps(*r2, *r3);
+	__m256 t2 = _mm256_unpackhi_ps(*r0, *r1);
+	__m256 t3 = _mm256_unpackhi_ps(*r2, *r3);
+	*r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+	*r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+	*r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	*r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+/* Gather 8 consecutive AoS vectors from v into a packet */
+static inline vec4x8_t vec4x8_load(const vec4_t *v){
+	vec4x8_t p;
+	p.x = _mm256_insertf128_ps(_mm256_castps128_ps256(v[0].v), v[4].v, 1);
+	p.y = _mm256_insertf128_ps(_mm256_castps128_ps256(v[1].v), v[5].v, 1);
+	p.z = _mm256_insertf128_ps(_mm256_castps128_ps256(v[2].v), v[6].v, 1);
+	p.w = _mm256_insertf128_ps(_mm256_castps128_ps256(v[3].v), v[7].v, 1);
+	vec4x8_transpose(&p.x, &p.y, &p.z, &p.w);
+	return p;
+}
+/*
+ * Gather the first n (< 8) vectors from v into a packet, for the tail of an
+ * array. The unused lanes are zero
+ */
+static inline vec4x8_t vec4x8_load_n(const vec4_t *v, size_t n){
+	vec4_t tmp[8];
+	for (size_t i = 0; i < 8; ++i){
+		tmp[i].v = i < n ? v[i].v : _mm_setzero_ps();
+	}
+	return vec4x8_load(tmp);
+}
+/* Scatter the packet back out to 8 consecutive AoS vectors in v */
+static inline void vec4x8_store(vec4x8_t p, vec4_t *v){
+	vec4x8_transpose(&p.x, &p.y, &p.z, &p.w);
+	v[0].v = _mm256_castps256_ps128(p.x);
+	v[1].v = _mm256_castps256_ps128(p.y);
+	v[2].v = _mm256_castps256_ps128(p.z);
+	v[3].v = _mm256_castps256_ps128(p.w);
+	v[4].v = _mm256_extractf128_ps(p.x, 1);
+	v[5].v = _mm256_extractf128_ps(p.y, 1);
+	v[6].v = _mm256_extractf128_ps(p.z, 1);
+	v[7].v = _mm256_extractf128_ps(p.w, 1);
+}
+/* Scatter only the first n (< 8) vectors of the packet out to v */
+static inline void vec4x8_store_n(vec4x8_t p, vec4_t *v, size_t n){
+	vec4_t tmp[8];
+	vec4x8_store(p, tmp);
+	for (size_t i = 0; i < n; ++i){
+		v[i] = tmp[i];
+	}
+}
+/* Compute a * b + c, as a single fused multiply-add if the target has FMA */
+static inline __m256 vec4x8_madd_ps(__m256 a, __m256 b, __m256 c){
+#ifdef __FMA__
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+/* Arithmetic operations */
+static inline vec4x8_t vec4x8_add(vec4x8_t a, vec4x8_t b){
+	a.x = _mm256_add_ps(a.x, b.x);
+	a.y = _mm256_add_ps(a.y, b.y);
+	a.z = _mm256_add_ps(a.z, b.z);
+	a.w = _mm256_add_ps(a.w, b.w);
+	return a;
+}
+static inline vec4x8_t vec4x8_sub(vec4x8_t a, vec4x8_t b){
+	a.x = _mm256_sub_ps(a.x, b.x);
+	a.y = _mm256_sub_ps(a.y, b.y);
+	a.z = _mm256_sub_ps(a.z, b.z);
+	a.w = _mm256_sub_ps(a.w, b.w);
+	return a;
+}
+static inline vec4x8_t vec4x8_mult(vec4x8_t a, vec4x8_t b){
+	a.x = _mm256_mul_ps(a.x, b.x);
+	a.y = _mm256_mul_ps(a.y, b.y);
+	a.z = _mm256_mul_ps(a.z, b.z);
+	a.w = _mm256_mul_ps(a.w, b.w);
+	return a;
+}
+/* Scale vector i in the packet by lane i of s */
+static inline vec4x8_t vec4x8_scale_v(vec4x8_t a, __m256 s){
+	a.x = _mm256_mul_ps(a.x, s);
+	a.y = _mm256_mul_ps(a.y, s);
+	a.z = _mm256_mul_ps(a.z, s);
+	a.w = _mm256_mul_ps(a.w, s);
+	return a;
+}
+static inline vec4x8_t vec4x8_scale(vec4x8_t a, float s){
+	return vec4x8_scale_v(a, _mm256_set1_ps(s));
+}
+/* Geometric operations, results for vector i are in lane i */
+static inline __m256 vec4x8_dot(vec4x8_t a, vec4x8_t b){
+	__m256 d = _mm256_mul_ps(a.x, b.x);
+	d = _mm256_add_ps(d, _mm256_mul_ps(a.y, b.y));
+	d = _mm256_add_ps(d, _mm256_mul_ps(a.z, b.z));
+	return _mm256_add_ps(d, _mm256_mul_ps(a.w, b.w));
+}
+/* Dot product of the x, y and z components only */
+static inline __m256 vec4x8_dot3(vec4x8_t a, vec4x8_t b){
+	return vec4x8_madd_ps(a.x, b.x, vec4x8_madd_ps(a.y, b.y, _mm256_mul_ps(a.z, b.z)));
+}
+static inline __m256 vec4x8_len(vec4x8_t a){
+	return _mm256_sqrt_ps(vec4x8_dot(a, a));
+}
+static inline vec4x8_t vec4x8_normalize(vec4x8_t a){
+	__m256 l = vec4x8_len(a);
+	a.x = _mm256_div_ps(a.x, l);
+	a.y = _mm256_div_ps(a.y, l);
+	a.z = _mm256_div_ps(a.z, l);
+	a.w = _mm256_div_ps(a.w, l);
+	return a;
+}
+/* Like vec4_cross the vectors are treated as 3-vectors and w is set to 0 */
+static inline vec4x8_t vec4x8_cross(vec4x8_t a, vec4x8_t b){
+	vec4x8_t c;
+	c.x = _mm256_sub_ps(_mm256_mul_ps(a.y, b.z), _mm256_mul_ps(a.z, b.y));
+	c.y = _mm256_sub_ps(_mm256_mul_ps(a.z, b.x), _mm256_mul_ps(a.x, b.z));
+	c.z = _mm256_sub_ps(_mm256_mul_ps(a.x, b.y), _mm256_mul_ps(a.y, b.x));
+	c.w = _mm256_setzero_ps();
+	return c;
+}
+/* Comparisons */
+/* Returns an 8 bit mask, bit i is set if vector i of a and b are equal */
+static inline int vec4x8_eq(vec4x8_t a, vec4x8_t b){
+	__m256 m = _mm256_and_ps(_mm256_cmp_ps(a.x, b.x, _CMP_EQ_OQ),
+		_mm256_cmp_ps(a.y, b.y, _CMP_EQ_OQ));
+	m = _mm256_and_ps(m, _mm256_cmp_ps(a.z, b.z, _CMP_EQ_OQ));
+	m = _mm256_and_ps(m, _mm256_cmp_ps(a.w, b.w, _CMP_EQ_OQ));
+	return _mm256_movemask_ps(m);
+}
+/* Handy utility for printing packets, one vector per line */
+static inline void vec4x8_print(vec4x8_t p){
+	vec4_t v[8];
+	vec4x8_store(p, v);
+	for (int i = 0; i < 8; ++i){
+		vec4_print(v[i]);
+	}
+}
+
+#endif
+#endif
+
@@ -0,0 +1,450 @@
+#ifndef SSE_VERTEX_PACK_H
+#define SSE_VERTEX_PACK_H
+
+#include <float.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <emmintrin.h>
+#if defined(__F16C__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+#include "vec4.h"
+#include "mat4.h"
+
+/*
+ * Convert vec4_t arrays to and from the smaller vertex attribute formats GL
+ * can read directly, so big meshes don't have to be uploaded as 4 32 bit
+ * floats per attribute. The packed arrays are tightly packed, one attribute
+ * stream per array, and only need the alignment of their element type. The
+ * formats and the most they're off by after a round trip:
+ *
+ * half     4 x GL_HALF_FLOAT, 8 bytes. Rounded to nearest even, so relative
+ *          error at most 2^-11 (4.9e-4) for |x| from 6.1e-5 to 65504, absolute
+ *          error at most 2^-25 (3e-8) below that (subnormal halves). Anything
+ *          at or above 65520 becomes inf, NaNs stay NaNs but lose their payload
+ *          without F16C
+ * snorm16  4 x GL_SHORT normalized, 8 bytes. Clamped to [-1, 1], absolute error
+ *          at most 0.5 / 32767 (1.53e-5)
+ * unorm8   4 x GL_UNSIGNED_BYTE normalized, 4 bytes. Clamped to [0, 1],
+ *          absolute error at most 0.5 / 255 (1.96e-3)
+ * oct      2 x GL_SHORT normalized, 4 bytes, for unit normals. The direction is
+ *          projected onto the octahedron |x| + |y| + |z| = 1, the lower half
+ *          folded out over the upper, and the x and y stored as snorm16. The
+ *          decoded normal is within 0.004 degrees (7e-5 radians) of the
+ *          original. w isn't stored and comes back as 0
+ *
+ * Halves use F16C's vcvtps2ph/vcvtph2ps when it's there and integer SSE2 bit
+ * twiddling that rounds the same way otherwise. The fused vpack_xform_*
+ * functions run the mat4_xform_n transforms and quantize the results while
+ * they're still in registers, so a compressed vertex buffer is written in one
+ * pass without a full precision copy in between
+ */
+
+/* Pick a where mask is set and b where it isn't */
+static inline __m128i vpack_select_si128(__m128i mask, __m128i a, __m128i b){
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+/*
+ * Convert the 4 floats in v to halves in the low 64 bits of the result, the
+ * high 64 bits are 0. Without F16C this is float_to_half_fast3_rtne from
+ * Fabian Giesen's half conversion gist done 4 at a time
+ */
+static inline __m128i vpack_half_ps(__m128 v){
+#ifdef __F16C__
+	return _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+#else
+	const __m128i x = _mm_castps_si128(v);
+	const __m128i sign = _mm_and_si128(x, _mm_set1_epi32(0x80000000));
+	const __m128i a = _mm_xor_si128(x, sign);
+	/* At or above 65520 rounds to inf, NaNs get the quiet bit */
+	__m128i big = _mm_cmpgt_epi32(a, _mm_set1_epi32(((127 + 16) << 23) - 1));
+	__m128i nan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7f800000));
+	__m128i special = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(nan, _mm_set1_epi32(0x200)));
+	/*
+	 * Below the smallest normal half, adding 0.5 lines the half's mantissa up with
+	 * the bottom of the float's and the add does the rounding
+	 */
+	__m128i tiny = _mm_cmplt_epi32(a, _mm_set1_epi32(113 << 23));
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(126 << 23));
+	__m128i sub = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(a), magic)),
+		_mm_castps_si128(magic));
+	/* Normal halves rebias the exponent and round to nearest even on the 13 bits dropped */
+	__m128i odd = _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(1));
+	__m128i norm = _mm_add_epi32(a, _mm_set1_epi32((int)(((15u - 127u) << 23) + 0xfff)));
+	norm = _mm_srli_epi32(_mm_add_epi32(norm, odd), 13);
+	__m128i h = vpack_select_si128(big, special, vpack_select_si128(tiny, sub, norm));
+	h = _mm_or_si128(h, _mm_srli_epi32(sign, 16));
+	/* Sign extend the low 16 bits so packing them doesn't saturate */
+	h = _mm_srai_epi32(_mm_slli_epi32(h, 16), 16);
+	return _mm_packs_epi32(h, _mm_setzero_si128());
+#endif
+}
+/*
+ * Convert the 4 halves in the low 64 bits of h to floats, this is exact.
+ * Without F16C it's half_to_float from the same gist
+ */
+static inline __m128 vpack_unhalf_ps(__m128i h){
+#ifdef __F16C__
+	return _mm_cvtph_ps(h);
+#else
+	const __m128i x = _mm_unpacklo_epi16(h, _mm_setzero_si128());
+	__m128i o = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x7fff)), 13);
+	const __m128i exp = _mm_and_si128(o, _mm_set1_epi32(0x7c00 << 13));
+	o = _mm_add_epi32(o, _mm_set1_epi32((127 - 15) << 23));
+	/* Infs and NaNs get the rest of the float exponent */
+	__m128i infnan = _mm_cmpeq_epi32(exp, _mm_set1_epi32(0x7c00 << 13));
+	o = _mm_add_epi32(o, _mm_and_si128(infnan, _mm_set1_epi32((128 - 16) << 23)));
+	/* Zeros and subnormals are renormalized by subtracting the smallest normal */
+	__m128i zero = _mm_cmpeq_epi32(exp, _mm_setzero_si128());
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(113 << 23));
+	__m128 sub = _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(o, _mm_set1_epi32(1 << 23))), magic);
+	o = vpack_select_si128(zero, _mm_castps_si128(sub), o);
+	o = _mm_or_si128(o, _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x8000)), 16));
+	return _mm_castsi128_ps(o);
+#endif
+}
+/* Convert n vectors to halves, out gets 4 per vector */
+static inline void vpack_half_n(const vec4_t *in, uint16_t *out, size_t n){
+	const float *src = (const float*)in;
+	size_t i = 0;
+#if defined(__AVX512F__)
+	for (; i + 4 <= n; i += 4){
+		_mm256_storeu_si256((__m256i*)(out + 4 * i),
+			_mm512_cvtps_ph(_mm512_loadu_ps(src + 4 * i), _MM_FROUND_TO_NEAREST_INT));
+	}
+#elif defined(__AVX__) && defined(__F16C__)
+	for (; i + 2 <= n; i += 2){
+		_mm_storeu_si128((__m128i*)(out + 4 * i),
+			_mm256_cvtps_ph(_mm256_loadu_ps(src + 4 * i), _MM_FROUND_TO_NEAREST_INT));
+	}
+#endif
+	for (; i + 2 <= n; i += 2){
+		__m128i a = vpack_half_ps(_mm_loadu_ps(src + 4 * i));
+		__m128i b = vpack_half_ps(_mm_loadu_ps(src + 4 * i + 4));
+		_mm_storeu_si128((__m128i*)(out + 4 * i), _mm_unpacklo_epi64(a, b));
+	}
+	if (i < n){
+		_mm_storel_epi64((__m128i*)(out + 4 * i), vpack_half_ps(_mm_loadu_ps(src + 4 * i)));
+	}
+}
+/* Convert n vectors of 4 halves back to floats */
+static inline void vpack_unhalf_n(const uint16_t *in, vec4_t *out, size_t n){
+	float *dst = (float*)out;
+	size_t i = 0;
+#if defined(__AVX512F__)
+	for (; i + 4 <= n; i += 4){
+		_mm512_storeu_ps(dst + 4 * i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(in + 4 * i))));
+	}
+#elif defined(__AVX__) && defined(__F16C__)
+	for (; i + 2 <= n; i += 2){
+		_mm256_storeu_ps(dst + 4 * i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + 4 * i))));
+	}
+#endif
+	for (; i + 2 <= n; i += 2){
+		__m128i h = _mm_loadu_si128((const __m128i*)(in + 4 * i));
+		_mm_storeu_ps(dst + 4 * i, vpack_unhalf_ps(h));
+		_mm_storeu_ps(dst + 4 * i + 4, vpack_unhalf_ps(_mm_unpackhi_epi64(h, h)));
+	}
+	if (i < n){
+		_mm_storeu_ps(dst + 4 * i, vpack_unhalf_ps(_mm_loadl_epi64((const __m128i*)(in + 4 * i))));
+	}
+}
+/* Clamp to [-1, 1] and scale to snorm16, rounding to nearest */
+static inline __m128i vpack_snorm16_epi32(__m128 v){
+	v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1)), _mm_set1_ps(1));
+	return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(32767)));
+}
+/* The GL snorm decode, -32768 comes back as -1 like -32767 */
+static inline __m128 vpack_unsnorm16_ps(__m128i v){
+	return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1 / 32767.f)), _mm_set1_ps(-1));
+}
+/* Convert n vectors to snorm16, out gets 4 per vector */
+static inline void vpack_snorm16_n(const vec4_t *in, int16_t *out, size_t n){
+	const float *src = (const float*)in;
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2){
+		__m128i a = vpack_snorm16_epi32(_mm_loadu_ps(src + 4 * i));
+		__m128i b = vpack_snorm16_epi32(_mm_loadu_ps(src + 4 * i + 4));
+		_mm_storeu_si128((__m128i*)(out + 4 * i), _mm_packs_epi32(a, b));
+	}
+	if (i < n){
+		__m128i a = vpack_snorm16_epi32(_mm_loadu_ps(src + 4 * i));
+		_mm_storel_epi64((__m128i*)(out + 4 * i), _mm_packs_epi32(a, a));
+	}
+}
+/* Convert n vectors of 4 snorm16s back to floats */
+static inline void vpack_unsnorm16_n(const int16_t *in, vec4_t *out, size_t n){
+	float *dst = (float*)out;
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2){
+		__m128i s = _mm_loadu_si128((const __m128i*)(in + 4 * i));
+		/* Put each short in the top of a lane and shift it back down to sign extend it */
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		_mm_storeu_ps(dst + 4 * i, vpack_unsnorm16_ps(lo));
+		_mm_storeu_ps(dst + 4 * i + 4, vpack_unsnorm16_ps(hi));
+	}
+	if (i < n){
+		__m128i s = _mm_loadl_epi64((const __m128i*)(in + 4 * i));
+		_mm_storeu_ps(dst + 4 * i, vpack_unsnorm16_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)));
+	}
+}
+/* Clamp to [0, 1] and scale to unorm8, rounding to nearest */
+static inline __m128i vpack_unorm8_epi32(__m128 v){
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1));
+	return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(255)));
+}
+/* Convert n vectors to unorm8, out gets 4 per vector in x, y, z, w order */
+static inline void vpack_unorm8_n(const vec4_t *in, uint8_t *out, size_t n){
+	const float *src = (const float*)in;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4){
+		__m128i a = vpack_unorm8_epi32(_mm_loadu_ps(src + 4 * i));
+		__m128i b = vpack_unorm8_epi32(_mm_loadu_ps(src + 4 * i + 4));
+		__m128i c = vpack_unorm8_epi32(_mm_loadu_ps(src + 4 * i + 8));
+		__m128i d = vpack_unorm8_epi32(_mm_loadu_ps(src + 4 * i + 12));
+		_mm_storeu_si128((__m128i*)(out + 4 * i),
+			_mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+	}
+	for (size_t j = 0; j < n % 4; ++j){
+		__m128i a = vpack_unorm8_epi32(_mm_loadu_ps(src + 4 * (i + j)));
+		a = _mm_packus_epi16(_mm_packs_epi32(a, a), a);
+		uint32_t p = _mm_cvtsi128_si32(a);
+		memcpy(out + 4 * (i + j), &p, sizeof(p));
+	}
+}
+/* Convert n vectors of 4 unorm8s back to floats */
+static inline void vpack_ununorm8_n(const uint8_t *in, vec4_t *out, size_t n){
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1 / 255.f);
+	float *dst = (float*)out;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4){
+		__m128i b = _mm_loadu_si128((const __m128i*)(in + 4 * i));
+		__m128i lo = _mm_unpacklo_epi8(b, zero), hi = _mm_unpackhi_epi8(b, zero);
+		_mm_storeu_ps(dst + 4 * i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + 4 * i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + 4 * i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(dst + 4 * i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+	}
+	for (size_t j = 0; j < n % 4; ++j){
+		uint32_t p;
+		memcpy(&p, in + 4 * (i + j), sizeof(p));
+		__m128i b = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(p), zero), zero);
+		_mm_storeu_ps(dst + 4 * (i + j), _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+	}
+}
+/*
+ * Octahedral encode the 4 directions with x, y and z in each lane, they
+ * don't need to be normalized since the projection divides by |x| + |y| + |z|
+ * anyway. Each lane of the result holds the snorm16 x in its low 16 bits and
+ * y in the high 16, which is the two shorts in memory order. Zero vectors
+ * encode as +z
+ */
+static inline __m128i vpack_oct_ps(__m128 x, __m128 y, __m128 z){
+	const __m128 sign = _mm_set1_ps(-0.f);
+	const __m128 one = _mm_set1_ps(1);
+	__m128 l1 = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign, x), _mm_andnot_ps(sign, y)), _mm_andnot_ps(sign, z));
+	l1 = _mm_max_ps(l1, _mm_set1_ps(FLT_MIN));
+	__m128 u = _mm_div_ps(x, l1);
+	__m128 v = _mm_div_ps(y, l1);
+	/* The lower hemisphere is folded out over the diagonals, keeping the signs of u and v */
+	__m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+	__m128 fu = _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(sign, v)), _mm_and_ps(sign, u));
+	__m128 fv = _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(sign, u)), _mm_and_ps(sign, v));
+	u = _mm_or_ps(_mm_and_ps(lower, fu), _mm_andnot_ps(lower, u));
+	v = _mm_or_ps(_mm_and_ps(lower, fv), _mm_andnot_ps(lower, v));
+	__m128i qu = _mm_and_si128(vpack_snorm16_epi32(u), _mm_set1_epi32(0xffff));
+	return _mm_or_si128(qu, _mm_slli_epi32(vpack_snorm16_epi32(v), 16));
+}
+/*
+ * Decode the 4 octahedral normals in oct (laid out like vpack_oct_ps returns
+ * them) to normalized x, y and z
+ */
+static inline void vpack_unoct_ps(__m128i oct, __m128 *x, __m128 *y, __m128 *z){
+	const __m128 sign = _mm_set1_ps(-0.f);
+	__m128 u = vpack_unsnorm16_ps(_mm_srai_epi32(_mm_slli_epi32(oct, 16), 16));
+	__m128 v = vpack_unsnorm16_ps(_mm_srai_epi32(oct, 16));
+	__m128 w = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1), _mm_andnot_ps(sign, u)), _mm_andnot_ps(sign, v));
+	/* Unfold the lower hemisphere, t is how far past the diagonal the point is */
+	__m128 t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), w), _mm_setzero_ps());
+	u = _mm_sub_ps(u, _mm_or_ps(t, _mm_and_ps(sign, u)));
+	v = _mm_sub_ps(v, _mm_or_ps(t, _mm_and_ps(sign, v)));
+	__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v)), _mm_mul_ps(w, w)));
+	*x = _mm_div_ps(u, len);
+	*y = _mm_div_ps(v, len);
+	*z = _mm_div_ps(w, len);
+}
+#ifdef __AVX2__
+/* vpack_oct_ps on 8 directions */
+static inline __m256i vpack_oct8_ps(__m256 x, __m256 y, __m256 z){
+	const __m256 sign = _mm256_set1_ps(-0.f);
+	const __m256 one = _mm256_set1_ps(1);
+	__m256 l1 = _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(sign, x), _mm256_andnot_ps(sign, y)),
+		_mm256_andnot_ps(sign, z));
+	l1 = _mm256_max_ps(l1, _mm256_set1_ps(FLT_MIN));
+	__m256 u = _mm256_div_ps(x, l1);
+	__m256 v = _mm256_div_ps(y, l1);
+	__m256 lower = _mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_LT_OQ);
+	__m256 fu = _mm256_or_ps(_mm256_sub_ps(one, _mm256_andnot_ps(sign, v)), _mm256_and_ps(sign, u));
+	__m256 fv = _mm256_or_ps(_mm256_sub_ps(one, _mm256_andnot_ps(sign, u)), _mm256_and_ps(sign, v));
+	u = _mm256_blendv_ps(u, fu, lower);
+	v = _mm256_blendv_ps(v, fv, lower);
+	const __m256 lo = _mm256_set1_ps(-1), hi = _mm256_set1_ps(1), scale = _mm256_set1_ps(32767);
+	__m256i qu = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(u, lo), hi), scale));
+	__m256i qv = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(v, lo), hi), scale));
+	return _mm256_or_si256(_mm256_and_si256(qu, _mm256_set1_epi32(0xffff)), _mm256_slli_epi32(qv, 16));
+}
+#endif
+/*
+ * Transform the n vectors in as vectors (ignoring w and the translation) by m
+ * and octahedral encode the results, out gets 2 per vector. Pass the normal
+ * matrix (mat4_normal_matrix) to pack a model's normals in world space. The
+ * transform is done on x, y and z in separate registers, 4 or 8 vectors at a
+ * time, with the same operations in the same order as mat4_transform_vectors
+ */
+static inline void vpack_xform_oct_n(const mat4_t *m, const vec4_t *in, int16_t *out, size_t n){
+	const float *src = (const float*)in;
+	size_t i = 0;
+#ifdef __AVX2__
+	{
+		__m256 c[3][3];
+		for (int j = 0; j < 3; ++j){
+			for (int k = 0; k < 3; ++k){
+				c[j][k] = _mm256_set1_ps(m->col[j].f[k]);
+			}
+		}
+		for (; i + 8 <= n; i += 8){
+			/* Get v0 and v4 in the two lanes of r0, v1 and v5 in r1 and so on, then transpose each lane */
+			__m256 a = _mm256_loadu_ps(src + 4 * i), b = _mm256_loadu_ps(src + 4 * i + 8);
+			__m256 e = _mm256_loadu_ps(src + 4 * i + 16), f = _mm256_loadu_ps(src + 4 * i + 24);
+			__m256 r0 = _mm256_permute2f128_ps(a, e, 0x20), r1 = _mm256_permute2f128_ps(a, e, 0x31);
+			__m256 r2 = _mm256_permute2f128_ps(b, f, 0x20), r3 = _mm256_permute2f128_ps(b, f, 0x31);
+			__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3);
+			__m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3);
+			__m256 x = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 y = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+			__m256 z = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			__m256 p[3];
+			for (int k = 0; k < 3; ++k){
+				p[k] = _mm256_mul_ps(c[0][k], x);
+				p[k] = vec4x8_madd_ps(c[1][k], y, p[k]);
+				p[k] = vec4x8_madd_ps(c[2][k], z, p[k]);
+			}
+			_mm256_storeu_si256((__m256i*)(out + 2 * i), vpack_oct8_ps(p[0], p[1], p[2]));
+		}
+	}
+#endif
+	__m128 c[3][3];
+	for (int j = 0; j < 3; ++j){
+		for (int k = 0; k < 3; ++k){
+			c[j][k] = _mm_set1_ps(m->col[j].f[k]);
+		}
+	}
+	for (; i < n; i += 4){
+		__m128 x, y, z, w;
+		if (i + 4 <= n){
+			x = _mm_loadu_ps(src + 4 * i);
+			y = _mm_loadu_ps(src + 4 * i + 4);
+			z = _mm_loadu_ps(src + 4 * i + 8);
+			w = _mm_loadu_ps(src + 4 * i + 12);
+		}
+		else {
+			/* Pad the tail out with +z so it's still 4 wide */
+			__m128 v[4];
+			for (size_t j = 0; j < 4; ++j){
+				v[j] = i + j < n ? _mm_loadu_ps(src + 4 * (i + j)) : _mm_set_ps(0, 1, 0, 0);
+			}
+			x = v[0];
+			y = v[1];
+			z = v[2];
+			w = v[3];
+		}
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		__m128 p[3];
+		for (int k = 0; k < 3; ++k){
+			p[k] = _mm_mul_ps(c[0][k], x);
+			p[k] = vec4_madd_ps(c[1][k], y, p[k]);
+			p[k] = vec4_madd_ps(c[2][k], z, p[k]);
+		}
+		__m128i oct = vpack_oct_ps(p[0], p[1], p[2]);
+		if (i + 4 <= n){
+			_mm_storeu_si128((__m128i*)(out + 2 * i), oct);
+		}
+		else {
+			uint32_t o[4];
+			_mm_storeu_si128((__m128i*)o, oct);
+			memcpy(out + 2 * i, o, (n - i) * sizeof(uint32_t));
+		}
+	}
+}
+/* Octahedral encode n normals, out gets 2 per normal */
+static inline void vpack_oct_n(const vec4_t *in, int16_t *out, size_t n){
+	/* Multiplying by the identity is exact, so this is the same as encoding in directly */
+	const mat4_t id = mat4_new();
+	vpack_xform_oct_n(&id, in, out, n);
+}
+/* Decode n octahedral normals, their w is set to 0 */
+static inline void vpack_unoct_n(const int16_t *in, vec4_t *out, size_t n){
+	float *dst = (float*)out;
+	for (size_t i = 0; i < n; i += 4){
+		size_t count = n - i < 4 ? n - i : 4;
+		__m128i oct;
+		if (count == 4){
+			oct = _mm_loadu_si128((const __m128i*)(in + 2 * i));
+		}
+		else {
+			uint32_t o[4] = { 0 };
+			memcpy(o, in + 2 * i, count * sizeof(uint32_t));
+			oct = _mm_loadu_si128((const __m128i*)o);
+		}
+		__m128 x, y, z, w = _mm_setzero_ps();
+		vpack_unoct_ps(oct, &x, &y, &z);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		const __m128 v[4] = { x, y, z, w };
+		for (size_t j = 0; j < count; ++j){
+			_mm_storeu_ps(dst + 4 * (i + j), v[j]);
+		}
+	}
+}
+/*
+ * Transform the n vectors in by m like mat4_xform_n and convert the results
+ * to halves, out gets 4 per vector
+ */
+static inline void vpack_xform_half_n(const mat4_t *m, const vec4_t *in, uint16_t *out, size_t n,
+	enum mat4_xform_mode mode)
+{
+	const __m128 c[4] = { m->col[0].v, m->col[1].v, m->col[2].v, m->col[3].v };
+	const float *src = (const float*)in;
+	size_t i = 0;
+#if defined(__AVX512F__)
+	const __m512 c16[4] = { _mm512_broadcast_f32x4(c[0]), _mm512_broadcast_f32x4(c[1]),
+		_mm512_broadcast_f32x4(c[2]), _mm512_broadcast_f32x4(c[3]) };
+	for (; i + 8 <= n; i += 8){
+		__m512 r0 = mat4_xform16(c16, _mm512_loadu_ps(src + 4 * i), mode);
+		__m512 r1 = mat4_xform16(c16, _mm512_loadu_ps(src + 4 * i + 16), mode);
+		_mm256_storeu_si256((__m256i*)(out + 4 * i), _mm512_cvtps_ph(r0, _MM_FROUND_TO_NEAREST_INT));
+		_mm256_storeu_si256((__m256i*)(out + 4 * i + 16), _mm512_cvtps_ph(r1, _MM_FROUND_TO_NEAREST_INT));
+	}
+#elif defined(__AVX__) && defined(__F16C__)
+	const __m256 c8[4] = { _mm256_broadcast_ps(&c[0]), _mm256_broadcast_ps(&c[1]),
+		_mm256_broadcast_ps(&c[2]), _mm256_broadcast_ps(&c[3]) };
+	for (; i + 4 <= n; i += 4){
+		__m256 r0 = mat4_xform8(c8, _mm256_loadu_ps(src + 4 * i), mode);
+		__m256 r1 = mat4_xform8(c8, _mm256_loadu_ps(src + 4 * i + 8), mode);
+		_mm_storeu_si128((__m128i*)(out + 4 * i), _mm256_cvtps_ph(r0, _MM_FROUND_TO_NEAREST_INT));
+		_mm_storeu_si128((__m128i*)(out + 4 * i + 8), _mm256_cvtps_ph(r1, _MM_FROUND_TO_NEAREST_INT));
+	}
+#endif
+	for (; i + 2 <= n; i += 2){
+		__m128i a = vpack_half_ps(mat4_xform_v(c, _mm_loadu_ps(src + 4 * i), mode));
+		__m128i b = vpack_half_ps(mat4_xform_v(c, _mm_loadu_ps(src + 4 * i + 4), mode));
+		_mm_storeu_si128((__m128i*)(out + 4 * i), _mm_unpacklo_epi64(a, b));
+	}
+	if (i < n){
+		_mm_storel_epi64((__m128i*)(out + 4 * i), vpack_half_ps(mat4_xform_v(c, _mm_loadu_ps(src + 4 * i), mode)));
+	}
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef SSE_XFORM_H
+#define SSE_XFORM_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "arena.h"
+
+/*
+ * A transform hierarchy: each node has a local matrix relative to its parent
+ * and xform_update computes world = parent world * local for the nodes whose
+ * local matrix changed and everything below them.
+ *
+ * The nodes are kept in flat arrays in breadth first order, so each level of
+ * the tree is a contiguous range and the children of a node are next to each
+ * other. The update walks down the tree a level at a time only visiting the
+ * nodes that need recomputing, runs of siblings are multiplied by their parent
+ * with one batched mat4_premult_n and everything else is gathered and done with
+ * mat4_mult_n, through the dispatched kernels. Big levels are split across
+ * the threads of a jobs.h pool since the nodes within a level don't depend on
+ * each other.
+ *
+ * Nodes are referred to by the handle returned from xform_add which doesn't
+ * change, the arrays are reordered on the next update after nodes are added
+ */
+typedef uint32_t xform_node_t;
+#define XFORM_NONE ((xform_node_t)-1)
+/* Levels with fewer nodes to update than this are done on the calling thread */
+#define XFORM_PARALLEL_MIN 2048
+
+struct jobs;
+struct xform_tree {
+	size_t count, capacity;
+	/* Indexed by slot, in breadth first order once sorted */
+	mat4_t *local, *world;
+	uint32_t *parent, *first_child, *child_count;
+	/* Set if the slot's world matrix needs recomputing */
+	uint8_t *dirty;
+	/* First slot of each level, with level_start[levels] = count */
+	uint32_t *level_start;
+	size_t levels;
+	/* Map between handles and slots */
+	uint32_t *slot, *handle;
+	/* Parent of each node by handle, the structure the sort is built from */
+	uint32_t *parent_handle;
+	/* Slots whose local matrix was changed since the last update */
+	uint32_t *pending;
+	size_t pending_count;
+	/* Slots updated by the last xform_update, grouped by level */
+	uint32_t *updated;
+	size_t updated_count;
+	int sorted;
+	struct jobs *jobs;
+	struct arena mem;
+};
+/*
+ * Set up a tree with room for capacity nodes, using threads threads to update
+ * it (including the caller, so 1 means no extra threads). Returns 0 on failure
+ */
+int xform_tree_init(struct xform_tree *t, size_t capacity, int threads);
+void xform_tree_destroy(struct xform_tree *t);
+/*
+ * Add a node under parent, or as a root if parent is XFORM_NONE. Returns
+ * XFORM_NONE if the tree is full or the parent doesn't exist
+ */
+xform_node_t xform_add(struct xform_tree *t, xform_node_t parent, mat4_t local);
+/*
+ * Set a node's local matrix, it and its subtree will be recomputed on the next
+ * update. Returns 0 and changes nothing if the node doesn't exist
+ */
+int xform_set_local(struct xform_tree *t, xform_node_t node, mat4_t local);
+/* Recompute the world matrices of everything that changed */
+void xform_update(struct xform_tree *t);
+/* The getters only check the node exists in debug builds, to stay cheap in the hot loops */
+static inline mat4_t xform_local(const struct xform_tree *t, xform_node_t node){
+	assert(node < t->count);
+	return t->local[t->slot[node]];
+}
+/* The node's world matrix as of the last update */
+static inline mat4_t xform_world(const struct xform_tree *t, xform_node_t node){
+	assert(node < t->count);
+	return t->world[t->slot[node]];
+}
+/*
+ * Get the slots updated by the last xform_update, eg. to upload just the
+ * changed matrices. Use xform_slot_world to get each one's world matrix
+ */
+static inline const uint32_t* xform_updated(const struct xform_tree *t, size_t *n){
+	*n = t->updated_count;
+	return t->updated;
+}
+static inline mat4_t xform_slot_world(const struct xform_tree *t, uint32_t slot){
+	return t->world[slot];
+}
+static inline xform_node_t xform_slot_node(const struct xform_tree *t, uint32_t slot){
+	return t->handle[slot];
+}
+
+#endif
@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Every chunk starts with this, padded to a cache line so the slots after it are aligned */
+struct pool_chunk {
+	struct pool_chunk *next;
+	size_t mapped;
+};
+
+static size_t round_up(size_t x, size_t align){
+	return (x + align - 1) & ~(align - 1);
+}
+/*
+ * Map size bytes of zeroed memory, trying for huge pages if asked. The size
+ * actually mapped is written to mapped. Returns NULL on failure
+ */
+static void* map_pages(size_t size, int flags, size_t *mapped){
+	void *p = MAP_FAILED;
+	if (flags & ARENA_HUGE_PAGES){
+		*mapped = round_up(size, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+		p = mmap(NULL, *mapped, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	}
+	else {
+		*mapped = round_up(size, sysconf(_SC_PAGESIZE));
+	}
+	if (p == MAP_FAILED){
+		p = mmap(NULL, *mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED){
+			return NULL;
+		}
+#ifdef MADV_HUGEPAGE
+		if (flags & ARENA_HUGE_PAGES){
+			madvise(p, *mapped, MADV_HUGEPAGE);
+		}
+#endif
+	}
+	return p;
+}
+
+int arena_init(struct arena *a, size_t size, int flags){
+	memset(a, 0, sizeof(*a));
+	a->base = map_pages(size, flags, &a->mapped);
+	if (!a->base){
+		return 0;
+	}
+	/* Might as well let the padding out to the page be used */
+	a->size = a->mapped;
+	a->flags = flags;
+	return 1;
+}
+void arena_destroy(struct arena *a){
+	if (a->base){
+		munmap(a->base, a->mapped);
+	}
+	memset(a, 0, sizeof(*a));
+}
+void* arena_alloc(struct arena *a, size_t size, size_t align){
+	if (align < ARENA_CACHE_LINE){
+		align = ARENA_CACHE_LINE;
+	}
+	size_t start = round_up(a->offset, align);
+	size = round_up(size, ARENA_CACHE_LINE);
+	if (start > a->size || size > a->size - start){
+		return NULL;
+	}
+	a->offset = start + size;
+	return a->base + start;
+}
+
+void pool_init(struct pool *p, size_t slot_size, size_t align, size_t slots_per_chunk, int flags){
+	memset(p, 0, sizeof(*p));
+	/* Free slots hold the next pointer of the free list */
+	if (slot_size < sizeof(void*)){
+		slot_size = sizeof(void*);
+	}
+	p->slot_size = round_up(slot_size, align);
+	p->slots_per_chunk = slots_per_chunk ? slots_per_chunk : 1;
+	p->flags = flags;
+}
+void pool_destroy(struct pool *p){
+	struct pool_chunk *c = p->chunks;
+	while (c){
+		struct pool_chunk *next = c->next;
+		munmap(c, c->mapped);
+		c = next;
+	}
+	memset(p, 0, sizeof(*p));
+}
+void* pool_alloc(struct pool *p){
+	if (!p->free_list){
+		size_t mapped;
+		size_t header = round_up(sizeof(struct pool_chunk), ARENA_CACHE_LINE);
+		struct pool_chunk *c = map_pages(header + p->slot_size * p->slots_per_chunk,
+			p->flags, &mapped);
+		if (!c){
+			return NULL;
+		}
+		c->next = p->chunks;
+		c->mapped = mapped;
+		p->chunks = c;
+		/* Use the whole mapping and push the slots so they're handed out in address order */
+		size_t n = (mapped - header) / p->slot_size;
+		char *slots = (char*)c + header;
+		for (size_t i = n; i-- > 0;){
+			void **s = (void**)(slots + i * p->slot_size);
+			*s = p->free_list;
+			p->free_list = s;
+		}
+	}
+	void **s = p->free_list;
+	p->free_list = *s;
+	++p->live;
+	return s;
+}
+void pool_free(struct pool *p, void *slot){
+	if (!slot){
+		return;
+	}
+	*(void**)slot = p->free_list;
+	p->free_list = slot;
+	--p->live;
+}
@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "ray.h"
+#include "bvh.h"
+
+/*
+ * Build, refit and trace times for the BVH on a headless scene of many
+ * tessellated spheres over a ground plane, seen by a pinhole camera. The
+ * closest hits are checked against ray_intersect_tris for a few of the rays
+ */
+#define RUNS 3
+#define WIDTH 640
+#define HEIGHT 480
+#define GRID 16
+#define SEGMENTS 32
+#define TRIS (2 + GRID * GRID * SEGMENTS * SEGMENTS)
+#define RAYS (WIDTH * HEIGHT)
+#define CHECK_STRIDE 997
+
+static vec4_t verts[3 * TRIS], moved[3 * TRIS];
+static ray_t rays[RAYS];
+static hit_t hits[RAYS];
+
+double now_s(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+/* Sphere of SEGMENTS x SEGMENTS / 2 quads, each split into 2 triangles */
+vec4_t* add_sphere(vec4_t *v, vec4_t c, float r){
+	for (int i = 0; i < SEGMENTS / 2; ++i){
+		float t0 = M_PI * i / (SEGMENTS / 2), t1 = M_PI * (i + 1) / (SEGMENTS / 2);
+		for (int j = 0; j < SEGMENTS; ++j){
+			float p0 = 2 * M_PI * j / SEGMENTS, p1 = 2 * M_PI * (j + 1) / SEGMENTS;
+			vec4_t a = vec4_new(sinf(t0) * cosf(p0), cosf(t0), sinf(t0) * sinf(p0), 0);
+			vec4_t b = vec4_new(sinf(t0) * cosf(p1), cosf(t0), sinf(t0) * sinf(p1), 0);
+			vec4_t d = vec4_new(sinf(t1) * cosf(p0), cosf(t1), sinf(t1) * sinf(p0), 0);
+			vec4_t e = vec4_new(sinf(t1) * cosf(p1), cosf(t1), sinf(t1) * sinf(p1), 0);
+			a = vec4_add(c, vec4_scale(a, r));
+			b = vec4_add(c, vec4_scale(b, r));
+			d = vec4_add(c, vec4_scale(d, r));
+			e = vec4_add(c, vec4_scale(e, r));
+			*v++ = a;
+			*v++ = b;
+			*v++ = d;
+			*v++ = b;
+			*v++ = e;
+			*v++ = d;
+		}
+	}
+	return v;
+}
+void build_scene(void){
+	vec4_t *v = verts;
+	vec4_t g[4] = { vec4_new(-40, 0, -40, 1), vec4_new(40, 0, -40, 1), vec4_new(40, 0, 40, 1),
+		vec4_new(-40, 0, 40, 1) };
+	*v++ = g[0];
+	*v++ = g[1];
+	*v++ = g[2];
+	*v++ = g[0];
+	*v++ = g[2];
+	*v++ = g[3];
+	for (int i = 0; i < GRID; ++i){
+		for (int j = 0; j < GRID; ++j){
+			vec4_t c = vec4_new(4 * (i - GRID / 2) + 2, 1 + (i + j) % 3, 4 * (j - GRID / 2) + 2, 1);
+			v = add_sphere(v, c, 0.8f + 0.4f * ((i * 7 + j) % 3));
+		}
+	}
+	/* The same scene squashed and sheared a bit, like a deforming mesh would be */
+	for (size_t i = 0; i < 3 * TRIS; ++i){
+		vec4_t p = verts[i];
+		moved[i] = vec4_new(p.f[0] + 0.3f * p.f[1], p.f[1] * 0.8f, p.f[2], 1);
+	}
+
+	/* Camera rays through the pixel centers, with the inverse view projection */
+	vec4_t eye = vec4_new(0, 20, 40, 1);
+	mat4_t inv = mat4_inverse(mat4_mult(mat4_perspective(60, (float)WIDTH / HEIGHT, 0.1f, 200),
+		mat4_look_at(eye, vec4_new(0, 0, 0, 1), vec4_new(0, 1, 0, 0))), NULL);
+	for (int y = 0; y < HEIGHT; ++y){
+		for (int x = 0; x < WIDTH; ++x){
+			vec4_t p = vec4_new(2 * (x + 0.5f) / WIDTH - 1, 1 - 2 * (y + 0.5f) / HEIGHT, 1, 1);
+			p = mat4_vec_mult(inv, p);
+			p = vec4_scale(p, 1 / p.f[3]);
+			rays[y * WIDTH + x] = ray_new(eye, vec4_normalize(vec4_sub(p, eye)));
+		}
+	}
+}
+/* Best of RUNS builds with some number of threads */
+double time_build(int threads){
+	double best = 1e30;
+	for (int r = 0; r < RUNS; ++r){
+		struct bvh b;
+		double start = now_s();
+		if (!bvh_build(&b, verts, TRIS, threads)){
+			fprintf(stderr, "Failed to build the BVH\n");
+			exit(1);
+		}
+		double time = now_s() - start;
+		if (time < best){
+			best = time;
+		}
+		bvh_destroy(&b);
+	}
+	return best;
+}
+double time_refit(struct bvh *b){
+	double best = 1e30;
+	for (int r = 0; r < RUNS; ++r){
+		double start = now_s();
+		bvh_refit(b, r % 2 ? verts : moved);
+		double time = now_s() - start;
+		if (time < best){
+			best = time;
+		}
+	}
+	bvh_refit(b, verts);
+	return best;
+}
+double time_closest(const struct bvh *b){
+	double best = 1e30;
+	for (int r = 0; r < RUNS; ++r){
+		for (size_t i = 0; i < RAYS; ++i){
+			hits[i] = hit_new(INFINITY);
+		}
+		double start = now_s();
+		bvh_intersect_n(b, rays, hits, RAYS);
+		double time = now_s() - start;
+		if (time < best){
+			best = time;
+		}
+	}
+	return best;
+}
+/* Shadow rays from each hit point back up towards the camera's side, with some offset to not hit the surface */
+double time_occluded(const struct bvh *b, size_t *blocked){
+	static ray_t shadow[RAYS];
+	size_t n = 0;
+	vec4_t light = vec4_normalize(vec4_new(0.4f, 1, 0.3f, 0));
+	for (size_t i = 0; i < RAYS; ++i){
+		if (hits[i].prim != RAY_MISS){
+			vec4_t p = vec4_add(rays[i].o, vec4_scale(rays[i].d, hits[i].t * 0.9999f));
+			shadow[n++] = ray_new(p, light);
+		}
+	}
+	double best = 1e30;
+	for (int r = 0; r < RUNS; ++r){
+		size_t count = 0;
+		double start = now_s();
+		for (size_t i = 0; i < n; ++i){
+			count += bvh_occluded(b, &shadow[i], INFINITY);
+		}
+		double time = now_s() - start;
+		if (time < best){
+			best = time;
+		}
+		*blocked = count;
+	}
+	return n ? best / n * RAYS : 0;
+}
+/* Check a sample of the closest hits by testing every triangle */
+int check_hits(void){
+	static tri_t tris[TRIS];
+	for (size_t i = 0; i < TRIS; ++i){
+		tris[i].v0 = verts[3 * i];
+		tris[i].v1 = verts[3 * i + 1];
+		tris[i].v2 = verts[3 * i + 2];
+	}
+	int bad = 0;
+	for (size_t i = 0; i < RAYS; i += CHECK_STRIDE){
+		hit_t ref = hit_new(INFINITY);
+		ray_intersect_tris(tris, TRIS, &rays[i], &ref, 1);
+		bad += ref.t != hits[i].t;
+	}
+	return bad;
+}
+
+int main(void){
+	build_scene();
+	printf("%d triangles, %dx%d camera rays, best of %d runs\n", TRIS, WIDTH, HEIGHT, RUNS);
+	double build1 = time_build(1);
+	printf("build 1 thread:   %8.2f ms\n", build1 * 1e3);
+	double build4 = time_build(4);
+	printf("build 4 threads:  %8.2f ms (%.2fx)\n", build4 * 1e3, build1 / build4);
+
+	struct bvh b;
+	if (!bvh_build(&b, verts, TRIS, 4)){
+		fprintf(stderr, "Failed to build the BVH\n");
+		return 1;
+	}
+	printf("%zu nodes (%zu KiB), %zu tri4 packs (%.2f triangles per pack)\n", b.node_count,
+		b.node_count * sizeof(struct bvh_node) / 1024, b.tri4_count, (double)TRIS / b.tri4_count);
+	double refit = time_refit(&b);
+	printf("refit:            %8.2f ms (%.1fx faster than building)\n", refit * 1e3, build1 / refit);
+
+	double closest = time_closest(&b);
+	size_t hit_count = 0;
+	for (size_t i = 0; i < RAYS; ++i){
+		hit_count += hits[i].prim != RAY_MISS;
+	}
+	printf("closest hit:      %8.2f Mrays/s, %zu hits\n", RAYS / closest * 1e-6, hit_count);
+	size_t blocked = 0;
+	double occluded = time_occluded(&b, &blocked);
+	printf("occlusion:        %8.2f Mrays/s, %zu of %zu blocked\n", RAYS / occluded * 1e-6, blocked, hit_count);
+	int bad = check_hits();
+	if (bad){
+		printf("%d of the sampled closest hits don't match testing every triangle\n", bad);
+	}
+	bvh_destroy(&b);
+	return bad != 0;
+}
@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "dispatch.h"
+#include "jobs.h"
+
+/*
+ * How the parallel kernels in jobs.h scale with the number of threads, on
+ * arrays big enough to be well out of cache. Each is timed with pools of 1, 2,
+ * 4, ... threads up to the number of CPUs (or the count given as the first
+ * argument) and reported as ns per element and speed up over 1 thread. The
+ * vector transforms run out of memory bandwidth long before the matrix
+ * inverses do
+ */
+#define RUNS 5
+#define VECS (4 * 1024 * 1024)
+#define MATS (1024 * 1024)
+#define MAX_POOLS 16
+
+static vec4_t *vin, *vout;
+static mat4_t *ma, *mb, *mout;
+static float *det;
+static struct jobs *pool;
+
+double now_s(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+void run_transform_points(void){
+	jobs_transform_points(pool, ma, vin, vout, VECS);
+}
+void run_project_points(void){
+	jobs_project_points(pool, ma, vin, vout, VECS);
+}
+void run_mult_n(void){
+	jobs_mult_n(pool, ma, mb, mout, MATS);
+}
+void run_premult_n(void){
+	jobs_premult_n(pool, ma, mb, mout, MATS);
+}
+void run_inverse_n(void){
+	jobs_inverse_n(pool, mb, mout, det, MATS);
+}
+void run_inverse_affine_n(void){
+	jobs_inverse_affine_n(pool, mb, mout, MATS);
+}
+void run_normal_matrix_n(void){
+	jobs_normal_matrix_n(pool, mb, mout, MATS);
+}
+/* Best of RUNS, in ns per element */
+double time_run(void (*fn)(void), size_t n){
+	double best = 1e30;
+	fn();
+	for (int r = 0; r < RUNS; ++r){
+		double start = now_s();
+		fn();
+		double time = now_s() - start;
+		if (time < best){
+			best = time;
+		}
+	}
+	return best / n * 1e9;
+}
+
+int main(int argc, char **argv){
+	const struct {
+		const char *name;
+		void (*fn)(void);
+		size_t n;
+	} benches[] = {
+		{ "transform_points", run_transform_points, VECS },
+		{ "project_points", run_project_points, VECS },
+		{ "mult_n", run_mult_n, MATS },
+		{ "premult_n", run_premult_n, MATS },
+		{ "inverse_n", run_inverse_n, MATS },
+		{ "inverse_affine_n", run_inverse_affine_n, MATS },
+		{ "normal_matrix_n", run_normal_matrix_n, MATS },
+	};
+	int max_threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	max_threads = max_threads > 0 ? max_threads : 1;
+	int threads[MAX_POOLS], pools = 0;
+	for (int t = 1; pools < MAX_POOLS; t *= 2){
+		threads[pools++] = t < max_threads ? t : max_threads;
+		if (t >= max_threads){
+			break;
+		}
+	}
+
+	vin = aligned_alloc(64, VECS * sizeof(vec4_t));
+	vout = aligned_alloc(64, VECS * sizeof(vec4_t));
+	ma = aligned_alloc(64, MATS * sizeof(mat4_t));
+	mb = aligned_alloc(64, MATS * sizeof(mat4_t));
+	mout = aligned_alloc(64, MATS * sizeof(mat4_t));
+	det = malloc(MATS * sizeof(float));
+	if (!vin || !vout || !ma || !mb || !mout || !det){
+		fprintf(stderr, "Failed to allocate the arrays\n");
+		return 1;
+	}
+	for (size_t i = 0; i < VECS; ++i){
+		vin[i] = vec4_new(i % 100, i % 37, i % 11, 1);
+	}
+	for (size_t i = 0; i < MATS; ++i){
+		ma[i] = mat4_mult(mat4_translate(vec4_new(i % 7, 1, 2, 1)), mat4_rotate(i % 360, vec4_new(0, 1, 0, 0)));
+		mb[i] = mat4_mult(ma[i], mat4_scale(1 + i % 3, 2, 1));
+	}
+
+	printf("%s kernels, %d vectors or %d matrices, best of %d runs, ns per element (speed up)\n",
+		sse_kernels->name, VECS, MATS, RUNS);
+	printf("%-18s", "threads");
+	for (int p = 0; p < pools; ++p){
+		printf(" %14d", threads[p]);
+	}
+	printf("\n");
+	double times[sizeof(benches) / sizeof(benches[0])][MAX_POOLS];
+	for (int p = 0; p < pools; ++p){
+		pool = jobs_create(threads[p], JOBS_PIN);
+		for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); ++b){
+			times[b][p] = time_run(benches[b].fn, benches[b].n);
+		}
+		jobs_destroy(pool);
+	}
+	for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); ++b){
+		printf("%-18s", benches[b].name);
+		for (int p = 0; p < pools; ++p){
+			printf(" %6.3f (%4.1fx)", times[b][p], times[b][0] / times[b][p]);
+		}
+		printf("\n");
+	}
+	return 0;
+}
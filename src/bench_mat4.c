@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+#include "vec4.h"
+#include "mat4.h"
+
+/*
+ * Compare throughput of the batched mat4 transforms against calling
+ * mat4_vec_mult in a loop, reported in points per cycle (rdtsc ticks), and
+ * the cost of mat4_mult against the old transpose and dot version
+ */
+#define RUNS 9
+#define MULT_COUNT 4096
+
+/* The old mat4_vec_mult which transposed on every call, to compare against */
+static inline vec4_t mat4_vec_mult_ref(mat4_t a, vec4_t b){
+	vec4_t c;
+	a = mat4_transpose(a);
+	for (int i = 0; i < 4; ++i){
+		c.f[i] = vec4_dot(a.col[i], b);
+	}
+	return c;
+}
+/* The old mat4_mult, transpose a and do 16 dot products */
+static inline mat4_t mat4_mult_ref(mat4_t a, mat4_t b){
+	mat4_t c;
+	a = mat4_transpose(a);
+	for (int i = 0; i < 4; ++i){
+		for (int j = 0; j < 4; ++j){
+			c.col[i].f[j] = vec4_dot(a.col[j], b.col[i]);
+		}
+	}
+	return c;
+}
+/* Keeps the compiler from throwing the results away */
+volatile float sink;
+
+void loop_ref(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		out[i] = mat4_vec_mult_ref(*m, in[i]);
+	}
+}
+void loop_call(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		out[i] = mat4_vec_mult(*m, in[i]);
+	}
+}
+/* Best of RUNS timings in points per cycle */
+double time_fn(void (*fn)(const mat4_t*, const vec4_t*, vec4_t*, size_t),
+	const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n)
+{
+	unsigned long long best = ~0ULL;
+	/* Warm up */
+	fn(m, in, out, n);
+	for (int r = 0; r < RUNS; ++r){
+		unsigned long long start = __rdtsc();
+		fn(m, in, out, n);
+		unsigned long long t = __rdtsc() - start;
+		if (t < best){
+			best = t;
+		}
+		sink = out[n - 1].f[0];
+	}
+	return (double)n / best;
+}
+
+void mult_ref(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		out[i] = mat4_mult_ref(a[i], b[i]);
+	}
+}
+void mult_call(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		out[i] = mat4_mult(a[i], b[i]);
+	}
+}
+/* Multiply a chain of matrices, each depending on the last, to measure latency */
+void mult_chain_ref(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	mat4_t c = *b;
+	for (size_t i = 0; i < n; ++i){
+		c = mat4_mult_ref(a[i], c);
+	}
+	*out = c;
+}
+void mult_chain(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	mat4_t c = *b;
+	for (size_t i = 0; i < n; ++i){
+		mat4_mult_to(&c, a + i, &c);
+	}
+	*out = c;
+}
+/* Best of RUNS timings in cycles per multiply */
+double time_mult(void (*fn)(const mat4_t*, const mat4_t*, mat4_t*, size_t),
+	const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n)
+{
+	unsigned long long best = ~0ULL;
+	fn(a, b, out, n);
+	for (int r = 0; r < RUNS; ++r){
+		unsigned long long start = __rdtsc();
+		fn(a, b, out, n);
+		unsigned long long t = __rdtsc() - start;
+		if (t < best){
+			best = t;
+		}
+		sink = out[0].col[0].f[0];
+	}
+	return (double)best / n;
+}
+void bench_mult(void){
+	mat4_t *a = _mm_malloc(MULT_COUNT * sizeof(mat4_t), 16);
+	mat4_t *b = _mm_malloc(MULT_COUNT * sizeof(mat4_t), 16);
+	mat4_t *out = _mm_malloc(MULT_COUNT * sizeof(mat4_t), 16);
+	for (size_t i = 0; i < MULT_COUNT; ++i){
+		a[i] = mat4_rotate(i % 360, vec4_new(1, 1, 0, 0));
+		b[i] = mat4_translate(vec4_new(i % 7, 1, 2, 1));
+	}
+	printf("\n%10s %14s %14s %14s %14s %14s\n", "matrices", "ref mult", "mat4_mult",
+		"mat4_mult_n", "ref chain", "mult_to chain");
+	printf("%10d %14.2f %14.2f %14.2f %14.2f %14.2f\n", MULT_COUNT,
+		time_mult(mult_ref, a, b, out, MULT_COUNT), time_mult(mult_call, a, b, out, MULT_COUNT),
+		time_mult(mat4_mult_n, a, b, out, MULT_COUNT), time_mult(mult_chain_ref, a, b, out, MULT_COUNT),
+		time_mult(mult_chain, a, b, out, MULT_COUNT));
+	printf("(cycles per multiply, best of %d runs)\n", RUNS);
+	_mm_free(a);
+	_mm_free(b);
+	_mm_free(out);
+}
+
+int main(int argc, char **argv){
+	size_t sizes[] = { 1024, 64 * 1024, 4 * 1024 * 1024 };
+	if (argc > 1){
+		sizes[0] = strtoul(argv[1], NULL, 10);
+	}
+	mat4_t m = mat4_mult(mat4_translate(vec4_new(1, 2, 3, 1)),
+		mat4_rotate(30, vec4_new(0, 1, 1, 0)));
+	printf("%10s %14s %14s %14s %14s %14s\n", "points", "ref loop", "call loop",
+		"vec_mult_n", "points", "project");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s){
+		size_t n = sizes[s];
+		vec4_t *in = _mm_malloc(n * sizeof(vec4_t), 16);
+		vec4_t *out = _mm_malloc(n * sizeof(vec4_t), 16);
+		for (size_t i = 0; i < n; ++i){
+			in[i] = vec4_new(i % 17, i % 5, i % 3, 1);
+		}
+		printf("%10zu %14.3f %14.3f %14.3f %14.3f %14.3f\n", n,
+			time_fn(loop_ref, &m, in, out, n), time_fn(loop_call, &m, in, out, n),
+			time_fn(mat4_vec_mult_n, &m, in, out, n), time_fn(mat4_transform_points, &m, in, out, n),
+			time_fn(mat4_project_points, &m, in, out, n));
+		_mm_free(in);
+		_mm_free(out);
+	}
+	printf("(points per cycle, best of %d runs)\n", RUNS);
+	bench_mult();
+	return 0;
+}
+
@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "vec4.h"
+#include "mesh.h"
+
+/*
+ * Write a big mesh with the streaming writer, then compare loading it by
+ * mapping it against reading it into aligned memory the way test_gl's
+ * read_file does, both with the file dropped from the page cache (as well as
+ * fadvise can) and with it cached. Each load is followed by summing every
+ * position so the mapped version pays for its page faults. The size in MB of
+ * the positions can be passed as the first argument
+ */
+#define MESH_PATH "bench_mesh.bin"
+#define CHUNK (1 << 16)
+
+double now_s(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+/* Ask the kernel to drop the file's pages from the cache, they're clean so this works without root */
+void drop_cache(void){
+	int fd = open(MESH_PATH, O_RDONLY);
+	if (fd != -1){
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+vec4_t sum_positions(const vec4_t *p, size_t n){
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2){
+		s0 = _mm_add_ps(s0, _mm_load_ps(p[i].f));
+		s1 = _mm_add_ps(s1, _mm_load_ps(p[i + 1].f));
+	}
+	for (; i < n; ++i){
+		s0 = _mm_add_ps(s0, _mm_load_ps(p[i].f));
+	}
+	vec4_t r;
+	r.v = _mm_add_ps(s0, s1);
+	return r;
+}
+/* Map the file and sum the positions, returns the time taken or -1 on failure */
+double load_mapped(int flags, size_t expect){
+	double start = now_s();
+	struct mesh_file m;
+	if (!mesh_open(&m, MESH_PATH, flags)){
+		fprintf(stderr, "Failed to open the mesh: %s\n", m.error);
+		return -1;
+	}
+	size_t n;
+	const vec4_t *p = mesh_positions(&m, &n);
+	vec4_t s = sum_positions(p, n);
+	double time = now_s() - start;
+	mesh_close(&m);
+	return n == expect && s.c.w == (float)n ? time : -1;
+}
+/* Read the whole file into aligned memory like read_file and sum the positions from there */
+double load_read(size_t expect){
+	double start = now_s();
+	FILE *fp = fopen(MESH_PATH, "rb");
+	if (!fp){
+		return -1;
+	}
+	fseek(fp, 0, SEEK_END);
+	size_t size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	char *buf = aligned_alloc(MESH_ALIGN, (size + MESH_ALIGN - 1) & ~(size_t)(MESH_ALIGN - 1));
+	if (!buf || fread(buf, 1, size, fp) != size){
+		fclose(fp);
+		free(buf);
+		return -1;
+	}
+	fclose(fp);
+	const struct mesh_header *h = (const struct mesh_header*)buf;
+	const struct mesh_section *s = (const struct mesh_section*)(buf + sizeof(*h));
+	size_t n = s[0].count;
+	vec4_t sum = sum_positions((const vec4_t*)(buf + s[0].offset), n);
+	double time = now_s() - start;
+	free(buf);
+	return n == expect && sum.c.w == (float)n ? time : -1;
+}
+
+int main(int argc, char **argv){
+	size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+	/* Keep the w sum exact in float */
+	size_t n = mb * 1024 * 1024 / sizeof(vec4_t);
+	n = n < (1 << 24) ? n : (1 << 24);
+	/* Whole chunks and whole triangles */
+	n -= n % (3 * CHUNK);
+	vec4_t *chunk = aligned_alloc(MESH_ALIGN, CHUNK * sizeof(vec4_t));
+	uint32_t *idx = malloc(CHUNK * sizeof(uint32_t));
+	struct mesh_writer w;
+	if (!chunk || !idx || !mesh_writer_open(&w, MESH_PATH)){
+		fprintf(stderr, "Failed to set up the writer\n");
+		return 1;
+	}
+	double start = now_s();
+	mesh_writer_begin(&w, MESH_POSITIONS, sizeof(vec4_t), 1);
+	for (size_t c = 0; c < n; c += CHUNK){
+		for (size_t i = 0; i < CHUNK; ++i){
+			chunk[i] = vec4_new(c + i, i % 7, i % 13, 1);
+		}
+		mesh_writer_append(&w, chunk, CHUNK);
+	}
+	mesh_writer_begin(&w, MESH_INDICES, sizeof(uint32_t), 1);
+	for (size_t c = 0; c < n; c += CHUNK){
+		for (size_t i = 0; i < CHUNK; ++i){
+			idx[i] = c + i;
+		}
+		mesh_writer_append(&w, idx, CHUNK);
+	}
+	if (!mesh_writer_close(&w)){
+		fprintf(stderr, "Failed to write the mesh\n");
+		return 1;
+	}
+	double file_mb = (double)n * (sizeof(vec4_t) + sizeof(uint32_t)) / (1024 * 1024);
+	printf("Wrote %zu vertices and indices (%.0f MB) in %.1f ms\n", n, file_mb, (now_s() - start) * 1e3);
+	free(chunk);
+	free(idx);
+
+	struct {
+		const char *name;
+		int flags;
+	} modes[] = {
+		{ "mmap", 0 }, { "mmap WILLNEED", MESH_WILLNEED }, { "mmap POPULATE", MESH_POPULATE },
+		{ "mmap VERIFY", MESH_VERIFY }
+	};
+	printf("%-16s %10s %10s\n", "load", "cold ms", "cached ms");
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i){
+		drop_cache();
+		double cold = load_mapped(modes[i].flags, n);
+		double warm = load_mapped(modes[i].flags, n);
+		printf("%-16s %10.1f %10.1f\n", modes[i].name, cold * 1e3, warm * 1e3);
+	}
+	drop_cache();
+	double cold = load_read(n);
+	double warm = load_read(n);
+	printf("%-16s %10.1f %10.1f\n", "fread + copy", cold * 1e3, warm * 1e3);
+
+	struct mesh_file m;
+	if (mesh_open(&m, MESH_PATH, MESH_POPULATE)){
+		start = now_s();
+		mesh_verify(&m);
+		double time = now_s() - start;
+		printf("Verifying the CRCs and indices: %.2f GB/s\n", m.size / time * 1e-9);
+		mesh_close(&m);
+	}
+	remove(MESH_PATH);
+	return 0;
+}
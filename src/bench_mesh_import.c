@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "vec4.h"
+#include "mesh.h"
+#include "mesh_import.h"
+
+/*
+ * Write a big OBJ scan (a noisy grid of vertices with normals, in quads) and
+ * time loading it line by line with fgets and strtof/strtol against
+ * mesh_import with 1, 2, 4, ... threads up to the CPU count, then time
+ * converting it to a mesh file. The file stays in the page cache between runs
+ * so this is the parsing speed. The number of vertices in millions can be
+ * passed as the first argument
+ */
+#define OBJ_PATH "bench_mesh_import.obj"
+#define MESH_PATH "bench_mesh_import.bin"
+
+double now_s(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+/* Write a grid of about n vertices, returns the file size */
+size_t write_obj(size_t n){
+	FILE *fp = fopen(OBJ_PATH, "wb");
+	if (!fp){
+		return 0;
+	}
+	const size_t w = 1000, h = n / w;
+	srand(3);
+	for (size_t r = 0; r < h; ++r){
+		for (size_t c = 0; c < w; ++c){
+			float noise = rand() / (float)RAND_MAX * 0.01f;
+			fprintf(fp, "v %.6f %.6f %.6f\nvn %.6f %.6f %.6f\n", c * 0.001f, r * 0.001f, noise,
+				noise * 10, -noise * 10, 0.999f);
+		}
+		for (size_t c = 0; r && c + 1 < w; ++c){
+			size_t a = (r - 1) * w + c + 1, b = r * w + c + 1;
+			fprintf(fp, "f %zu//%zu %zu//%zu %zu//%zu %zu//%zu\n", a, a, a + 1, a + 1, b + 1, b + 1, b, b);
+		}
+	}
+	long size = ftell(fp);
+	fclose(fp);
+	return size;
+}
+/* The scalar loader we had, returns the time or -1 on failure */
+double load_strtof(size_t *n_pos, size_t *n_idx){
+	double start = now_s();
+	FILE *fp = fopen(OBJ_PATH, "rb");
+	if (!fp){
+		return -1;
+	}
+	struct mesh_data d;
+	memset(&d, 0, sizeof(d));
+	char line[256];
+	size_t cap_pos = 0, cap_nrm = 0, cap_idx = 0;
+	while (fgets(line, sizeof(line), fp)){
+		char *p = line;
+		if (p[0] == 'v' && (p[1] == ' ' || p[1] == 'n')){
+			int normal = p[1] == 'n';
+			vec4_t v = vec4_new(0, 0, 0, normal ? 0 : 1);
+			p += 2;
+			for (int i = 0; i < 3; ++i){
+				v.f[i] = strtof(p, &p);
+			}
+			vec4_t **arr = normal ? &d.normals : &d.positions;
+			size_t *cnt = normal ? &d.n_normals : &d.n_positions, *cap = normal ? &cap_nrm : &cap_pos;
+			if (*cnt == *cap){
+				*cap = *cap ? *cap * 2 : 1024;
+				*arr = realloc(*arr, *cap * sizeof(vec4_t));
+			}
+			(*arr)[(*cnt)++] = v;
+		}
+		else if (p[0] == 'f'){
+			long c[4];
+			p += 1;
+			for (int i = 0; i < 4; ++i){
+				c[i] = strtol(p, &p, 10) - 1;
+				while (*p == '/' || (*p >= '0' && *p <= '9')){
+					++p;
+				}
+			}
+			if (d.n_indices + 6 > cap_idx){
+				cap_idx = cap_idx ? cap_idx * 2 : 1024;
+				d.indices = realloc(d.indices, cap_idx * sizeof(uint32_t));
+			}
+			const int tri[6] = { 0, 1, 2, 0, 2, 3 };
+			for (int i = 0; i < 6; ++i){
+				d.indices[d.n_indices++] = c[tri[i]];
+			}
+		}
+	}
+	fclose(fp);
+	double time = now_s() - start;
+	*n_pos = d.n_positions;
+	*n_idx = d.n_indices;
+	mesh_data_free(&d);
+	return time;
+}
+double load_import(int threads, size_t n_pos, size_t n_idx){
+	double start = now_s();
+	struct mesh_data d;
+	const char *err;
+	if (!mesh_import_data(&d, OBJ_PATH, threads, &err)){
+		fprintf(stderr, "Import failed: %s\n", err);
+		return -1;
+	}
+	double time = now_s() - start;
+	int ok = d.n_positions == n_pos && d.n_normals == n_pos && d.n_indices == n_idx;
+	mesh_data_free(&d);
+	return ok ? time : -1;
+}
+
+int main(int argc, char **argv){
+	size_t n = (argc > 1 ? atof(argv[1]) : 2) * 1e6;
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	max_threads = max_threads > 0 ? max_threads : 1;
+	size_t size = write_obj(n);
+	if (!size){
+		fprintf(stderr, "Failed to write %s\n", OBJ_PATH);
+		return 1;
+	}
+	printf("%s: %.1f MB\n", OBJ_PATH, size / 1e6);
+	size_t n_pos, n_idx;
+	/* Run the baseline once first so the file is in the page cache for everyone */
+	load_strtof(&n_pos, &n_idx);
+	double base = load_strtof(&n_pos, &n_idx);
+	printf("%-24s %8.1f ms %8.1f MB/s\n", "fgets + strtof", base * 1e3, size / 1e6 / base);
+	for (int t = 1;; t *= 2){
+		t = t < max_threads ? t : max_threads;
+		double time = load_import(t, n_pos, n_idx);
+		if (time < 0){
+			printf("mesh_import with %d threads gave the wrong mesh\n", t);
+			break;
+		}
+		char name[32];
+		snprintf(name, sizeof(name), "mesh_import %d threads", t);
+		printf("%-24s %8.1f ms %8.1f MB/s %6.2fx\n", name, time * 1e3, size / 1e6 / time, base / time);
+		if (t == max_threads){
+			break;
+		}
+	}
+	double start = now_s();
+	const char *err;
+	if (!mesh_import_file(OBJ_PATH, MESH_PATH, 0, &err)){
+		printf("mesh_import_file failed: %s\n", err);
+	}
+	else {
+		double time = now_s() - start;
+		printf("%-24s %8.1f ms %8.1f MB/s\n", "mesh_import_file", time * 1e3, size / 1e6 / time);
+	}
+	remove(OBJ_PATH);
+	remove(MESH_PATH);
+	return 0;
+}
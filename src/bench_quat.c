@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <math.h>
+#include <x86intrin.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "quat.h"
+#include "dispatch.h"
+
+/*
+ * Compare sampling bone rotations between keyframes as quaternions against
+ * lerping the keyframe matrices and re-orthonormalizing them, reported in
+ * cycles per sample (rdtsc ticks). slerp_n is quat_slerp_n built for SSE2 and
+ * the kernel is the one for the best tier the CPU has
+ */
+#define RUNS 9
+#define BONES 4096
+
+/* Keeps the compiler from throwing the results away */
+volatile float sink;
+
+/* Lerp the matrices then Gram-Schmidt the rotation back to orthonormal */
+void sample_matrix(const mat4_t *a, const mat4_t *b, const float *t, mat4_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		mat4_t m;
+		for (int j = 0; j < 4; ++j){
+			m.col[j] = vec4_add(a[i].col[j], vec4_scale(vec4_sub(b[i].col[j], a[i].col[j]), t[i]));
+		}
+		vec4_t x = vec4_normalize(m.col[0]);
+		vec4_t y = vec4_normalize(vec4_sub(m.col[1], vec4_scale(x, vec4_dot(x, m.col[1]))));
+		m.col[0] = x;
+		m.col[1] = y;
+		m.col[2] = vec4_cross(x, y);
+		out[i] = m;
+	}
+}
+void sample_slerp_call(const quat_t *a, const quat_t *b, const float *t, quat_t *out, size_t n){
+	for (size_t i = 0; i < n; ++i){
+		out[i] = quat_slerp(a[i], b[i], t[i]);
+	}
+}
+double time_quat(void (*fn)(const quat_t*, const quat_t*, const float*, quat_t*, size_t),
+	const quat_t *a, const quat_t *b, const float *t, quat_t *out)
+{
+	unsigned long long best = ~0ULL;
+	fn(a, b, t, out, BONES);
+	for (int r = 0; r < RUNS; ++r){
+		unsigned long long start = __rdtsc();
+		fn(a, b, t, out, BONES);
+		unsigned long long e = __rdtsc() - start;
+		if (e < best){
+			best = e;
+		}
+		sink = out[0].f[0];
+	}
+	return (double)best / BONES;
+}
+double time_mat(const mat4_t *a, const mat4_t *b, const float *t, mat4_t *out){
+	unsigned long long best = ~0ULL;
+	sample_matrix(a, b, t, out, BONES);
+	for (int r = 0; r < RUNS; ++r){
+		unsigned long long start = __rdtsc();
+		sample_matrix(a, b, t, out, BONES);
+		unsigned long long e = __rdtsc() - start;
+		if (e < best){
+			best = e;
+		}
+		sink = out[0].col[0].f[0];
+	}
+	return (double)best / BONES;
+}
+
+int main(void){
+	static quat_t qa[BONES], qb[BONES], qout[BONES];
+	static mat4_t ma[BONES], mb[BONES], mout[BONES];
+	static float t[BONES];
+	for (int i = 0; i < BONES; ++i){
+		vec4_t axis = vec4_new(i % 3, 1, i % 5, 0);
+		qa[i] = quat_from_axis_angle(axis, i % 360);
+		qb[i] = quat_from_axis_angle(axis, (i * 7) % 360);
+		ma[i] = quat_to_mat4(qa[i]);
+		mb[i] = quat_to_mat4(qb[i]);
+		t[i] = (i % 100) / 100.f;
+	}
+	printf("%10s %14s %14s %14s %14s %14s\n", "bones", "matrix lerp", "slerp call",
+		"slerp_n", "slerp_n kernel", "nlerp_n");
+	printf("%10d %14.2f %14.2f %14.2f %14.2f %14.2f\n", BONES, time_mat(ma, mb, t, mout),
+		time_quat(sample_slerp_call, qa, qb, t, qout), time_quat(quat_slerp_n, qa, qb, t, qout),
+		time_quat(sse_kernels->slerp_n, qa, qb, t, qout), time_quat(quat_nlerp_n, qa, qb, t, qout));
+	printf("(cycles per sample, best of %d runs, %s kernel)\n", RUNS, sse_kernels->name);
+	return 0;
+}
+
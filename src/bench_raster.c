@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "dispatch.h"
+#include "raster.h"
+#include "trace.h"
+
+/*
+ * Draw the test_gl scene headless and write it out as test_gl.ppm and
+ * test_gl_depth.pgm, then time the rasterizer on a scene of many tessellated
+ * spheres over a ground plane (which crosses the near plane) with 1, 2, 4, ...
+ * threads up to the CPU count or the count passed as the first argument. The
+ * occlusion queries are timed against the depth buffer that leaves
+ */
+#define RUNS 5
+#define WIDTH 1280
+#define HEIGHT 720
+#define GRID 16
+#define SEGMENTS 32
+#define TRIS (2 + GRID * GRID * SEGMENTS * SEGMENTS)
+#define QUERIES 100000
+#define MAX_POOLS 16
+
+static vec4_t verts[3 * TRIS];
+static aabb_t boxes[QUERIES];
+
+double now_s(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+/* Sphere of SEGMENTS x SEGMENTS / 2 quads, each split into 2 triangles */
+vec4_t* add_sphere(vec4_t *v, vec4_t c, float r){
+	for (int i = 0; i < SEGMENTS / 2; ++i){
+		float t0 = M_PI * i / (SEGMENTS / 2), t1 = M_PI * (i + 1) / (SEGMENTS / 2);
+		for (int j = 0; j < SEGMENTS; ++j){
+			float p0 = 2 * M_PI * j / SEGMENTS, p1 = 2 * M_PI * (j + 1) / SEGMENTS;
+			vec4_t a = vec4_new(sinf(t0) * cosf(p0), cosf(t0), sinf(t0) * sinf(p0), 0);
+			vec4_t b = vec4_new(sinf(t0) * cosf(p1), cosf(t0), sinf(t0) * sinf(p1), 0);
+			vec4_t d = vec4_new(sinf(t1) * cosf(p0), cosf(t1), sinf(t1) * sinf(p0), 0);
+			vec4_t e = vec4_new(sinf(t1) * cosf(p1), cosf(t1), sinf(t1) * sinf(p1), 0);
+			a = vec4_add(c, vec4_scale(a, r));
+			b = vec4_add(c, vec4_scale(b, r));
+			d = vec4_add(c, vec4_scale(d, r));
+			e = vec4_add(c, vec4_scale(e, r));
+			*v++ = a;
+			*v++ = b;
+			*v++ = d;
+			*v++ = b;
+			*v++ = e;
+			*v++ = d;
+		}
+	}
+	return v;
+}
+void build_scene(void){
+	vec4_t *v = verts;
+	vec4_t g[4] = { vec4_new(-100, 0, -100, 1), vec4_new(100, 0, -100, 1), vec4_new(100, 0, 100, 1),
+		vec4_new(-100, 0, 100, 1) };
+	*v++ = g[0];
+	*v++ = g[1];
+	*v++ = g[2];
+	*v++ = g[0];
+	*v++ = g[2];
+	*v++ = g[3];
+	for (int i = 0; i < GRID; ++i){
+		for (int j = 0; j < GRID; ++j){
+			vec4_t c = vec4_new(4 * (i - GRID / 2) + 2, 1 + (i + j) % 3, 4 * (j - GRID / 2) + 2, 1);
+			v = add_sphere(v, c, 0.8f + 0.4f * ((i * 7 + j) % 3));
+		}
+	}
+	/* Boxes scattered over the scene, many of them hidden behind the spheres */
+	srand(3);
+	for (int i = 0; i < QUERIES; ++i){
+		vec4_t c = vec4_new(rand() % 64 - 32, rand() % 4, rand() % 64 - 32, 1);
+		vec4_t h = vec4_new(0.25f, 0.25f, 0.25f, 0);
+		boxes[i].min = vec4_sub(c, h);
+		boxes[i].max = vec4_add(c, h);
+	}
+}
+/* The scene and matrices from test_gl.c */
+int draw_test_gl(void){
+	const vec4_t object[18] = {
+		vec4_new(-1, -1, 1, 1), vec4_new(1, -1, 1, 1), vec4_new(1, 1, 1, 1),
+		vec4_new(1, 1, 1, 1), vec4_new(-1, 1, 1, 1), vec4_new(-1, -1, 1, 1),
+		vec4_new(1, -1, 1, 1), vec4_new(1, -1, -1, 1), vec4_new(1, 1, -1, 1),
+		vec4_new(1, 1, -1, 1), vec4_new(1, 1, 1, 1), vec4_new(1, -1, 1, 1),
+		vec4_new(-1, -1, 1, 1), vec4_new(-1, -1, -1, 1), vec4_new(-1, 1, -1, 1),
+		vec4_new(-1, 1, -1, 1), vec4_new(-1, 1, 1, 1), vec4_new(-1, -1, 1, 1)
+	};
+	mat4_t model = mat4_mult(mat4_rotate(45, vec4_new(1, 1, 0, 0)), mat4_scale(2, 2, 2));
+	model = mat4_mult(mat4_translate(vec4_new(0, 2, -5, 1)), model);
+	mat4_t view = mat4_look_at(vec4_new(0, 0, 5, 0), vec4_new(0, 0, 0, 0), vec4_new(0, 1, 0, 0));
+	mat4_t proj = mat4_perspective(75, 640.f / 480, 1, 100);
+	mat4_t mvp = mat4_mult(proj, mat4_mult(view, model));
+
+	struct raster r;
+	if (!raster_init(&r, 640, 480, 1)){
+		return 0;
+	}
+	raster_clear(&r, 0, 1);
+	int ok = raster_draw(&r, &mvp, object, 18, RASTER_RGBA(255, 255, 255, 255), 0)
+		&& raster_write_ppm(&r, "test_gl.ppm") && raster_write_depth_pgm(&r, "test_gl_depth.pgm");
+	raster_destroy(&r);
+	return ok;
+}
+
+int main(int argc, char **argv){
+	if (!draw_test_gl()){
+		fprintf(stderr, "Failed to draw the test_gl scene\n");
+		return 1;
+	}
+	printf("Wrote test_gl.ppm and test_gl_depth.pgm\n");
+
+	int max_threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	max_threads = max_threads > 0 ? max_threads : 1;
+	int threads[MAX_POOLS], pools = 0;
+	for (int t = 1; pools < MAX_POOLS; t *= 2){
+		threads[pools++] = t < max_threads ? t : max_threads;
+		if (t >= max_threads){
+			break;
+		}
+	}
+	build_scene();
+	mat4_t vp = mat4_mult(mat4_perspective(60, (float)WIDTH / HEIGHT, 0.5f, 200),
+		mat4_look_at(vec4_new(0, 8, 36, 1), vec4_new(0, 0, 0, 1), vec4_new(0, 1, 0, 0)));
+
+	printf("%s kernels, %d triangles at %dx%d, best of %d runs\n", sse_kernels->name, TRIS, WIDTH, HEIGHT, RUNS);
+	for (int p = 0; p < pools; ++p){
+		struct raster r;
+		if (!raster_init(&r, WIDTH, HEIGHT, threads[p])){
+			fprintf(stderr, "Failed to set up the raster\n");
+			return 1;
+		}
+		double best = 1e30, best_depth = 1e30;
+		for (int i = 0; i < RUNS; ++i){
+			double start = now_s();
+			raster_clear(&r, 0, 1);
+			raster_draw(&r, &vp, verts, 3 * TRIS, RASTER_RGBA(200, 200, 200, 255), 0);
+			double time = now_s() - start;
+			best = time < best ? time : best;
+
+			start = now_s();
+			raster_clear(&r, 0, 1);
+			raster_draw(&r, &vp, verts, 3 * TRIS, 0, RASTER_DEPTH_ONLY);
+			time = now_s() - start;
+			best_depth = time < best_depth ? time : best_depth;
+		}
+		printf("%2d threads: %7.2f ms per frame (%6.1f Mtris/s), depth only %7.2f ms\n",
+			threads[p], best * 1e3, TRIS / best * 1e-6, best_depth * 1e3);
+		if (p == pools - 1){
+			double start = now_s();
+			int visible = 0;
+			for (int i = 0; i < QUERIES; ++i){
+				visible += raster_aabb_visible(&r, &vp, &boxes[i]);
+			}
+			double time = now_s() - start;
+			printf("Occlusion queries: %.1f ns per box, %d of %d visible\n", time / QUERIES * 1e9,
+				visible, QUERIES);
+		}
+		raster_destroy(&r);
+	}
+#ifdef SSE_FIDDLE_TRACE
+	/* In a traced build, break a frame on one thread down by vec4/mat4 function */
+	struct raster r;
+	if (raster_init(&r, WIDTH, HEIGHT, 1)){
+		raster_clear(&r, 0, 1);
+		sse_trace_reset();
+		sse_trace_set_cycles(1);
+		raster_draw(&r, &vp, verts, 3 * TRIS, RASTER_RGBA(200, 200, 200, 255), 0);
+		sse_trace_set_cycles(0);
+		printf("\nOne frame on 1 thread:\n");
+		sse_trace_write(stdout, SSE_TRACE_TABLE);
+		raster_destroy(&r);
+	}
+#endif
+	return 0;
+}
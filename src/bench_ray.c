@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "ray.h"
+#include "dispatch.h"
+
+/*
+ * Rays per second for the ray/triangle and ray/box tests on a small headless
+ * scene: a ground plane and some tessellated spheres seen by a pinhole camera.
+ * There's no acceleration structure, every camera ray is tested against every
+ * triangle (or triangle's bounding box), so this measures the raw intersection
+ * throughput of each form of the tests and of the intersect_tris kernel on
+ * each tier the CPU supports
+ */
+#define RUNS 5
+#define WIDTH 160
+#define HEIGHT 120
+#define SPHERES 8
+#define SEGMENTS 12
+#define TRIS (2 + SPHERES * SEGMENTS * SEGMENTS)
+#define RAYS (WIDTH * HEIGHT)
+
+static tri_t tris[TRIS];
+static tri4_t tri4s[(TRIS + 3) / 4];
+static aabb_t boxes[TRIS];
+static aabb4_t box4s[(TRIS + 3) / 4];
+static ray_t rays[RAYS];
+static hit_t hits[RAYS];
+static const struct sse_kernels *kern;
+/* Keeps the compiler from throwing the box test results away */
+volatile int sink;
+
+double now_s(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+/* Sphere of SEGMENTS x SEGMENTS / 2 quads, each split into 2 triangles */
+tri_t* add_sphere(tri_t *t, vec4_t c, float r){
+	for (int i = 0; i < SEGMENTS / 2; ++i){
+		float t0 = M_PI * i / (SEGMENTS / 2), t1 = M_PI * (i + 1) / (SEGMENTS / 2);
+		for (int j = 0; j < SEGMENTS; ++j){
+			float p0 = 2 * M_PI * j / SEGMENTS, p1 = 2 * M_PI * (j + 1) / SEGMENTS;
+			vec4_t a = vec4_new(sinf(t0) * cosf(p0), cosf(t0), sinf(t0) * sinf(p0), 0);
+			vec4_t b = vec4_new(sinf(t0) * cosf(p1), cosf(t0), sinf(t0) * sinf(p1), 0);
+			vec4_t d = vec4_new(sinf(t1) * cosf(p0), cosf(t1), sinf(t1) * sinf(p0), 0);
+			vec4_t e = vec4_new(sinf(t1) * cosf(p1), cosf(t1), sinf(t1) * sinf(p1), 0);
+			a = vec4_add(c, vec4_scale(a, r));
+			b = vec4_add(c, vec4_scale(b, r));
+			d = vec4_add(c, vec4_scale(d, r));
+			e = vec4_add(c, vec4_scale(e, r));
+			t->v0 = a;
+			t->v1 = b;
+			t->v2 = d;
+			++t;
+			t->v0 = b;
+			t->v1 = e;
+			t->v2 = d;
+			++t;
+		}
+	}
+	return t;
+}
+void build_scene(void){
+	tri_t *t = tris;
+	vec4_t g[4] = { vec4_new(-20, 0, -20, 1), vec4_new(20, 0, -20, 1), vec4_new(20, 0, 20, 1),
+		vec4_new(-20, 0, 20, 1) };
+	t->v0 = g[0];
+	t->v1 = g[1];
+	t->v2 = g[2];
+	++t;
+	t->v0 = g[0];
+	t->v1 = g[2];
+	t->v2 = g[3];
+	++t;
+	for (int i = 0; i < SPHERES; ++i){
+		float a = 2 * M_PI * i / SPHERES;
+		t = add_sphere(t, vec4_new(4 * cosf(a), 1 + (i % 3), 4 * sinf(a), 1), 0.8f + 0.2f * (i % 3));
+	}
+	for (size_t i = 0; i < TRIS; ++i){
+		boxes[i].min.v = _mm_min_ps(tris[i].v0.v, _mm_min_ps(tris[i].v1.v, tris[i].v2.v));
+		boxes[i].max.v = _mm_max_ps(tris[i].v0.v, _mm_max_ps(tris[i].v1.v, tris[i].v2.v));
+	}
+	for (size_t i = 0; i < TRIS; i += 4){
+		size_t n = TRIS - i < 4 ? TRIS - i : 4;
+		tri4s[i / 4] = tri4_new(tris + i, n, i);
+		box4s[i / 4] = aabb4_new(boxes + i, n);
+	}
+
+	/* Camera rays through the pixel centers, with the inverse view projection */
+	mat4_t inv = mat4_inverse(mat4_mult(mat4_perspective(60, (float)WIDTH / HEIGHT, 0.1f, 100),
+		mat4_look_at(vec4_new(0, 6, 12, 1), vec4_new(0, 1, 0, 1), vec4_new(0, 1, 0, 0))), NULL);
+	vec4_t eye = vec4_new(0, 6, 12, 1);
+	for (int y = 0; y < HEIGHT; ++y){
+		for (int x = 0; x < WIDTH; ++x){
+			vec4_t p = vec4_new(2 * (x + 0.5f) / WIDTH - 1, 1 - 2 * (y + 0.5f) / HEIGHT, 1, 1);
+			p = mat4_vec_mult(inv, p);
+			p = vec4_scale(p, 1 / p.f[3]);
+			vec4_t d = vec4_normalize(vec4_sub(p, eye));
+			rays[y * WIDTH + x] = ray_new(eye, d);
+		}
+	}
+}
+void reset_hits(void){
+	for (size_t i = 0; i < RAYS; ++i){
+		hits[i] = hit_new(INFINITY);
+	}
+}
+void trace_tri4(void){
+	for (size_t i = 0; i < RAYS; ++i){
+		for (size_t j = 0; j < (TRIS + 3) / 4; ++j){
+			ray_intersect_tri4(&rays[i], &tri4s[j], &hits[i]);
+		}
+	}
+}
+void trace_ray4(void){
+	for (size_t i = 0; i < RAYS; i += 4){
+		ray4_t r = ray4_load_n(rays + i, 4);
+		hit4_t h = hit4_load_n(hits + i, 4);
+		__m128 active = ray4_active(4);
+		for (size_t j = 0; j < TRIS; ++j){
+			ray4_intersect_tri(&r, &tris[j], j, active, &h);
+		}
+		hit4_store_n(&h, hits + i, 4);
+	}
+}
+void trace_kernel(void){
+	kern->intersect_tris(tris, TRIS, rays, hits, RAYS);
+}
+void trace_aabb4(void){
+	int n = 0;
+	for (size_t i = 0; i < RAYS; ++i){
+		for (size_t j = 0; j < (TRIS + 3) / 4; ++j){
+			__m128 t_near;
+			n += ray_intersect_aabb4(&rays[i], &box4s[j], hits[i].t, &t_near) != 0;
+		}
+	}
+	sink = n;
+}
+void trace_ray4_aabb(void){
+	__m128 n = _mm_setzero_ps();
+	for (size_t i = 0; i < RAYS; i += 4){
+		ray4_t r = ray4_load_n(rays + i, 4);
+		hit4_t h = hit4_load_n(hits + i, 4);
+		__m128 active = ray4_active(4);
+		for (size_t j = 0; j < TRIS; ++j){
+			__m128 t_near;
+			n = _mm_add_ps(n, _mm_and_ps(ray4_intersect_aabb(&r, &boxes[j], active, &h, &t_near),
+				_mm_set1_ps(1.f)));
+		}
+	}
+	sink = _mm_cvtss_f32(n);
+}
+/* Best of RUNS, the hits are reset before each run unless keep_hits is set */
+double time_trace(void (*fn)(void), int keep_hits){
+	double best = 1e30;
+	for (int r = 0; r < RUNS; ++r){
+		if (!keep_hits){
+			reset_hits();
+		}
+		double start = now_s();
+		fn();
+		double time = now_s() - start;
+		if (time < best){
+			best = time;
+		}
+	}
+	return best;
+}
+/* Count the rays that hit something and sum up the primitive ids to compare the forms */
+void report(const char *name, double time, size_t prims){
+	size_t hit_count = 0;
+	unsigned long long sum = 0;
+	for (size_t i = 0; i < RAYS; ++i){
+		if (hits[i].prim != RAY_MISS){
+			++hit_count;
+			sum += hits[i].prim;
+		}
+	}
+	printf("%-26s %10.2f %14.1f %8zu %12llu\n", name, RAYS / time * 1e-6,
+		(double)RAYS * prims / time * 1e-6, hit_count, sum);
+}
+
+int main(void){
+	build_scene();
+	printf("%dx%d camera rays against %d triangles, best of %d runs\n", WIDTH, HEIGHT, TRIS, RUNS);
+	printf("%-26s %10s %14s %8s %12s\n", "test", "Mrays/s", "Mtests/s", "hits", "prim sum");
+	report("ray vs tri4", time_trace(trace_tri4, 0), TRIS);
+	report("ray4 vs tri", time_trace(trace_ray4, 0), TRIS);
+	for (int t = 0; t < SSE_TIER_COUNT; ++t){
+		kern = sse_kernels_for_tier(t);
+		if (kern){
+			char name[64];
+			snprintf(name, sizeof(name), "intersect_tris %s", kern->name);
+			report(name, time_trace(trace_kernel, 0), TRIS);
+		}
+	}
+	/* The box tests use the closest triangle hit as their max t, like a BVH traversal would */
+	double time = time_trace(trace_aabb4, 1);
+	printf("%-26s %10.2f %14.1f\n", "ray vs aabb4", RAYS / time * 1e-6, (double)RAYS * TRIS / time * 1e-6);
+	time = time_trace(trace_ray4_aabb, 1);
+	printf("%-26s %10.2f %14.1f\n", "ray4 vs aabb", RAYS / time * 1e-6, (double)RAYS * TRIS / time * 1e-6);
+	return 0;
+}
@@ -0,0 +1,825 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "vec4.h"
+#include "mat4.h"
+#include "vec4_math.h"
+#include "quat.h"
+#include "mat3x4.h"
+#include "frustum.h"
+#include "ray.h"
+#include "raster.h"
+#include "vertex_pack.h"
+#include "dispatch.h"
+
+/*
+ * Benchmark every vec4/mat4 function and each batched kernel for every tier
+ * the CPU supports. Each case runs over BENCH_N elements, is warmed up and then
+ * timed over a number of runs, and the best and median time per element is
+ * reported along with the perf counters if they're available.
+ *
+ * usage: bench_sse [-r runs] [-f filter] [-T tier] [-p] [-j out.json]
+ *                  [-c baseline.json] [-t percent]
+ *
+ * -T runs only the kernels for that tier, or with "inline" only the cases that
+ * call the header functions directly.
+ * -j writes the results as JSON ('-' for stdout), -c compares against a JSON
+ * file written by an earlier run and exits with 1 if anything got more than
+ * -t percent (default 5) slower
+ */
+#define BENCH_N 512
+#define WARMUP_RUNS 3
+#define DEFAULT_RUNS 15
+#define MAX_RUNS 255
+/* Most results read back from a baseline file */
+#define MAX_RESULTS 256
+
+/* Inputs and outputs shared by all the cases, filled in by fill_inputs */
+static vec4_t va[BENCH_N], vb[BENCH_N], vc[BENCH_N], vout[BENCH_N];
+static mat4_t ma[BENCH_N], mb[BENCH_N], mout[BENCH_N];
+/* The affine ma and mb */
+static mat3x4_t aa[BENCH_N], ab[BENCH_N], aout[BENCH_N];
+static float fa[BENCH_N], fb[BENCH_N], fc[BENCH_N], fd[BENCH_N], fout[BENCH_N];
+static aabb_t boxes[BENCH_N];
+static uint32_t indices[BENCH_N];
+static frustum_t frustum;
+/* Each ray in intersect_tris is tested against all BENCH_TRIS triangles */
+#define BENCH_TRIS 64
+static tri_t tris[BENCH_TRIS];
+static ray_t rays[BENCH_N];
+static hit_t hits[BENCH_N];
+/* raster_tile draws BENCH_N small triangles scattered over one tile */
+static struct raster_tri raster_tris[BENCH_N];
+static uint32_t raster_ids[BENCH_N];
+static float raster_depth_buf[RASTER_TILE * RASTER_TILE] ALIGN_64;
+static uint32_t raster_color_buf[RASTER_TILE * RASTER_TILE] ALIGN_64;
+/* scan_lines and count_lines go over BENCH_N OBJ vertex lines */
+#define BENCH_LINE 32
+static char text[BENCH_N * BENCH_LINE] ALIGN_64;
+/* Packed vertex attributes from va */
+static uint16_t halves[4 * BENCH_N];
+static int16_t shorts[4 * BENCH_N];
+static uint8_t bytes[4 * BENCH_N];
+/* Keeps the compiler from throwing the results away */
+volatile float sink;
+/* The kernel table the tiered cases run with */
+static const struct sse_kernels *kern;
+
+struct bench_case {
+	const char *name;
+	void (*fn)(void);
+	/* Run once for each supported tier through kern instead of once inline */
+	int tiered;
+};
+struct bench_result {
+	char name[64];
+	char tier[16];
+	/* Per element: best and median wall time, rdtsc ticks and perf counts */
+	double ns, ns_median, tsc;
+	double cycles, instructions, l1d_misses;
+	int have_perf;
+};
+
+#define BENCH_VEC4_UNARY(fn) static void bench_##fn(void){\
+	for (size_t i = 0; i < BENCH_N; ++i){\
+		vout[i] = fn(va[i]);\
+	}\
+}
+#define BENCH_VEC4_BINARY(fn) static void bench_##fn(void){\
+	for (size_t i = 0; i < BENCH_N; ++i){\
+		vout[i] = fn(va[i], vb[i]);\
+	}\
+}
+#define BENCH_VEC4_REG(fn, ...) static void bench_##fn(void){\
+	for (size_t i = 0; i < BENCH_N; ++i){\
+		vout[i].v = fn(__VA_ARGS__);\
+	}\
+}
+#define BENCH_VEC4_FLOAT(fn, ...) static void bench_##fn(void){\
+	for (size_t i = 0; i < BENCH_N; ++i){\
+		fout[i] = fn(__VA_ARGS__);\
+	}\
+}
+#define BENCH_MAT4_UNARY(fn) static void bench_##fn(void){\
+	for (size_t i = 0; i < BENCH_N; ++i){\
+		mout[i] = fn(ma[i]);\
+	}\
+}
+#define BENCH_MAT4_BINARY(fn) static void bench_##fn(void){\
+	for (size_t i = 0; i < BENCH_N; ++i){\
+		mout[i] = fn(ma[i], mb[i]);\
+	}\
+}
+/* The _to versions writing through pointers, and the setters modifying in place */
+#define BENCH_UNARY_TO(fn, out, in) static void bench_##fn(void){\
+	for (size_t i = 0; i < BENCH_N; ++i){\
+		fn(&out[i], &in[i]);\
+	}\
+}
+#define BENCH_BINARY_TO(fn, out, a, b) static void bench_##fn(void){\
+	for (size_t i = 0; i < BENCH_N; ++i){\
+		fn(&out[i], &a[i], &b[i]);\
+	}\
+}
+#define BENCH_VEC4_SET(fn) static void bench_##fn(void){\
+	for (size_t i = 0; i < BENCH_N; ++i){\
+		vout[i] = va[i];\
+		fn(&vout[i], fa[i]);\
+	}\
+}
+
+BENCH_VEC4_BINARY(vec4_add)
+BENCH_VEC4_BINARY(vec4_sub)
+BENCH_VEC4_BINARY(vec4_mult)
+BENCH_VEC4_BINARY(vec4_cross)
+BENCH_VEC4_BINARY(vec4_veq)
+BENCH_VEC4_UNARY(vec4_normalize)
+BENCH_VEC4_UNARY(vec4_normalize_fast)
+BENCH_VEC4_REG(vec4_dot_v, va[i], vb[i])
+BENCH_VEC4_REG(vec4_dot3_v, va[i], vb[i])
+BENCH_VEC4_REG(vec4_len_v, va[i])
+BENCH_VEC4_FLOAT(vec4_dot, va[i], vb[i])
+BENCH_VEC4_FLOAT(vec4_len, va[i])
+BENCH_VEC4_FLOAT(vec4_eq, va[i], vb[i])
+BENCH_VEC4_UNARY(vec4_sin)
+BENCH_VEC4_UNARY(vec4_cos)
+BENCH_VEC4_UNARY(vec4_tan)
+BENCH_VEC4_UNARY(vec4_exp)
+BENCH_VEC4_UNARY(vec4_log)
+BENCH_VEC4_UNARY(vec4_asin)
+BENCH_VEC4_UNARY(vec4_acos)
+BENCH_MAT4_UNARY(mat4_transpose)
+BENCH_MAT4_UNARY(mat4_inverse_affine)
+BENCH_MAT4_UNARY(mat4_inverse_rigid)
+BENCH_MAT4_UNARY(mat4_normal_matrix)
+BENCH_MAT4_BINARY(mat4_add)
+BENCH_MAT4_BINARY(mat4_sub)
+BENCH_MAT4_BINARY(mat4_mult)
+BENCH_VEC4_FLOAT(mat4_eq, ma[i], mb[i])
+BENCH_VEC4_SET(vec4_set_x)
+BENCH_VEC4_SET(vec4_set_y)
+BENCH_VEC4_SET(vec4_set_z)
+BENCH_VEC4_SET(vec4_set_w)
+BENCH_UNARY_TO(mat4_transpose_to, mout, ma)
+BENCH_UNARY_TO(mat4_inverse_to, mout, ma)
+BENCH_UNARY_TO(mat4_inverse_affine_to, mout, ma)
+BENCH_UNARY_TO(mat4_inverse_rigid_to, mout, ma)
+BENCH_UNARY_TO(mat4_normal_matrix_to, mout, ma)
+BENCH_BINARY_TO(mat4_mult_to, mout, ma, mb)
+BENCH_UNARY_TO(mat3x4_inverse_to, aout, aa)
+BENCH_UNARY_TO(mat3x4_inverse_rigid_to, aout, ab)
+BENCH_BINARY_TO(mat3x4_mult_to, aout, aa, ab)
+BENCH_BINARY_TO(mat4_mult_mat3x4_to, mout, ma, aa)
+BENCH_VEC4_BINARY(quat_mult)
+BENCH_VEC4_UNARY(quat_normalize)
+BENCH_VEC4_BINARY(quat_rotate)
+BENCH_VEC4_FLOAT(quat_dot, va[i], vb[i])
+
+static void bench_vec4_new(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vout[i] = vec4_new(fa[i], fb[i], fc[i], fd[i]);
+	}
+}
+static void bench_vec4_scale(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vout[i] = vec4_scale(va[i], fa[i]);
+	}
+}
+static void bench_vec4_sincos(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vec4_t s, c;
+		vec4_sincos(va[i], &s, &c);
+		vout[i] = vec4_add(s, c);
+	}
+}
+static void bench_mat4_from_cols(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_from_cols(va[i].f);
+	}
+}
+static void bench_mat4_from_rows(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_from_rows(va[i].f);
+	}
+}
+static void bench_mat4_vec_mult(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vout[i] = mat4_vec_mult(ma[i], va[i]);
+	}
+}
+static void bench_mat4_translate(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_translate(va[i]);
+	}
+}
+static void bench_mat4_scale(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_scale(fa[i], fb[i], fc[i]);
+	}
+}
+static void bench_mat4_rotate(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_rotate(fa[i], vb[i]);
+	}
+}
+static void bench_mat4_look_at(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_look_at(va[i], vb[i], vec4_new(0, 1, 0, 0));
+	}
+}
+static void bench_mat4_ortho(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_ortho(-fa[i], fa[i], -fb[i], fb[i], fc[i], fd[i]);
+	}
+}
+static void bench_mat4_perspective(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_perspective(fa[i], fb[i], fc[i], fd[i]);
+	}
+}
+static void bench_mat4_inverse(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_inverse(ma[i], &fout[i]);
+	}
+}
+static void bench_mat3x4_mult(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		aout[i] = mat3x4_mult(aa[i], ab[i]);
+	}
+}
+static void bench_mat3x4_inverse(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		aout[i] = mat3x4_inverse(aa[i]);
+	}
+}
+static void bench_mat3x4_transform_point(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vout[i] = mat3x4_transform_point(aa[i], va[i]);
+	}
+}
+static void bench_mat3x4_premult_n(void){
+	mat3x4_premult_n(aa, ab, aout, BENCH_N);
+}
+static void bench_mat4_mult_mat3x4_n(void){
+	mat4_mult_mat3x4_n(ma, aa, mout, BENCH_N);
+}
+static void bench_vpack_snorm16_n(void){
+	vpack_snorm16_n(va, shorts, BENCH_N);
+}
+static void bench_vpack_unsnorm16_n(void){
+	vpack_unsnorm16_n(shorts, vout, BENCH_N);
+}
+static void bench_vpack_unorm8_n(void){
+	vpack_unorm8_n(va, bytes, BENCH_N);
+}
+static void bench_vpack_ununorm8_n(void){
+	vpack_ununorm8_n(bytes, vout, BENCH_N);
+}
+static void bench_vpack_oct_n(void){
+	vpack_oct_n(va, shorts, BENCH_N);
+}
+static void bench_vpack_unoct_n(void){
+	vpack_unoct_n(shorts, vout, BENCH_N);
+}
+static void bench_quat_from_axis_angle(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vout[i] = quat_from_axis_angle(vb[i], fa[i]);
+	}
+}
+static void bench_quat_nlerp(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vout[i] = quat_nlerp(vc[i], vb[i], fb[i]);
+	}
+}
+static void bench_quat_slerp(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vout[i] = quat_slerp(vc[i], vb[i], fb[i]);
+	}
+}
+static void bench_quat_slerp_n(void){
+	quat_slerp_n(vc, vb, fb, vout, BENCH_N);
+}
+static void bench_quat_to_mat4(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = quat_to_mat4(vc[i]);
+	}
+}
+static void bench_quat_to_mat4_n(void){
+	quat_to_mat4_n(vc, mout, BENCH_N);
+}
+static void bench_mat4_to_quat(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vout[i] = mat4_to_quat(ma[i]);
+	}
+}
+static void bench_mat4_compose(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		mout[i] = mat4_compose(va[i], vc[i], vb[i]);
+	}
+}
+static void bench_mat4_decompose(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		vec4_t t, s;
+		quat_t r;
+		fout[i] = mat4_decompose(ma[i], &t, &r, &s);
+		vout[i] = vec4_add(vec4_add(t, r), s);
+	}
+}
+
+/* The batched kernels, run through the table for each tier */
+static void bench_vec_mult_n(void){
+	kern->vec_mult_n(ma, va, vout, BENCH_N);
+}
+static void bench_transform_points(void){
+	kern->transform_points(ma, va, vout, BENCH_N);
+}
+static void bench_transform_vectors(void){
+	kern->transform_vectors(ma, va, vout, BENCH_N);
+}
+static void bench_project_points(void){
+	kern->project_points(ma, va, vout, BENCH_N);
+}
+static void bench_mult_n(void){
+	kern->mult_n(ma, mb, mout, BENCH_N);
+}
+static void bench_premult_n(void){
+	kern->premult_n(ma, mb, mout, BENCH_N);
+}
+static void bench_transpose_n(void){
+	kern->transpose_n(ma, mout, BENCH_N);
+}
+static void bench_inverse_n(void){
+	kern->inverse_n(ma, mout, fout, BENCH_N);
+}
+static void bench_inverse_affine_n(void){
+	kern->inverse_affine_n(ma, mout, BENCH_N);
+}
+static void bench_inverse_rigid_n(void){
+	kern->inverse_rigid_n(ma, mout, BENCH_N);
+}
+static void bench_normal_matrix_n(void){
+	kern->normal_matrix_n(ma, mout, BENCH_N);
+}
+static void bench_rotate_n(void){
+	kern->rotate_n(fa, vb, mout, BENCH_N);
+}
+static void bench_perspective_n(void){
+	kern->perspective_n(fa, fb, fc, fd, mout, BENCH_N);
+}
+static void bench_slerp_n(void){
+	kern->slerp_n(vc, vb, fb, vout, BENCH_N);
+}
+static void bench_cull_spheres(void){
+	fout[0] = kern->cull_spheres(&frustum, va, BENCH_N, indices);
+}
+static void bench_cull_aabbs(void){
+	fout[0] = kern->cull_aabbs(&frustum, boxes, BENCH_N, indices);
+}
+static void bench_intersect_tris(void){
+	for (size_t i = 0; i < BENCH_N; ++i){
+		hits[i] = hit_new(INFINITY);
+	}
+	kern->intersect_tris(tris, BENCH_TRIS, rays, hits, BENCH_N);
+}
+static void bench_raster_tile(void){
+	struct raster_target target = { raster_depth_buf, raster_color_buf, RASTER_TILE };
+	for (size_t i = 0; i < RASTER_TILE * RASTER_TILE; ++i){
+		raster_depth_buf[i] = 1;
+	}
+	kern->raster_tile(&target, raster_tris, raster_ids, BENCH_N, 0, 0, RASTER_TILE, RASTER_TILE, 0xffffffff);
+}
+
+static void bench_scan_lines(void){
+	fout[0] = kern->scan_lines(text, sizeof(text), indices, BENCH_N);
+}
+static void bench_count_lines(void){
+	fout[0] = kern->count_lines(text, sizeof(text));
+}
+static void bench_half_n(void){
+	kern->half_n(va, halves, BENCH_N);
+}
+static void bench_unhalf_n(void){
+	kern->unhalf_n(halves, vout, BENCH_N);
+}
+static void bench_xform_half_n(void){
+	kern->xform_half_n(ma, va, halves, BENCH_N, MAT4_XFORM_POINT);
+}
+static void bench_xform_oct_n(void){
+	kern->xform_oct_n(ma, va, shorts, BENCH_N);
+}
+
+#define CASE(fn) { #fn, bench_##fn, 0 }
+#define KERNEL(fn) { #fn, bench_##fn, 1 }
+static const struct bench_case cases[] = {
+	CASE(vec4_new), CASE(vec4_set_x), CASE(vec4_set_y), CASE(vec4_set_z), CASE(vec4_set_w), CASE(vec4_add), CASE(vec4_sub), CASE(vec4_mult), CASE(vec4_scale),
+	CASE(vec4_dot_v), CASE(vec4_dot3_v), CASE(vec4_len_v), CASE(vec4_dot), CASE(vec4_len),
+	CASE(vec4_normalize), CASE(vec4_normalize_fast), CASE(vec4_cross), CASE(vec4_eq),
+	CASE(vec4_veq), CASE(vec4_sincos), CASE(vec4_sin), CASE(vec4_cos), CASE(vec4_tan),
+	CASE(vec4_exp), CASE(vec4_log), CASE(vec4_asin), CASE(vec4_acos),
+	CASE(mat4_transpose), CASE(mat4_transpose_to), CASE(mat4_from_cols), CASE(mat4_from_rows),
+	CASE(mat4_add), CASE(mat4_sub), CASE(mat4_vec_mult), CASE(mat4_mult), CASE(mat4_mult_to),
+	CASE(mat4_translate), CASE(mat4_scale), CASE(mat4_rotate), CASE(mat4_look_at), CASE(mat4_ortho),
+	CASE(mat4_perspective), CASE(mat4_inverse), CASE(mat4_inverse_to), CASE(mat4_inverse_affine),
+	CASE(mat4_inverse_affine_to), CASE(mat4_inverse_rigid), CASE(mat4_inverse_rigid_to),
+	CASE(mat4_normal_matrix), CASE(mat4_normal_matrix_to), CASE(mat4_eq),
+	CASE(quat_from_axis_angle), CASE(quat_mult), CASE(quat_dot), CASE(quat_normalize),
+	CASE(quat_rotate), CASE(quat_nlerp), CASE(quat_slerp), CASE(quat_slerp_n),
+	CASE(quat_to_mat4), CASE(quat_to_mat4_n), CASE(mat4_to_quat), CASE(mat4_compose),
+	CASE(mat4_decompose), CASE(mat3x4_mult), CASE(mat3x4_mult_to), CASE(mat3x4_inverse),
+	CASE(mat3x4_inverse_to), CASE(mat3x4_inverse_rigid_to), CASE(mat3x4_transform_point),
+	CASE(mat3x4_premult_n), CASE(mat4_mult_mat3x4_to), CASE(mat4_mult_mat3x4_n), CASE(vpack_snorm16_n), CASE(vpack_unsnorm16_n),
+	CASE(vpack_unorm8_n), CASE(vpack_ununorm8_n), CASE(vpack_oct_n), CASE(vpack_unoct_n),
+	KERNEL(vec_mult_n), KERNEL(transform_points), KERNEL(transform_vectors),
+	KERNEL(project_points), KERNEL(mult_n), KERNEL(premult_n), KERNEL(transpose_n),
+	KERNEL(inverse_n), KERNEL(inverse_affine_n), KERNEL(inverse_rigid_n), KERNEL(normal_matrix_n),
+	KERNEL(rotate_n), KERNEL(perspective_n), KERNEL(slerp_n), KERNEL(cull_spheres), KERNEL(cull_aabbs),
+	KERNEL(intersect_tris), KERNEL(raster_tile), KERNEL(scan_lines), KERNEL(count_lines),
+	KERNEL(half_n), KERNEL(unhalf_n), KERNEL(xform_half_n), KERNEL(xform_oct_n)
+};
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+/*
+ * Hardware counters through perf_event_open: a group of cycles, instructions
+ * and L1 data cache read misses, user space only. If the kernel doesn't allow
+ * it (see /proc/sys/kernel/perf_event_paranoid) we just go without
+ */
+enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_COUNT };
+static int perf_fd[PERF_COUNT] = { -1, -1, -1 };
+
+#ifdef __linux__
+static int perf_open_counter(unsigned int type, unsigned long long config, int group){
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+int perf_open(void){
+#ifdef __linux__
+	perf_fd[PERF_CYCLES] = perf_open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+	if (perf_fd[PERF_CYCLES] == -1){
+		return 0;
+	}
+	perf_fd[PERF_INSTRUCTIONS] = perf_open_counter(PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_INSTRUCTIONS, perf_fd[PERF_CYCLES]);
+	perf_fd[PERF_L1D_MISSES] = perf_open_counter(PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), perf_fd[PERF_CYCLES]);
+	if (perf_fd[PERF_INSTRUCTIONS] == -1 || perf_fd[PERF_L1D_MISSES] == -1){
+		for (int i = 0; i < PERF_COUNT; ++i){
+			if (perf_fd[i] != -1){
+				close(perf_fd[i]);
+				perf_fd[i] = -1;
+			}
+		}
+		return 0;
+	}
+	return 1;
+#else
+	return 0;
+#endif
+}
+void perf_start(void){
+#ifdef __linux__
+	if (perf_fd[PERF_CYCLES] != -1){
+		ioctl(perf_fd[PERF_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(perf_fd[PERF_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+#endif
+}
+/* Stop the counters and read them into counts, returns 0 if they're not open */
+int perf_stop(unsigned long long counts[PERF_COUNT]){
+#ifdef __linux__
+	/* With PERF_FORMAT_GROUP the read gives the number of counters then each value */
+	unsigned long long buf[PERF_COUNT + 1];
+	if (perf_fd[PERF_CYCLES] == -1){
+		return 0;
+	}
+	ioctl(perf_fd[PERF_CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	if (read(perf_fd[PERF_CYCLES], buf, sizeof(buf)) != sizeof(buf)){
+		return 0;
+	}
+	memcpy(counts, buf + 1, sizeof(unsigned long long) * PERF_COUNT);
+	return 1;
+#else
+	(void)counts;
+	return 0;
+#endif
+}
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+static int cmp_double(const void *a, const void *b){
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+/* Time a case, the counters are summed over all the timed runs */
+void run_case(const struct bench_case *c, const char *tier, int runs, int use_perf,
+	struct bench_result *res)
+{
+	double ns[MAX_RUNS];
+	unsigned long long best_tsc = ~0ULL;
+	unsigned long long total[PERF_COUNT] = { 0 };
+	int have_perf = use_perf;
+	for (int r = 0; r < WARMUP_RUNS; ++r){
+		c->fn();
+	}
+	for (int r = 0; r < runs; ++r){
+		unsigned long long counts[PERF_COUNT];
+		if (use_perf){
+			perf_start();
+		}
+		double start = now_ns();
+		unsigned long long start_tsc = __rdtsc();
+		c->fn();
+		unsigned long long t = __rdtsc() - start_tsc;
+		ns[r] = now_ns() - start;
+		if (use_perf){
+			if (perf_stop(counts)){
+				for (int i = 0; i < PERF_COUNT; ++i){
+					total[i] += counts[i];
+				}
+			}
+			else {
+				have_perf = 0;
+			}
+		}
+		if (t < best_tsc){
+			best_tsc = t;
+		}
+		sink = vout[BENCH_N - 1].f[0] + mout[BENCH_N - 1].col[3].f[0] + fout[BENCH_N - 1];
+	}
+	qsort(ns, runs, sizeof(double), cmp_double);
+	snprintf(res->name, sizeof(res->name), "%s", c->name);
+	snprintf(res->tier, sizeof(res->tier), "%s", tier);
+	res->ns = ns[0] / BENCH_N;
+	res->ns_median = ns[runs / 2] / BENCH_N;
+	res->tsc = (double)best_tsc / BENCH_N;
+	res->have_perf = have_perf;
+	res->cycles = (double)total[PERF_CYCLES] / runs / BENCH_N;
+	res->instructions = (double)total[PERF_INSTRUCTIONS] / runs / BENCH_N;
+	res->l1d_misses = (double)total[PERF_L1D_MISSES] / runs / BENCH_N;
+}
+/*
+ * Fill the inputs with something that's valid for everything: invertible
+ * matrices, unit quaternions in vc, sensible fov/aspect/near/far in fa..fd
+ */
+void fill_inputs(void){
+	srand(5);
+	for (size_t i = 0; i < BENCH_N; ++i){
+		float r[4];
+		for (int j = 0; j < 4; ++j){
+			r[j] = (float)rand() / RAND_MAX;
+		}
+		va[i] = vec4_new(r[0] * 8 - 4, r[1] * 8 - 4, r[2] * 8 - 4, 1);
+		vb[i] = vec4_normalize(vec4_new(r[1] - 0.5f, r[2] + 0.1f, r[3] - 0.5f, 0));
+		vc[i] = quat_from_axis_angle(vb[i], r[0] * 360);
+		fa[i] = 30 + r[0] * 60;
+		fb[i] = 0.5f + r[1];
+		fc[i] = 0.1f + r[2];
+		fd[i] = 100 + r[3] * 100;
+		mb[i] = mat4_rotate(fa[i], vb[i]);
+		ma[i] = mat4_mult(mat4_translate(va[i]), mat4_mult(mb[i], mat4_scale(fb[i], fb[i], 2)));
+		aa[i] = mat3x4_from_mat4(ma[i]);
+		ab[i] = mat3x4_from_mat4(mb[i]);
+		boxes[i].min = vec4_sub(va[i], vec4_new(r[1], r[2], r[3], 0));
+		boxes[i].max = vec4_add(va[i], vec4_new(r[3], r[1], r[2], 0));
+		rays[i] = ray_new(vec4_new(0, 0, 5, 1), vec4_normalize(vec4_sub(va[i], vec4_new(0, 0, 5, 1))));
+	}
+	/* Triangles scattered through the same volume as the points */
+	for (size_t i = 0; i < BENCH_TRIS; ++i){
+		tris[i].v0 = va[i];
+		tris[i].v1 = vec4_add(va[i], vec4_new(fb[i], 0, 0, 0));
+		tris[i].v2 = vec4_add(va[i], vec4_new(0, fb[i], 0, 0));
+	}
+	/* Triangles about 16 pixels across, which the setup never culls */
+	for (size_t i = 0; i < BENCH_N; ++i){
+		int32_t x0 = (va[i].f[0] + 4) * 96, y0 = (va[i].f[1] + 4) * 96;
+		const int32_t x[3] = { x0, x0 + 256, x0 + 64 };
+		const int32_t y[3] = { y0, y0 + 32, y0 + 256 };
+		const float z[3] = { fa[i] / 100, fb[i] / 2, fc[i] };
+		raster_setup(&raster_tris[i], x, y, z, RASTER_TILE, RASTER_TILE);
+		raster_ids[i] = i;
+	}
+	/* Lines of varying length, padded out with spaces to BENCH_LINE bytes on average */
+	size_t len = 0;
+	for (size_t i = 0; i < BENCH_N && len < sizeof(text) - 64; ++i){
+		len += sprintf(text + len, "v %g %g %g\n", va[i].f[0], va[i].f[1], va[i].f[2]);
+	}
+	memset(text + len, ' ', sizeof(text) - len);
+	for (size_t i = len; i + BENCH_LINE <= sizeof(text); i += BENCH_LINE){
+		text[i + BENCH_LINE - 1] = '\n';
+	}
+	/* So the unpacking cases have something to unpack whichever runs first */
+	vpack_half_n(va, halves, BENCH_N);
+	vpack_snorm16_n(vb, shorts, BENCH_N);
+	vpack_unorm8_n(vb, bytes, BENCH_N);
+	/* Looking at the middle of the points so about half of them get culled */
+	frustum = frustum_from_mat4(mat4_mult(mat4_perspective(60, 1, 0.1f, 10),
+		mat4_look_at(vec4_new(0, 0, 5, 1), vec4_new(0, 0, 0, 1), vec4_new(0, 1, 0, 0))));
+}
+
+/* Load the results from a JSON file written with -j, returns the count or -1 */
+int load_baseline(const char *file, struct bench_result *res, int max){
+	FILE *fp = fopen(file, "r");
+	char line[512];
+	int n = 0;
+	if (!fp){
+		return -1;
+	}
+	/* Each result is on its own line so we don't need a real JSON parser */
+	while (n < max && fgets(line, sizeof(line), fp)){
+		char *name = strstr(line, "\"name\": \"");
+		char *tier = strstr(line, "\"tier\": \"");
+		char *ns = strstr(line, "\"ns\": ");
+		if (!name || !tier || !ns){
+			continue;
+		}
+		memset(&res[n], 0, sizeof(res[n]));
+		if (sscanf(name + 9, "%63[^\"]", res[n].name) == 1
+			&& sscanf(tier + 9, "%15[^\"]", res[n].tier) == 1
+			&& sscanf(ns + 6, "%lf", &res[n].ns) == 1)
+		{
+			++n;
+		}
+	}
+	fclose(fp);
+	return n;
+}
+void write_json(FILE *fp, const struct bench_result *res, int n, int runs){
+	fprintf(fp, "{\n\t\"cpu_tier\": \"%s\",\n\t\"elements\": %d,\n\t\"runs\": %d,\n\t\"results\": [\n",
+		sse_tier_name(sse_cpu_tier()), BENCH_N, runs);
+	for (int i = 0; i < n; ++i){
+		fprintf(fp, "\t\t{\"name\": \"%s\", \"tier\": \"%s\", \"ns\": %.4f, \"ns_median\": %.4f, "
+			"\"tsc\": %.3f", res[i].name, res[i].tier, res[i].ns, res[i].ns_median, res[i].tsc);
+		if (res[i].have_perf){
+			fprintf(fp, ", \"cycles\": %.3f, \"instructions\": %.3f, \"l1d_misses\": %.4f",
+				res[i].cycles, res[i].instructions, res[i].l1d_misses);
+		}
+		fprintf(fp, "}%s\n", i + 1 < n ? "," : "");
+	}
+	fprintf(fp, "\t]\n}\n");
+}
+/* Print how each result changed from the baseline, returns the number of regressions */
+int compare(FILE *fp, const struct bench_result *res, int n, const struct bench_result *base,
+	int nbase, double threshold)
+{
+	int regressions = 0;
+	fprintf(fp, "\n%-24s %-7s %10s %10s %8s\n", "function", "tier", "base ns", "ns", "change");
+	for (int i = 0; i < n; ++i){
+		const struct bench_result *b = NULL;
+		for (int j = 0; j < nbase && !b; ++j){
+			if (!strcmp(res[i].name, base[j].name) && !strcmp(res[i].tier, base[j].tier)){
+				b = &base[j];
+			}
+		}
+		if (!b || b->ns <= 0){
+			fprintf(fp, "%-24s %-7s %10s %10.3f %8s\n", res[i].name, res[i].tier, "-", res[i].ns, "new");
+			continue;
+		}
+		double change = (res[i].ns / b->ns - 1) * 100;
+		int slower = change > threshold;
+		regressions += slower;
+		fprintf(fp, "%-24s %-7s %10.3f %10.3f %+7.1f%%%s\n", res[i].name, res[i].tier, b->ns, res[i].ns,
+			change, slower ? "  REGRESSION" : "");
+	}
+	return regressions;
+}
+void usage(const char *prog){
+	fprintf(stderr, "usage: %s [-r runs] [-f filter] [-T tier] [-p] [-j out.json]"
+		" [-c baseline.json] [-t percent]\n", prog);
+}
+
+int main(int argc, char **argv){
+	/* Each case runs at most once per tier */
+	static struct bench_result results[CASE_COUNT * SSE_TIER_COUNT], baseline[MAX_RESULTS];
+	const char *filter = NULL, *json_file = NULL, *base_file = NULL;
+	/* -T, SSE_TIER_COUNT runs everything and only_inline just the untiered cases */
+	enum sse_tier only_tier = SSE_TIER_COUNT;
+	int only_inline = 0;
+	int runs = DEFAULT_RUNS, use_perf = 0, nres = 0, nbase = 0;
+	double threshold = 5;
+	int opt;
+	while ((opt = getopt(argc, argv, "r:f:T:pj:c:t:h")) != -1){
+		switch (opt){
+			case 'r':
+				runs = atoi(optarg);
+				break;
+			case 'f':
+				filter = optarg;
+				break;
+			case 'T':
+				only_inline = !strcmp(optarg, "inline");
+				only_tier = sse_tier_from_name(optarg);
+				if (only_tier == SSE_TIER_COUNT && !only_inline){
+					fprintf(stderr, "Unknown tier %s\n", optarg);
+					return 2;
+				}
+				break;
+			case 'p':
+				use_perf = 1;
+				break;
+			case 'j':
+				json_file = optarg;
+				break;
+			case 'c':
+				base_file = optarg;
+				break;
+			case 't':
+				threshold = atof(optarg);
+				break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	if (runs < 1 || runs > MAX_RUNS){
+		fprintf(stderr, "Runs must be between 1 and %d\n", MAX_RUNS);
+		return 2;
+	}
+	if (base_file){
+		nbase = load_baseline(base_file, baseline, MAX_RESULTS);
+		if (nbase < 0){
+			fprintf(stderr, "Failed to read baseline %s\n", base_file);
+			return 2;
+		}
+	}
+	if (use_perf && !perf_open()){
+		fprintf(stderr, "perf counters unavailable, check perf_event_paranoid\n");
+		use_perf = 0;
+	}
+	fill_inputs();
+
+	/* JSON to stdout replaces the table so it can be piped somewhere */
+	FILE *table = json_file && !strcmp(json_file, "-") ? stderr : stdout;
+	fprintf(table, "CPU supports up to %s, %d elements, best/median of %d runs\n",
+		sse_tier_name(sse_cpu_tier()), BENCH_N, runs);
+	fprintf(table, "%-24s %-7s %10s %10s %10s", "function", "tier", "ns/elem", "median", "tsc/elem");
+	if (use_perf){
+		fprintf(table, " %10s %10s %10s", "cyc/elem", "ins/elem", "l1d/elem");
+	}
+	fprintf(table, "\n");
+	for (size_t c = 0; c < CASE_COUNT; ++c){
+		if (filter && !strstr(cases[c].name, filter)){
+			continue;
+		}
+		for (int t = 0; t < SSE_TIER_COUNT; ++t){
+			const char *tier = "inline";
+			if (cases[c].tiered){
+				kern = sse_kernels_for_tier(t);
+				if (!kern || only_inline || (only_tier != SSE_TIER_COUNT && (enum sse_tier)t != only_tier)){
+					continue;
+				}
+				tier = kern->name;
+			}
+			else if (t > 0 || only_tier != SSE_TIER_COUNT){
+				break;
+			}
+			struct bench_result *r = &results[nres++];
+			run_case(&cases[c], tier, runs, use_perf, r);
+			fprintf(table, "%-24s %-7s %10.3f %10.3f %10.3f", r->name, r->tier, r->ns,
+				r->ns_median, r->tsc);
+			if (r->have_perf){
+				fprintf(table, " %10.3f %10.3f %10.4f", r->cycles, r->instructions, r->l1d_misses);
+			}
+			fprintf(table, "\n");
+		}
+	}
+	if (json_file){
+		FILE *fp = strcmp(json_file, "-") ? fopen(json_file, "w") : stdout;
+		if (!fp){
+			fprintf(stderr, "Failed to open %s\n", json_file);
+			return 2;
+		}
+		write_json(fp, results, nres, runs);
+		if (fp != stdout){
+			fclose(fp);
+		}
+	}
+	if (base_file){
+		int regressions = compare(table, results, nres, baseline, nbase, threshold);
+		if (regressions){
+			fprintf(table, "%d regressions over %.1f%%\n", regressions, threshold);
+			return 1;
+		}
+	}
+	return 0;
+}
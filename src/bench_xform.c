@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "xform.h"
+
+/*
+ * Time updating a big transform hierarchy when different fractions of its
+ * nodes move each frame, against recomputing every world matrix, reported in
+ * ticks (rdtsc) per node in the tree
+ */
+#define RUNS 9
+#define NODES (128 * 1024)
+
+/* Keeps the compiler from throwing the results away */
+volatile float sink;
+
+/* Recompute everything walking the handles, parents always come before children */
+void update_all(const struct xform_tree *t, mat4_t *world){
+	for (size_t h = 0; h < t->count; ++h){
+		xform_node_t p = t->parent_handle[h];
+		mat4_t local = xform_local(t, h);
+		world[h] = p == XFORM_NONE ? local : mat4_mult(world[p], local);
+	}
+}
+void build(struct xform_tree *t, int threads){
+	srand(7);
+	xform_tree_init(t, NODES, threads);
+	/* Something scene-like: a few roots, wide middle levels and some deeper chains */
+	for (int i = 0; i < 16; ++i){
+		xform_add(t, XFORM_NONE, mat4_translate(vec4_new(i, 0, 0, 1)));
+	}
+	for (int i = 16; i < NODES; ++i){
+		xform_node_t p = i < 1024 ? rand() % 16 : rand() % (i < 8192 ? 1024 : i);
+		xform_add(t, p, mat4_mult(mat4_translate(vec4_new(1, i % 3, 0, 1)),
+			mat4_rotate(i % 360, vec4_new(0, 1, 0, 0))));
+	}
+	xform_update(t);
+}
+/* Best of RUNS ticks per node, moving a random one in every stride nodes before each update */
+double time_update(struct xform_tree *t, size_t stride){
+	unsigned long long best = ~0ULL;
+	for (int r = 0; r < RUNS + 1; ++r){
+		for (size_t i = 0; i < t->count / stride; ++i){
+			xform_node_t h = stride == 1 ? i : (size_t)rand() % t->count;
+			xform_set_local(t, h, xform_local(t, h));
+		}
+		unsigned long long start = __rdtsc();
+		xform_update(t);
+		unsigned long long time = __rdtsc() - start;
+		/* First run is the warm up */
+		if (r > 0 && time < best){
+			best = time;
+		}
+		sink = xform_world(t, t->count - 1).col[3].f[0];
+	}
+	return (double)best / t->count;
+}
+
+int main(void){
+	size_t strides[] = { 1, 10, 100, 1000, 10000 };
+	struct xform_tree t1, t4;
+	build(&t1, 1);
+	build(&t4, 4);
+
+	mat4_t *world = _mm_malloc(NODES * sizeof(mat4_t), 64);
+	unsigned long long best = ~0ULL;
+	for (int r = 0; r < RUNS; ++r){
+		unsigned long long start = __rdtsc();
+		update_all(&t1, world);
+		unsigned long long time = __rdtsc() - start;
+		if (time < best){
+			best = time;
+		}
+		sink = world[NODES - 1].col[3].f[0];
+	}
+	printf("%d nodes, recomputing all of them: %.2f\n", NODES, (double)best / NODES);
+	printf("%10s %14s %14s\n", "moved", "1 thread", "4 threads");
+	for (size_t s = 0; s < sizeof(strides) / sizeof(strides[0]); ++s){
+		printf("%9.2f%% %14.3f %14.3f\n", 100.0 / strides[s], time_update(&t1, strides[s]),
+			time_update(&t4, strides[s]));
+	}
+	printf("(ticks per node in the tree, best of %d runs)\n", RUNS);
+	_mm_free(world);
+	xform_tree_destroy(&t1);
+	xform_tree_destroy(&t4);
+	return 0;
+}
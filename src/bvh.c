@@ -0,0 +1,415 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "jobs.h"
+#include "bvh.h"
+
+/* Bins per axis for the surface area heuristic */
+#define BINS 16
+/* Cost of visiting a node relative to testing a tri4_t */
+#define COST_NODE 1.f
+
+/* A range of the triangle ids, with the bounds of the triangles and of their centroids */
+struct range {
+	uint32_t lo, hi;
+	aabb_t bounds, cbounds;
+};
+/* A child being set up, either a leaf or the split it'll start its own node with */
+struct child {
+	struct range r, split[2];
+	int leaf;
+};
+/* A subtree forked off to be built by any thread */
+struct subtree {
+	struct job job;
+	struct build *c;
+	uint32_t node;
+	int depth;
+	struct range split[2];
+};
+struct build {
+	struct bvh *b;
+	const vec4_t *verts;
+	uint32_t *ids;
+	vec4_t *centroids;
+	aabb_t *boxes;
+	/* Bumped atomically as the threads allocate nodes and tri4_ts */
+	uint32_t node_count, tri4_count;
+	/* NULL if it's all built on the calling thread */
+	struct jobs *jobs;
+};
+
+static void build_node(struct build *c, uint32_t node, const struct range split[2], int depth);
+
+static aabb_t aabb_empty(void){
+	aabb_t b;
+	b.min = vec4_new(INFINITY, INFINITY, INFINITY, INFINITY);
+	b.max = vec4_new(-INFINITY, -INFINITY, -INFINITY, -INFINITY);
+	return b;
+}
+static aabb_t aabb_union(aabb_t a, aabb_t b){
+	a.min.v = _mm_min_ps(a.min.v, b.min.v);
+	a.max.v = _mm_max_ps(a.max.v, b.max.v);
+	return a;
+}
+static float half_area(aabb_t b){
+	vec4_t e = vec4_sub(b.max, b.min);
+	return e.f[0] * e.f[1] + e.f[1] * e.f[2] + e.f[2] * e.f[0];
+}
+static aabb_t tri_bounds(const vec4_t *v){
+	aabb_t b;
+	b.min.v = _mm_min_ps(v[0].v, _mm_min_ps(v[1].v, v[2].v));
+	b.max.v = _mm_max_ps(v[0].v, _mm_max_ps(v[1].v, v[2].v));
+	return b;
+}
+static uint32_t tri4s_for(uint32_t n){
+	return (n + 3) / 4;
+}
+static void range_bounds(const struct build *c, struct range *r){
+	r->bounds = aabb_empty();
+	r->cbounds = aabb_empty();
+	for (uint32_t i = r->lo; i < r->hi; ++i){
+		uint32_t id = c->ids[i];
+		r->bounds = aabb_union(r->bounds, c->boxes[id]);
+		r->cbounds.min.v = _mm_min_ps(r->cbounds.min.v, c->centroids[id].v);
+		r->cbounds.max.v = _mm_max_ps(r->cbounds.max.v, c->centroids[id].v);
+	}
+}
+static int bin_of(float x, float min, float k){
+	int b = (int)((x - min) * k);
+	return b < 0 ? 0 : b >= BINS ? BINS - 1 : b;
+}
+/*
+ * Split r in two with the binned SAH, writing the halves to out. Returns 0 if
+ * it's better off as a leaf. Past BVH_MAX_DEPTH, or if the centroids are all
+ * in the same spot, ranges too big for a leaf are split in half instead
+ */
+static int split_range(struct build *c, const struct range *r, int depth, struct range out[2]){
+	uint32_t n = r->hi - r->lo;
+	uint32_t split = 0;
+	if (n <= 4){
+		return 0;
+	}
+	vec4_t ext = vec4_sub(r->cbounds.max, r->cbounds.min);
+	if (depth < BVH_MAX_DEPTH && (ext.f[0] > 0 || ext.f[1] > 0 || ext.f[2] > 0)){
+		struct {
+			aabb_t b;
+			uint32_t n;
+		} bins[3][BINS];
+		float k[3];
+		for (int a = 0; a < 3; ++a){
+			k[a] = ext.f[a] > 0 ? BINS / ext.f[a] : 0;
+			for (int i = 0; i < BINS; ++i){
+				bins[a][i].b = aabb_empty();
+				bins[a][i].n = 0;
+			}
+		}
+		for (uint32_t i = r->lo; i < r->hi; ++i){
+			uint32_t id = c->ids[i];
+			for (int a = 0; a < 3; ++a){
+				int j = bin_of(c->centroids[id].f[a], r->cbounds.min.f[a], k[a]);
+				bins[a][j].b = aabb_union(bins[a][j].b, c->boxes[id]);
+				++bins[a][j].n;
+			}
+		}
+		/* Sweep from the right to get the areas right of each split, then from the left */
+		float best = INFINITY;
+		int best_axis = 0, best_bin = 0;
+		for (int a = 0; a < 3; ++a){
+			if (ext.f[a] <= 0){
+				continue;
+			}
+			float right_area[BINS];
+			uint32_t right_n[BINS];
+			aabb_t acc = aabb_empty();
+			uint32_t count = 0;
+			for (int i = BINS - 1; i > 0; --i){
+				acc = aabb_union(acc, bins[a][i].b);
+				count += bins[a][i].n;
+				right_area[i] = count ? half_area(acc) : 0;
+				right_n[i] = count;
+			}
+			acc = aabb_empty();
+			count = 0;
+			for (int i = 0; i < BINS - 1; ++i){
+				acc = aabb_union(acc, bins[a][i].b);
+				count += bins[a][i].n;
+				if (!count || !right_n[i + 1]){
+					continue;
+				}
+				float cost = half_area(acc) * tri4s_for(count) + right_area[i + 1] * tri4s_for(right_n[i + 1]);
+				if (cost < best){
+					best = cost;
+					best_axis = a;
+					best_bin = i;
+				}
+			}
+		}
+		if (best < INFINITY){
+			float area = half_area(r->bounds);
+			float split_cost = area > 0 ? COST_NODE + best / area : INFINITY;
+			if (n <= BVH_LEAF_MAX && tri4s_for(n) <= split_cost){
+				return 0;
+			}
+			uint32_t i = r->lo, j = r->hi;
+			float min = r->cbounds.min.f[best_axis], kb = k[best_axis];
+			while (i < j){
+				if (bin_of(c->centroids[c->ids[i]].f[best_axis], min, kb) <= best_bin){
+					++i;
+				}
+				else {
+					uint32_t tmp = c->ids[i];
+					c->ids[i] = c->ids[--j];
+					c->ids[j] = tmp;
+				}
+			}
+			split = i;
+		}
+	}
+	if (!split){
+		if (n <= BVH_LEAF_MAX){
+			return 0;
+		}
+		split = r->lo + n / 2;
+	}
+	out[0].lo = r->lo;
+	out[0].hi = split;
+	out[1].lo = split;
+	out[1].hi = r->hi;
+	range_bounds(c, &out[0]);
+	range_bounds(c, &out[1]);
+	return 1;
+}
+/* Check the decoded value q for an axis is below/above v, with and without FMA */
+static int decodes_above(float origin, float scale, int q, float v){
+	return origin + q * scale > v || fmaf(q, scale, origin) > v;
+}
+static int decodes_below(float origin, float scale, int q, float v){
+	return origin + q * scale < v || fmaf(q, scale, origin) < v;
+}
+/*
+ * Store the child boxes in the node, rounding outwards so the decoded boxes
+ * contain them. Unused children get inside out boxes. Returns the node's bounds
+ */
+static aabb_t quantize(struct bvh_node *n, const aabb_t *boxes, int count){
+	aabb_t all = aabb_empty();
+	for (int i = 0; i < count; ++i){
+		all = aabb_union(all, boxes[i]);
+	}
+	for (int a = 0; a < 3; ++a){
+		float origin = count ? all.min.f[a] : 0;
+		float scale = count ? (all.max.f[a] - origin) / 255 : 0;
+		while (count && decodes_below(origin, scale, 255, all.max.f[a])){
+			scale = nextafterf(scale, INFINITY);
+		}
+		n->origin[a] = origin;
+		n->scale[a] = scale;
+		for (int i = 0; i < 4; ++i){
+			int lo = 255, hi = 0;
+			if (i < count && scale == 0){
+				lo = hi = 0;
+			}
+			else if (i < count){
+				lo = (int)floorf((boxes[i].min.f[a] - origin) / scale);
+				hi = (int)ceilf((boxes[i].max.f[a] - origin) / scale);
+				lo = lo < 0 ? 0 : lo > 255 ? 255 : lo;
+				hi = hi < 0 ? 0 : hi > 255 ? 255 : hi;
+				while (lo > 0 && decodes_above(origin, scale, lo, boxes[i].min.f[a])){
+					--lo;
+				}
+				while (hi < 255 && decodes_below(origin, scale, hi, boxes[i].max.f[a])){
+					++hi;
+				}
+			}
+			n->q[a][0][i] = lo;
+			n->q[a][1][i] = hi;
+		}
+	}
+	return all;
+}
+/* Pack n (<= 4) triangles by id, the prim of each lane is the triangle's id */
+static tri4_t pack_tris(const vec4_t *verts, const uint32_t *ids, size_t n){
+	tri_t t[4];
+	for (size_t i = 0; i < n; ++i){
+		t[i].v0 = verts[3 * ids[i]];
+		t[i].v1 = verts[3 * ids[i] + 1];
+		t[i].v2 = verts[3 * ids[i] + 2];
+	}
+	tri4_t p = tri4_new(t, n, 0);
+	for (size_t i = 0; i < n; ++i){
+		p.prim[i] = ids[i];
+	}
+	return p;
+}
+static uint32_t make_leaf(struct build *c, const struct range *r){
+	uint32_t n = r->hi - r->lo;
+	uint32_t count = tri4s_for(n);
+	uint32_t first = __sync_fetch_and_add(&c->tri4_count, count);
+	for (uint32_t i = 0; i < count; ++i){
+		uint32_t lanes = n - 4 * i < 4 ? n - 4 * i : 4;
+		c->b->tris[first + i] = pack_tris(c->verts, c->ids + r->lo + 4 * i, lanes);
+	}
+	return BVH_LEAF | (count - 1) << BVH_LEAF_SHIFT | first;
+}
+static void build_subtree(struct job *job){
+	struct subtree *t = (struct subtree*)job;
+	build_node(t->c, t->node, t->split, t->depth);
+}
+/*
+ * Fill in a node that starts with the two halves of split as its children,
+ * splitting the biggest child until there are 4 or none are worth splitting
+ */
+static void build_node(struct build *c, uint32_t node, const struct range split[2], int depth){
+	struct child k[4];
+	int count = 2;
+	for (int i = 0; i < 2; ++i){
+		k[i].r = split[i];
+		k[i].leaf = !split_range(c, &k[i].r, depth + 1, k[i].split);
+	}
+	while (count < 4){
+		int best = -1;
+		float area = -1;
+		for (int i = 0; i < count; ++i){
+			if (!k[i].leaf && half_area(k[i].r.bounds) > area){
+				best = i;
+				area = half_area(k[i].r.bounds);
+			}
+		}
+		if (best < 0){
+			break;
+		}
+		k[count].r = k[best].split[1];
+		k[best].r = k[best].split[0];
+		k[best].leaf = !split_range(c, &k[best].r, depth + 1, k[best].split);
+		k[count].leaf = !split_range(c, &k[count].r, depth + 1, k[count].split);
+		++count;
+	}
+
+	struct bvh_node *n = c->b->nodes + node;
+	aabb_t boxes[4];
+	for (int i = 0; i < 4; ++i){
+		if (i >= count){
+			n->child[i] = BVH_EMPTY;
+			continue;
+		}
+		boxes[i] = k[i].r.bounds;
+		n->child[i] = k[i].leaf ? make_leaf(c, &k[i].r) : __sync_fetch_and_add(&c->node_count, 1);
+	}
+	c->b->bounds[node] = quantize(n, boxes, count);
+	/* Big subtrees are forked off for other threads to pick up, the rest are built here */
+	struct subtree sub[4];
+	struct job_group g = { 0 };
+	for (int i = 0; i < count; ++i){
+		if (k[i].leaf){
+			continue;
+		}
+		sub[i].job.run = build_subtree;
+		sub[i].c = c;
+		sub[i].node = n->child[i];
+		sub[i].depth = depth + 1;
+		sub[i].split[0] = k[i].split[0];
+		sub[i].split[1] = k[i].split[1];
+		if (c->jobs && k[i].r.hi - k[i].r.lo >= BVH_PARALLEL_MIN){
+			jobs_fork(c->jobs, &g, &sub[i].job);
+		}
+		else {
+			build_subtree(&sub[i].job);
+		}
+	}
+	jobs_join(c->jobs, &g);
+}
+int bvh_build(struct bvh *b, const vec4_t *verts, size_t n, int threads){
+	memset(b, 0, sizeof(*b));
+	if (n >= BVH_LEAF_FIRST){
+		return 0;
+	}
+	/*
+	 * There are at most n leaves, so fewer than n inner nodes and at most n
+	 * tri4_ts. Those are upper bounds and the arena's pages are only touched as
+	 * they're used, so the unused tail doesn't cost anything
+	 */
+	size_t cap = n + 1;
+	size_t pad = ARENA_CACHE_LINE;
+	size_t keep = cap * (sizeof(struct bvh_node) + sizeof(aabb_t) + sizeof(tri4_t)) + 3 * pad;
+	size_t scratch = cap * (sizeof(uint32_t) + sizeof(vec4_t) + sizeof(aabb_t)) + 3 * pad;
+	int flags = keep >= 16 * 1024 * 1024 ? ARENA_HUGE_PAGES : 0;
+	if (!arena_init(&b->mem, keep + scratch, flags)){
+		return 0;
+	}
+	b->nodes = arena_alloc(&b->mem, cap * sizeof(struct bvh_node), ARENA_CACHE_LINE);
+	b->bounds = arena_alloc(&b->mem, cap * sizeof(aabb_t), ARENA_CACHE_LINE);
+	b->tris = arena_alloc(&b->mem, cap * sizeof(tri4_t), ARENA_CACHE_LINE);
+	b->tri_count = n;
+
+	arena_mark_t mark = arena_mark(&b->mem);
+	struct build c;
+	memset(&c, 0, sizeof(c));
+	c.b = b;
+	c.verts = verts;
+	c.ids = arena_alloc(&b->mem, cap * sizeof(uint32_t), ARENA_CACHE_LINE);
+	c.centroids = arena_alloc_vec4(&b->mem, cap);
+	c.boxes = arena_alloc(&b->mem, cap * sizeof(aabb_t), ARENA_CACHE_LINE);
+	for (size_t i = 0; i < n; ++i){
+		c.ids[i] = i;
+		c.boxes[i] = tri_bounds(verts + 3 * i);
+		c.centroids[i] = vec4_scale(vec4_add(c.boxes[i].min, c.boxes[i].max), 0.5f);
+	}
+	struct range root = { 0, n, aabb_empty(), aabb_empty() };
+	range_bounds(&c, &root);
+	c.node_count = 1;
+	struct range split[2];
+	if (split_range(&c, &root, 0, split)){
+		if (threads > 1 && n >= BVH_PARALLEL_MIN){
+			c.jobs = jobs_create(threads, 0);
+		}
+		build_node(&c, 0, split, 0);
+		jobs_destroy(c.jobs);
+	}
+	else {
+		/* Few enough triangles for the root to have one leaf */
+		int count = n ? 1 : 0;
+		b->nodes[0].child[0] = n ? make_leaf(&c, &root) : BVH_EMPTY;
+		for (int i = 1; i < 4; ++i){
+			b->nodes[0].child[i] = BVH_EMPTY;
+		}
+		b->bounds[0] = quantize(b->nodes, &root.bounds, count);
+	}
+	b->node_count = c.node_count;
+	b->tri4_count = c.tri4_count;
+	arena_reset_to(&b->mem, mark);
+	return 1;
+}
+void bvh_destroy(struct bvh *b){
+	arena_destroy(&b->mem);
+	memset(b, 0, sizeof(*b));
+}
+/* Repack a leaf's triangles from the new vertices and get its bounds */
+static aabb_t refit_leaf(struct bvh *b, uint32_t ref, const vec4_t *verts){
+	tri4_t *tris = b->tris + (ref & BVH_LEAF_FIRST);
+	size_t count = ((ref & ~BVH_LEAF) >> BVH_LEAF_SHIFT) + 1;
+	aabb_t box = aabb_empty();
+	for (size_t i = 0; i < count; ++i){
+		uint32_t ids[4];
+		size_t lanes = 0;
+		for (; lanes < 4 && tris[i].prim[lanes] != RAY_MISS; ++lanes){
+			ids[lanes] = tris[i].prim[lanes];
+			box = aabb_union(box, tri_bounds(verts + 3 * ids[lanes]));
+		}
+		tris[i] = pack_tris(verts, ids, lanes);
+	}
+	return box;
+}
+void bvh_refit(struct bvh *b, const vec4_t *verts){
+	/* Children come after their parents, so going backwards does them first */
+	for (size_t i = b->node_count; i-- > 0;){
+		struct bvh_node *n = b->nodes + i;
+		aabb_t boxes[4];
+		int count = 0;
+		for (; count < 4 && n->child[count] != BVH_EMPTY; ++count){
+			uint32_t ref = n->child[count];
+			boxes[count] = ref & BVH_LEAF ? refit_leaf(b, ref, verts) : b->bounds[ref];
+		}
+		b->bounds[i] = quantize(n, boxes, count);
+	}
+}
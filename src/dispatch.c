@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cpuid.h>
+#include "dispatch.h"
+
+extern const struct sse_kernels sse_kernels_sse2;
+extern const struct sse_kernels sse_kernels_sse41;
+extern const struct sse_kernels sse_kernels_avx2;
+extern const struct sse_kernels sse_kernels_avx512;
+
+static const struct sse_kernels *tier_tables[SSE_TIER_COUNT] = {
+	&sse_kernels_sse2, &sse_kernels_sse41, &sse_kernels_avx2, &sse_kernels_avx512
+};
+static const char *tier_names[SSE_TIER_COUNT] = { "sse2", "sse41", "avx2", "avx512" };
+
+/* SSE2 is the x86-64 baseline so it's always safe to start with */
+const struct sse_kernels *sse_kernels = &sse_kernels_sse2;
+
+/* Read the OS's enabled register state, only valid if cpuid reports OSXSAVE */
+static unsigned long long xgetbv(void){
+	unsigned int lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+}
+enum sse_tier sse_cpu_tier(void){
+	static int tier = -1;
+	if (tier != -1){
+		return tier;
+	}
+	unsigned int eax, ebx, ecx, edx;
+	tier = SSE_TIER_SSE2;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)){
+		return tier;
+	}
+	tier = SSE_TIER_SSE41;
+	/* The OS must be saving the YMM (and for AVX-512 the ZMM and mask) registers */
+	int fma = ecx & bit_FMA, f16c = ecx & bit_F16C;
+	if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)){
+		return tier;
+	}
+	unsigned long long xcr0 = xgetbv();
+	if ((xcr0 & 0x6) != 0x6 || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)){
+		return tier;
+	}
+	if (!(ebx & bit_AVX2) || !fma || !f16c){
+		return tier;
+	}
+	tier = SSE_TIER_AVX2;
+	const unsigned int avx512 = bit_AVX512F | bit_AVX512VL | bit_AVX512DQ | bit_AVX512BW;
+	if ((xcr0 & 0xe6) == 0xe6 && (ebx & avx512) == avx512){
+		tier = SSE_TIER_AVX512;
+	}
+	return tier;
+}
+const struct sse_kernels* sse_kernels_for_tier(enum sse_tier tier){
+	if (tier >= SSE_TIER_COUNT || tier > sse_cpu_tier()){
+		return NULL;
+	}
+	return tier_tables[tier];
+}
+const struct sse_kernels* sse_dispatch_set_tier(enum sse_tier tier){
+	enum sse_tier best = sse_cpu_tier();
+	if (tier > best){
+		tier = best;
+	}
+	sse_kernels = tier_tables[tier];
+	return sse_kernels;
+}
+const char* sse_tier_name(enum sse_tier tier){
+	return tier < SSE_TIER_COUNT ? tier_names[tier] : "unknown";
+}
+enum sse_tier sse_tier_from_name(const char *name){
+	for (int i = 0; i < SSE_TIER_COUNT; ++i){
+		if (strcmp(name, tier_names[i]) == 0){
+			return i;
+		}
+	}
+	return SSE_TIER_COUNT;
+}
+/* Pick the tier once at startup, before main */
+__attribute__((constructor)) static void sse_dispatch_init(void){
+	enum sse_tier tier = sse_cpu_tier();
+	const char *force = getenv("SSE_FIDDLE_TIER");
+	if (force && *force){
+		enum sse_tier t = sse_tier_from_name(force);
+		if (t == SSE_TIER_COUNT){
+			fprintf(stderr, "SSE_FIDDLE_TIER: unknown tier '%s', using %s\n",
+				force, sse_tier_name(tier));
+		}
+		else if (t > tier){
+			fprintf(stderr, "SSE_FIDDLE_TIER: %s isn't supported by this CPU, using %s\n",
+				force, sse_tier_name(tier));
+		}
+		else {
+			tier = t;
+		}
+	}
+	sse_dispatch_set_tier(tier);
+}
+
@@ -0,0 +1,499 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "arena.h"
+#include "dispatch.h"
+#include "jobs.h"
+
+/* Failed attempts to find a job before an idle worker goes to sleep */
+#define IDLE_SPINS 64
+/* Most chunks the culling kernels are split into, the counts of each are kept on the stack */
+#define CULL_CHUNKS 256
+
+/*
+ * A Chase-Lev deque: the owning thread pushes and pops at the bottom and other
+ * threads steal from the top. Only taking the last job needs a compare and swap
+ * against the thieves. top and bottom are on their own cache lines so thieves
+ * polling top don't keep taking bottom away from the owner
+ */
+struct deque {
+	int64_t top ALIGN_64;
+	int64_t bottom ALIGN_64;
+	struct job *jobs[JOBS_DEQUE_SIZE] ALIGN_64;
+};
+struct worker {
+	struct jobs *pool;
+	struct deque *deque;
+	pthread_t thread;
+	int index;
+	uint32_t rand;
+};
+struct jobs {
+	/* Workers, including worker 0 for the creating thread, and how many threads were started */
+	int count, started;
+	struct worker *workers;
+	/* Bumped each time a job is pushed, sleeping workers wait for it to change */
+	unsigned epoch;
+	int sleeping, quit;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	struct arena mem;
+};
+
+/* Pool and worker of the current thread, threads that aren't workers of a pool use worker 0 */
+static __thread struct jobs *tls_pool;
+static __thread int tls_index;
+
+static int deque_push(struct deque *d, struct job *job){
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+	int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	if (b - t >= JOBS_DEQUE_SIZE){
+		return 0;
+	}
+	__atomic_store_n(&d->jobs[b & (JOBS_DEQUE_SIZE - 1)], job, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	return 1;
+}
+static struct job* deque_pop(struct deque *d){
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+	if (t > b){
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	struct job *job = __atomic_load_n(&d->jobs[b & (JOBS_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+	if (t == b){
+		/* The last job, race any thieves for it */
+		if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)){
+			job = NULL;
+		}
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+	return job;
+}
+static struct job* deque_steal(struct deque *d){
+	int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+	if (t >= b){
+		return NULL;
+	}
+	struct job *job = __atomic_load_n(&d->jobs[t & (JOBS_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)){
+		return NULL;
+	}
+	return job;
+}
+
+static struct worker* current_worker(struct jobs *j){
+	return j->workers + (tls_pool == j ? tls_index : 0);
+}
+/* Take a job from our own deque or else try stealing one, starting from a random victim */
+static struct job* find_job(struct jobs *j, struct worker *w){
+	struct job *job = deque_pop(w->deque);
+	if (job){
+		return job;
+	}
+	w->rand ^= w->rand << 13;
+	w->rand ^= w->rand >> 17;
+	w->rand ^= w->rand << 5;
+	int start = w->rand % j->count;
+	for (int i = 0; i < j->count; ++i){
+		int v = (start + i) % j->count;
+		if (v != w->index && (job = deque_steal(j->workers[v].deque))){
+			return job;
+		}
+	}
+	return NULL;
+}
+static void run_job(struct job *job){
+	/* The job's memory belongs to whoever joins the group, so don't touch it once it's counted done */
+	struct job_group *g = job->group;
+	job->run(job);
+	__atomic_sub_fetch(&g->pending, 1, __ATOMIC_RELEASE);
+}
+static void* worker_main(void *arg){
+	struct worker *w = arg;
+	struct jobs *j = w->pool;
+	tls_pool = j;
+	tls_index = w->index;
+	int idle = 0;
+	for (;;){
+		unsigned epoch = __atomic_load_n(&j->epoch, __ATOMIC_SEQ_CST);
+		struct job *job = find_job(j, w);
+		if (job){
+			run_job(job);
+			idle = 0;
+			continue;
+		}
+		if (__atomic_load_n(&j->quit, __ATOMIC_ACQUIRE)){
+			break;
+		}
+		if (++idle < IDLE_SPINS){
+			sched_yield();
+			continue;
+		}
+		/*
+		 * Anything pushed after we read epoch changes it, and the pusher
+		 * sees sleeping set before we wait, so the wake up can't be missed
+		 */
+		pthread_mutex_lock(&j->lock);
+		__atomic_add_fetch(&j->sleeping, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&j->epoch, __ATOMIC_SEQ_CST) == epoch && !j->quit){
+			pthread_cond_wait(&j->wake, &j->lock);
+		}
+		__atomic_sub_fetch(&j->sleeping, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&j->lock);
+		idle = 0;
+	}
+	return NULL;
+}
+/* Pin worker i to the i'th CPU the process is allowed on, wrapping around if there are fewer */
+static void pin_worker(struct worker *w){
+	cpu_set_t allowed, one;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0){
+		return;
+	}
+	int nth = w->index % CPU_COUNT(&allowed);
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu){
+		if (CPU_ISSET(cpu, &allowed) && nth-- == 0){
+			CPU_ZERO(&one);
+			CPU_SET(cpu, &one);
+			pthread_setaffinity_np(w->thread, sizeof(one), &one);
+			return;
+		}
+	}
+}
+struct jobs* jobs_create(int threads, int flags){
+	if (threads <= 0){
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = threads > 0 ? threads : 1;
+	}
+	size_t pad = ARENA_CACHE_LINE;
+	size_t size = sizeof(struct jobs) + threads * (sizeof(struct worker) + sizeof(struct deque)) + (threads + 2) * pad;
+	struct arena mem;
+	if (!arena_init(&mem, size, 0)){
+		return NULL;
+	}
+	struct jobs *j = arena_alloc(&mem, sizeof(struct jobs), ARENA_CACHE_LINE);
+	memset(j, 0, sizeof(*j));
+	j->mem = mem;
+	j->count = threads;
+	j->workers = arena_alloc(&j->mem, threads * sizeof(struct worker), ARENA_CACHE_LINE);
+	memset(j->workers, 0, threads * sizeof(struct worker));
+	for (int i = 0; i < threads; ++i){
+		struct worker *w = j->workers + i;
+		w->pool = j;
+		w->index = i;
+		w->rand = 2654435761u * (i + 1);
+		w->deque = arena_alloc(&j->mem, sizeof(struct deque), ARENA_CACHE_LINE);
+		memset(w->deque, 0, sizeof(struct deque));
+	}
+	pthread_mutex_init(&j->lock, NULL);
+	pthread_cond_init(&j->wake, NULL);
+	for (int i = 1; i < threads; ++i){
+		if (pthread_create(&j->workers[i].thread, NULL, worker_main, &j->workers[i]) != 0){
+			jobs_destroy(j);
+			return NULL;
+		}
+		++j->started;
+		if (flags & JOBS_PIN){
+			pin_worker(&j->workers[i]);
+		}
+	}
+	return j;
+}
+void jobs_destroy(struct jobs *j){
+	if (!j){
+		return;
+	}
+	pthread_mutex_lock(&j->lock);
+	__atomic_store_n(&j->quit, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&j->epoch, 1, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&j->wake);
+	pthread_mutex_unlock(&j->lock);
+	for (int i = 1; i <= j->started; ++i){
+		pthread_join(j->workers[i].thread, NULL);
+	}
+	pthread_mutex_destroy(&j->lock);
+	pthread_cond_destroy(&j->wake);
+	struct arena mem = j->mem;
+	arena_destroy(&mem);
+}
+int jobs_thread_count(const struct jobs *j){
+	return j ? j->count : 1;
+}
+void jobs_fork(struct jobs *j, struct job_group *g, struct job *job){
+	job->group = g;
+	if (!j || j->count == 1){
+		job->run(job);
+		return;
+	}
+	__atomic_add_fetch(&g->pending, 1, __ATOMIC_RELAXED);
+	if (!deque_push(current_worker(j)->deque, job)){
+		run_job(job);
+		return;
+	}
+	__atomic_add_fetch(&j->epoch, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&j->sleeping, __ATOMIC_SEQ_CST)){
+		pthread_mutex_lock(&j->lock);
+		pthread_cond_signal(&j->wake);
+		pthread_mutex_unlock(&j->lock);
+	}
+}
+void jobs_join(struct jobs *j, struct job_group *g){
+	if (!j){
+		return;
+	}
+	struct worker *w = current_worker(j);
+	while (__atomic_load_n(&g->pending, __ATOMIC_ACQUIRE)){
+		/* Our own jobs are on the bottom of the deque, so we'll usually be running the group's */
+		struct job *job = find_job(j, w);
+		if (job){
+			run_job(job);
+		}
+		else {
+			sched_yield();
+		}
+	}
+}
+
+struct range_job {
+	struct job job;
+	struct jobs *pool;
+	void (*fn)(void *arg, size_t lo, size_t hi);
+	void *arg;
+	size_t lo, hi, grain;
+};
+static void run_range(struct job *job);
+/* Fork off the top half of the range until it's small enough, then run it */
+static void split_range(struct jobs *j, void (*fn)(void *arg, size_t lo, size_t hi), void *arg,
+	size_t lo, size_t hi, size_t grain)
+{
+	struct job_group g = { 0 };
+	struct range_job top[64];
+	int forked = 0;
+	while (hi - lo > grain){
+		size_t mid = lo + (hi - lo) / 2;
+		if (grain >= 32){
+			mid = (mid + 8) & ~(size_t)15;
+		}
+		struct range_job *t = &top[forked++];
+		t->job.run = run_range;
+		t->pool = j;
+		t->fn = fn;
+		t->arg = arg;
+		t->lo = mid;
+		t->hi = hi;
+		t->grain = grain;
+		jobs_fork(j, &g, &t->job);
+		hi = mid;
+	}
+	fn(arg, lo, hi);
+	jobs_join(j, &g);
+}
+static void run_range(struct job *job){
+	struct range_job *t = (struct range_job*)job;
+	split_range(t->pool, t->fn, t->arg, t->lo, t->hi, t->grain);
+}
+void jobs_parallel_for(struct jobs *j, size_t n, size_t grain,
+	void (*fn)(void *arg, size_t lo, size_t hi), void *arg)
+{
+	if (grain == 0){
+		grain = JOBS_GRAIN(vec4_t);
+	}
+	if (!j || j->count == 1 || n <= grain){
+		if (n){
+			fn(arg, 0, n);
+		}
+		return;
+	}
+	split_range(j, fn, arg, 0, n, grain);
+}
+
+/* Arguments of any of the kernels, each uses the ones it needs */
+struct kernel_args {
+	const mat4_t *m, *a, *b;
+	const vec4_t *in;
+	vec4_t *out;
+	mat4_t *mout;
+	const float *f[4];
+	float *det;
+	const frustum_t *frustum;
+	const void *objects;
+	uint32_t *visible;
+	size_t n, chunk, chunks, counts[CULL_CHUNKS];
+	int spheres;
+	const tri_t *tris;
+	size_t n_tris;
+	const ray_t *rays;
+	hit_t *hits;
+};
+static void vec_mult_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->vec_mult_n(k->m, k->in + lo, k->out + lo, hi - lo);
+}
+static void transform_points_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->transform_points(k->m, k->in + lo, k->out + lo, hi - lo);
+}
+static void transform_vectors_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->transform_vectors(k->m, k->in + lo, k->out + lo, hi - lo);
+}
+static void project_points_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->project_points(k->m, k->in + lo, k->out + lo, hi - lo);
+}
+static void mult_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->mult_n(k->a + lo, k->b + lo, k->mout + lo, hi - lo);
+}
+static void premult_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->premult_n(k->a, k->b + lo, k->mout + lo, hi - lo);
+}
+static void inverse_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->inverse_n(k->m + lo, k->mout + lo, k->det ? k->det + lo : NULL, hi - lo);
+}
+static void transpose_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->transpose_n(k->m + lo, k->mout + lo, hi - lo);
+}
+static void inverse_affine_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->inverse_affine_n(k->m + lo, k->mout + lo, hi - lo);
+}
+static void inverse_rigid_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->inverse_rigid_n(k->m + lo, k->mout + lo, hi - lo);
+}
+static void normal_matrix_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->normal_matrix_n(k->m + lo, k->mout + lo, hi - lo);
+}
+static void rotate_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->rotate_n(k->f[0] + lo, k->in + lo, k->mout + lo, hi - lo);
+}
+static void perspective_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->perspective_n(k->f[0] + lo, k->f[1] + lo, k->f[2] + lo, k->f[3] + lo, k->mout + lo, hi - lo);
+}
+static void intersect_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	sse_kernels->intersect_tris(k->tris, k->n_tris, k->rays + lo, k->hits + lo, hi - lo);
+}
+
+void jobs_vec_mult_n(struct jobs *j, const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	struct kernel_args k = { .m = m, .in = in, .out = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(vec4_t), vec_mult_range, &k);
+}
+void jobs_transform_points(struct jobs *j, const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	struct kernel_args k = { .m = m, .in = in, .out = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(vec4_t), transform_points_range, &k);
+}
+void jobs_transform_vectors(struct jobs *j, const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	struct kernel_args k = { .m = m, .in = in, .out = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(vec4_t), transform_vectors_range, &k);
+}
+void jobs_project_points(struct jobs *j, const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	struct kernel_args k = { .m = m, .in = in, .out = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(vec4_t), project_points_range, &k);
+}
+void jobs_mult_n(struct jobs *j, const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	struct kernel_args k = { .a = a, .b = b, .mout = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(mat4_t), mult_range, &k);
+}
+void jobs_premult_n(struct jobs *j, const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	struct kernel_args k = { .a = a, .b = b, .mout = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(mat4_t), premult_range, &k);
+}
+void jobs_inverse_n(struct jobs *j, const mat4_t *in, mat4_t *out, float *det, size_t n){
+	struct kernel_args k = { .m = in, .mout = out, .det = det };
+	jobs_parallel_for(j, n, JOBS_GRAIN(mat4_t), inverse_range, &k);
+}
+void jobs_transpose_n(struct jobs *j, const mat4_t *in, mat4_t *out, size_t n){
+	struct kernel_args k = { .m = in, .mout = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(mat4_t), transpose_range, &k);
+}
+void jobs_inverse_affine_n(struct jobs *j, const mat4_t *in, mat4_t *out, size_t n){
+	struct kernel_args k = { .m = in, .mout = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(mat4_t), inverse_affine_range, &k);
+}
+void jobs_inverse_rigid_n(struct jobs *j, const mat4_t *in, mat4_t *out, size_t n){
+	struct kernel_args k = { .m = in, .mout = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(mat4_t), inverse_rigid_range, &k);
+}
+void jobs_normal_matrix_n(struct jobs *j, const mat4_t *in, mat4_t *out, size_t n){
+	struct kernel_args k = { .m = in, .mout = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(mat4_t), normal_matrix_range, &k);
+}
+void jobs_rotate_n(struct jobs *j, const float *d, const vec4_t *axis, mat4_t *out, size_t n){
+	struct kernel_args k = { .f = { d }, .in = axis, .mout = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(mat4_t), rotate_range, &k);
+}
+void jobs_perspective_n(struct jobs *j, const float *fovY, const float *aspect, const float *near,
+	const float *far, mat4_t *out, size_t n)
+{
+	struct kernel_args k = { .f = { fovY, aspect, near, far }, .mout = out };
+	jobs_parallel_for(j, n, JOBS_GRAIN(mat4_t), perspective_range, &k);
+}
+
+/*
+ * Cull chunks of the objects into their own part of visible, with the indices
+ * offset to the whole array. The last chunk also takes the remainder
+ */
+static void cull_range(void *arg, size_t lo, size_t hi){
+	struct kernel_args *k = arg;
+	for (size_t c = lo; c < hi; ++c){
+		size_t first = c * k->chunk;
+		size_t n = c == k->chunks - 1 ? k->n - first : k->chunk;
+		uint32_t *vis = k->visible + first;
+		size_t count = k->spheres
+			? sse_kernels->cull_spheres(k->frustum, (const vec4_t*)k->objects + first, n, vis)
+			: sse_kernels->cull_aabbs(k->frustum, (const aabb_t*)k->objects + first, n, vis);
+		for (size_t i = 0; i < count; ++i){
+			vis[i] += first;
+		}
+		k->counts[c] = count;
+	}
+}
+/* Cull the chunks in parallel then pack their indices down to the front of visible */
+static size_t cull(struct jobs *j, struct kernel_args *k, size_t grain){
+	k->chunk = grain > k->n / CULL_CHUNKS ? grain : (k->n / CULL_CHUNKS + 16) & ~(size_t)15;
+	k->chunks = k->n / k->chunk;
+	if (k->chunks == 0){
+		k->chunks = 1;
+	}
+	jobs_parallel_for(j, k->chunks, 1, cull_range, k);
+	size_t count = 0;
+	for (size_t c = 0; c < k->chunks; ++c){
+		memmove(k->visible + count, k->visible + c * k->chunk, k->counts[c] * sizeof(uint32_t));
+		count += k->counts[c];
+	}
+	return count;
+}
+size_t jobs_cull_spheres(struct jobs *j, const frustum_t *f, const vec4_t *s, size_t n, uint32_t *visible){
+	struct kernel_args k = { .frustum = f, .objects = s, .n = n, .visible = visible, .spheres = 1 };
+	return n ? cull(j, &k, JOBS_GRAIN(vec4_t)) : 0;
+}
+size_t jobs_cull_aabbs(struct jobs *j, const frustum_t *f, const aabb_t *boxes, size_t n, uint32_t *visible){
+	struct kernel_args k = { .frustum = f, .objects = boxes, .n = n, .visible = visible };
+	return n ? cull(j, &k, JOBS_GRAIN(aabb_t)) : 0;
+}
+void jobs_intersect_tris(struct jobs *j, const tri_t *tris, size_t n_tris, const ray_t *rays, hit_t *hits,
+	size_t n_rays)
+{
+	struct kernel_args k = { .tris = tris, .n_tris = n_tris, .rays = rays, .hits = hits };
+	/* Aim for a similar amount of work per chunk as the other kernels, a ray costs one test per triangle */
+	size_t grain = JOBS_GRAIN(vec4_t) * 4 / (n_tris + 1);
+	jobs_parallel_for(j, n_rays, grain < 8 ? 8 : grain, intersect_range, &k);
+}
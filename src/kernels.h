@@ -0,0 +1,132 @@
+#ifndef SSE_KERNELS_H
+#define SSE_KERNELS_H
+
+/*
+ * The kernel table for a tier, this is included by each kernels_<tier>.c
+ * which is built with that tier's compiler flags, so the inline functions
+ * in the headers get compiled for that instruction set
+ */
+#include "dispatch.h"
+
+#ifndef KERNEL_TIER
+#error "KERNEL_TIER must be defined before including kernels.h"
+#endif
+
+#define KERNEL_CAT_(A, B) A ## _ ## B
+#define KERNEL_CAT(A, B) KERNEL_CAT_(A, B)
+#define KERNEL_NAME(N) KERNEL_CAT(N, KERNEL_TIER)
+#define KERNEL_STR_(A) #A
+#define KERNEL_STR(A) KERNEL_STR_(A)
+
+static void KERNEL_NAME(vec_mult_n)(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	mat4_vec_mult_n(m, in, out, n);
+}
+static void KERNEL_NAME(transform_points)(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	mat4_transform_points(m, in, out, n);
+}
+static void KERNEL_NAME(transform_vectors)(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	mat4_transform_vectors(m, in, out, n);
+}
+static void KERNEL_NAME(project_points)(const mat4_t *m, const vec4_t *in, vec4_t *out, size_t n){
+	mat4_project_points(m, in, out, n);
+}
+static void KERNEL_NAME(mult_n)(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	mat4_mult_n(a, b, out, n);
+}
+static void KERNEL_NAME(premult_n)(const mat4_t *a, const mat4_t *b, mat4_t *out, size_t n){
+	mat4_premult_n(a, b, out, n);
+}
+static void KERNEL_NAME(transpose_n)(const mat4_t *in, mat4_t *out, size_t n){
+	mat4_transpose_n(in, out, n);
+}
+static void KERNEL_NAME(inverse_n)(const mat4_t *in, mat4_t *out, float *det, size_t n){
+	mat4_inverse_n(in, out, det, n);
+}
+static void KERNEL_NAME(inverse_affine_n)(const mat4_t *in, mat4_t *out, size_t n){
+	mat4_inverse_affine_n(in, out, n);
+}
+static void KERNEL_NAME(inverse_rigid_n)(const mat4_t *in, mat4_t *out, size_t n){
+	mat4_inverse_rigid_n(in, out, n);
+}
+static void KERNEL_NAME(normal_matrix_n)(const mat4_t *in, mat4_t *out, size_t n){
+	mat4_normal_matrix_n(in, out, n);
+}
+static void KERNEL_NAME(rotate_n)(const float *d, const vec4_t *axis, mat4_t *out, size_t n){
+	mat4_rotate_n(d, axis, out, n);
+}
+static void KERNEL_NAME(perspective_n)(const float *fovY, const float *aspect, const float *near,
+	const float *far, mat4_t *out, size_t n)
+{
+	mat4_perspective_n(fovY, aspect, near, far, out, n);
+}
+static void KERNEL_NAME(slerp_n)(const quat_t *a, const quat_t *b, const float *t, quat_t *out, size_t n){
+	quat_slerp_n(a, b, t, out, n);
+}
+static size_t KERNEL_NAME(cull_spheres)(const frustum_t *f, const vec4_t *s, size_t n, uint32_t *visible){
+	return frustum_cull_spheres(f, s, n, visible);
+}
+static size_t KERNEL_NAME(cull_aabbs)(const frustum_t *f, const aabb_t *boxes, size_t n, uint32_t *visible){
+	return frustum_cull_aabbs(f, boxes, n, visible);
+}
+static void KERNEL_NAME(intersect_tris)(const tri_t *tris, size_t n_tris, const ray_t *rays, hit_t *hits,
+	size_t n_rays)
+{
+	ray_intersect_tris(tris, n_tris, rays, hits, n_rays);
+}
+static void KERNEL_NAME(raster_tile)(const struct raster_target *target, const struct raster_tri *tris,
+	const uint32_t *ids, size_t n, int x0, int y0, int x1, int y1, uint32_t color)
+{
+	raster_tile(target, tris, ids, n, x0, y0, x1, y1, color);
+}
+static size_t KERNEL_NAME(scan_lines)(const char *text, size_t n, uint32_t *ends, size_t max){
+	return mesh_scan_lines(text, n, ends, max);
+}
+static size_t KERNEL_NAME(count_lines)(const char *text, size_t n){
+	return mesh_count_lines(text, n);
+}
+static void KERNEL_NAME(half_n)(const vec4_t *in, uint16_t *out, size_t n){
+	vpack_half_n(in, out, n);
+}
+static void KERNEL_NAME(unhalf_n)(const uint16_t *in, vec4_t *out, size_t n){
+	vpack_unhalf_n(in, out, n);
+}
+static void KERNEL_NAME(xform_half_n)(const mat4_t *m, const vec4_t *in, uint16_t *out, size_t n,
+	enum mat4_xform_mode mode)
+{
+	vpack_xform_half_n(m, in, out, n, mode);
+}
+static void KERNEL_NAME(xform_oct_n)(const mat4_t *m, const vec4_t *in, int16_t *out, size_t n){
+	vpack_xform_oct_n(m, in, out, n);
+}
+
+const struct sse_kernels KERNEL_NAME(sse_kernels) = {
+	KERNEL_TIER_ENUM,
+	KERNEL_STR(KERNEL_TIER),
+	KERNEL_NAME(vec_mult_n),
+	KERNEL_NAME(transform_points),
+	KERNEL_NAME(transform_vectors),
+	KERNEL_NAME(project_points),
+	KERNEL_NAME(mult_n),
+	KERNEL_NAME(premult_n),
+	KERNEL_NAME(transpose_n),
+	KERNEL_NAME(inverse_n),
+	KERNEL_NAME(inverse_affine_n),
+	KERNEL_NAME(inverse_rigid_n),
+	KERNEL_NAME(normal_matrix_n),
+	KERNEL_NAME(rotate_n),
+	KERNEL_NAME(perspective_n),
+	KERNEL_NAME(slerp_n),
+	KERNEL_NAME(cull_spheres),
+	KERNEL_NAME(cull_aabbs),
+	KERNEL_NAME(intersect_tris),
+	KERNEL_NAME(raster_tile),
+	KERNEL_NAME(scan_lines),
+	KERNEL_NAME(count_lines),
+	KERNEL_NAME(half_n),
+	KERNEL_NAME(unhalf_n),
+	KERNEL_NAME(xform_half_n),
+	KERNEL_NAME(xform_oct_n)
+};
+
+#endif
+
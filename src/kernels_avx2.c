@@ -0,0 +1,4 @@
+#define KERNEL_TIER avx2
+#define KERNEL_TIER_ENUM SSE_TIER_AVX2
+#include "kernels.h"
+
@@ -0,0 +1,4 @@
+#define KERNEL_TIER avx512
+#define KERNEL_TIER_ENUM SSE_TIER_AVX512
+#include "kernels.h"
+
@@ -0,0 +1,4 @@
+#define KERNEL_TIER sse2
+#define KERNEL_TIER_ENUM SSE_TIER_SSE2
+#include "kernels.h"
+
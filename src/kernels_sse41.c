@@ -0,0 +1,4 @@
+#define KERNEL_TIER sse41
+#define KERNEL_TIER_ENUM SSE_TIER_SSE41
+#include "kernels.h"
+
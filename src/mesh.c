@@ -0,0 +1,316 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cpuid.h>
+#include <nmmintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mesh.h"
+
+/* Slicing by 8 tables for CRC-32C, used if the CPU doesn't have SSE4.2's crc32 */
+static uint32_t crc_table[8][256];
+static int crc_hw;
+
+__attribute__((constructor)) static void mesh_crc_init(void){
+	for (uint32_t i = 0; i < 256; ++i){
+		uint32_t c = i;
+		for (int k = 0; k < 8; ++k){
+			c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+		}
+		crc_table[0][i] = c;
+	}
+	for (uint32_t i = 0; i < 256; ++i){
+		for (int t = 1; t < 8; ++t){
+			crc_table[t][i] = (crc_table[t - 1][i] >> 8) ^ crc_table[0][crc_table[t - 1][i] & 0xff];
+		}
+	}
+	unsigned int eax, ebx, ecx, edx;
+	crc_hw = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+}
+static uint32_t crc32c_sw(uint32_t c, const unsigned char *p, size_t size){
+	for (; size >= 8; size -= 8, p += 8){
+		uint64_t v;
+		memcpy(&v, p, 8);
+		v ^= c;
+		c = crc_table[7][v & 0xff] ^ crc_table[6][(v >> 8) & 0xff]
+			^ crc_table[5][(v >> 16) & 0xff] ^ crc_table[4][(v >> 24) & 0xff]
+			^ crc_table[3][(v >> 32) & 0xff] ^ crc_table[2][(v >> 40) & 0xff]
+			^ crc_table[1][(v >> 48) & 0xff] ^ crc_table[0][v >> 56];
+	}
+	for (; size; --size, ++p){
+		c = (c >> 8) ^ crc_table[0][(c ^ *p) & 0xff];
+	}
+	return c;
+}
+/*
+ * The crc32 instruction has a latency of 3 so a single chain only gets a third
+ * of its throughput, but that's still several times the table version
+ */
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hw(uint32_t c, const unsigned char *p, size_t size){
+	uint64_t c64 = c;
+	for (; size >= 8; size -= 8, p += 8){
+		uint64_t v;
+		memcpy(&v, p, 8);
+		c64 = _mm_crc32_u64(c64, v);
+	}
+	c = (uint32_t)c64;
+	for (; size; --size, ++p){
+		c = _mm_crc32_u8(c, *p);
+	}
+	return c;
+}
+uint32_t mesh_crc32c(uint32_t crc, const void *data, size_t size){
+	uint32_t c = ~crc;
+	c = crc_hw ? crc32c_hw(c, data, size) : crc32c_sw(c, data, size);
+	return ~c;
+}
+static size_t round_up(size_t x, size_t align){
+	return (x + align - 1) & ~(align - 1);
+}
+static uint32_t header_crc(const struct mesh_header *h, const struct mesh_section *s){
+	struct mesh_header tmp = *h;
+	tmp.crc = 0;
+	uint32_t c = mesh_crc32c(0, &tmp, sizeof(tmp));
+	return mesh_crc32c(c, s, MESH_MAX_SECTIONS * sizeof(struct mesh_section));
+}
+/* The element size each section type has to have, or 0 if the type is unknown */
+static uint32_t section_elem_size(uint32_t type){
+	switch (type){
+	case MESH_POSITIONS:
+	case MESH_NORMALS:
+		return sizeof(vec4_t);
+	case MESH_INDICES:
+		return sizeof(uint32_t);
+	default:
+		return 0;
+	}
+}
+/* Check the header and section table, returns the reason it's bad or NULL if it's ok */
+static const char* check_header(const struct mesh_file *m){
+	const struct mesh_header *h = m->header;
+	if (m->size < MESH_DATA_OFFSET || memcmp(h->magic, MESH_MAGIC, sizeof(MESH_MAGIC))){
+		return "not a mesh file";
+	}
+	if (h->version != MESH_VERSION){
+		return "unsupported version";
+	}
+	if (h->file_size != m->size){
+		return "file size doesn't match the header, it may be truncated";
+	}
+	if (h->crc != header_crc(h, m->sections)){
+		return "header checksum mismatch";
+	}
+	if (h->n_sections > MESH_MAX_SECTIONS){
+		return "too many sections";
+	}
+	for (uint32_t i = 0; i < h->n_sections; ++i){
+		const struct mesh_section *s = &m->sections[i];
+		uint32_t elem = section_elem_size(s->type);
+		/* Unknown types are skipped so newer files with extra sections still load */
+		if (elem && s->elem_size != elem){
+			return "section has the wrong element size";
+		}
+		if (s->offset % MESH_ALIGN || s->offset < MESH_DATA_OFFSET || s->offset > m->size){
+			return "section offset is out of bounds";
+		}
+		if (s->elem_size && s->count > (m->size - s->offset) / s->elem_size){
+			return "section runs past the end of the file";
+		}
+	}
+	return NULL;
+}
+int mesh_open(struct mesh_file *m, const char *path, int flags){
+	memset(m, 0, sizeof(*m));
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1){
+		m->error = "couldn't open the file";
+		return 0;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1){
+		close(fd);
+		m->error = "couldn't stat the file";
+		return 0;
+	}
+	if (st.st_size < (off_t)MESH_DATA_OFFSET){
+		close(fd);
+		m->error = "not a mesh file";
+		return 0;
+	}
+	int map_flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+	if (flags & MESH_POPULATE){
+		map_flags |= MAP_POPULATE;
+	}
+#endif
+	void *p = mmap(NULL, st.st_size, PROT_READ, map_flags, fd, 0);
+	/* The mapping keeps the file open */
+	close(fd);
+	if (p == MAP_FAILED){
+		m->error = "couldn't map the file";
+		return 0;
+	}
+	m->base = p;
+	m->size = st.st_size;
+	m->header = p;
+	m->sections = (const struct mesh_section*)(m->base + sizeof(struct mesh_header));
+	if (flags & MESH_SEQUENTIAL){
+		madvise(p, m->size, MADV_SEQUENTIAL);
+	}
+	if (flags & MESH_WILLNEED){
+		madvise(p, m->size, MADV_WILLNEED);
+	}
+	const char *err = check_header(m);
+	if (err || ((flags & MESH_VERIFY) && !mesh_verify(m))){
+		err = err ? err : m->error;
+		mesh_close(m);
+		m->error = err;
+		return 0;
+	}
+	return 1;
+}
+void mesh_close(struct mesh_file *m){
+	if (m->base){
+		munmap((void*)m->base, m->size);
+	}
+	memset(m, 0, sizeof(*m));
+}
+int mesh_verify(struct mesh_file *m){
+	for (uint32_t i = 0; i < m->header->n_sections; ++i){
+		const struct mesh_section *s = &m->sections[i];
+		if ((s->flags & MESH_SECTION_CRC) && mesh_crc32c(0, m->base + s->offset, s->count * s->elem_size) != s->crc){
+			m->error = "section checksum mismatch";
+			return 0;
+		}
+	}
+	size_t n_verts, n_indices;
+	const uint32_t *indices = mesh_indices(m, &n_indices);
+	mesh_positions(m, &n_verts);
+	if (indices){
+		/* Or the compares together so there's no branch per index and the loop vectorizes */
+		uint32_t bad = 0;
+		for (size_t i = 0; i < n_indices; ++i){
+			bad |= (uint32_t)(indices[i] >= n_verts);
+		}
+		if (bad || n_indices % 3){
+			m->error = "indices are out of range";
+			return 0;
+		}
+	}
+	return 1;
+}
+const struct mesh_section* mesh_find_section(const struct mesh_file *m, enum mesh_section_type type){
+	for (uint32_t i = 0; i < m->header->n_sections; ++i){
+		if (m->sections[i].type == (uint32_t)type){
+			return &m->sections[i];
+		}
+	}
+	return NULL;
+}
+void mesh_prefetch(const struct mesh_file *m, const struct mesh_section *s){
+	if (!s){
+		return;
+	}
+	/* madvise needs a page aligned start */
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t start = s->offset & ~(page - 1);
+	size_t end = s->offset + s->count * s->elem_size;
+	madvise((void*)(m->base + start), end - start, MADV_WILLNEED);
+}
+
+static int writer_write(struct mesh_writer *w, const void *data, size_t size){
+	if (!w->failed && size && fwrite(data, 1, size, w->fp) != size){
+		w->failed = 1;
+	}
+	w->offset += size;
+	return !w->failed;
+}
+/* Pad the file out with zeros to the next multiple of MESH_ALIGN */
+static int writer_pad(struct mesh_writer *w){
+	static const char zeros[MESH_ALIGN];
+	return writer_write(w, zeros, round_up(w->offset, MESH_ALIGN) - w->offset);
+}
+int mesh_writer_open(struct mesh_writer *w, const char *path){
+	memset(w, 0, sizeof(*w));
+	w->current = -1;
+	w->fp = fopen(path, "wb");
+	if (!w->fp){
+		return 0;
+	}
+	/* Big sections go straight through from the caller's buffer anyway, this is for the small writes */
+	setvbuf(w->fp, NULL, _IOFBF, 1 << 20);
+	memcpy(w->header.magic, MESH_MAGIC, sizeof(MESH_MAGIC));
+	w->header.version = MESH_VERSION;
+	/* Leave room for the header and table, they're written last */
+	struct mesh_header h;
+	struct mesh_section s[MESH_MAX_SECTIONS];
+	memset(&h, 0, sizeof(h));
+	memset(s, 0, sizeof(s));
+	writer_write(w, &h, sizeof(h));
+	writer_write(w, s, sizeof(s));
+	if (w->failed){
+		/* Don't leave a file behind that the caller doesn't know to close */
+		fclose(w->fp);
+		w->fp = NULL;
+		remove(path);
+		return 0;
+	}
+	return 1;
+}
+int mesh_writer_begin(struct mesh_writer *w, enum mesh_section_type type, uint32_t elem_size, int crc){
+	if (w->header.n_sections == MESH_MAX_SECTIONS || !elem_size){
+		return 0;
+	}
+	writer_pad(w);
+	w->current = w->header.n_sections++;
+	struct mesh_section *s = &w->sections[w->current];
+	s->type = type;
+	s->flags = crc ? MESH_SECTION_CRC : 0;
+	s->offset = w->offset;
+	s->elem_size = elem_size;
+	return !w->failed;
+}
+int mesh_writer_append(struct mesh_writer *w, const void *data, size_t count){
+	if (w->current == -1){
+		return 0;
+	}
+	struct mesh_section *s = &w->sections[w->current];
+	size_t size = count * s->elem_size;
+	if (s->flags & MESH_SECTION_CRC){
+		s->crc = mesh_crc32c(s->crc, data, size);
+	}
+	s->count += count;
+	return writer_write(w, data, size);
+}
+int mesh_writer_close(struct mesh_writer *w){
+	writer_pad(w);
+	w->header.file_size = w->offset;
+	w->header.crc = header_crc(&w->header, w->sections);
+	int ok = !w->failed && fseek(w->fp, 0, SEEK_SET) == 0
+		&& fwrite(&w->header, sizeof(w->header), 1, w->fp) == 1
+		&& fwrite(w->sections, sizeof(w->sections), 1, w->fp) == 1;
+	ok = fclose(w->fp) == 0 && ok;
+	w->fp = NULL;
+	return ok;
+}
+int mesh_write(const char *path, const vec4_t *positions, const vec4_t *normals, size_t n_verts,
+	const uint32_t *indices, size_t n_indices)
+{
+	struct mesh_writer w;
+	if (!mesh_writer_open(&w, path)){
+		return 0;
+	}
+	mesh_writer_begin(&w, MESH_POSITIONS, sizeof(vec4_t), 1);
+	mesh_writer_append(&w, positions, n_verts);
+	if (normals){
+		mesh_writer_begin(&w, MESH_NORMALS, sizeof(vec4_t), 1);
+		mesh_writer_append(&w, normals, n_verts);
+	}
+	if (indices){
+		mesh_writer_begin(&w, MESH_INDICES, sizeof(uint32_t), 1);
+		mesh_writer_append(&w, indices, n_indices);
+	}
+	return mesh_writer_close(&w);
+}
@@ -0,0 +1,961 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "mesh_import.h"
+#include "mesh.h"
+#include "dispatch.h"
+#include "jobs.h"
+
+/* Line ends found per scan_lines call while walking a part */
+#define LINE_BATCH 1024
+/* Parts each thread's share of a block is cut into, so threads that finish early have some to steal */
+#define PARTS_PER_THREAD 4
+/* Blocks aren't cut into parts smaller than this */
+#define MIN_PART (256 * 1024)
+#define PLY_MAX_ELEMENTS 16
+#define PLY_MAX_PROPS 32
+
+enum format { FORMAT_OBJ, FORMAT_PLY_ASCII, FORMAT_PLY_BINARY };
+enum ply_type {
+	PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64
+};
+enum ply_kind { PLY_OTHER, PLY_VERTEX, PLY_FACE };
+struct ply_prop {
+	enum ply_type type;
+	/* Type of a list's count, PLY_NONE if it isn't a list */
+	enum ply_type count_type;
+	/*
+	 * For vertices the component it's read into, 0-2 for the position and 3-5
+	 * for the normal. For faces 0 if it's the vertex index list. -1 if unused
+	 */
+	int slot;
+};
+struct ply_element {
+	enum ply_kind kind;
+	uint64_t count;
+	/* Body line the element starts on in ASCII files */
+	uint64_t first_line;
+	int n_props;
+	struct ply_prop props[PLY_MAX_PROPS];
+};
+struct ply {
+	int n_elements;
+	struct ply_element elements[PLY_MAX_ELEMENTS];
+	int has_normals;
+	/* Lines in the body of an ASCII file */
+	uint64_t lines;
+};
+/* A piece of a block parsed by one job, and what it parsed */
+struct part {
+	const char *text;
+	size_t len;
+	/* Body line of an ASCII PLY file the part starts on */
+	uint64_t line;
+	vec4_t *pos, *nrm;
+	uint32_t *idx;
+	/*
+	 * Slots in idx holding negative (relative) OBJ indices, these are stored
+	 * relative to the part's first position until the positions before the
+	 * part are known
+	 */
+	uint32_t *fix;
+	size_t n_pos, n_nrm, n_idx, n_fix;
+	size_t pos_cap, nrm_cap, idx_cap, fix_cap;
+	const char *error;
+};
+struct importer {
+	const struct mesh_sink *sink;
+	struct jobs *jobs;
+	enum format format;
+	struct ply ply;
+	struct part *parts;
+	int max_parts, n_parts;
+	/* Elements handed to the sink so far, and the highest index */
+	uint64_t n_pos, n_idx;
+	uint32_t max_idx;
+	/* ASCII PLY lines parsed so far */
+	uint64_t line;
+	/* The binary PLY element being read and the records left in it */
+	int elem;
+	uint64_t left;
+	const char *error;
+};
+
+/*
+ * Get a buffer of at least size bytes in place of buf, which has room for
+ * *cap bytes, copying its contents over. Returns NULL, leaving buf alone, if
+ * the memory couldn't be allocated
+ */
+static void* grow(void *buf, size_t *cap, size_t size){
+	size_t new_cap = (size + size / 2 + 63) & ~(size_t)63;
+	void *b = aligned_alloc(64, new_cap);
+	if (!b){
+		return NULL;
+	}
+	if (buf){
+		memcpy(b, buf, *cap);
+	}
+	free(buf);
+	*cap = new_cap;
+	return b;
+}
+static int push_vec4(vec4_t **buf, size_t *n, size_t *cap, vec4_t v){
+	if ((*n + 1) * sizeof(vec4_t) > *cap){
+		vec4_t *b = grow(*buf, cap, (*n + 1) * sizeof(vec4_t));
+		if (!b){
+			return 0;
+		}
+		*buf = b;
+	}
+	(*buf)[(*n)++] = v;
+	return 1;
+}
+static int push_u32(uint32_t **buf, size_t *n, size_t *cap, uint32_t v){
+	if ((*n + 1) * sizeof(uint32_t) > *cap){
+		uint32_t *b = grow(*buf, cap, (*n + 1) * sizeof(uint32_t));
+		if (!b){
+			return 0;
+		}
+		*buf = b;
+	}
+	(*buf)[(*n)++] = v;
+	return 1;
+}
+/* Parse an integer at *s after skipping spaces and tabs, returns 0 if there isn't one */
+static int parse_int(const char **s, int64_t *out){
+	const char *p = *s;
+	while (*p == ' ' || *p == '\t'){
+		++p;
+	}
+	int neg = *p == '-';
+	p += neg || *p == '+';
+	if ((unsigned)(*p - '0') >= 10){
+		return 0;
+	}
+	int64_t v = 0;
+	for (; (unsigned)(*p - '0') < 10; ++p){
+		v = v < INT64_MAX / 10 ? v * 10 + (*p - '0') : v;
+	}
+	*out = neg ? -v : v;
+	*s = p;
+	return 1;
+}
+static int is_space(char c){
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* A corner of an OBJ face, rel is set if v is relative to the part's first position */
+struct corner {
+	uint32_t v;
+	int rel;
+};
+static int push_corner(struct part *t, struct corner c){
+	if (c.rel && !push_u32(&t->fix, &t->n_fix, &t->fix_cap, (uint32_t)t->n_idx)){
+		return 0;
+	}
+	return push_u32(&t->idx, &t->n_idx, &t->idx_cap, c.v);
+}
+/* Parse the v/vt/vn corners of a face after the f, splitting it into a fan of triangles */
+static const char* parse_obj_face(struct part *t, const char *p){
+	struct corner first = { 0, 0 }, prev = first, c;
+	int k = 0;
+	for (;; ++k){
+		while (is_space(*p)){
+			++p;
+		}
+		if (*p == '\n' || *p == '#'){
+			break;
+		}
+		int64_t v;
+		if (!parse_int(&p, &v) || v == 0){
+			return "bad face";
+		}
+		/* Skip the texture coordinate and normal indices */
+		while (*p == '/' || *p == '-' || (unsigned)(*p - '0') < 10){
+			++p;
+		}
+		if (v > 0){
+			if (v > UINT32_MAX){
+				return "face index too big";
+			}
+			c.v = (uint32_t)(v - 1);
+			c.rel = 0;
+		}
+		else {
+			if (v < INT32_MIN){
+				return "face index too big";
+			}
+			c.v = (uint32_t)(int32_t)((int64_t)t->n_pos + v);
+			c.rel = 1;
+		}
+		if (k == 0){
+			first = c;
+		}
+		else if (k >= 2 && !(push_corner(t, first) && push_corner(t, prev) && push_corner(t, c))){
+			return "out of memory";
+		}
+		prev = c;
+	}
+	return k < 3 ? "face with fewer than 3 vertices" : NULL;
+}
+/* Parse up to 3 floats after the keyword, missing ones are an error */
+static int parse_vec3(const char *p, float *f){
+	return mesh_parse_float(&p, &f[0]) && mesh_parse_float(&p, &f[1]) && mesh_parse_float(&p, &f[2]);
+}
+static const char* parse_obj_line(struct part *t, const char *p){
+	while (is_space(*p)){
+		++p;
+	}
+	float f[3];
+	if (p[0] == 'v' && is_space(p[1])){
+		if (!parse_vec3(p + 1, f)){
+			return "bad vertex";
+		}
+		return push_vec4(&t->pos, &t->n_pos, &t->pos_cap, vec4_new(f[0], f[1], f[2], 1))
+			? NULL : "out of memory";
+	}
+	if (p[0] == 'v' && p[1] == 'n' && is_space(p[2])){
+		if (!parse_vec3(p + 2, f)){
+			return "bad normal";
+		}
+		return push_vec4(&t->nrm, &t->n_nrm, &t->nrm_cap, vec4_new(f[0], f[1], f[2], 0))
+			? NULL : "out of memory";
+	}
+	if (p[0] == 'f' && is_space(p[1])){
+		return parse_obj_face(t, p + 1);
+	}
+	/* Comments, texture coordinates, groups, materials and so on */
+	return NULL;
+}
+static const char* parse_ply_vertex(struct part *t, const struct ply *ply, const struct ply_element *e,
+	const char *p)
+{
+	float c[6] = { 0 };
+	for (int i = 0; i < e->n_props; ++i){
+		float f;
+		if (!mesh_parse_float(&p, &f)){
+			return "bad vertex";
+		}
+		if (e->props[i].slot >= 0){
+			c[e->props[i].slot] = f;
+		}
+	}
+	if (!push_vec4(&t->pos, &t->n_pos, &t->pos_cap, vec4_new(c[0], c[1], c[2], 1))
+		|| (ply->has_normals && !push_vec4(&t->nrm, &t->n_nrm, &t->nrm_cap, vec4_new(c[3], c[4], c[5], 0))))
+	{
+		return "out of memory";
+	}
+	return NULL;
+}
+/* Add index v as the k'th corner of a face being split into a fan */
+static const char* push_fan(struct part *t, int64_t v, int k, struct corner *first, struct corner *prev){
+	if (v < 0 || v > UINT32_MAX){
+		return "face index out of range";
+	}
+	struct corner c = { (uint32_t)v, 0 };
+	if (k == 0){
+		*first = c;
+	}
+	else if (k >= 2 && !(push_corner(t, *first) && push_corner(t, *prev) && push_corner(t, c))){
+		return "out of memory";
+	}
+	*prev = c;
+	return NULL;
+}
+static const char* parse_ply_face(struct part *t, const struct ply_element *e, const char *p){
+	for (int i = 0; i < e->n_props; ++i){
+		const struct ply_prop *prop = &e->props[i];
+		int64_t n = 1;
+		if (prop->count_type != PLY_NONE && (!parse_int(&p, &n) || n < 0)){
+			return "bad face";
+		}
+		if (prop->slot == 0 && n < 3){
+			return "face with fewer than 3 vertices";
+		}
+		struct corner first = { 0, 0 }, prev = first;
+		for (int64_t k = 0; k < n; ++k){
+			float f;
+			int64_t v;
+			if (prop->slot != 0){
+				if (!mesh_parse_float(&p, &f)){
+					return "bad face";
+				}
+				continue;
+			}
+			if (!parse_int(&p, &v)){
+				return "bad face";
+			}
+			const char *err = push_fan(t, v, k, &first, &prev);
+			if (err){
+				return err;
+			}
+		}
+	}
+	return NULL;
+}
+/* Parse the part's lines, finding where each one ends with the scan_lines kernel */
+static void parse_part(struct importer *im, struct part *t){
+	uint32_t ends[LINE_BATCH];
+	const struct ply *ply = &im->ply;
+	/* The PLY element the line is in, and the line it ends before */
+	int elem = 0;
+	uint64_t line = t->line, elem_end = 0;
+	if (im->format == FORMAT_PLY_ASCII){
+		while (elem < ply->n_elements && line >= ply->elements[elem].first_line + ply->elements[elem].count){
+			++elem;
+		}
+		elem_end = elem < ply->n_elements ? ply->elements[elem].first_line + ply->elements[elem].count : UINT64_MAX;
+	}
+	size_t off = 0;
+	while (off < t->len && !t->error){
+		const char *text = t->text + off;
+		size_t n = sse_kernels->scan_lines(text, t->len - off, ends, LINE_BATCH);
+		if (!n){
+			break;
+		}
+		const char *p = text;
+		for (size_t i = 0; i < n && !t->error; ++i, ++line){
+			if (im->format == FORMAT_OBJ){
+				t->error = parse_obj_line(t, p);
+			}
+			else if (elem < ply->n_elements){
+				if (line == elem_end){
+					++elem;
+					while (elem < ply->n_elements && !ply->elements[elem].count){
+						++elem;
+					}
+					elem_end = elem < ply->n_elements ? elem_end + ply->elements[elem].count : UINT64_MAX;
+				}
+				if (elem < ply->n_elements){
+					const struct ply_element *e = &ply->elements[elem];
+					if (e->kind == PLY_VERTEX){
+						t->error = parse_ply_vertex(t, ply, e, p);
+					}
+					else if (e->kind == PLY_FACE){
+						t->error = parse_ply_face(t, e, p);
+					}
+				}
+			}
+			p = text + ends[i] + 1;
+		}
+		off += ends[n - 1] + 1;
+	}
+}
+struct parse_args {
+	struct importer *im;
+	int count;
+};
+static void parse_range(void *arg, size_t lo, size_t hi){
+	struct parse_args *a = arg;
+	for (size_t i = lo; i < hi; ++i){
+		struct part *t = &a->im->parts[i];
+		if (a->count){
+			t->line = sse_kernels->count_lines(t->text, t->len);
+		}
+		else {
+			parse_part(a->im, t);
+		}
+	}
+}
+/*
+ * Hand a part's elements to the sink, resolving its relative indices now
+ * that the positions before it are known
+ */
+static int emit_part(struct importer *im, struct part *t){
+	if (t->error){
+		im->error = t->error;
+		return 0;
+	}
+	for (size_t i = 0; i < t->n_fix; ++i){
+		int64_t v = (int64_t)im->n_pos + (int32_t)t->idx[t->fix[i]];
+		if (v < 0){
+			im->error = "face index out of range";
+			return 0;
+		}
+		t->idx[t->fix[i]] = (uint32_t)v;
+	}
+	/* No branch per index so the loop vectorizes */
+	uint32_t mx = im->max_idx;
+	for (size_t i = 0; i < t->n_idx; ++i){
+		mx = t->idx[i] > mx ? t->idx[i] : mx;
+	}
+	im->max_idx = mx;
+	im->n_pos += t->n_pos;
+	im->n_idx += t->n_idx;
+	if (im->n_pos > (uint64_t)UINT32_MAX + 1){
+		im->error = "too many positions for 32 bit indices";
+		return 0;
+	}
+	const struct mesh_sink *s = im->sink;
+	if ((t->n_pos && !s->positions(s->user, t->pos, t->n_pos))
+		|| (t->n_nrm && !s->normals(s->user, t->nrm, t->n_nrm))
+		|| (t->n_idx && !s->indices(s->user, t->idx, t->n_idx)))
+	{
+		im->error = "the sink stopped the import";
+		return 0;
+	}
+	return 1;
+}
+static void reset_part(struct part *t, const char *text, size_t len){
+	t->text = text;
+	t->len = len;
+	t->n_pos = t->n_nrm = t->n_idx = t->n_fix = 0;
+	t->error = NULL;
+}
+/*
+ * Parse the whole lines at the start of text in parallel, returns how many
+ * bytes were used. When eof is set the text has to end in a newline
+ */
+static size_t consume_text(struct importer *im, const char *text, size_t len, int eof){
+	size_t cut = len;
+	if (!eof){
+		const char *nl = memrchr(text, '\n', len);
+		if (!nl){
+			return 0;
+		}
+		cut = nl - text + 1;
+	}
+	int n = cut / MIN_PART + 1;
+	n = n < im->max_parts ? n : im->max_parts;
+	size_t start = 0;
+	for (int i = 0; i < n; ++i){
+		size_t end = cut;
+		if (i < n - 1){
+			end = cut / n * (i + 1);
+			end = end < start ? start : end;
+			/* A long line may have taken the rest already */
+			const char *nl = end < cut ? memchr(text + end, '\n', cut - end) : NULL;
+			end = nl ? (size_t)(nl - text + 1) : cut;
+		}
+		reset_part(&im->parts[i], text + start, end - start);
+		start = end;
+	}
+	im->n_parts = n;
+	struct parse_args args = { im, 1 };
+	if (im->format == FORMAT_PLY_ASCII){
+		/* Count each part's lines then sum them to get the line each one starts on */
+		jobs_parallel_for(im->jobs, n, 1, parse_range, &args);
+		uint64_t line = im->line;
+		for (int i = 0; i < n; ++i){
+			uint64_t count = im->parts[i].line;
+			im->parts[i].line = line;
+			line += count;
+		}
+		im->line = line;
+	}
+	args.count = 0;
+	jobs_parallel_for(im->jobs, n, 1, parse_range, &args);
+	for (int i = 0; i < n; ++i){
+		if (!emit_part(im, &im->parts[i])){
+			break;
+		}
+	}
+	return cut;
+}
+
+static size_t ply_type_size(enum ply_type t){
+	static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+	return sizes[t];
+}
+static double ply_read(const unsigned char *p, enum ply_type t){
+	int8_t i8;
+	int16_t i16;
+	uint16_t u16;
+	int32_t i32;
+	uint32_t u32;
+	float f;
+	double d;
+	switch (t){
+	case PLY_INT8:
+		memcpy(&i8, p, 1);
+		return i8;
+	case PLY_UINT8:
+		return *p;
+	case PLY_INT16:
+		memcpy(&i16, p, 2);
+		return i16;
+	case PLY_UINT16:
+		memcpy(&u16, p, 2);
+		return u16;
+	case PLY_INT32:
+		memcpy(&i32, p, 4);
+		return i32;
+	case PLY_UINT32:
+		memcpy(&u32, p, 4);
+		return u32;
+	case PLY_FLOAT32:
+		memcpy(&f, p, 4);
+		return f;
+	case PLY_FLOAT64:
+		memcpy(&d, p, 8);
+		return d;
+	default:
+		return 0;
+	}
+}
+/*
+ * Read a list count. Every element takes at least a byte so a count over the
+ * len bytes there can't fit, it's clamped to len + 1 before converting so huge
+ * float counts don't overflow. Negative and NaN counts are errors
+ */
+static const char* ply_list_count(const unsigned char *p, enum ply_type type, size_t len, size_t *n){
+	double c = ply_read(p, type);
+	if (c < 0){
+		return "negative list count";
+	}
+	if (c != c){
+		return "bad list count";
+	}
+	*n = c <= (double)len ? (size_t)c : len + 1;
+	return NULL;
+}
+/*
+ * Size of the binary record at p, or 0 if it runs past the len bytes there.
+ * A bad list count also gives 0, with error set
+ */
+static size_t ply_record_size(const struct ply_element *e, const unsigned char *p, size_t len,
+	const char **error)
+{
+	size_t size = 0;
+	for (int i = 0; i < e->n_props; ++i){
+		const struct ply_prop *prop = &e->props[i];
+		size_t n = 1;
+		if (prop->count_type != PLY_NONE){
+			size_t cs = ply_type_size(prop->count_type);
+			if (size + cs > len){
+				return 0;
+			}
+			*error = ply_list_count(p + size, prop->count_type, len, &n);
+			if (*error){
+				return 0;
+			}
+			size += cs;
+		}
+		if (n > (len - size) / ply_type_size(prop->type)){
+			return 0;
+		}
+		size += n * ply_type_size(prop->type);
+	}
+	return size;
+}
+/* Parse a record of len bytes, as measured by ply_record_size */
+static const char* parse_ply_binary(struct part *t, const struct ply *ply, const struct ply_element *e,
+	const unsigned char *p, size_t len)
+{
+	if (e->kind == PLY_VERTEX){
+		float c[6] = { 0 };
+		for (int i = 0; i < e->n_props; ++i){
+			if (e->props[i].slot >= 0){
+				c[e->props[i].slot] = (float)ply_read(p, e->props[i].type);
+			}
+			p += ply_type_size(e->props[i].type);
+		}
+		if (!push_vec4(&t->pos, &t->n_pos, &t->pos_cap, vec4_new(c[0], c[1], c[2], 1))
+			|| (ply->has_normals && !push_vec4(&t->nrm, &t->n_nrm, &t->nrm_cap, vec4_new(c[3], c[4], c[5], 0))))
+		{
+			return "out of memory";
+		}
+		return NULL;
+	}
+	for (int i = 0; i < e->n_props; ++i){
+		const struct ply_prop *prop = &e->props[i];
+		size_t size = ply_type_size(prop->type);
+		size_t n = 1;
+		if (prop->count_type != PLY_NONE){
+			const char *err = ply_list_count(p, prop->count_type, len, &n);
+			if (err){
+				return err;
+			}
+			p += ply_type_size(prop->count_type);
+		}
+		if (prop->slot != 0){
+			p += n * size;
+			continue;
+		}
+		if (n < 3){
+			return "face with fewer than 3 vertices";
+		}
+		struct corner first = { 0, 0 }, prev = first;
+		for (size_t k = 0; k < n; ++k, p += size){
+			/* Float indices could be out of int64_t's range too */
+			double v = ply_read(p, prop->type);
+			if (!(v >= 0 && v <= UINT32_MAX)){
+				return "face index out of range";
+			}
+			const char *err = push_fan(t, (int64_t)v, k, &first, &prev);
+			if (err){
+				return err;
+			}
+		}
+	}
+	return NULL;
+}
+/* Parse the whole binary PLY records at the start of data, returns how many bytes were used */
+static size_t consume_binary(struct importer *im, const char *data, size_t len){
+	const struct ply *ply = &im->ply;
+	struct part *t = &im->parts[0];
+	reset_part(t, data, len);
+	size_t off = 0;
+	while (im->elem < ply->n_elements && !t->error){
+		const struct ply_element *e = &ply->elements[im->elem];
+		if (!im->left){
+			if (++im->elem < ply->n_elements){
+				im->left = ply->elements[im->elem].count;
+			}
+			continue;
+		}
+		const unsigned char *p = (const unsigned char*)data + off;
+		size_t size = ply_record_size(e, p, len - off, &t->error);
+		if (!size){
+			break;
+		}
+		if (e->kind != PLY_OTHER){
+			t->error = parse_ply_binary(t, ply, e, p, size);
+		}
+		off += size;
+		--im->left;
+	}
+	emit_part(im, t);
+	/* Anything after the last element is ignored */
+	return im->elem < ply->n_elements ? off : len;
+}
+
+static enum ply_type ply_type_from_name(const char *name){
+	static const struct { const char *name; enum ply_type type; } types[] = {
+		{ "char", PLY_INT8 }, { "int8", PLY_INT8 }, { "uchar", PLY_UINT8 }, { "uint8", PLY_UINT8 },
+		{ "short", PLY_INT16 }, { "int16", PLY_INT16 }, { "ushort", PLY_UINT16 }, { "uint16", PLY_UINT16 },
+		{ "int", PLY_INT32 }, { "int32", PLY_INT32 }, { "uint", PLY_UINT32 }, { "uint32", PLY_UINT32 },
+		{ "float", PLY_FLOAT32 }, { "float32", PLY_FLOAT32 }, { "double", PLY_FLOAT64 }, { "float64", PLY_FLOAT64 }
+	};
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i){
+		if (!strcmp(name, types[i].name)){
+			return types[i].type;
+		}
+	}
+	return PLY_NONE;
+}
+/*
+ * Parse the PLY header at the start of the len bytes of text, returns its size
+ * or 0 with im->error set if it's bad or doesn't end in text
+ */
+static size_t parse_ply_header(struct importer *im, const char *text, size_t len){
+	static const char *slots[] = { "x", "y", "z", "nx", "ny", "nz" };
+	struct ply *ply = &im->ply;
+	const char *end = memmem(text, len, "end_header", 10);
+	const char *nl = end ? memchr(end, '\n', text + len - end) : NULL;
+	if (!nl){
+		im->error = "PLY header is missing its end or doesn't fit in a block";
+		return 0;
+	}
+	int format = 0, normal_slots = 0, xyz_slots = 0;
+	struct ply_element *e = NULL;
+	for (const char *p = text, *eol; p < end && (eol = memchr(p, '\n', end - p)); p = eol + 1){
+		char line[256], a[64], b[64], c[64], d[64];
+		size_t n = eol - p;
+		n = n < sizeof(line) - 1 ? n : sizeof(line) - 1;
+		memcpy(line, p, n);
+		line[n] = '\0';
+		unsigned long long count;
+		if (sscanf(line, "format %63s", a) == 1){
+			if (!strcmp(a, "ascii")){
+				format = FORMAT_PLY_ASCII;
+			}
+			else if (!strcmp(a, "binary_little_endian")){
+				format = FORMAT_PLY_BINARY;
+			}
+			else {
+				im->error = "unsupported PLY format";
+				return 0;
+			}
+		}
+		else if (sscanf(line, "element %63s %llu", a, &count) == 2){
+			if (ply->n_elements == PLY_MAX_ELEMENTS){
+				im->error = "too many PLY elements";
+				return 0;
+			}
+			e = &ply->elements[ply->n_elements++];
+			e->kind = !strcmp(a, "vertex") ? PLY_VERTEX : !strcmp(a, "face") ? PLY_FACE : PLY_OTHER;
+			e->count = count;
+			e->first_line = ply->lines;
+			ply->lines += count;
+		}
+		else if (sscanf(line, "property list %63s %63s %63s", a, b, c) == 3 && e){
+			struct ply_prop prop = { ply_type_from_name(b), ply_type_from_name(a), -1 };
+			if (prop.type == PLY_NONE || prop.count_type == PLY_NONE || e->kind == PLY_VERTEX){
+				im->error = "unsupported PLY list property";
+				return 0;
+			}
+			if (e->kind == PLY_FACE && (!strcmp(c, "vertex_indices") || !strcmp(c, "vertex_index"))){
+				prop.slot = 0;
+			}
+			if (e->n_props == PLY_MAX_PROPS){
+				im->error = "too many PLY properties";
+				return 0;
+			}
+			e->props[e->n_props++] = prop;
+		}
+		else if (sscanf(line, "property %63s %63s", a, d) == 2 && e){
+			struct ply_prop prop = { ply_type_from_name(a), PLY_NONE, -1 };
+			if (prop.type == PLY_NONE || e->n_props == PLY_MAX_PROPS){
+				im->error = "unsupported PLY property";
+				return 0;
+			}
+			for (int i = 0; i < 6 && e->kind == PLY_VERTEX; ++i){
+				if (!strcmp(d, slots[i])){
+					prop.slot = i;
+					if (i < 3){
+						xyz_slots |= 1 << i;
+					}
+					else {
+						normal_slots |= 1 << i;
+					}
+				}
+			}
+			e->props[e->n_props++] = prop;
+		}
+	}
+	if (!format){
+		im->error = "PLY header has no format";
+		return 0;
+	}
+	if (xyz_slots != 7){
+		im->error = "PLY vertices need an x, y and z";
+		return 0;
+	}
+	im->format = format;
+	ply->has_normals = normal_slots == 0x38;
+	im->elem = 0;
+	im->left = ply->n_elements ? ply->elements[0].count : 0;
+	return nl - text + 1;
+}
+/* Read until buf is full or the file ends, returns the bytes read or -1 on error */
+static ssize_t read_full(int fd, char *buf, size_t size){
+	size_t got = 0;
+	while (got < size){
+		ssize_t r = read(fd, buf + got, size - got);
+		if (r == 0){
+			break;
+		}
+		if (r == -1){
+			return -1;
+		}
+		got += r;
+	}
+	return got;
+}
+int mesh_import(const char *path, const struct mesh_sink *sink, int threads, size_t block_size,
+	const char **error)
+{
+	struct importer im;
+	memset(&im, 0, sizeof(im));
+	im.sink = sink;
+	block_size = block_size ? block_size : MESH_IMPORT_BLOCK;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1){
+		if (error){
+			*error = "couldn't open the file";
+		}
+		return 0;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	if (threads != 1){
+		im.jobs = jobs_create(threads, 0);
+	}
+	im.max_parts = im.jobs ? jobs_thread_count(im.jobs) * PARTS_PER_THREAD : 1;
+	im.parts = calloc(im.max_parts, sizeof(struct part));
+	/* One more byte for a newline after a last line that doesn't have one */
+	char *buf = aligned_alloc(64, (block_size + 64) & ~(size_t)63);
+	if (!im.parts || !buf || (threads != 1 && !im.jobs)){
+		im.error = "out of memory";
+	}
+	size_t len = 0;
+	int eof = 0, first = 1;
+	while (!im.error && !eof){
+		if (len == block_size){
+			im.error = im.format == FORMAT_PLY_BINARY ? "record doesn't fit in a block" : "line doesn't fit in a block";
+			break;
+		}
+		ssize_t got = read_full(fd, buf + len, block_size - len);
+		if (got == -1){
+			im.error = "couldn't read the file";
+			break;
+		}
+		eof = (size_t)got < block_size - len;
+		len += got;
+		size_t start = 0;
+		if (first){
+			first = 0;
+			if (len >= 4 && (!memcmp(buf, "ply\n", 4) || !memcmp(buf, "ply\r", 4))){
+				start = parse_ply_header(&im, buf, len);
+				if (!start){
+					break;
+				}
+			}
+		}
+		if (eof && im.format != FORMAT_PLY_BINARY && len > start && buf[len - 1] != '\n'){
+			buf[len++] = '\n';
+		}
+		if (im.format == FORMAT_PLY_BINARY){
+			start += consume_binary(&im, buf + start, len - start);
+		}
+		else {
+			start += consume_text(&im, buf + start, len - start, eof);
+		}
+		memmove(buf, buf + start, len - start);
+		len -= start;
+	}
+	if (!im.error){
+		if (im.format == FORMAT_PLY_BINARY && im.elem < im.ply.n_elements){
+			im.error = "file is truncated";
+		}
+		else if (im.format == FORMAT_PLY_ASCII && im.line < im.ply.lines){
+			im.error = "file is truncated";
+		}
+		else if (im.n_idx && im.max_idx >= im.n_pos){
+			im.error = "face index out of range";
+		}
+	}
+	close(fd);
+	jobs_destroy(im.jobs);
+	for (int i = 0; im.parts && i < im.max_parts; ++i){
+		free(im.parts[i].pos);
+		free(im.parts[i].nrm);
+		free(im.parts[i].idx);
+		free(im.parts[i].fix);
+	}
+	free(im.parts);
+	free(buf);
+	if (error){
+		*error = im.error;
+	}
+	return !im.error;
+}
+
+/* Append count elements of size bytes to an aligned array */
+static int append(void **buf, size_t *n, size_t *cap, const void *src, size_t count, size_t size){
+	if ((*n + count) * size > *cap){
+		void *b = grow(*buf, cap, (*n + count) * size);
+		if (!b){
+			return 0;
+		}
+		*buf = b;
+	}
+	memcpy((char*)*buf + *n * size, src, count * size);
+	*n += count;
+	return 1;
+}
+static int data_positions(void *user, const vec4_t *p, size_t n){
+	struct mesh_data *d = user;
+	void *b = d->positions;
+	int ok = append(&b, &d->n_positions, &d->positions_cap, p, n, sizeof(vec4_t));
+	d->positions = b;
+	return ok;
+}
+static int data_normals(void *user, const vec4_t *nrm, size_t n){
+	struct mesh_data *d = user;
+	void *b = d->normals;
+	int ok = append(&b, &d->n_normals, &d->normals_cap, nrm, n, sizeof(vec4_t));
+	d->normals = b;
+	return ok;
+}
+static int data_indices(void *user, const uint32_t *idx, size_t n){
+	struct mesh_data *d = user;
+	void *b = d->indices;
+	int ok = append(&b, &d->n_indices, &d->indices_cap, idx, n, sizeof(uint32_t));
+	d->indices = b;
+	return ok;
+}
+int mesh_import_data(struct mesh_data *d, const char *path, int threads, const char **error){
+	memset(d, 0, sizeof(*d));
+	struct mesh_sink sink = { data_positions, data_normals, data_indices, d };
+	if (!mesh_import(path, &sink, threads, 0, error)){
+		mesh_data_free(d);
+		return 0;
+	}
+	return 1;
+}
+void mesh_data_free(struct mesh_data *d){
+	free(d->positions);
+	free(d->normals);
+	free(d->indices);
+	memset(d, 0, sizeof(*d));
+}
+
+/* Positions go straight to the mesh file, the rest waits in temporary files */
+struct file_sink {
+	struct mesh_writer w;
+	FILE *normals, *indices;
+	size_t n_positions, n_normals;
+};
+static int file_positions(void *user, const vec4_t *p, size_t n){
+	struct file_sink *f = user;
+	f->n_positions += n;
+	return mesh_writer_append(&f->w, p, n);
+}
+static int file_normals(void *user, const vec4_t *nrm, size_t n){
+	struct file_sink *f = user;
+	f->n_normals += n;
+	return fwrite(nrm, sizeof(vec4_t), n, f->normals) == n;
+}
+static int file_indices(void *user, const uint32_t *idx, size_t n){
+	struct file_sink *f = user;
+	return fwrite(idx, sizeof(uint32_t), n, f->indices) == n;
+}
+/* Copy a spooled section into the mesh file a chunk at a time */
+static int copy_spool(struct mesh_writer *w, FILE *fp, enum mesh_section_type type, uint32_t elem_size){
+	enum { CHUNK = 1 << 20 };
+	char *buf = aligned_alloc(64, CHUNK);
+	int ok = buf && fflush(fp) == 0 && fseek(fp, 0, SEEK_SET) == 0 && mesh_writer_begin(w, type, elem_size, 1);
+	size_t n;
+	while (ok && (n = fread(buf, elem_size, CHUNK / elem_size, fp)) > 0){
+		ok = mesh_writer_append(w, buf, n);
+	}
+	free(buf);
+	return ok && !ferror(fp);
+}
+int mesh_import_file(const char *path, const char *out_path, int threads, const char **error){
+	struct file_sink f;
+	memset(&f, 0, sizeof(f));
+	if (!mesh_writer_open(&f.w, out_path)){
+		if (error){
+			*error = "couldn't create the mesh file";
+		}
+		return 0;
+	}
+	f.normals = tmpfile();
+	f.indices = tmpfile();
+	struct mesh_sink sink = { file_positions, file_normals, file_indices, &f };
+	int ok = f.normals && f.indices && mesh_writer_begin(&f.w, MESH_POSITIONS, sizeof(vec4_t), 1);
+	if (!ok && error){
+		*error = "couldn't create the temporary files";
+	}
+	ok = ok && mesh_import(path, &sink, threads, 0, error);
+	if (ok){
+		if (f.n_normals && f.n_normals == f.n_positions){
+			ok = copy_spool(&f.w, f.normals, MESH_NORMALS, sizeof(vec4_t));
+		}
+		ok = ok && copy_spool(&f.w, f.indices, MESH_INDICES, sizeof(uint32_t));
+		if (!ok && error){
+			*error = "couldn't write the mesh file";
+		}
+	}
+	if (f.normals){
+		fclose(f.normals);
+	}
+	if (f.indices){
+		fclose(f.indices);
+	}
+	if (!mesh_writer_close(&f.w) && ok){
+		ok = 0;
+		if (error){
+			*error = "couldn't write the mesh file";
+		}
+	}
+	if (!ok){
+		remove(out_path);
+	}
+	return ok;
+}
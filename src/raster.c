@@ -0,0 +1,467 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "dispatch.h"
+#include "jobs.h"
+#include "raster.h"
+
+/* Triangles transformed and set up per chunk, a multiple of 4 for the SIMD setup */
+#define SETUP_GRAIN 1024
+/* Most vertices a triangle can have after clipping to the near plane and the 4 guard band planes */
+#define CLIP_MAX_VERTS 8
+
+enum tri_state { TRI_CULLED, TRI_DRAW, TRI_CLIP };
+
+struct draw_args {
+	struct raster *r;
+	const mat4_t *mvp;
+	const vec4_t *verts;
+	struct raster_target target;
+	uint32_t color;
+};
+
+/*
+ * Get a buffer of at least size bytes in place of buf, which has room for
+ * *cap bytes and is kept if it's big enough. If keep is set its contents are
+ * copied over when it isn't. Returns NULL, leaving buf alone, if the memory
+ * couldn't be allocated
+ */
+static void* grow(void *buf, size_t *cap, size_t size, int keep){
+	if (size <= *cap){
+		return buf;
+	}
+	size_t new_cap = (size + size / 2 + 63) & ~(size_t)63;
+	void *b = aligned_alloc(64, new_cap);
+	if (!b){
+		return NULL;
+	}
+	if (keep && buf){
+		memcpy(b, buf, *cap);
+	}
+	free(buf);
+	*cap = new_cap;
+	return b;
+}
+static float hmin(__m128 v){
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(_mm_min_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1))));
+}
+static float hmax(__m128 v){
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1))));
+}
+/* Round to the nearest subpixel like _mm_cvtps_epi32 does in the SIMD setup */
+static int32_t snap(float f){
+	return _mm_cvtss_si32(_mm_set_ss(f));
+}
+
+int raster_init(struct raster *r, int width, int height, int threads){
+	memset(r, 0, sizeof(*r));
+	if (width <= 0 || height <= 0 || width > RASTER_MAX_SIZE || height > RASTER_MAX_SIZE){
+		return 0;
+	}
+	r->width = width;
+	r->height = height;
+	r->tiles_x = (width + RASTER_TILE - 1) / RASTER_TILE;
+	r->tiles_y = (height + RASTER_TILE - 1) / RASTER_TILE;
+	r->target.pitch = r->tiles_x * RASTER_TILE;
+	size_t pixels = r->target.pitch * r->tiles_y * RASTER_TILE;
+	size_t tiles = r->tiles_x * r->tiles_y;
+	r->target.depth = aligned_alloc(64, pixels * sizeof(float));
+	r->target.color = aligned_alloc(64, pixels * sizeof(uint32_t));
+	r->bin_start = malloc((tiles + 1) * sizeof(uint32_t));
+	r->bin_fill = malloc(tiles * sizeof(uint32_t));
+	if (threads > 1){
+		r->jobs = jobs_create(threads, 0);
+	}
+	if (!r->target.depth || !r->target.color || !r->bin_start || !r->bin_fill || (threads > 1 && !r->jobs)){
+		raster_destroy(r);
+		return 0;
+	}
+	raster_clear(r, 0, 1);
+	return 1;
+}
+void raster_destroy(struct raster *r){
+	jobs_destroy(r->jobs);
+	free(r->target.depth);
+	free(r->target.color);
+	free(r->clip);
+	free(r->tris);
+	free(r->state);
+	free(r->order);
+	free(r->bin_start);
+	free(r->bin_fill);
+	free(r->bins);
+	memset(r, 0, sizeof(*r));
+}
+void raster_clear(struct raster *r, uint32_t color, float depth){
+	size_t pixels = r->target.pitch * r->tiles_y * RASTER_TILE;
+	const __m128 d = _mm_set1_ps(depth);
+	const __m128i c = _mm_set1_epi32(color);
+	for (size_t i = 0; i < pixels; i += 4){
+		_mm_store_ps(r->target.depth + i, d);
+		_mm_store_si128((__m128i*)(r->target.color + i), c);
+	}
+}
+/*
+ * Transform a chunk of triangles to clip space and set up the ones entirely
+ * inside the guard band, 4 at a time. Triangles entirely outside one of the
+ * clip planes are culled and the rest are left for clip_triangle
+ */
+static void setup_range(void *arg, size_t lo, size_t hi){
+	const struct draw_args *d = arg;
+	struct raster *r = d->r;
+	sse_kernels->vec_mult_n(d->mvp, d->verts + 3 * lo, r->clip + 3 * lo, 3 * (hi - lo));
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 guard = _mm_set1_ps(RASTER_GUARD);
+	const __m128 half_w = _mm_set1_ps(r->width * 0.5f * RASTER_SUBPIXEL);
+	const __m128 half_h = _mm_set1_ps(r->height * 0.5f * RASTER_SUBPIXEL);
+	for (size_t i = lo; i < hi; i += 4){
+		size_t lanes = hi - i < 4 ? hi - i : 4;
+		__m128 x[3], y[3], z[3], w[3];
+		for (int k = 0; k < 3; ++k){
+			/* Lanes past the end just repeat the first triangle */
+			__m128 v[4];
+			for (size_t l = 0; l < 4; ++l){
+				v[l] = r->clip[3 * (i + (l < lanes ? l : 0)) + k].v;
+			}
+			_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+			x[k] = v[0];
+			y[k] = v[1];
+			z[k] = v[2];
+			w[k] = v[3];
+		}
+		__m128 left = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		__m128 right = left, bottom = left, top = left, near = left, far = left;
+		__m128 clip = zero;
+		for (int k = 0; k < 3; ++k){
+			__m128 nw = _mm_sub_ps(zero, w[k]);
+			__m128 gw = _mm_mul_ps(guard, w[k]);
+			__m128 ngw = _mm_sub_ps(zero, gw);
+			left = _mm_and_ps(left, _mm_cmplt_ps(x[k], nw));
+			right = _mm_and_ps(right, _mm_cmpgt_ps(x[k], w[k]));
+			bottom = _mm_and_ps(bottom, _mm_cmplt_ps(y[k], nw));
+			top = _mm_and_ps(top, _mm_cmpgt_ps(y[k], w[k]));
+			near = _mm_and_ps(near, _mm_cmplt_ps(z[k], nw));
+			far = _mm_and_ps(far, _mm_cmpgt_ps(z[k], w[k]));
+			__m128 outside = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(x[k], gw), _mm_cmplt_ps(x[k], ngw)),
+				_mm_or_ps(_mm_cmpgt_ps(y[k], gw), _mm_cmplt_ps(y[k], ngw)));
+			clip = _mm_or_ps(clip, _mm_or_ps(outside, _mm_or_ps(_mm_cmplt_ps(z[k], nw), _mm_cmple_ps(w[k], zero))));
+		}
+		int reject = _mm_movemask_ps(_mm_or_ps(_mm_or_ps(_mm_or_ps(left, right), _mm_or_ps(bottom, top)),
+			_mm_or_ps(near, far)));
+		int needs_clip = _mm_movemask_ps(clip) & ~reject;
+		/* The divides for lanes being culled or clipped are thrown away */
+		int32_t sx[3][4] ALIGN_16, sy[3][4] ALIGN_16;
+		float sz[3][4] ALIGN_16;
+		for (int k = 0; k < 3; ++k){
+			__m128 inv = _mm_div_ps(one, w[k]);
+			__m128 px = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(x[k], inv), one), half_w);
+			__m128 py = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(y[k], inv)), half_h);
+			__m128 pz = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(z[k], inv), half), half);
+			_mm_store_si128((__m128i*)sx[k], _mm_cvtps_epi32(px));
+			_mm_store_si128((__m128i*)sy[k], _mm_cvtps_epi32(py));
+			_mm_store_ps(sz[k], pz);
+		}
+		for (size_t l = 0; l < lanes; ++l){
+			if (reject & (1 << l)){
+				r->state[i + l] = TRI_CULLED;
+			}
+			else if (needs_clip & (1 << l)){
+				r->state[i + l] = TRI_CLIP;
+			}
+			else {
+				const int32_t tx[3] = { sx[0][l], sx[1][l], sx[2][l] };
+				const int32_t ty[3] = { sy[0][l], sy[1][l], sy[2][l] };
+				const float tz[3] = { sz[0][l], sz[1][l], sz[2][l] };
+				r->state[i + l] = raster_setup(r->tris + i + l, tx, ty, tz, r->width, r->height)
+					? TRI_DRAW : TRI_CULLED;
+			}
+		}
+	}
+}
+/*
+ * Clip the polygon to the near plane and the guard band, returning its new
+ * vertex count or 0 if nothing's left
+ */
+static int clip_polygon(vec4_t *poly, int n){
+	const vec4_t planes[5] = {
+		vec4_new(0, 0, 1, 1),
+		vec4_new(-1, 0, 0, RASTER_GUARD),
+		vec4_new(1, 0, 0, RASTER_GUARD),
+		vec4_new(0, -1, 0, RASTER_GUARD),
+		vec4_new(0, 1, 0, RASTER_GUARD)
+	};
+	vec4_t out[CLIP_MAX_VERTS];
+	for (int p = 0; p < 5 && n >= 3; ++p){
+		int m = 0;
+		for (int i = 0; i < n; ++i){
+			vec4_t a = poly[i], b = poly[(i + 1) % n];
+			float da = vec4_dot(planes[p], a), db = vec4_dot(planes[p], b);
+			if (da >= 0){
+				out[m++] = a;
+			}
+			if ((da >= 0) != (db >= 0)){
+				out[m++] = vec4_add(a, vec4_scale(vec4_sub(b, a), da / (da - db)));
+			}
+		}
+		memcpy(poly, out, m * sizeof(vec4_t));
+		n = m;
+	}
+	return n >= 3 ? n : 0;
+}
+/*
+ * Clip triangle i and set up the fan of triangles left at the end of the
+ * setups, adding them to the draw order. Returns 0 if they didn't fit
+ */
+static int clip_triangle(struct raster *r, size_t i, size_t *n_tris, size_t *n_order){
+	vec4_t poly[CLIP_MAX_VERTS] = { r->clip[3 * i], r->clip[3 * i + 1], r->clip[3 * i + 2] };
+	int n = clip_polygon(poly, 3);
+	if (!n){
+		return 1;
+	}
+	void *tris = grow(r->tris, &r->tris_size, (*n_tris + n - 2) * sizeof(struct raster_tri), 1);
+	if (!tris){
+		return 0;
+	}
+	r->tris = tris;
+	void *order = grow(r->order, &r->order_size, (*n_order + n - 2) * sizeof(uint32_t), 1);
+	if (!order){
+		return 0;
+	}
+	r->order = order;
+	/* The same math as the SIMD setup so shared vertices snap to the same place */
+	int32_t sx[CLIP_MAX_VERTS], sy[CLIP_MAX_VERTS];
+	float sz[CLIP_MAX_VERTS];
+	for (int k = 0; k < n; ++k){
+		if (poly[k].f[3] <= 0){
+			return 1;
+		}
+		float inv = 1.f / poly[k].f[3];
+		sx[k] = snap((poly[k].f[0] * inv + 1.f) * (r->width * 0.5f * RASTER_SUBPIXEL));
+		sy[k] = snap((1.f - poly[k].f[1] * inv) * (r->height * 0.5f * RASTER_SUBPIXEL));
+		sz[k] = poly[k].f[2] * inv * 0.5f + 0.5f;
+	}
+	for (int k = 1; k < n - 1; ++k){
+		const int32_t tx[3] = { sx[0], sx[k], sx[k + 1] };
+		const int32_t ty[3] = { sy[0], sy[k], sy[k + 1] };
+		const float tz[3] = { sz[0], sz[k], sz[k + 1] };
+		if (raster_setup(r->tris + *n_tris, tx, ty, tz, r->width, r->height)){
+			r->order[(*n_order)++] = *n_tris;
+			++*n_tris;
+		}
+	}
+	return 1;
+}
+/* Sort the triangles in draw order into the tiles they overlap, returns 0 if the bins didn't fit */
+static int bin_triangles(struct raster *r, size_t n_order){
+	size_t tiles = r->tiles_x * r->tiles_y;
+	uint32_t *count = r->bin_fill;
+	memset(count, 0, tiles * sizeof(uint32_t));
+	size_t total = 0;
+	for (size_t i = 0; i < n_order; ++i){
+		const struct raster_tri *t = r->tris + r->order[i];
+		for (int ty = t->y0 / RASTER_TILE; ty <= t->y1 / RASTER_TILE; ++ty){
+			for (int tx = t->x0 / RASTER_TILE; tx <= t->x1 / RASTER_TILE; ++tx){
+				++count[ty * r->tiles_x + tx];
+			}
+		}
+		total += (t->y1 / RASTER_TILE - t->y0 / RASTER_TILE + 1) * (t->x1 / RASTER_TILE - t->x0 / RASTER_TILE + 1);
+	}
+	if (total > UINT32_MAX){
+		return 0;
+	}
+	void *bins = grow(r->bins, &r->bins_size, total * sizeof(uint32_t), 0);
+	if (!bins){
+		return 0;
+	}
+	r->bins = bins;
+	r->bin_start[0] = 0;
+	for (size_t t = 0; t < tiles; ++t){
+		r->bin_start[t + 1] = r->bin_start[t] + count[t];
+		count[t] = r->bin_start[t];
+	}
+	for (size_t i = 0; i < n_order; ++i){
+		const struct raster_tri *t = r->tris + r->order[i];
+		for (int ty = t->y0 / RASTER_TILE; ty <= t->y1 / RASTER_TILE; ++ty){
+			for (int tx = t->x0 / RASTER_TILE; tx <= t->x1 / RASTER_TILE; ++tx){
+				r->bins[count[ty * r->tiles_x + tx]++] = r->order[i];
+			}
+		}
+	}
+	return 1;
+}
+static void raster_range(void *arg, size_t lo, size_t hi){
+	const struct draw_args *d = arg;
+	const struct raster *r = d->r;
+	for (size_t t = lo; t < hi; ++t){
+		uint32_t first = r->bin_start[t];
+		if (first == r->bin_start[t + 1]){
+			continue;
+		}
+		int x0 = (t % r->tiles_x) * RASTER_TILE, y0 = (t / r->tiles_x) * RASTER_TILE;
+		sse_kernels->raster_tile(&d->target, r->tris, r->bins + first, r->bin_start[t + 1] - first,
+			x0, y0, x0 + RASTER_TILE, y0 + RASTER_TILE, d->color);
+	}
+}
+int raster_draw(struct raster *r, const mat4_t *mvp, const vec4_t *verts, size_t n, uint32_t color, int flags){
+	size_t n_tris = n / 3;
+	if (!n_tris){
+		return 1;
+	}
+	void *p = grow(r->clip, &r->clip_size, 3 * n_tris * sizeof(vec4_t), 0);
+	if (!p){
+		return 0;
+	}
+	r->clip = p;
+	if (!(p = grow(r->state, &r->state_size, n_tris, 0))){
+		return 0;
+	}
+	r->state = p;
+	/* Leave some room for triangles split up by clipping */
+	if (!(p = grow(r->tris, &r->tris_size, (n_tris + n_tris / 8 + 64) * sizeof(struct raster_tri), 0))){
+		return 0;
+	}
+	r->tris = p;
+	if (!(p = grow(r->order, &r->order_size, n_tris * sizeof(uint32_t), 0))){
+		return 0;
+	}
+	r->order = p;
+
+	struct draw_args d = { r, mvp, verts, r->target, color };
+	if (flags & RASTER_DEPTH_ONLY){
+		d.target.color = NULL;
+	}
+	jobs_parallel_for(r->jobs, n_tris, SETUP_GRAIN, setup_range, &d);
+	/* Put the triangles in order, the ones made by clipping go after the others in the setups */
+	size_t n_setup = n_tris, n_order = 0;
+	for (size_t i = 0; i < n_tris; ++i){
+		if (r->state[i] == TRI_DRAW){
+			r->order[n_order++] = i;
+		}
+		else if (r->state[i] == TRI_CLIP && !clip_triangle(r, i, &n_setup, &n_order)){
+			return 0;
+		}
+	}
+	if (!bin_triangles(r, n_order)){
+		return 0;
+	}
+	jobs_parallel_for(r->jobs, r->tiles_x * r->tiles_y, 1, raster_range, &d);
+	return 1;
+}
+int raster_aabb_visible(const struct raster *r, const mat4_t *mvp, const aabb_t *box){
+	const __m128 c[4] = { mvp->col[0].v, mvp->col[1].v, mvp->col[2].v, mvp->col[3].v };
+	vec4_t clip[8];
+	for (int i = 0; i < 8; ++i){
+		vec4_t corner = vec4_new(i & 1 ? box->max.f[0] : box->min.f[0], i & 2 ? box->max.f[1] : box->min.f[1],
+			i & 4 ? box->max.f[2] : box->min.f[2], 1);
+		clip[i].v = mat4_xform_v(c, corner.v, MAT4_XFORM_FULL);
+	}
+	/* Window space bounds of the corners, 4 at a time */
+	const __m128 one = _mm_set1_ps(1);
+	__m128 min_x = _mm_set1_ps(INFINITY), min_y = min_x, min_z = min_x;
+	__m128 max_x = _mm_set1_ps(-INFINITY), max_y = max_x;
+	for (int i = 0; i < 8; i += 4){
+		__m128 x = clip[i].v, y = clip[i + 1].v, z = clip[i + 2].v, w = clip[i + 3].v;
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+		/* Anything reaching behind the near plane might cover the whole screen */
+		if (_mm_movemask_ps(_mm_or_ps(_mm_cmple_ps(w, _mm_setzero_ps()),
+			_mm_cmplt_ps(z, _mm_sub_ps(_mm_setzero_ps(), w)))))
+		{
+			return 1;
+		}
+		__m128 inv = _mm_div_ps(one, w);
+		x = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(x, inv), one), _mm_set1_ps(r->width * 0.5f));
+		y = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(y, inv)), _mm_set1_ps(r->height * 0.5f));
+		z = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(z, inv), _mm_set1_ps(0.5f)), _mm_set1_ps(0.5f));
+		min_x = _mm_min_ps(min_x, x);
+		max_x = _mm_max_ps(max_x, x);
+		min_y = _mm_min_ps(min_y, y);
+		max_y = _mm_max_ps(max_y, y);
+		min_z = _mm_min_ps(min_z, z);
+	}
+	float lo_x = hmin(min_x), hi_x = hmax(max_x), lo_y = hmin(min_y), hi_y = hmax(max_y);
+	float near = hmin(min_z);
+	if (near > 1){
+		return 0;
+	}
+	/* Every pixel whose center could be covered, with a pixel of slack for snapping */
+	float fx0 = floorf(lo_x - 0.5f), fx1 = ceilf(hi_x - 0.5f);
+	float fy0 = floorf(lo_y - 0.5f), fy1 = ceilf(hi_y - 0.5f);
+	fx0 = fx0 < 0 ? 0 : fx0;
+	fy0 = fy0 < 0 ? 0 : fy0;
+	fx1 = fx1 > r->width - 1 ? r->width - 1 : fx1;
+	fy1 = fy1 > r->height - 1 ? r->height - 1 : fy1;
+	if (!(fx0 <= fx1 && fy0 <= fy1)){
+		return 0;
+	}
+	int x0 = fx0, x1 = fx1, y0 = fy0, y1 = fy1;
+	const __m128 z = _mm_set1_ps(near);
+	for (int y = y0; y <= y1; ++y){
+		const float *row = r->target.depth + y * r->target.pitch;
+		int x = x0;
+		for (; x + 3 <= x1; x += 4){
+			if (_mm_movemask_ps(_mm_cmplt_ps(z, _mm_loadu_ps(row + x)))){
+				return 1;
+			}
+		}
+		for (; x <= x1; ++x){
+			if (near < row[x]){
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+int raster_write_ppm(const struct raster *r, const char *fname){
+	FILE *fp = fopen(fname, "wb");
+	if (!fp){
+		return 0;
+	}
+	unsigned char *row = malloc(3 * r->width);
+	int ok = row != NULL && fprintf(fp, "P6\n%d %d\n255\n", r->width, r->height) > 0;
+	for (int y = 0; ok && y < r->height; ++y){
+		for (int x = 0; x < r->width; ++x){
+			uint32_t c = raster_pixel(r, x, y);
+			row[3 * x] = c & 0xff;
+			row[3 * x + 1] = (c >> 8) & 0xff;
+			row[3 * x + 2] = (c >> 16) & 0xff;
+		}
+		ok = fwrite(row, 3, r->width, fp) == (size_t)r->width;
+	}
+	free(row);
+	return fclose(fp) == 0 && ok;
+}
+int raster_write_depth_pgm(const struct raster *r, const char *fname){
+	/* Depths of 1 and up are the cleared background */
+	float lo = 1, hi = 0;
+	for (int y = 0; y < r->height; ++y){
+		for (int x = 0; x < r->width; ++x){
+			float d = raster_depth(r, x, y);
+			if (d < 1){
+				lo = d < lo ? d : lo;
+				hi = d > hi ? d : hi;
+			}
+		}
+	}
+	float scale = hi > lo ? 223 / (hi - lo) : 0;
+	FILE *fp = fopen(fname, "wb");
+	if (!fp){
+		return 0;
+	}
+	unsigned char *row = malloc(r->width);
+	int ok = row != NULL && fprintf(fp, "P5\n%d %d\n255\n", r->width, r->height) > 0;
+	for (int y = 0; ok && y < r->height; ++y){
+		for (int x = 0; x < r->width; ++x){
+			float d = raster_depth(r, x, y);
+			row[x] = d < 1 ? 255 - (unsigned char)((d - lo) * scale) : 0;
+		}
+		ok = fwrite(row, 1, r->width, fp) == (size_t)r->width;
+	}
+	free(row);
+	return fclose(fp) == 0 && ok;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "arena.h"
+
+/* Check the arena and pool alignment, reset and reuse behavior */
+void arena_test(int flags);
+void pool_test(void);
+
+int main(void){
+	arena_test(0);
+	arena_test(ARENA_HUGE_PAGES);
+	pool_test();
+
+	return 0;
+}
+void arena_test(int flags){
+	struct arena a;
+	if (!arena_init(&a, 64 * 1024, flags)){
+		printf("Arena init is wrong\n");
+		return;
+	}
+	float *f = arena_alloc(&a, 3 * sizeof(float), 16);
+	vec4_t *v = arena_alloc_vec4(&a, 5);
+	mat4_t *m = arena_alloc_mat4(&a, 3);
+	void *big = arena_alloc(&a, 100, 4096);
+	if ((uintptr_t)f % 64 || (uintptr_t)v % 64 || (uintptr_t)m % 64 || (uintptr_t)big % 4096){
+		printf("Arena alignment is wrong\n");
+	}
+	/* Blocks are padded to a cache line, the 5 vectors take up 80 bytes so two lines */
+	if ((char*)v != (char*)f + 64 || (char*)m != (char*)v + 128){
+		printf("Arena padding is wrong\n");
+	}
+	for (int i = 0; i < 5; ++i){
+		v[i] = vec4_new(i, 1, 2, 3);
+	}
+	for (int i = 0; i < 3; ++i){
+		m[i] = mat4_translate(v[i]);
+	}
+
+	/* A frame's worth of allocations after the mark should all go away */
+	arena_mark_t mark = arena_mark(&a);
+	vec4_t *frame = arena_alloc_vec4(&a, 100);
+	arena_reset_to(&a, mark);
+	if (arena_alloc_vec4(&a, 100) != frame){
+		printf("Arena reset to mark is wrong\n");
+	}
+	if (!vec4_eq(m[2].col[3], vec4_new(2, 1, 2, 1))){
+		printf("Arena reset clobbered earlier blocks\n");
+	}
+	if (arena_alloc(&a, arena_remaining(&a) + 1, 16) != NULL){
+		printf("Arena overflow is wrong\n");
+	}
+	arena_reset(&a);
+	if (arena_alloc(&a, 16, 16) != (void*)f || arena_alloc(&a, arena_remaining(&a), 16) == NULL){
+		printf("Arena reset is wrong\n");
+	}
+	arena_destroy(&a);
+}
+void pool_test(void){
+	enum { N = 3000 };
+	static mat4_t *mats[N];
+	struct pool p;
+	mat4_pool_init(&p, 0);
+	/* More than one chunk's worth so the pool has to grow */
+	for (int i = 0; i < N; ++i){
+		mats[i] = mat4_pool_alloc(&p);
+		if (!mats[i] || (uintptr_t)mats[i] % 64){
+			printf("Pool alloc is wrong\n");
+			return;
+		}
+		*mats[i] = mat4_translate(vec4_new(i, 0, 0, 1));
+	}
+	if (p.live != N){
+		printf("Pool live count is wrong\n");
+	}
+	for (int i = 0; i < N; ++i){
+		if (mats[i]->col[3].f[0] != i){
+			printf("Pool slots overlap\n");
+			break;
+		}
+	}
+	/* Freed slots are reused most recently freed first */
+	mat4_t *a = mats[10], *b = mats[2000];
+	pool_free(&p, a);
+	pool_free(&p, b);
+	if (mat4_pool_alloc(&p) != b || mat4_pool_alloc(&p) != a || p.live != N){
+		printf("Pool free list is wrong\n");
+	}
+
+	struct pool small;
+	pool_init(&small, 12, 16, 4, ARENA_HUGE_PAGES);
+	char *s0 = pool_alloc(&small), *s1 = pool_alloc(&small);
+	if (s1 - s0 != 16 || (uintptr_t)s0 % 16){
+		printf("Pool slot size is wrong\n");
+	}
+	pool_destroy(&small);
+	pool_destroy(&p);
+}
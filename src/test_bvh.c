@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "vec4.h"
+#include "ray.h"
+#include "bvh.h"
+
+/*
+ * Build BVHs over a few kinds of triangle soup, check the tree is well formed
+ * and its boxes contain what's under them, then check closest and any hit
+ * queries against testing every triangle. Then move the vertices, refit and
+ * check it all again
+ */
+#define RAYS 600
+
+void soup_test(const char *name, vec4_t *verts, size_t n);
+/* Walk the tree checking it, returns the real bounds of the subtree and counts each triangle seen */
+aabb_t check_node(const struct bvh *b, const vec4_t *verts, uint32_t node, int depth, int *seen, int *ok);
+int check_tree(const struct bvh *b, const vec4_t *verts, const char *what);
+void check_queries(const struct bvh *b, const vec4_t *verts, const char *what);
+float randf(float lo, float hi);
+
+int main(void){
+	enum { N = 20000 };
+	static vec4_t verts[3 * N];
+	srand(9);
+
+	/* Small random triangles scattered through a cube */
+	for (int i = 0; i < N; ++i){
+		vec4_t c = vec4_new(randf(-10, 10), randf(-10, 10), randf(-10, 10), 1);
+		for (int j = 0; j < 3; ++j){
+			verts[3 * i + j] = vec4_add(c, vec4_new(randf(-0.5f, 0.5f), randf(-0.5f, 0.5f),
+				randf(-0.5f, 0.5f), 0));
+		}
+	}
+	soup_test("Random", verts, N);
+	soup_test("Small", verts, 1000);
+	soup_test("Three", verts, 3);
+	soup_test("One", verts, 1);
+	soup_test("Empty", verts, 0);
+
+	/* Copies of the same triangle, there's nothing to split on but it's too big for one leaf */
+	for (int i = 0; i < 500; ++i){
+		verts[3 * i] = vec4_new(0, 0, 0, 1);
+		verts[3 * i + 1] = vec4_new(1, 0, 0, 1);
+		verts[3 * i + 2] = vec4_new(0, 1, 0, 1);
+	}
+	soup_test("Stacked", verts, 500);
+
+	/* A flat grid with long thin triangles, the boxes are flat on one axis */
+	for (int i = 0; i < 5000; ++i){
+		float x = i % 100, z = i / 100;
+		verts[3 * i] = vec4_new(x, 2, z, 1);
+		verts[3 * i + 1] = vec4_new(x + 1, 2, z, 1);
+		verts[3 * i + 2] = vec4_new(x, 2, z + 0.1f, 1);
+	}
+	soup_test("Flat", verts, 5000);
+	return 0;
+}
+float randf(float lo, float hi){
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+void soup_test(const char *name, vec4_t *verts, size_t n){
+	char what[64];
+	for (int threads = 1; threads <= 4; threads += 3){
+		struct bvh b;
+		snprintf(what, sizeof(what), "%s %zu triangles %d threads", name, n, threads);
+		if (!bvh_build(&b, verts, n, threads)){
+			printf("%s: build is wrong\n", what);
+			continue;
+		}
+		if (check_tree(&b, verts, what)){
+			check_queries(&b, verts, what);
+		}
+
+		/* Stretch and wobble everything, the tree is the same but every box changes */
+		vec4_t *moved = malloc(3 * n * sizeof(vec4_t) + sizeof(vec4_t));
+		for (size_t i = 0; i < 3 * n; ++i){
+			vec4_t v = verts[i];
+			moved[i] = vec4_new(v.f[0] * 1.5f + sinf(v.f[1]), v.f[1] + cosf(v.f[2]) * 2, -v.f[2], 1);
+		}
+		bvh_refit(&b, moved);
+		snprintf(what, sizeof(what), "%s %zu triangles %d threads refit", name, n, threads);
+		if (check_tree(&b, moved, what)){
+			check_queries(&b, moved, what);
+		}
+		free(moved);
+		bvh_destroy(&b);
+	}
+}
+aabb_t check_node(const struct bvh *b, const vec4_t *verts, uint32_t node, int depth, int *seen, int *ok){
+	const struct bvh_node *n = b->nodes + node;
+	aabb_t all = { { { INFINITY, INFINITY, INFINITY, 0 } }, { { -INFINITY, -INFINITY, -INFINITY, 0 } } };
+	if (depth > BVH_MAX_DEPTH + 16){
+		*ok = 0;
+		return all;
+	}
+	for (int i = 0; i < 4; ++i){
+		uint32_t ref = n->child[i];
+		if (ref == BVH_EMPTY){
+			/* Empty slots are all at the end */
+			for (int j = i; j < 4; ++j){
+				*ok &= n->child[j] == BVH_EMPTY;
+			}
+			break;
+		}
+		aabb_t box = { { { INFINITY, INFINITY, INFINITY, 0 } }, { { -INFINITY, -INFINITY, -INFINITY, 0 } } };
+		if (ref & BVH_LEAF){
+			size_t first = ref & BVH_LEAF_FIRST;
+			size_t count = ((ref & ~BVH_LEAF) >> BVH_LEAF_SHIFT) + 1;
+			if (first + count > b->tri4_count){
+				*ok = 0;
+				return all;
+			}
+			for (size_t t = first; t < first + count; ++t){
+				for (int l = 0; l < 4; ++l){
+					uint32_t prim = b->tris[t].prim[l];
+					if (prim == RAY_MISS){
+						continue;
+					}
+					if (prim >= b->tri_count){
+						*ok = 0;
+						return all;
+					}
+					++seen[prim];
+					for (int v = 0; v < 3; ++v){
+						box.min.v = _mm_min_ps(box.min.v, verts[3 * prim + v].v);
+						box.max.v = _mm_max_ps(box.max.v, verts[3 * prim + v].v);
+					}
+				}
+			}
+		}
+		else {
+			/* Children always come after their parents */
+			if (ref <= node || ref >= b->node_count){
+				*ok = 0;
+				return all;
+			}
+			box = check_node(b, verts, ref, depth + 1, seen, ok);
+		}
+		/* The decoded box has to contain everything under it */
+		for (int a = 0; a < 3; ++a){
+			float lo = n->origin[a] + n->q[a][0][i] * n->scale[a];
+			float hi = n->origin[a] + n->q[a][1][i] * n->scale[a];
+			if (lo > box.min.f[a] || hi < box.max.f[a]){
+				*ok = 0;
+			}
+		}
+		all.min.v = _mm_min_ps(all.min.v, box.min.v);
+		all.max.v = _mm_max_ps(all.max.v, box.max.v);
+	}
+	return all;
+}
+int check_tree(const struct bvh *b, const vec4_t *verts, const char *what){
+	int ok = 1;
+	int *seen = calloc(b->tri_count + 1, sizeof(int));
+	check_node(b, verts, 0, 0, seen, &ok);
+	for (size_t i = 0; i < b->tri_count; ++i){
+		ok &= seen[i] == 1;
+	}
+	free(seen);
+	if (!ok){
+		printf("%s: tree is wrong\n", what);
+	}
+	if (b->tri_count && (b->node_count == 0 || b->node_count > b->tri_count || b->tri4_count > b->tri_count)){
+		printf("%s: node counts are wrong\n", what);
+		ok = 0;
+	}
+	return ok;
+}
+void check_queries(const struct bvh *b, const vec4_t *verts, const char *what){
+	size_t n = b->tri_count;
+	tri_t *tris = malloc(n * sizeof(tri_t) + sizeof(tri_t));
+	ray_t rays[RAYS];
+	hit_t ref[RAYS], hit[RAYS], ref_occ[RAYS];
+	for (size_t i = 0; i < n; ++i){
+		tris[i].v0 = verts[3 * i];
+		tris[i].v1 = verts[3 * i + 1];
+		tris[i].v2 = verts[3 * i + 2];
+	}
+	for (int i = 0; i < RAYS; ++i){
+		vec4_t o = vec4_new(randf(-15, 15), randf(-15, 15), randf(-15, 15), 1);
+		vec4_t d = vec4_new(randf(-1, 1), randf(-1, 1), randf(-1, 1), 0);
+		/* Some axis aligned ones, with infinite 1 / d */
+		if (i % 10 == 0){
+			d = vec4_new(0, 0, 0, 0);
+			d.f[i % 3] = i % 20 ? 1 : -1;
+		}
+		rays[i] = ray_new(o, d);
+		ref[i] = hit_new(INFINITY);
+		hit[i] = hit_new(INFINITY);
+		ref_occ[i] = hit_new(4);
+	}
+	ray_intersect_tris(tris, n, rays, ref, RAYS);
+	ray_intersect_tris(tris, n, rays, ref_occ, RAYS);
+	bvh_intersect_n(b, rays, hit, RAYS);
+	int hits = 0;
+	for (int i = 0; i < RAYS; ++i){
+		/* The same arithmetic is done either way, so only ties could pick a different triangle */
+		if (hit[i].t != ref[i].t || (hit[i].prim == RAY_MISS) != (ref[i].prim == RAY_MISS)){
+			printf("%s: closest hit for ray %d is wrong\n", what, i);
+			break;
+		}
+		hits += ref[i].prim != RAY_MISS;
+		if (bvh_occluded(b, &rays[i], 4) != (ref_occ[i].prim != RAY_MISS)){
+			printf("%s: occlusion for ray %d is wrong\n", what, i);
+			break;
+		}
+	}
+	if (n >= 1000 && hits == 0){
+		printf("%s: hit count is wrong\n", what);
+	}
+	free(tris);
+}
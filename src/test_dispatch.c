@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "dispatch.h"
+
+/*
+ * Make sure every tier the CPU supports gives the same results as the inline
+ * baseline versions, up to rounding differences from FMA
+ */
+void tier_tests(void);
+int vec4_near(vec4_t a, vec4_t b, float eps);
+/* Check n matrices against the reference ones, printing that the kernel is wrong if they're not near */
+void check_mats(const char *tier, const char *kernel, const mat4_t *res, const mat4_t *ref, size_t n, float eps);
+/* Same for n vectors */
+void check_vecs(const char *tier, const char *kernel, const vec4_t *res, const vec4_t *ref, size_t n, float eps);
+
+int main(void){
+	printf("CPU supports up to %s, installed kernels are %s\n",
+		sse_tier_name(sse_cpu_tier()), sse_kernels->name);
+	if (sse_kernels->tier > sse_cpu_tier()){
+		printf("Installed tier is wrong\n");
+	}
+	if (sse_tier_from_name("avx2") != SSE_TIER_AVX2
+		|| sse_tier_from_name("nope") != SSE_TIER_COUNT)
+	{
+		printf("Tier names are wrong\n");
+	}
+	tier_tests();
+
+	return 0;
+}
+int vec4_near(vec4_t a, vec4_t b, float eps){
+	for (int i = 0; i < 4; ++i){
+		if (fabsf(a.f[i] - b.f[i]) > eps * fmaxf(1.f, fabsf(b.f[i]))){
+			return 0;
+		}
+	}
+	return 1;
+}
+void check_mats(const char *tier, const char *kernel, const mat4_t *res, const mat4_t *ref, size_t n, float eps){
+	for (size_t i = 0; i < n; ++i){
+		for (int j = 0; j < 4; ++j){
+			if (!vec4_near(res[i].col[j], ref[i].col[j], eps)){
+				printf("%s %s is wrong\n", tier, kernel);
+				return;
+			}
+		}
+	}
+}
+void check_vecs(const char *tier, const char *kernel, const vec4_t *res, const vec4_t *ref, size_t n, float eps){
+	for (size_t i = 0; i < n; ++i){
+		if (!vec4_near(res[i], ref[i], eps)){
+			printf("%s %s is wrong\n", tier, kernel);
+			return;
+		}
+	}
+}
+void tier_tests(void){
+	/* Enough that the AVX-512 loops run a couple of times before the tails */
+	enum { N = 37 };
+	mat4_t m = mat4_mult(mat4_translate(vec4_new(1, 2, 3, 1)),
+		mat4_rotate(30, vec4_new(0, 1, 1, 0)));
+	mat4_t ms[N], expect[N], res[N];
+	vec4_t in[N], out[N], ref[N];
+	for (int i = 0; i < N; ++i){
+		in[i] = vec4_new(i, i % 3, -i, 1);
+		ms[i] = mat4_mult(mat4_rotate(i * 10, vec4_new(1, 0, 1, 0)),
+			mat4_scale(1 + i, 2, 1));
+	}
+	mat4_transform_points(&m, in, ref, N);
+	mat4_inverse_n(ms, expect, NULL, N);
+	/* The wide matrix and vector kernels, each checked against the SSE versions */
+	vec4_t ref_full[N], ref_vectors[N], ref_project[N];
+	mat4_t ref_mult[N], ref_premult[N], ref_transpose[N];
+	mat4_vec_mult_n(&m, in, ref_full, N);
+	mat4_transform_vectors(&m, in, ref_vectors, N);
+	mat4_project_points(&ms[3], in, ref_project, N);
+	mat4_mult_n(ms, expect, ref_mult, N);
+	mat4_premult_n(&m, ms, ref_premult, N);
+	mat4_transpose_n(ms, ref_transpose, N);
+	/* The builders and special inverses, rigid transforms for inverse_rigid_n */
+	float angles[N], fovs[N], aspects[N], nears[N], fars[N];
+	vec4_t axes[N];
+	mat4_t rigid[N], ref_rotate[N], ref_perspective[N], ref_affine[N], ref_rigid[N], ref_normal[N];
+	for (int i = 0; i < N; ++i){
+		angles[i] = i * 17 - 300;
+		axes[i] = vec4_new(i % 3 - 1, 1, i % 5 * 0.5f, 0);
+		fovs[i] = 30 + i * 3;
+		aspects[i] = 0.5f + i * 0.1f;
+		nears[i] = 0.1f + i * 0.05f;
+		fars[i] = 100 + i * 10;
+		rigid[i] = mat4_mult(mat4_translate(vec4_new(i, -2 * i, 3, 1)), mat4_rotate(i * 10, vec4_new(1, 0, 1, 0)));
+	}
+	mat4_rotate_n(angles, axes, ref_rotate, N);
+	mat4_perspective_n(fovs, aspects, nears, fars, ref_perspective, N);
+	mat4_inverse_affine_n(ms, ref_affine, N);
+	mat4_inverse_rigid_n(rigid, ref_rigid, N);
+	mat4_normal_matrix_n(ms, ref_normal, N);
+	/* Spheres of radius 1 along a diagonal, some in front of the camera and some not */
+	frustum_t f = frustum_from_mat4(mat4_mult(mat4_perspective(60, 1, 1, 20),
+		mat4_look_at(vec4_new(0, 0, 5, 1), vec4_new(0, 0, 0, 1), vec4_new(0, 1, 0, 0))));
+	vec4_t spheres[N];
+	aabb_t boxes[N];
+	uint32_t visible[N], cull_ref[N], cull_box_ref[N];
+	size_t ncull_ref = 0, ncull_box_ref = 0;
+	for (int i = 0; i < N; ++i){
+		spheres[i] = vec4_new(i % 5 - 2, i % 3 - 1, 5 - i, 1);
+		boxes[i].min = vec4_sub(spheres[i], vec4_new(i % 4, 0.5f, 2, 0));
+		boxes[i].max = vec4_add(spheres[i], vec4_new(0.5f, i % 3, 0.5f, 0));
+		if (frustum_sphere_visible(&f, spheres[i])){
+			cull_ref[ncull_ref++] = i;
+		}
+		if (frustum_aabb_visible(&f, boxes[i])){
+			cull_box_ref[ncull_box_ref++] = i;
+		}
+	}
+	/*
+	 * Stacked triangles x + y < size facing rays pointing down -z, placed so no
+	 * ray comes near an edge and every tier has to agree on what's hit
+	 */
+	tri_t tris[8];
+	ray_t rays[N];
+	hit_t hits[N], hit_ref[N];
+	for (int i = 0; i < 8; ++i){
+		float size = 0.3f * (1 + i % 4);
+		tris[i].v0 = vec4_new(0, 0, -1 - i, 1);
+		tris[i].v1 = vec4_new(size, 0, -1 - i, 1);
+		tris[i].v2 = vec4_new(0, size, -1 - i, 1);
+	}
+	for (int i = 0; i < N; ++i){
+		rays[i] = ray_new(vec4_new(0.05f + 0.1f * (i % 7), 0.1f + 0.1f * (i % 5), 1, 1),
+			vec4_new(0, 0, i == N - 1 ? 1 : -1, 0));
+		hit_ref[i] = hit_new(INFINITY);
+	}
+	ray_intersect_tris(tris, 8, rays, hit_ref, N);
+	if (hit_ref[0].prim != 0 || hit_ref[N - 1].prim != RAY_MISS){
+		printf("Reference intersect_tris is wrong\n");
+	}
+	/* Overlapping triangles in a tile, every tier has to draw exactly the same pixels and depths */
+	static float depth[RASTER_TILE * RASTER_TILE] ALIGN_64, depth_ref[RASTER_TILE * RASTER_TILE] ALIGN_64;
+	static uint32_t color[RASTER_TILE * RASTER_TILE] ALIGN_64, color_ref[RASTER_TILE * RASTER_TILE] ALIGN_64;
+	struct raster_tri raster_tris[N];
+	uint32_t raster_ids[N];
+	size_t n_raster = 0;
+	for (int i = 0; i < N; ++i){
+		const int32_t x[3] = { 37 * i % 1000, 1020 - 29 * i % 700, 500 + 13 * i };
+		const int32_t y[3] = { 11 * i % 900, 300 + 17 * i % 700, 1000 - 23 * i % 800 };
+		const float z[3] = { (i % 7) / 7.f, 0.5f, 1 - (i % 5) / 5.f };
+		if (raster_setup(&raster_tris[n_raster], x, y, z, RASTER_TILE, RASTER_TILE)){
+			raster_ids[n_raster] = n_raster;
+			++n_raster;
+		}
+	}
+	struct raster_target target = { depth_ref, color_ref, RASTER_TILE };
+	for (int i = 0; i < RASTER_TILE * RASTER_TILE; ++i){
+		depth_ref[i] = 1;
+		color_ref[i] = 0;
+	}
+	raster_tile(&target, raster_tris, raster_ids, n_raster, 0, 0, RASTER_TILE, RASTER_TILE, 0xffffffff);
+	if (n_raster < N / 2 || !color_ref[RASTER_TILE * 20 + 40] || depth_ref[RASTER_TILE * 20 + 40] == 1){
+		printf("Reference raster_tile is wrong\n");
+	}
+
+	for (int t = 0; t < SSE_TIER_COUNT; ++t){
+		const struct sse_kernels *k = sse_kernels_for_tier(t);
+		if (!k){
+			printf("Tier %s not supported, skipping\n", sse_tier_name(t));
+			if (sse_dispatch_set_tier(t)->tier != sse_cpu_tier()){
+				printf("Forcing an unsupported tier is wrong\n");
+			}
+			continue;
+		}
+		printf("Testing tier %s\n", k->name);
+		if (k->tier != (enum sse_tier)t || sse_dispatch_set_tier(t) != k){
+			printf("Kernel table lookup is wrong\n");
+		}
+		k->transform_points(&m, in, out, N);
+		for (int i = 0; i < N; ++i){
+			if (!vec4_near(out[i], ref[i], 1e-5f)){
+				printf("%s transform_points is wrong\n", k->name);
+				break;
+			}
+		}
+		k->vec_mult_n(&m, in, out, N);
+		check_vecs(k->name, "vec_mult_n", out, ref_full, N, 1e-5f);
+		k->transform_vectors(&m, in, out, N);
+		check_vecs(k->name, "transform_vectors", out, ref_vectors, N, 1e-5f);
+		k->project_points(&ms[3], in, out, N);
+		check_vecs(k->name, "project_points", out, ref_project, N, 1e-5f);
+		k->inverse_n(ms, res, NULL, N);
+		check_mats(k->name, "inverse_n", res, expect, N, 1e-4f);
+		k->mult_n(ms, expect, res, N);
+		check_mats(k->name, "mult_n", res, ref_mult, N, 1e-4f);
+		k->premult_n(&m, ms, res, N);
+		check_mats(k->name, "premult_n", res, ref_premult, N, 1e-5f);
+		/* Transposing only moves the values so it has to be exact */
+		k->transpose_n(ms, res, N);
+		if (memcmp(res, ref_transpose, sizeof(res))){
+			printf("%s transpose_n is wrong\n", k->name);
+		}
+		k->rotate_n(angles, axes, res, N);
+		check_mats(k->name, "rotate_n", res, ref_rotate, N, 1e-5f);
+		k->perspective_n(fovs, aspects, nears, fars, res, N);
+		check_mats(k->name, "perspective_n", res, ref_perspective, N, 1e-5f);
+		k->inverse_affine_n(ms, res, N);
+		check_mats(k->name, "inverse_affine_n", res, ref_affine, N, 1e-4f);
+		k->inverse_rigid_n(rigid, res, N);
+		check_mats(k->name, "inverse_rigid_n", res, ref_rigid, N, 1e-5f);
+		k->normal_matrix_n(ms, res, N);
+		check_mats(k->name, "normal_matrix_n", res, ref_normal, N, 1e-4f);
+		size_t ncull = k->cull_spheres(&f, spheres, N, visible);
+		if (ncull != ncull_ref || memcmp(visible, cull_ref, ncull * sizeof(uint32_t))){
+			printf("%s cull_spheres is wrong\n", k->name);
+		}
+		ncull = k->cull_aabbs(&f, boxes, N, visible);
+		if (ncull != ncull_box_ref || memcmp(visible, cull_box_ref, ncull * sizeof(uint32_t))){
+			printf("%s cull_aabbs is wrong\n", k->name);
+		}
+		for (int i = 0; i < N; ++i){
+			hits[i] = hit_new(INFINITY);
+		}
+		k->intersect_tris(tris, 8, rays, hits, N);
+		for (int i = 0; i < N; ++i){
+			if (hits[i].prim != hit_ref[i].prim || fabsf(hits[i].t - hit_ref[i].t) > 1e-5f){
+				printf("%s intersect_tris is wrong\n", k->name);
+				break;
+			}
+		}
+		target.depth = depth;
+		target.color = color;
+		for (int i = 0; i < RASTER_TILE * RASTER_TILE; ++i){
+			depth[i] = 1;
+			color[i] = 0;
+		}
+		k->raster_tile(&target, raster_tris, raster_ids, n_raster, 0, 0, RASTER_TILE, RASTER_TILE, 0xffffffff);
+		if (memcmp(depth, depth_ref, sizeof(depth)) || memcmp(color, color_ref, sizeof(color))){
+			printf("%s raster_tile is wrong\n", k->name);
+		}
+	}
+}
+
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <math.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "dvec4.h"
+#include "dmat4.h"
+
+/*
+ * Built twice like test_dvec4, for the SSE2 halves and with -mavx. The results
+ * are checked against the float mat4 functions and exact values
+ */
+void basic_tests(void);
+void builder_tests(void);
+void inverse_tests(void);
+void relative_tests(void);
+/* Check if the matrices are equal within some epsilon */
+int dmat4_near(dmat4_t a, dmat4_t b, double eps);
+/* Check a double matrix against a float one within some epsilon */
+int dmat4_near_mat4(dmat4_t a, mat4_t b, double eps);
+
+int main(void){
+#ifdef __AVX__
+	printf("Testing the AVX dmat4\n");
+#else
+	printf("Testing the SSE2 dmat4\n");
+#endif
+	basic_tests();
+	builder_tests();
+	inverse_tests();
+	relative_tests();
+	return 0;
+}
+int dmat4_near(dmat4_t a, dmat4_t b, double eps){
+	for (int i = 0; i < 4; ++i){
+		for (int j = 0; j < 4; ++j){
+			if (fabs(a.col[i].d[j] - b.col[i].d[j]) > eps){
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+int dmat4_near_mat4(dmat4_t a, mat4_t b, double eps){
+	return dmat4_near(a, dmat4_from_mat4(b), eps);
+}
+void basic_tests(void){
+	const double a_rows[16] = {
+		1, 5, 0, 0,
+		2, 1, 3, 5,
+		6, 9, 0, 2,
+		5, 3, 8, 9
+	};
+	const double b_rows[16] = {
+		4, 0, 2, 0,
+		1, 2, 7, 1,
+		0, 0, 2, 0,
+		1, 2, 0, 1
+	};
+	const double c_rows[16] = {
+		9, 10, 37, 5,
+		14, 12, 17, 6,
+		35, 22, 75, 11,
+		32, 24, 47, 12
+	};
+	dmat4_t a = dmat4_from_rows(a_rows), b = dmat4_from_rows(b_rows);
+	dmat4_t c = dmat4_from_rows(c_rows);
+	if (a.col[0].d[1] != 2 || a.col[1].d[0] != 5 || a.col[3].d[2] != 2){
+		printf("From rows is wrong\n");
+	}
+	if (!dmat4_eq(dmat4_transpose(dmat4_transpose(a)), a) || !dmat4_eq(dmat4_transpose(a), dmat4_from_cols(a_rows))){
+		printf("Transpose is wrong\n");
+	}
+	if (!dmat4_eq(dmat4_mult(a, b), c)){
+		printf("Multiplication is wrong\n");
+		dmat4_print(dmat4_mult(a, b));
+	}
+	/* In place should work when dst aliases either side */
+	dmat4_t d = a;
+	dmat4_mult_to(&d, &d, &b);
+	dmat4_t e = b;
+	dmat4_mult_to(&e, &a, &e);
+	if (!dmat4_eq(d, c) || !dmat4_eq(e, c)){
+		printf("In place multiplication is wrong\n");
+	}
+	if (!dmat4_eq(dmat4_sub(dmat4_add(a, b), b), a)){
+		printf("Add/sub is wrong\n");
+	}
+	dvec4_t v = dmat4_vec_mult(&a, dvec4_new(1, 2, 3, 4));
+	if (!dvec4_eq(v, dvec4_new(11, 33, 32, 71))){
+		printf("Vector multiplication is wrong\n");
+		dvec4_print(v);
+	}
+	if (!dmat4_eq(dmat4_mult(dmat4_new(), a), a)){
+		printf("Identity is wrong\n");
+	}
+	/* Round tripping through float is exact for these */
+	if (!dmat4_eq(dmat4_from_mat4(dmat4_to_mat4(a)), a)){
+		printf("Float conversion is wrong\n");
+	}
+}
+void builder_tests(void){
+	dmat4_t t = dmat4_translate(dvec4_new(1, 2, 3, 0));
+	if (!dvec4_eq(dmat4_vec_mult(&t, dvec4_new(1, 1, 1, 1)), dvec4_new(2, 3, 4, 1))){
+		printf("Translate is wrong\n");
+	}
+	dmat4_t s = dmat4_scale(2, 3, 4);
+	if (!dvec4_eq(dmat4_vec_mult(&s, dvec4_new(1, 1, 1, 1)), dvec4_new(2, 3, 4, 1))){
+		printf("Scale is wrong\n");
+	}
+	dmat4_t r = dmat4_rotate(90, dvec4_new(1, 0, 0, 0));
+	dvec4_t v = dmat4_vec_mult(&r, dvec4_new(0, 1, 0, 0));
+	if (fabs(v.c.x) > 1e-12 || fabs(v.c.y) > 1e-12 || fabs(v.c.z - 1) > 1e-12 || v.c.w != 0){
+		printf("Rotation is wrong\n");
+		dvec4_print(v);
+	}
+	r = dmat4_rotate(37, dvec4_new(1, 2, -1, 0));
+	if (!dmat4_near_mat4(r, mat4_rotate(37, vec4_new(1, 2, -1, 0)), 1e-6)){
+		printf("Rotation doesn't match mat4_rotate\n");
+	}
+	dmat4_t l = dmat4_look_at(dvec4_new(1, 3, 5, 0), dvec4_new(0, 0, 0, 0), dvec4_new(0, 1, 0, 0));
+	mat4_t fl = mat4_look_at(vec4_new(1, 3, 5, 0), vec4_new(0, 0, 0, 0), vec4_new(0, 1, 0, 0));
+	if (!dmat4_near_mat4(l, fl, 1e-5)){
+		printf("Look at doesn't match mat4_look_at\n");
+		dmat4_print(l);
+	}
+	dmat4_t p = dmat4_perspective(75, 640.0 / 480, 1, 100);
+	if (!dmat4_near_mat4(p, mat4_perspective(75, 640.f / 480, 1, 100), 1e-5)){
+		printf("Perspective doesn't match mat4_perspective\n");
+		dmat4_print(p);
+	}
+	dmat4_t o = dmat4_ortho(-2, 4, -1, 3, 0.5, 20);
+	if (!dmat4_near_mat4(o, mat4_ortho(-2, 4, -1, 3, 0.5f, 20), 1e-6)){
+		printf("Ortho doesn't match mat4_ortho\n");
+	}
+}
+void inverse_tests(void){
+	const double a_rows[16] = {
+		1, 5, 0, 0,
+		2, 1, 3, 5,
+		6, 9, 0, 2,
+		5, 3, 8, 9
+	};
+	dmat4_t a = dmat4_from_rows(a_rows);
+	double det;
+	float fdet;
+	dmat4_t inv = dmat4_inverse(a, &det);
+	mat4_t finv = mat4_inverse(dmat4_to_mat4(a), &fdet);
+	if (det != -261 || fdet != -261){
+		printf("Determinant is wrong: %f\n", det);
+	}
+	if (!dmat4_near(dmat4_mult(a, inv), dmat4_new(), 1e-13) || !dmat4_near(dmat4_mult(inv, a), dmat4_new(), 1e-13)){
+		printf("Inverse is wrong\n");
+		dmat4_print(inv);
+	}
+	if (!dmat4_near_mat4(inv, finv, 1e-5)){
+		printf("Inverse doesn't match mat4_inverse\n");
+	}
+	/* A far away model matrix, the float inverse can't get close to this */
+	dmat4_t m = dmat4_mult(dmat4_translate(dvec4_new(3e6, -1e6, 2e6, 0)),
+		dmat4_mult(dmat4_rotate(30, dvec4_new(0, 1, 1, 0)), dmat4_scale(2, 2, 0.5)));
+	inv = dmat4_inverse(m, NULL);
+	if (!dmat4_near(dmat4_mult(inv, m), dmat4_new(), 1e-9)){
+		printf("Inverse of a far transform is wrong\n");
+	}
+	if (!dmat4_near(dmat4_inverse_affine(m), inv, 1e-9)){
+		printf("Affine inverse is wrong\n");
+	}
+	dmat4_t rigid = dmat4_mult(dmat4_translate(dvec4_new(3e6, -1e6, 2e6, 0)), dmat4_rotate(30, dvec4_new(0, 1, 1, 0)));
+	if (!dmat4_near(dmat4_inverse_rigid(rigid), dmat4_inverse(rigid, NULL), 1e-9)){
+		printf("Rigid inverse is wrong\n");
+	}
+	/* The determinant is 0 for a singular matrix */
+	dmat4_inverse(dmat4_scale(1, 0, 1), &det);
+	if (det != 0){
+		printf("Determinant of a singular matrix is wrong\n");
+	}
+}
+void relative_tests(void){
+	/*
+	 * A model matrix placing an object 1e7 from the origin, seen by a camera close
+	 * to it. Narrowing relative to the camera keeps the object's offset exact
+	 * while narrowing the absolute matrix loses it completely
+	 */
+	dvec4_t cam = dvec4_new(1e7, 5e6, -1e7, 0);
+	dmat4_t model = dmat4_translate(dvec4_add(cam, dvec4_new(0.3, -0.2, 0.1, 0)));
+	mat4_t rel = dmat4_to_mat4_rel(model, cam);
+	if (fabsf(rel.col[3].c.x - 0.3f) > 1e-6f || fabsf(rel.col[3].c.y + 0.2f) > 1e-6f
+		|| fabsf(rel.col[3].c.z - 0.1f) > 1e-6f || rel.col[3].c.w != 1)
+	{
+		printf("Camera relative narrowing is wrong\n");
+		mat4_print(rel);
+	}
+	mat4_t naive = dmat4_to_mat4(model);
+	if (fabsf(naive.col[3].c.x - 1e7f - 0.3f) < 0.01f){
+		printf("Float precision at 1e7 is unexpectedly good, the precision test is wrong\n");
+	}
+	dmat4_t models[3] = { model, dmat4_mult(model, dmat4_scale(2, 2, 2)), dmat4_translate(cam) };
+	mat4_t out[3];
+	dmat4_to_mat4_rel_n(models, cam, out, 3);
+	for (int i = 0; i < 3; ++i){
+		if (!mat4_eq(out[i], dmat4_to_mat4_rel(models[i], cam))){
+			printf("Batch camera relative narrowing is wrong\n");
+		}
+	}
+	if (!mat4_eq(out[2], mat4_new())){
+		printf("Narrowing the camera's own position is wrong\n");
+	}
+}
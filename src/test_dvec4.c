@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <math.h>
+#include "vec4.h"
+#include "dvec4.h"
+
+/*
+ * Built twice, once for the baseline SSE2 halves and once with -mavx for the
+ * __m256d path, both should give exactly the same results
+ */
+void basic_tests(void);
+void geometry_tests(void);
+void narrowing_tests(void);
+
+int main(void){
+#ifdef __AVX__
+	printf("Testing the AVX dvec4\n");
+#else
+	printf("Testing the SSE2 dvec4\n");
+#endif
+	basic_tests();
+	geometry_tests();
+	narrowing_tests();
+	return 0;
+}
+void basic_tests(void){
+	dvec4_t a = dvec4_new(1, 2, 3, 4), b = dvec4_new(5, 6, 7, 8);
+	if (a.c.x != 1 || a.c.y != 2 || a.c.z != 3 || a.c.w != 4){
+		printf("dvec4_new is wrong\n");
+	}
+	if (!dvec4_eq(dvec4_add(a, b), dvec4_new(6, 8, 10, 12))){
+		printf("Add is wrong\n");
+	}
+	if (!dvec4_eq(dvec4_sub(a, b), dvec4_new(-4, -4, -4, -4))){
+		printf("Sub is wrong\n");
+	}
+	if (!dvec4_eq(dvec4_mult(a, b), dvec4_new(5, 12, 21, 32))){
+		printf("Mult is wrong\n");
+	}
+	if (!dvec4_eq(dvec4_div(b, dvec4_set1(2)), dvec4_new(2.5, 3, 3.5, 4))){
+		printf("Div is wrong\n");
+	}
+	if (!dvec4_eq(dvec4_madd(a, b, a), dvec4_new(6, 14, 24, 36))){
+		printf("Madd is wrong\n");
+	}
+	for (int i = 0; i < 4; ++i){
+		if (!dvec4_eq(dvec4_splat(a, i), dvec4_set1(i + 1))){
+			printf("Splat of %d is wrong\n", i);
+		}
+	}
+	/* Splat needs a constant index */
+	if (!dvec4_eq(dvec4_splat(b, 0), dvec4_set1(5)) || !dvec4_eq(dvec4_splat(b, 1), dvec4_set1(6))
+		|| !dvec4_eq(dvec4_splat(b, 2), dvec4_set1(7)) || !dvec4_eq(dvec4_splat(b, 3), dvec4_set1(8)))
+	{
+		printf("Constant splat is wrong\n");
+	}
+	if (!dvec4_eq(dvec4_hsum(a), dvec4_set1(10))){
+		printf("Hsum is wrong\n");
+	}
+	if (dvec4_eq(a, dvec4_new(1, 2, 3, 5)) || dvec4_eq(a, dvec4_new(0, 2, 3, 4))){
+		printf("Eq is wrong\n");
+	}
+}
+void geometry_tests(void){
+	dvec4_t a = dvec4_new(1, 2, 3, 4), b = dvec4_new(5, 6, 7, 8);
+	if (dvec4_dot(a, b) != 70 || dvec4_dot3(a, b) != 38){
+		printf("Dot is wrong\n");
+	}
+	if (dvec4_len(dvec4_new(2, 3, 6, 0)) != 7){
+		printf("Len is wrong\n");
+	}
+	dvec4_t n = dvec4_normalize(dvec4_new(0, 3, 4, 0));
+	if (!dvec4_eq(n, dvec4_new(0, 0.6, 0.8, 0))){
+		printf("Normalize is wrong\n");
+		dvec4_print(n);
+	}
+	if (!dvec4_eq(dvec4_cross(dvec4_new(1, 0, 0, 0), dvec4_new(0, 1, 0, 0)), dvec4_new(0, 0, 1, 0))){
+		printf("Cross of x and y is wrong\n");
+	}
+	/* Against the float cross product, all the values are exact in float */
+	dvec4_t c = dvec4_cross(a, b);
+	vec4_t fc = vec4_cross(vec4_new(1, 2, 3, 4), vec4_new(5, 6, 7, 8));
+	if (!dvec4_eq(c, dvec4_new(-4, 8, -4, 0)) || !dvec4_eq(c, dvec4_from_vec4(fc))){
+		printf("Cross is wrong\n");
+		dvec4_print(c);
+	}
+}
+void narrowing_tests(void){
+	vec4_t f = vec4_new(1.5f, -2.25f, 3, 0.125f);
+	dvec4_t d = dvec4_from_vec4(f);
+	if (!dvec4_eq(d, dvec4_new(1.5, -2.25, 3, 0.125)) || !vec4_eq(dvec4_to_vec4(d), f)){
+		printf("Float conversion is wrong\n");
+	}
+	/*
+	 * 1e7 + 0.3 can't be told apart from 1e7 in float but the camera relative
+	 * position is exact enough
+	 */
+	dvec4_t cam = dvec4_new(1e7, -2e7, 3e7, 0);
+	dvec4_t p = dvec4_add(cam, dvec4_new(0.3, 0.25, -0.7, 1));
+	vec4_t rel = dvec4_to_vec4_rel(p, cam);
+	vec4_t naive = vec4_sub(dvec4_to_vec4(p), dvec4_to_vec4(cam));
+	if (fabsf(rel.c.x - 0.3f) > 1e-6f || fabsf(rel.c.y - 0.25f) > 1e-6f || fabsf(rel.c.z + 0.7f) > 1e-6f
+		|| rel.c.w != 1)
+	{
+		printf("Camera relative narrowing is wrong\n");
+		vec4_print(rel);
+	}
+	if (fabsf(naive.c.x - 0.3f) < 0.01f){
+		printf("Float precision at 1e7 is unexpectedly good, the precision test is wrong\n");
+	}
+	dvec4_t in[5];
+	vec4_t out[5], out_rel[5];
+	for (int i = 0; i < 5; ++i){
+		in[i] = dvec4_add(cam, dvec4_new(i, 2 * i, 0.5 * i, 1));
+	}
+	dvec4_to_vec4_n(in, out, 5);
+	dvec4_to_vec4_rel_n(in, cam, out_rel, 5);
+	for (int i = 0; i < 5; ++i){
+		if (!vec4_eq(out[i], dvec4_to_vec4(in[i]))){
+			printf("Batch narrowing is wrong\n");
+		}
+		if (!vec4_eq(out_rel[i], vec4_new(i, 2 * i, 0.5f * i, 1))){
+			printf("Batch camera relative narrowing is wrong\n");
+		}
+	}
+}
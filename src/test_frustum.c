@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "frustum.h"
+
+/* Check the extracted planes against known points and the batched culling against the single tests */
+void plane_test(void);
+void cull_test(void);
+
+int main(void){
+	plane_test();
+	cull_test();
+
+	return 0;
+}
+void plane_test(void){
+	/* Camera at the origin looking down -z, 60 degree fov so the sides are at x = +-tan(30) * -z */
+	mat4_t view = mat4_look_at(vec4_new(0, 0, 0, 1), vec4_new(0, 0, -1, 1), vec4_new(0, 1, 0, 0));
+	frustum_t f = frustum_from_mat4(mat4_mult(mat4_perspective(60, 1, 1, 100), view));
+	for (int i = 0; i < FRUSTUM_PLANES; ++i){
+		float len = f.a[i] * f.a[i] + f.b[i] * f.b[i] + f.c[i] * f.c[i];
+		if (fabsf(len - 1) > 1e-5f){
+			printf("Plane %d normalization is wrong\n", i);
+		}
+	}
+	struct {
+		vec4_t s;
+		int visible;
+	} cases[] = {
+		{ { { 0, 0, -10, 1 } }, 1 },
+		/* Behind the camera */
+		{ { { 0, 0, 10, 1 } }, 0 },
+		/* In front of the near plane, and one crossing it */
+		{ { { 0, 0, -0.5f, 0.1f } }, 0 },
+		{ { { 0, 0, -0.5f, 1 } }, 1 },
+		/* Past the far plane, and one crossing it */
+		{ { { 0, 0, -150, 10 } }, 0 },
+		{ { { 0, 0, -105, 10 } }, 1 },
+		/* Off to the side, and one just touching the right plane */
+		{ { { 30, 0, -10, 1 } }, 0 },
+		{ { { 6, 0, -10, 1 } }, 1 },
+		{ { { 0, -30, -10, 1 } }, 0 },
+		{ { { 0, 5.5f, -10, 0 } }, 1 },
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i){
+		if (frustum_sphere_visible(&f, cases[i].s) != cases[i].visible){
+			printf("Sphere %zu visibility is wrong\n", i);
+		}
+		/* The box around the sphere should agree for these */
+		aabb_t b;
+		vec4_t r = vec4_new(cases[i].s.f[3], cases[i].s.f[3], cases[i].s.f[3], 0);
+		b.min = vec4_sub(cases[i].s, r);
+		b.max = vec4_add(cases[i].s, r);
+		if (frustum_aabb_visible(&f, b) != cases[i].visible){
+			printf("Box %zu visibility is wrong\n", i);
+		}
+	}
+
+	f = frustum_from_mat4(mat4_mult(mat4_ortho(-1, 1, -1, 1, 1, 10), view));
+	if (!frustum_sphere_visible(&f, vec4_new(0.5f, 0.5f, -5, 0))
+		|| frustum_sphere_visible(&f, vec4_new(2, 0, -5, 0.5f))
+		|| frustum_sphere_visible(&f, vec4_new(0, 0, -11, 0.5f)))
+	{
+		printf("Ortho frustum is wrong\n");
+	}
+}
+void cull_test(void){
+	enum { N = 1003 };
+	static vec4_t spheres[N];
+	static aabb_t boxes[N];
+	static uint32_t visible[N];
+	mat4_t view = mat4_look_at(vec4_new(3, 2, 10, 1), vec4_new(0, 0, 0, 1), vec4_new(0, 1, 0, 0));
+	frustum_t f = frustum_from_mat4(mat4_mult(mat4_perspective(75, 1.5f, 0.5f, 30), view));
+	srand(11);
+	for (int i = 0; i < N; ++i){
+		vec4_t c = vec4_new(rand() % 80 - 40, rand() % 80 - 40, rand() % 80 - 40, 0);
+		vec4_t e = vec4_new(rand() % 40 / 10.f, rand() % 40 / 10.f, rand() % 40 / 10.f, 0);
+		spheres[i] = vec4_add(vec4_new(0, 0, 0, 1), vec4_add(c, vec4_new(0, 0, 0, e.f[0])));
+		boxes[i].min = vec4_sub(c, e);
+		boxes[i].max = vec4_add(c, e);
+	}
+	size_t n = frustum_cull_spheres(&f, spheres, N, visible);
+	size_t j = 0;
+	for (int i = 0; i < N; ++i){
+		if (frustum_sphere_visible(&f, spheres[i])){
+			if (j >= n || visible[j] != (uint32_t)i){
+				printf("Sphere culling is wrong\n");
+				break;
+			}
+			++j;
+		}
+	}
+	if (j != n || n == 0 || n == N){
+		printf("Sphere culling count is wrong\n");
+	}
+
+	n = frustum_cull_aabbs(&f, boxes, N, visible);
+	j = 0;
+	for (int i = 0; i < N; ++i){
+		int vis = frustum_aabb_visible(&f, boxes[i]);
+		if (vis){
+			if (j >= n || visible[j] != (uint32_t)i){
+				printf("Box culling is wrong\n");
+				break;
+			}
+			++j;
+		}
+		/* Conservative, so any corner inside the frustum means it must be kept */
+		for (int k = 0; k < 8 && !vis; ++k){
+			vec4_t p = vec4_new(k & 1 ? boxes[i].max.f[0] : boxes[i].min.f[0],
+				k & 2 ? boxes[i].max.f[1] : boxes[i].min.f[1],
+				k & 4 ? boxes[i].max.f[2] : boxes[i].min.f[2], 0);
+			if (frustum_sphere_visible(&f, p)){
+				printf("Box culling rejected a visible box\n");
+				break;
+			}
+		}
+	}
+	if (j != n || n == 0 || n == N){
+		printf("Box culling count is wrong\n");
+	}
+	if (frustum_cull_spheres(&f, spheres, 0, visible) != 0){
+		printf("Culling nothing is wrong\n");
+	}
+}
@@ -11,6 +11,7 @@
 
 #include "vec4.h"
 #include "mat4.h"
+#include "mesh.h"
 
 const int WIN_WIDTH = 640;
 const int WIN_HEIGHT = 480;
@@ -73,6 +74,20 @@ int main(int argc, char **argv){
 	object[16] = vec4_new(-1, 1, 1, 1);
 	object[17] = vec4_new(-1, -1, 1, 1);
 
+	/* Draw a mesh file instead if one's passed, it's uploaded straight from the mapping */
+	const vec4_t *verts = object;
+	const uint32_t *indices = NULL;
+	size_t n_verts = 18, n_indices = 0;
+	struct mesh_file mesh;
+	if (argc > 1){
+		if (!mesh_open(&mesh, argv[1], MESH_SEQUENTIAL | MESH_WILLNEED)){
+			fprintf(stderr, "Failed to open mesh %s: %s\n", argv[1], mesh.error);
+			return 1;
+		}
+		verts = mesh_positions(&mesh, &n_verts);
+		indices = mesh_indices(&mesh, &n_indices);
+	}
+
 	if (SDL_Init(SDL_INIT_EVERYTHING) != 0){
 		fprintf(stderr, "SDL Init error: %s\n", SDL_GetError());
 		return 1;
@@ -119,9 +134,19 @@ int main(int argc, char **argv){
 	glBindVertexArray(model[0]);
 	glGenBuffers(1, model + 1);
 	glBindBuffer(GL_ARRAY_BUFFER, model[1]);
-	glBufferData(GL_ARRAY_BUFFER, 4 * 6 * 3 * sizeof(GLfloat), object, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, n_verts * sizeof(vec4_t), verts, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	GLuint elems = 0;
+	if (indices){
+		glGenBuffers(1, &elems);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elems);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, n_indices * sizeof(uint32_t), indices, GL_STATIC_DRAW);
+	}
+	/* The GL has its own copy now */
+	if (argc > 1){
+		mesh_close(&mesh);
+	}
 	if (check_GL_error("Setup buffers")){
 		return 1;
 	}
@@ -151,7 +176,12 @@ int main(int argc, char **argv){
 	glUniformMatrix4fv(proj_unif, 1, GL_FALSE, (GLfloat*)&proj_mat);
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glDrawArrays(GL_TRIANGLES, 0, 18);
+	if (elems){
+		glDrawElements(GL_TRIANGLES, n_indices, GL_UNSIGNED_INT, 0);
+	}
+	else {
+		glDrawArrays(GL_TRIANGLES, 0, n_verts);
+	}
 	SDL_GL_SwapWindow(win);
 	check_GL_error("Post Draw");
 
@@ -168,6 +198,9 @@ int main(int argc, char **argv){
 	glDeleteProgram(program);
 	glDeleteVertexArrays(1, model);
 	glDeleteBuffers(1, model + 1);
+	if (elems){
+		glDeleteBuffers(1, &elems);
+	}
 	SDL_GL_DeleteContext(context);
 	SDL_DestroyWindow(win);
 
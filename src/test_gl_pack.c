@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "gl_pack.h"
+
+/*
+ * Check the std140/std430 offsets and strides against the layout rules and the
+ * bytes written by the pack functions, including that padding is left alone
+ */
+#define N 37
+#define FILL 0xab
+
+void layout_test(void);
+void pack_test(int flags);
+mat4_t random_mat4(void);
+/* Check the bytes in [lo, hi) are still the fill value */
+int untouched(const unsigned char *buf, size_t lo, size_t hi);
+
+int main(void){
+	srand(11);
+	layout_test();
+	pack_test(0);
+	pack_test(PACK_STREAM);
+	pack_test(PACK_TRANSPOSE);
+	pack_test(PACK_STREAM | PACK_TRANSPOSE);
+
+	return 0;
+}
+mat4_t random_mat4(void){
+	mat4_t m;
+	for (int i = 0; i < 16; ++i){
+		m.col[i / 4].f[i % 4] = rand() % 1000 / 10.f - 50;
+	}
+	return m;
+}
+int untouched(const unsigned char *buf, size_t lo, size_t hi){
+	for (size_t i = lo; i < hi; ++i){
+		if (buf[i] != FILL){
+			return 0;
+		}
+	}
+	return 1;
+}
+void layout_test(void){
+	const size_t std140[] = { 16, 16, 16, 16, 48, 64 };
+	const size_t std430[] = { 4, 8, 16, 16, 48, 64 };
+	for (int t = PACK_FLOAT; t <= PACK_MAT4; ++t){
+		if (gl_pack_array_stride(PACK_STD140, t) != std140[t]){
+			printf("std140 array stride of type %d is wrong\n", t);
+		}
+		if (gl_pack_array_stride(PACK_STD430, t) != std430[t]){
+			printf("std430 array stride of type %d is wrong\n", t);
+		}
+	}
+	/*
+	 * struct {
+	 *     float a; vec3 b; float c; vec2 d; float e[3]; mat3 f; vec3 g; mat4 h[2]; float i;
+	 * };
+	 */
+	const enum pack_type types[] = { PACK_FLOAT, PACK_VEC3, PACK_FLOAT, PACK_VEC2, PACK_FLOAT,
+		PACK_MAT3, PACK_VEC3, PACK_MAT4, PACK_FLOAT };
+	const size_t counts[] = { 0, 0, 0, 0, 3, 0, 0, 2, 0 };
+	/* c packs into the end of b, then std140 pads the float array out to vec4s */
+	const size_t offsets140[] = { 0, 16, 28, 32, 48, 96, 144, 160, 288 };
+	const size_t offsets430[] = { 0, 16, 28, 32, 40, 64, 112, 128, 256 };
+	struct pack_block b140 = gl_pack_block_new(PACK_STD140);
+	struct pack_block b430 = gl_pack_block_new(PACK_STD430);
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i){
+		size_t o140 = gl_pack_block_add(&b140, types[i], counts[i]);
+		size_t o430 = gl_pack_block_add(&b430, types[i], counts[i]);
+		if (o140 != offsets140[i]){
+			printf("std140 offset of member %zu is wrong\n", i);
+		}
+		if (o430 != offsets430[i]){
+			printf("std430 offset of member %zu is wrong\n", i);
+		}
+	}
+	if (gl_pack_block_stride(&b140) != 304 || gl_pack_block_stride(&b430) != 272){
+		printf("Block strides are wrong\n");
+	}
+	/* std140 structs are always vec4 aligned, std430 ones only as much as their members need */
+	b140 = gl_pack_block_new(PACK_STD140);
+	b430 = gl_pack_block_new(PACK_STD430);
+	gl_pack_block_add(&b140, PACK_FLOAT, 0);
+	gl_pack_block_add(&b430, PACK_FLOAT, 0);
+	gl_pack_block_add(&b140, PACK_VEC2, 0);
+	gl_pack_block_add(&b430, PACK_VEC2, 0);
+	if (gl_pack_block_stride(&b140) != 16 || gl_pack_block_stride(&b430) != 16){
+		printf("Small block strides are wrong\n");
+	}
+	b430 = gl_pack_block_new(PACK_STD430);
+	gl_pack_block_add(&b430, PACK_FLOAT, 0);
+	gl_pack_block_add(&b430, PACK_FLOAT, 0);
+	gl_pack_block_add(&b430, PACK_FLOAT, 0);
+	if (gl_pack_block_stride(&b430) != 12){
+		printf("std430 float block stride is wrong\n");
+	}
+}
+void pack_test(int flags){
+	/* Per instance struct { mat4 model; mat4 mvp; mat3 normal; vec4 color; vec3 pos; float scale; } */
+	struct pack_block block = gl_pack_block_new(PACK_STD430);
+	size_t model_at = gl_pack_block_add(&block, PACK_MAT4, 0);
+	size_t mvp_at = gl_pack_block_add(&block, PACK_MAT4, 0);
+	size_t normal_at = gl_pack_block_add(&block, PACK_MAT3, 0);
+	size_t color_at = gl_pack_block_add(&block, PACK_VEC4, 0);
+	size_t pos_at = gl_pack_block_add(&block, PACK_VEC3, 0);
+	size_t scale_at = gl_pack_block_add(&block, PACK_FLOAT, 0);
+	size_t stride = gl_pack_block_stride(&block);
+	if (model_at != 0 || mvp_at != 64 || normal_at != 128 || color_at != 176 || pos_at != 192
+		|| scale_at != 204 || stride != 208)
+	{
+		printf("Instance block layout is wrong\n");
+		return;
+	}
+
+	static mat4_t model[N], normal[N];
+	static vec4_t color[N], pos[N];
+	static float scale[N];
+	mat4_t vp = random_mat4();
+	for (int i = 0; i < N; ++i){
+		model[i] = random_mat4();
+		normal[i] = random_mat4();
+		color[i] = vec4_new(i, i + 0.25f, i + 0.5f, 1);
+		pos[i] = vec4_new(-i, 2 * i, 3 * i, 99);
+		scale[i] = i * 0.5f;
+	}
+	static unsigned char buf[N * 208 + 64] ALIGN_64;
+	memset(buf, FILL, N * stride + 64);
+	gl_pack_mat4(buf + model_at, stride, model, N, flags);
+	gl_pack_premult_mat4(buf + mvp_at, stride, &vp, model, N, flags);
+	gl_pack_mat3(buf + normal_at, stride, normal, N, flags);
+	gl_pack_vec4(buf + color_at, stride, color, N, flags);
+	gl_pack_vec3(buf + pos_at, stride, pos, N);
+	gl_pack_float(buf + scale_at, stride, scale, N);
+
+	for (int i = 0; i < N; ++i){
+		const unsigned char *inst = buf + i * stride;
+		mat4_t m = model[i], mvp = mat4_mult(vp, model[i]), nm = normal[i];
+		if (flags & PACK_TRANSPOSE){
+			m = mat4_transpose(m);
+			mvp = mat4_transpose(mvp);
+			nm = mat4_transpose(nm);
+		}
+		/* mat3 padding is always 0 */
+		for (int j = 0; j < 3; ++j){
+			nm.col[j].f[3] = 0;
+		}
+		if (memcmp(inst + model_at, &m, 64) || memcmp(inst + mvp_at, &mvp, 64)
+			|| memcmp(inst + normal_at, &nm, 48) || memcmp(inst + color_at, &color[i], 16)
+			|| memcmp(inst + pos_at, &pos[i], 12) || memcmp(inst + scale_at, &scale[i], 4))
+		{
+			printf("Instance %d packed with flags %d is wrong\n", i, flags);
+			break;
+		}
+	}
+	if (!untouched(buf, N * stride, N * stride + 64)){
+		printf("Packing with flags %d writing past the end is wrong\n", flags);
+	}
+
+	/* Tightly packed arrays, and an unaligned one that can't be streamed */
+	memset(buf, FILL, N * stride + 64);
+	gl_pack_mat4(buf, gl_pack_array_stride(PACK_STD140, PACK_MAT4), model, N, flags);
+	for (int i = 0; i < N; ++i){
+		mat4_t m = flags & PACK_TRANSPOSE ? mat4_transpose(model[i]) : model[i];
+		if (memcmp(buf + 64 * i, &m, 64)){
+			printf("Tight mat4 array packed with flags %d is wrong\n", flags);
+			break;
+		}
+	}
+	memset(buf, FILL, N * stride + 64);
+	gl_pack_vec4(buf + 4, 20, color, N, flags);
+	for (int i = 0; i < N; ++i){
+		if (memcmp(buf + 4 + 20 * i, &color[i], 16) || !untouched(buf, 20 * i, 20 * i + 4)){
+			printf("Unaligned vec4 array packed with flags %d is wrong\n", flags);
+			break;
+		}
+	}
+	/* std140 vec2 arrays only use the first 8 bytes of each vec4 */
+	memset(buf, FILL, N * stride + 64);
+	gl_pack_vec2(buf, gl_pack_array_stride(PACK_STD140, PACK_VEC2), pos, N);
+	for (int i = 0; i < N; ++i){
+		if (memcmp(buf + 16 * i, &pos[i], 8) || !untouched(buf, 16 * i + 8, 16 * i + 16)){
+			printf("std140 vec2 array is wrong\n");
+			break;
+		}
+	}
+	/* std140 float arrays only use the first 4 bytes of each vec4 */
+	memset(buf, FILL, N * stride + 64);
+	gl_pack_float(buf, gl_pack_array_stride(PACK_STD140, PACK_FLOAT), scale, N);
+	for (int i = 0; i < N; ++i){
+		if (memcmp(buf + 16 * i, &scale[i], 4) || !untouched(buf, 16 * i + 4, 16 * i + 16)){
+			printf("std140 float array is wrong\n");
+			break;
+		}
+	}
+}
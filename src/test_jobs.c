@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "dispatch.h"
+#include "jobs.h"
+
+/*
+ * Check parallel_for covers each index once in properly sized chunks, that
+ * nested fork/join works, and that the parallel kernels give exactly the same
+ * results as calling the kernel on the whole array
+ */
+#define N 50001
+
+void for_test(struct jobs *j, const char *what);
+void fork_test(struct jobs *j, const char *what);
+void kernel_test(struct jobs *j, const char *what);
+float randf(float lo, float hi);
+
+int main(void){
+	const struct { int threads, flags; } pools[] = { { 1, 0 }, { 4, 0 }, { 3, JOBS_PIN }, { 0, 0 } };
+	char what[64];
+	srand(5);
+	for_test(NULL, "No pool");
+	fork_test(NULL, "No pool");
+	kernel_test(NULL, "No pool");
+	for (size_t i = 0; i < sizeof(pools) / sizeof(pools[0]); ++i){
+		struct jobs *j = jobs_create(pools[i].threads, pools[i].flags);
+		if (!j){
+			printf("Creating a pool with %d threads is wrong\n", pools[i].threads);
+			continue;
+		}
+		if (pools[i].threads > 0 && jobs_thread_count(j) != pools[i].threads){
+			printf("Thread count of %d thread pool is wrong\n", pools[i].threads);
+		}
+		snprintf(what, sizeof(what), "%d thread pool%s", jobs_thread_count(j),
+			pools[i].flags & JOBS_PIN ? " pinned" : "");
+		for_test(j, what);
+		fork_test(j, what);
+		kernel_test(j, what);
+		jobs_destroy(j);
+	}
+	return 0;
+}
+float randf(float lo, float hi){
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+/* With one thread the whole range is one chunk, so the sizes are only checked with more */
+struct for_args {
+	int *visits;
+	size_t grain;
+	int bad_chunk;
+};
+static void count_visits(void *arg, size_t lo, size_t hi){
+	struct for_args *a = arg;
+	if (hi <= lo || (a->grain && (hi - lo > a->grain || (a->grain >= 32 && lo % 16)))){
+		a->bad_chunk = 1;
+	}
+	for (size_t i = lo; i < hi; ++i){
+		__sync_fetch_and_add(&a->visits[i], 1);
+	}
+}
+void for_test(struct jobs *j, const char *what){
+	static int visits[N];
+	const size_t sizes[] = { 0, 1, 31, 1000, N };
+	const size_t grains[] = { 1, 7, 64, 1000, 0 };
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s){
+		for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); ++g){
+			struct for_args a = { visits, grains[g] ? grains[g] : JOBS_GRAIN(vec4_t), 0 };
+			if (jobs_thread_count(j) == 1){
+				a.grain = 0;
+			}
+			memset(visits, 0, sizeof(visits));
+			jobs_parallel_for(j, sizes[s], grains[g], count_visits, &a);
+			if (a.bad_chunk){
+				printf("%s: parallel_for chunks over %zu with grain %zu are wrong\n", what, sizes[s], grains[g]);
+			}
+			for (size_t i = 0; i < N; ++i){
+				if (visits[i] != (i < sizes[s])){
+					printf("%s: parallel_for over %zu with grain %zu visiting %zu is wrong\n",
+						what, sizes[s], grains[g], i);
+					break;
+				}
+			}
+		}
+	}
+}
+
+/* Sum a range by forking the top half and joining, down to single elements */
+struct sum_job {
+	struct job job;
+	struct jobs *pool;
+	const uint32_t *vals;
+	size_t n;
+	uint64_t sum;
+};
+static void sum_range(struct job *job){
+	struct sum_job *s = (struct sum_job*)job;
+	if (s->n == 1){
+		s->sum = s->vals[0];
+		return;
+	}
+	struct job_group g = { 0 };
+	struct sum_job lo = { { sum_range, NULL }, s->pool, s->vals, s->n / 2, 0 };
+	struct sum_job hi = { { sum_range, NULL }, s->pool, s->vals + s->n / 2, s->n - s->n / 2, 0 };
+	jobs_fork(s->pool, &g, &hi.job);
+	sum_range(&lo.job);
+	jobs_join(s->pool, &g);
+	s->sum = lo.sum + hi.sum;
+}
+void fork_test(struct jobs *j, const char *what){
+	static uint32_t vals[N];
+	uint64_t expect = 0;
+	for (size_t i = 0; i < N; ++i){
+		vals[i] = rand();
+		expect += vals[i];
+	}
+	struct sum_job s = { { sum_range, NULL }, j, vals, N, 0 };
+	sum_range(&s.job);
+	if (s.sum != expect){
+		printf("%s: fork/join sum is wrong\n", what);
+	}
+}
+
+int mat4_equal_n(const mat4_t *a, const mat4_t *b, size_t n){
+	return memcmp(a, b, n * sizeof(mat4_t)) == 0;
+}
+void kernel_test(struct jobs *j, const char *what){
+	enum { M = 10001, TRIS = 40, RAYS = 1003 };
+	static vec4_t vin[N], vout[N], vref[N];
+	static mat4_t a[M], b[M], out[M], ref[M];
+	static float det[M], det_ref[M], f[4][M];
+	static uint32_t vis[N], vis_ref[N];
+	static aabb_t boxes[N];
+	static tri_t tris[TRIS];
+	static ray_t rays[RAYS];
+	static hit_t hits[RAYS], hits_ref[RAYS];
+	mat4_t m = mat4_mult(mat4_perspective(70, 1.3f, 0.1f, 50),
+		mat4_look_at(vec4_new(1, 2, 3, 1), vec4_new(0, 0, 0, 1), vec4_new(0, 1, 0, 0)));
+	for (size_t i = 0; i < N; ++i){
+		vin[i] = vec4_new(randf(-20, 20), randf(-20, 20), randf(-20, 20), randf(0.1f, 2));
+		boxes[i].min = vec4_sub(vin[i], vec4_new(0.5f, 0.5f, 0.5f, 0));
+		boxes[i].max = vec4_add(vin[i], vec4_new(0.5f, 0.5f, 0.5f, 0));
+	}
+	for (size_t i = 0; i < M; ++i){
+		a[i] = mat4_mult(mat4_translate(vec4_new(randf(-5, 5), randf(-5, 5), randf(-5, 5), 1)),
+			mat4_rotate(randf(0, 360), vec4_new(randf(-1, 1), 1, randf(-1, 1), 0)));
+		b[i] = mat4_mult(a[i], mat4_scale(randf(0.5f, 2), randf(0.5f, 2), randf(0.5f, 2)));
+		f[0][i] = randf(30, 120);
+		f[1][i] = randf(0.5f, 2);
+		f[2][i] = randf(0.01f, 1);
+		f[3][i] = randf(10, 1000);
+	}
+
+	/* The vector kernels, each against the kernel run over the whole array */
+	const struct {
+		const char *name;
+		void (*par)(struct jobs*, const mat4_t*, const vec4_t*, vec4_t*, size_t);
+		void (*ser)(const mat4_t*, const vec4_t*, vec4_t*, size_t);
+	} vec_kernels[] = {
+		{ "vec_mult_n", jobs_vec_mult_n, sse_kernels->vec_mult_n },
+		{ "transform_points", jobs_transform_points, sse_kernels->transform_points },
+		{ "transform_vectors", jobs_transform_vectors, sse_kernels->transform_vectors },
+		{ "project_points", jobs_project_points, sse_kernels->project_points },
+	};
+	for (size_t k = 0; k < sizeof(vec_kernels) / sizeof(vec_kernels[0]); ++k){
+		vec_kernels[k].ser(&m, vin, vref, N);
+		vec_kernels[k].par(j, &m, vin, vout, N);
+		if (memcmp(vout, vref, sizeof(vref))){
+			printf("%s: jobs_%s is wrong\n", what, vec_kernels[k].name);
+		}
+	}
+
+	sse_kernels->mult_n(a, b, ref, M);
+	jobs_mult_n(j, a, b, out, M);
+	if (!mat4_equal_n(out, ref, M)){
+		printf("%s: jobs_mult_n is wrong\n", what);
+	}
+	sse_kernels->premult_n(&m, b, ref, M);
+	jobs_premult_n(j, &m, b, out, M);
+	if (!mat4_equal_n(out, ref, M)){
+		printf("%s: jobs_premult_n is wrong\n", what);
+	}
+	sse_kernels->transpose_n(b, ref, M);
+	jobs_transpose_n(j, b, out, M);
+	if (!mat4_equal_n(out, ref, M)){
+		printf("%s: jobs_transpose_n is wrong\n", what);
+	}
+	sse_kernels->inverse_n(b, ref, det_ref, M);
+	jobs_inverse_n(j, b, out, det, M);
+	if (!mat4_equal_n(out, ref, M) || memcmp(det, det_ref, sizeof(det))){
+		printf("%s: jobs_inverse_n is wrong\n", what);
+	}
+	jobs_inverse_n(j, b, out, NULL, M);
+	if (!mat4_equal_n(out, ref, M)){
+		printf("%s: jobs_inverse_n without determinants is wrong\n", what);
+	}
+	sse_kernels->inverse_affine_n(b, ref, M);
+	jobs_inverse_affine_n(j, b, out, M);
+	if (!mat4_equal_n(out, ref, M)){
+		printf("%s: jobs_inverse_affine_n is wrong\n", what);
+	}
+	sse_kernels->inverse_rigid_n(a, ref, M);
+	jobs_inverse_rigid_n(j, a, out, M);
+	if (!mat4_equal_n(out, ref, M)){
+		printf("%s: jobs_inverse_rigid_n is wrong\n", what);
+	}
+	sse_kernels->normal_matrix_n(b, ref, M);
+	jobs_normal_matrix_n(j, b, out, M);
+	if (!mat4_equal_n(out, ref, M)){
+		printf("%s: jobs_normal_matrix_n is wrong\n", what);
+	}
+	sse_kernels->rotate_n(f[0], vin, ref, M);
+	jobs_rotate_n(j, f[0], vin, out, M);
+	if (!mat4_equal_n(out, ref, M)){
+		printf("%s: jobs_rotate_n is wrong\n", what);
+	}
+	sse_kernels->perspective_n(f[0], f[1], f[2], f[3], ref, M);
+	jobs_perspective_n(j, f[0], f[1], f[2], f[3], out, M);
+	if (!mat4_equal_n(out, ref, M)){
+		printf("%s: jobs_perspective_n is wrong\n", what);
+	}
+
+	/* Culling has to give the same visible indices in the same order, for a few sizes */
+	frustum_t fr = frustum_from_mat4(m);
+	const size_t counts[] = { 0, 5, 1000, N };
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c){
+		size_t n = counts[c];
+		size_t expect = sse_kernels->cull_spheres(&fr, vin, n, vis_ref);
+		size_t got = jobs_cull_spheres(j, &fr, vin, n, vis);
+		if (got != expect || memcmp(vis, vis_ref, got * sizeof(uint32_t))){
+			printf("%s: jobs_cull_spheres of %zu is wrong\n", what, n);
+		}
+		expect = sse_kernels->cull_aabbs(&fr, boxes, n, vis_ref);
+		got = jobs_cull_aabbs(j, &fr, boxes, n, vis);
+		if (got != expect || memcmp(vis, vis_ref, got * sizeof(uint32_t))){
+			printf("%s: jobs_cull_aabbs of %zu is wrong\n", what, n);
+		}
+	}
+
+	for (int i = 0; i < TRIS; ++i){
+		vec4_t c = vec4_new(randf(-3, 3), randf(-3, 3), randf(-3, 3), 1);
+		tris[i].v0 = c;
+		tris[i].v1 = vec4_add(c, vec4_new(randf(-1, 1), randf(-1, 1), randf(-1, 1), 0));
+		tris[i].v2 = vec4_add(c, vec4_new(randf(-1, 1), randf(-1, 1), randf(-1, 1), 0));
+	}
+	for (int i = 0; i < RAYS; ++i){
+		rays[i] = ray_new(vec4_new(randf(-1, 1), randf(-1, 1), 8, 1),
+			vec4_normalize(vec4_new(randf(-0.4f, 0.4f), randf(-0.4f, 0.4f), -1, 0)));
+		hits[i] = hit_new(INFINITY);
+		hits_ref[i] = hit_new(INFINITY);
+	}
+	sse_kernels->intersect_tris(tris, TRIS, rays, hits_ref, RAYS);
+	jobs_intersect_tris(j, tris, TRIS, rays, hits, RAYS);
+	if (memcmp(hits, hits_ref, sizeof(hits))){
+		printf("%s: jobs_intersect_tris is wrong\n", what);
+	}
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <math.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "quat.h"
+#include "mat3x4.h"
+
+/* Check the affine transforms against doing the same with full mat4s */
+void basic_test(void);
+void inverse_test(void);
+void batch_test(void);
+int mat4_near(mat4_t a, mat4_t b, float eps);
+int vec4_near(vec4_t a, vec4_t b, float eps);
+
+int main(void){
+	basic_test();
+	inverse_test();
+	batch_test();
+
+	return 0;
+}
+int mat4_near(mat4_t a, mat4_t b, float eps){
+	for (int i = 0; i < 4; ++i){
+		if (!vec4_near(a.col[i], b.col[i], eps)){
+			return 0;
+		}
+	}
+	return 1;
+}
+int vec4_near(vec4_t a, vec4_t b, float eps){
+	for (int i = 0; i < 4; ++i){
+		if (fabsf(a.f[i] - b.f[i]) > eps){
+			return 0;
+		}
+	}
+	return 1;
+}
+void basic_test(void){
+	if (sizeof(mat3x4_t) != 48){
+		printf("mat3x4_t size is wrong\n");
+	}
+	if (!mat4_eq(mat3x4_to_mat4(mat3x4_new()), mat4_new())){
+		printf("Identity is wrong\n");
+	}
+	mat4_t t = mat4_translate(vec4_new(1, 2, 3, 1));
+	mat4_t r = mat4_rotate(30, vec4_new(1, 1, 0, 0));
+	mat4_t s = mat4_scale(2, 3, 0.5f);
+	if (!mat4_eq(mat3x4_to_mat4(mat3x4_translate(vec4_new(1, 2, 3, 1))), t)
+		|| !mat4_eq(mat3x4_to_mat4(mat3x4_rotate(30, vec4_new(1, 1, 0, 0))), r)
+		|| !mat4_eq(mat3x4_to_mat4(mat3x4_scale(2, 3, 0.5f)), s))
+	{
+		printf("Building transforms is wrong\n");
+	}
+	mat3x4_t a = mat3x4_from_mat4(t);
+	if (a.row[0].f[3] != 1 || a.row[1].f[3] != 2 || a.row[2].f[3] != 3 || a.row[0].f[0] != 1){
+		printf("From mat4 is wrong\n");
+		mat3x4_print(a);
+	}
+	mat4_t trs = mat4_mult(t, mat4_mult(r, s));
+	mat3x4_t m = mat3x4_mult(mat3x4_from_mat4(t), mat3x4_mult(mat3x4_from_mat4(r), mat3x4_from_mat4(s)));
+	/* Same operations in the same order so it should match exactly */
+	if (!mat4_eq(mat3x4_to_mat4(m), trs)){
+		printf("Multiplication is wrong\n");
+		mat3x4_print(m);
+	}
+	mat3x4_t n = mat3x4_from_mat4(r);
+	mat3x4_mult_to(&n, &m, &n);
+	if (!mat4_eq(mat3x4_to_mat4(n), mat4_mult(trs, r))){
+		printf("In place multiplication is wrong\n");
+	}
+	quat_t q = quat_from_axis_angle(vec4_new(0, 1, 1, 0), 70);
+	if (!mat4_eq(mat3x4_to_mat4(mat3x4_compose(vec4_new(4, 5, 6, 0), q, vec4_new(1, 2, 3, 0))),
+		mat4_compose(vec4_new(4, 5, 6, 0), q, vec4_new(1, 2, 3, 0))))
+	{
+		printf("Compose is wrong\n");
+	}
+	vec4_t v = vec4_new(1, -2, 5, 7);
+	vec4_t p = mat3x4_transform_point(m, v);
+	vec4_t p_ref = mat4_vec_mult(trs, vec4_new(1, -2, 5, 1));
+	if (!vec4_near(p, p_ref, 1e-5f) || p.c.w != 1){
+		printf("Point transform is wrong\n");
+		vec4_print(p);
+	}
+	vec4_t d = mat3x4_transform_vector(m, v);
+	if (!vec4_near(d, mat4_vec_mult(trs, vec4_new(1, -2, 5, 0)), 1e-5f) || d.c.w != 0){
+		printf("Vector transform is wrong\n");
+	}
+	mat4_t proj = mat4_perspective(60, 1.5f, 0.1f, 100);
+	mat4_t view = mat4_look_at(vec4_new(1, 2, 5, 0), vec4_new(0, 0, 0, 0), vec4_new(0, 1, 0, 0));
+	if (!mat4_eq(mat3x4_to_mat4(mat3x4_look_at(vec4_new(1, 2, 5, 0), vec4_new(0, 0, 0, 0),
+		vec4_new(0, 1, 0, 0))), view))
+	{
+		printf("Look at is wrong\n");
+	}
+	if (!mat4_near(mat4_mult_mat3x4(proj, m), mat4_mult(proj, trs), 1e-5f)){
+		printf("Projection times affine is wrong\n");
+	}
+}
+void inverse_test(void){
+	mat4_t t = mat4_translate(vec4_new(-4, 2, 9, 1));
+	mat4_t r = mat4_rotate(-75, vec4_new(1, 2, 3, 0));
+	mat4_t trs = mat4_mult(t, mat4_mult(r, mat4_scale(2, 3, 0.5f)));
+	mat3x4_t m = mat3x4_from_mat4(trs);
+	float det;
+	mat3x4_t inv = m;
+	det = mat3x4_inverse_to(&inv, &inv);
+	if (fabsf(det - 3) > 1e-5f){
+		printf("Determinant is wrong: %f\n", det);
+	}
+	if (!mat4_near(mat3x4_to_mat4(inv), mat4_inverse_affine(trs), 1e-5f)){
+		printf("Inverse is wrong\n");
+		mat3x4_print(inv);
+	}
+	if (!mat4_near(mat3x4_to_mat4(mat3x4_mult(inv, m)), mat4_new(), 1e-5f)){
+		printf("Inverse times m is wrong\n");
+	}
+	mat3x4_t rigid = mat3x4_from_mat4(mat4_mult(t, r));
+	if (!mat4_near(mat3x4_to_mat4(mat3x4_inverse_rigid(rigid)), mat4_inverse_rigid(mat4_mult(t, r)), 1e-5f)){
+		printf("Rigid inverse is wrong\n");
+	}
+}
+void batch_test(void){
+	enum { N = 13 };
+	mat3x4_t a[N], b[N], out[N];
+	mat4_t out4[N];
+	vec4_t v[N], vout[N];
+	mat4_t proj = mat4_perspective(75, 1, 1, 50);
+	for (int i = 0; i < N; ++i){
+		a[i] = mat3x4_compose(vec4_new(i, -i, 2 * i, 0), quat_from_axis_angle(vec4_new(1, i, 2, 0), 10 * i),
+			vec4_new(1 + i, 1, 2, 0));
+		b[i] = mat3x4_mult(mat3x4_translate(vec4_new(0, 1, i, 0)), mat3x4_rotate(5 * i, vec4_new(0, 0, 1, 0)));
+		v[i] = vec4_new(i, 1 - i, 0.5f * i, 1);
+	}
+	mat3x4_mult_n(a, b, out, N);
+	for (int i = 0; i < N; ++i){
+		if (!mat3x4_eq(out[i], mat3x4_mult(a[i], b[i]))){
+			printf("Batch multiplication is wrong\n");
+			break;
+		}
+	}
+	mat3x4_premult_n(&a[3], b, out, N);
+	for (int i = 0; i < N; ++i){
+		if (!mat3x4_eq(out[i], mat3x4_mult(a[3], b[i]))){
+			printf("Batch premultiplication is wrong\n");
+			break;
+		}
+	}
+	mat4_mult_mat3x4_n(&proj, a, out4, N);
+	for (int i = 0; i < N; ++i){
+		if (!mat4_eq(out4[i], mat4_mult_mat3x4(proj, a[i]))){
+			printf("Batch projection times affine is wrong\n");
+			break;
+		}
+	}
+	mat3x4_inverse_n(a, out, N);
+	for (int i = 0; i < N; ++i){
+		if (!mat3x4_eq(out[i], mat3x4_inverse(a[i]))){
+			printf("Batch inverse is wrong\n");
+			break;
+		}
+	}
+	mat3x4_inverse_rigid_n(b, out, N);
+	for (int i = 0; i < N; ++i){
+		if (!mat3x4_eq(out[i], mat3x4_inverse_rigid(b[i]))){
+			printf("Batch rigid inverse is wrong\n");
+			break;
+		}
+	}
+	mat3x4_transform_points(&a[5], v, vout, N);
+	for (int i = 0; i < N; ++i){
+		if (!vec4_near(vout[i], mat3x4_transform_point(a[5], v[i]), 1e-4f)){
+			printf("Batch point transform is wrong\n");
+			break;
+		}
+	}
+	mat3x4_transform_vectors(&a[5], v, vout, N);
+	for (int i = 0; i < N; ++i){
+		if (!vec4_near(vout[i], mat3x4_transform_vector(a[5], v[i]), 1e-4f)){
+			printf("Batch vector transform is wrong\n");
+			break;
+		}
+	}
+}
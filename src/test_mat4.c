@@ -4,10 +4,18 @@
 
 void basic_test(void);
 void proj_tests(void);
+void batch_tests(void);
+void inverse_tests(void);
+void batch_build_tests(void);
+/* Check if the matrices are equal within some epsilon */
+int mat4_near(mat4_t a, mat4_t b, float eps);
 
 int main(void){
 	basic_test();
 	proj_tests();
+	batch_tests();
+	inverse_tests();
+	batch_build_tests();
 
 	return 0;
 }
@@ -32,8 +40,28 @@ void basic_test(void){
 	mat4_print(b);
 
 	printf("Multiplication result:\n");
+	float ALIGN_16 c_rows[16] = {
+		9, 10, 37, 5,
+		14, 12, 17, 6,
+		35, 22, 75, 11,
+		32, 24, 47, 12
+	};
+	mat4_t c = mat4_from_rows(c_rows);
+	mat4_t d;
+	mat4_mult_to(&d, &a, &b);
 	a = mat4_mult(a, b);
+	if (!mat4_eq(a, c) || !mat4_eq(d, c)){
+		printf("Multiplication is wrong\n");
+	}
 	mat4_print(a);
+	/* In place should work when dst aliases either side */
+	a = mat4_from_rows(a_rows);
+	mat4_mult_to(&a, &a, &b);
+	d = mat4_from_rows(a_rows);
+	mat4_mult_to(&b, &d, &b);
+	if (!mat4_eq(a, c) || !mat4_eq(b, c)){
+		printf("In place multiplication is wrong\n");
+	}
 
 	vec4_t v = vec4_new(1, 2, 3, 1);
 	a = mat4_translate(v);
@@ -64,4 +92,191 @@ void proj_tests(void){
 	printf("perspective:\n");
 	mat4_print(m);
 }
+void batch_tests(void){
+	mat4_t m = mat4_mult(mat4_translate(vec4_new(1, 2, 3, 1)),
+		mat4_rotate(30, vec4_new(0, 1, 1, 0)));
+	mat4_t p = mat4_mult(mat4_perspective(60, 1, 1, 100), m);
+	/* Offset by a float to check unaligned input and output, 7 to hit the tail loop */
+	float ALIGN_16 in_f[4 * 7 + 1], out_f[4 * 7 + 1];
+	vec4_t *in = (vec4_t*)(in_f + 1);
+	vec4_t *out = (vec4_t*)(out_f + 1);
+	for (int i = 0; i < 7; ++i){
+		for (int j = 0; j < 4; ++j){
+			in_f[1 + 4 * i + j] = i + j * 0.5f - 1;
+		}
+	}
+
+	mat4_vec_mult_n(&m, in, out, 7);
+	for (int i = 0; i < 7; ++i){
+		vec4_t v = vec4_new(in_f[1 + 4 * i], in_f[2 + 4 * i], in_f[3 + 4 * i], in_f[4 + 4 * i]);
+		vec4_t e = mat4_vec_mult(m, v);
+		if (!vec4_eq(e, vec4_new(out_f[1 + 4 * i], out_f[2 + 4 * i], out_f[3 + 4 * i], out_f[4 + 4 * i]))){
+			printf("Batched vec mult is wrong\n");
+		}
+	}
+	mat4_transform_points(&m, in, out, 7);
+	for (int i = 0; i < 7; ++i){
+		vec4_t v = vec4_new(in_f[1 + 4 * i], in_f[2 + 4 * i], in_f[3 + 4 * i], 1);
+		vec4_t e = mat4_vec_mult(m, v);
+		if (!vec4_eq(e, vec4_new(out_f[1 + 4 * i], out_f[2 + 4 * i], out_f[3 + 4 * i], out_f[4 + 4 * i]))){
+			printf("Batched point transform is wrong\n");
+		}
+	}
+	mat4_transform_vectors(&m, in, out, 7);
+	for (int i = 0; i < 7; ++i){
+		vec4_t v = vec4_new(in_f[1 + 4 * i], in_f[2 + 4 * i], in_f[3 + 4 * i], 0);
+		vec4_t e = mat4_vec_mult(m, v);
+		if (!vec4_eq(e, vec4_new(out_f[1 + 4 * i], out_f[2 + 4 * i], out_f[3 + 4 * i], out_f[4 + 4 * i]))){
+			printf("Batched vector transform is wrong\n");
+		}
+	}
+	mat4_project_points(&p, in, out, 7);
+	for (int i = 0; i < 7; ++i){
+		vec4_t v = vec4_new(in_f[1 + 4 * i], in_f[2 + 4 * i], in_f[3 + 4 * i], 1);
+		vec4_t e = mat4_vec_mult(p, v);
+		e = vec4_scale(e, 1.f / e.f[3]);
+		vec4_t r = vec4_new(out_f[1 + 4 * i], out_f[2 + 4 * i], out_f[3 + 4 * i], out_f[4 + 4 * i]);
+		if (vec4_len(vec4_sub(e, r)) > 1e-5f){
+			printf("Batched projection is wrong\n");
+		}
+	}
+	printf("Projected points:\n");
+	for (int i = 0; i < 7; ++i){
+		vec4_print(vec4_new(out_f[1 + 4 * i], out_f[2 + 4 * i], out_f[3 + 4 * i], out_f[4 + 4 * i]));
+	}
+
+	mat4_t ms[3] = { m, p, mat4_scale(1, 2, 3) };
+	mat4_t res[3];
+	mat4_premult_n(&p, ms, res, 3);
+	for (int i = 0; i < 3; ++i){
+		if (!mat4_eq(res[i], mat4_mult(p, ms[i]))){
+			printf("Batched pre-multiply is wrong\n");
+		}
+	}
+	mat4_mult_n(ms, ms, res, 3);
+	for (int i = 0; i < 3; ++i){
+		if (!mat4_eq(res[i], mat4_mult(ms[i], ms[i]))){
+			printf("Batched multiply is wrong\n");
+		}
+	}
+
+	/* Big enough to take the streaming store path */
+	size_t n = MAT4_STREAM_BYTES / sizeof(vec4_t) + 3;
+	vec4_t *big_in = _mm_malloc(n * sizeof(vec4_t), 16);
+	vec4_t *big_out = _mm_malloc(n * sizeof(vec4_t), 16);
+	for (size_t i = 0; i < n; ++i){
+		big_in[i] = vec4_new(i % 17, i % 5, i % 3, 1);
+	}
+	mat4_transform_points(&m, big_in, big_out, n);
+	for (size_t i = 0; i < n; ++i){
+		if (!vec4_eq(big_out[i], mat4_vec_mult(m, big_in[i]))){
+			printf("Streaming point transform is wrong\n");
+			break;
+		}
+	}
+	_mm_free(big_in);
+	_mm_free(big_out);
+}
+int mat4_near(mat4_t a, mat4_t b, float eps){
+	for (int i = 0; i < 4; ++i){
+		for (int j = 0; j < 4; ++j){
+			if (fabsf(a.col[i].f[j] - b.col[i].f[j]) > eps){
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+void inverse_tests(void){
+	float ALIGN_16 a_rows[16] = {
+		1, 5, 0, 0,
+		2, 1, 3, 5,
+		6, 9, 0, 2,
+		5, 3, 8, 9
+	};
+	mat4_t a = mat4_from_rows(a_rows);
+	float det;
+	mat4_t inv = mat4_inverse(a, &det);
+	printf("Inverse, det = %.2f:\n", det);
+	mat4_print(inv);
+	if (fabsf(det + 261.f) > 1e-3f){
+		printf("Determinant is wrong\n");
+	}
+	if (!mat4_near(mat4_mult(a, inv), mat4_new(), 1e-5f)
+		|| !mat4_near(mat4_mult(inv, a), mat4_new(), 1e-5f))
+	{
+		printf("Inverse is wrong\n");
+	}
+
+	mat4_t view = mat4_look_at(vec4_new(1, 3, 5, 0), vec4_new(0, 0, 0, 0), vec4_new(0, 1, 0, 0));
+	mat4_t model = mat4_mult(mat4_translate(vec4_new(4, -2, 1, 1)),
+		mat4_mult(mat4_rotate(70, vec4_new(1, 2, 3, 0)), mat4_scale(2, 0.5, 3)));
+	mat4_t mats[3] = { view, model, mat4_rotate(-20, vec4_new(0, 0, 1, 0)) };
+	mat4_t invs[3];
+	float dets[3];
+	mat4_inverse_n(mats, invs, dets, 3);
+	for (int i = 0; i < 3; ++i){
+		if (!mat4_near(mat4_mult(mats[i], invs[i]), mat4_new(), 1e-5f)){
+			printf("Batched inverse is wrong\n");
+		}
+	}
+	if (fabsf(dets[1] - 3.f) > 1e-4f){
+		printf("Batched determinant is wrong\n");
+	}
+	mat4_inverse_affine_n(mats, invs, 3);
+	for (int i = 0; i < 3; ++i){
+		if (!mat4_near(mat4_mult(mats[i], invs[i]), mat4_new(), 1e-5f)){
+			printf("Affine inverse is wrong\n");
+		}
+	}
+	/* The look at and rotation matrices are rigid, the model matrix is scaled */
+	mat4_inverse_rigid_n(mats, invs, 3);
+	if (!mat4_near(mat4_mult(mats[0], invs[0]), mat4_new(), 1e-5f)
+		|| !mat4_near(mat4_mult(mats[2], invs[2]), mat4_new(), 1e-5f))
+	{
+		printf("Rigid inverse is wrong\n");
+	}
+
+	mat4_normal_matrix_n(mats, invs, 3);
+	mat4_t expect = mat4_transpose(mat4_inverse(model, NULL));
+	expect.col[3] = vec4_new(0, 0, 0, 1);
+	expect.col[0].f[3] = expect.col[1].f[3] = expect.col[2].f[3] = 0;
+	if (!mat4_near(invs[1], expect, 1e-5f)){
+		printf("Normal matrix is wrong\n");
+	}
+}
+void batch_build_tests(void){
+	enum { N = 11 };
+	float deg[N], fov[N], aspect[N], near[N], far[N];
+	vec4_t axis[N];
+	mat4_t res[N];
+	for (int i = 0; i < N; ++i){
+		deg[i] = i * 33.f - 100.f;
+		axis[i] = vec4_new(i % 3, 1, i % 5 - 2, 0);
+		fov[i] = 30.f + i * 10.f;
+		aspect[i] = 1.f + i * 0.25f;
+		near[i] = 0.1f * (i + 1);
+		far[i] = 100.f + i;
+	}
+	mat4_rotate_n(deg, axis, res, N);
+	for (int i = 0; i < N; ++i){
+		if (!mat4_near(res[i], mat4_rotate(deg[i], axis[i]), 1e-6f)){
+			printf("Batched rotate is wrong\n");
+		}
+		/* Should still be a rotation */
+		if (!mat4_near(mat4_mult(res[i], mat4_transpose(res[i])), mat4_new(), 1e-6f)){
+			printf("Batched rotate isn't orthonormal\n");
+		}
+	}
+	mat4_perspective_n(fov, aspect, near, far, res, N);
+	for (int i = 0; i < N; ++i){
+		if (!mat4_near(res[i], mat4_perspective(fov[i], aspect[i], near[i], far[i]), 1e-5f)){
+			printf("Batched perspective is wrong\n");
+		}
+	}
+	mat4_t p = mat4_perspective(90, 1, 1, 100);
+	if (fabsf(p.col[0].f[0] - 1.f) > 1e-6f || fabsf(p.col[1].f[1] - 1.f) > 1e-6f){
+		printf("Perspective is wrong\n");
+	}
+}
 
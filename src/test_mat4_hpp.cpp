@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <math.h>
+#include "mat4.hpp"
+
+/*
+ * Check the C++ mat4 against the C functions, and that matrix vector products
+ * in sums are fused into a single chain
+ */
+void basic_test();
+void xform_test();
+/* a * b + c like native_ops::fmadd does it */
+float madd(float a, float b, float c);
+/* Check if the matrices are equal within some epsilon */
+bool near(const sse::mat4 &a, const sse::mat4 &b, float eps);
+
+constexpr sse::mat4 ident = sse::mat4::identity();
+static_assert(ident(0, 0) == 1 && ident(3, 3) == 1 && ident(1, 2) == 0, "constexpr identity is wrong");
+static_assert(ident[1].y() == 1, "constexpr column is wrong");
+
+int main(){
+	basic_test();
+	xform_test();
+
+	return 0;
+}
+float madd(float a, float b, float c){
+#ifdef __FMA__
+	return fmaf(a, b, c);
+#else
+	return a * b + c;
+#endif
+}
+bool near(const sse::mat4 &a, const sse::mat4 &b, float eps){
+	for (int c = 0; c < 4; ++c){
+		for (int r = 0; r < 4; ++r){
+			if (fabsf(a(r, c) - b(r, c)) > eps){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+void basic_test(){
+	float ALIGN_16 rows[16] = {
+		1, 5, 0, 0,
+		2, 1, 3, 5,
+		6, 9, 0, 2,
+		5, 3, 8, 9
+	};
+	mat4_t ca = mat4_from_rows(rows);
+	mat4_t cb = mat4_rotate(30, vec4_new(1, 1, 0, 0));
+	sse::mat4 a = ca, b = cb;
+	if (a(0, 1) != 5 || a(3, 2) != 8 || a[2] != sse::vec4(0, 3, 0, 8)){
+		printf("Element access is wrong\n");
+	}
+	if (!mat4_eq(a, ca) || sse::mat4(mat4_new()) != ident){
+		printf("Converting to and from mat4_t is wrong\n");
+	}
+	if (a * b != sse::mat4(mat4_mult(ca, cb)) || b * a != sse::mat4(mat4_mult(cb, ca))){
+		printf("Matrix product is wrong\n");
+	}
+	sse::mat4 r = a;
+	r *= b;
+	if (r != a * b){
+		printf("Matrix *= is wrong\n");
+	}
+	if (a + b != sse::mat4(mat4_add(ca, cb)) || a - b != sse::mat4(mat4_sub(ca, cb))){
+		printf("Matrix addition is wrong\n");
+	}
+	if (sse::transpose(a) != sse::mat4(mat4_transpose(ca))){
+		printf("Transpose is wrong\n");
+	}
+	float det = 0, cdet = 0;
+	if (sse::inverse(a, &det) != sse::mat4(mat4_inverse(ca, &cdet)) || det != cdet
+		|| !near(sse::inverse(a) * a, ident, 1e-5f))
+	{
+		printf("Inverse is wrong\n");
+	}
+	sse::mat4 t = sse::mat4::translate(sse::vec4(1, 2, 3, 0)) * b;
+	if (sse::inverse_rigid(t) != sse::mat4(mat4_inverse_rigid(t))
+		|| !near(sse::inverse_affine(t), sse::inverse_rigid(t), 1e-6f)
+		|| sse::normal_matrix(t) != sse::mat4(mat4_normal_matrix(t)))
+	{
+		printf("Special inverses are wrong\n");
+	}
+	if (sse::mat4::scale(1, 2, 3) != sse::mat4(mat4_scale(1, 2, 3))
+		|| sse::mat4::ortho(-1, 2, -3, 4, 1, 10) != sse::mat4(mat4_ortho(-1, 2, -3, 4, 1, 10))
+		|| sse::mat4::perspective(60, 1.5f, 1, 100) != sse::mat4(mat4_perspective(60, 1.5f, 1, 100)))
+	{
+		printf("Matrix factories are wrong\n");
+	}
+}
+void xform_test(){
+	mat4_t cm = mat4_mult(mat4_rotate(37, vec4_new(1, 2, 3, 0)), mat4_scale(1.1f, 0.7f, 1.3f));
+	cm.col[3] = vec4_new(0.3f, -2, 5, 1);
+	sse::mat4 m = cm;
+	sse::vec4 v(1.5f, -0.25f, 3.1f, 0.9f), t(0.1f, 0.2f, -0.3f, 4), s(3, 3, 3, 3);
+	sse::vec4 mv = m * v;
+	if (mv != sse::vec4(mat4_vec_mult(cm, v))){
+		printf("m * v is wrong\n");
+	}
+	/*
+	 * The other terms start the chain and the columns are fused onto them. The
+	 * first column times x is 1 + 2^-11 + 2^-24, which isn't a float, so fused
+	 * and unfused results differ when t cancels the rest of it
+	 */
+	const float h = 1 + 1.f / 4096;
+	m[0] = sse::vec4(h, h, -h, h);
+	v = sse::vec4(h, 1.f / (1 << 20), -1.f / (1 << 21), 0);
+	s = sse::vec4(1, 2, 2, 3);
+	t = sse::vec4(-1 - 1.f / 2048, -1 - 1.f / 2048, 1 + 1.f / 2048, -1 - 1.f / 2048);
+	float sum[4], diff[4], rsub[4];
+	for (int i = 0; i < 4; ++i){
+		sum[i] = t[i];
+		rsub[i] = -t[i];
+		diff[i] = madd(m(i, 0), v[0] * s[0], t[i]);
+		for (int c = 0; c < 4; ++c){
+			sum[i] = madd(m(i, c), v[c] * s[c], sum[i]);
+			rsub[i] = madd(-m(i, c), v[c] * s[c], rsub[i]);
+			if (c){
+				diff[i] = madd(m(i, c), v[c] * s[c], diff[i]);
+			}
+		}
+	}
+	sse::vec4 r = m * (v * s) + t;
+	sse::vec4 r2 = t + m * (v * s);
+	sse::vec4 u = -t;
+	sse::vec4 r3 = m * (v * s) - u;
+	sse::vec4 r4 = u - m * (v * s);
+	for (int i = 0; i < 4; ++i){
+		if (r[i] != sum[i] || r2[i] != sum[i]){
+			printf("m * v + t is wrong\n");
+			break;
+		}
+	}
+	for (int i = 0; i < 4; ++i){
+		if (r3[i] != diff[i]){
+			printf("m * v - t is wrong\n");
+			break;
+		}
+	}
+	for (int i = 0; i < 4; ++i){
+		if (r4[i] != rsub[i]){
+			printf("t - m * v is wrong\n");
+			break;
+		}
+	}
+}
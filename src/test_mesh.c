@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "vec4.h"
+#include "mesh.h"
+
+/*
+ * Write meshes, read them back through the mapping and make sure damaged
+ * files are caught
+ */
+#define MESH_PATH "test_mesh.bin"
+
+void crc_test(void);
+void round_trip_test(void);
+void streaming_test(void);
+void damaged_test(void);
+/* Flip a byte in the file at offset */
+void corrupt(const char *path, long offset);
+
+int main(void){
+	crc_test();
+	round_trip_test();
+	streaming_test();
+	damaged_test();
+	remove(MESH_PATH);
+
+	return 0;
+}
+void corrupt(const char *path, long offset){
+	FILE *fp = fopen(path, "r+b");
+	if (!fp){
+		printf("Opening the file to corrupt is wrong\n");
+		return;
+	}
+	fseek(fp, offset, SEEK_SET);
+	int c = fgetc(fp);
+	fseek(fp, offset, SEEK_SET);
+	fputc(c ^ 0x40, fp);
+	fclose(fp);
+}
+void crc_test(void){
+	/* The standard check value for CRC-32C */
+	if (mesh_crc32c(0, "123456789", 9) != 0xe3069283){
+		printf("CRC-32C is wrong: %x\n", mesh_crc32c(0, "123456789", 9));
+	}
+	/* Continuing a CRC over pieces gives the same as doing it all at once */
+	const char *msg = "The quick brown fox jumps over the lazy dog";
+	uint32_t c = mesh_crc32c(0, msg, 5);
+	c = mesh_crc32c(c, msg + 5, strlen(msg) - 5);
+	if (c != mesh_crc32c(0, msg, strlen(msg))){
+		printf("Continued CRC is wrong\n");
+	}
+}
+void round_trip_test(void){
+	/* The test_gl object */
+	const vec4_t object[18] = {
+		vec4_new(-1, -1, 1, 1), vec4_new(1, -1, 1, 1), vec4_new(1, 1, 1, 1),
+		vec4_new(1, 1, 1, 1), vec4_new(-1, 1, 1, 1), vec4_new(-1, -1, 1, 1),
+		vec4_new(1, -1, 1, 1), vec4_new(1, -1, -1, 1), vec4_new(1, 1, -1, 1),
+		vec4_new(1, 1, -1, 1), vec4_new(1, 1, 1, 1), vec4_new(1, -1, 1, 1),
+		vec4_new(-1, -1, 1, 1), vec4_new(-1, -1, -1, 1), vec4_new(-1, 1, -1, 1),
+		vec4_new(-1, 1, -1, 1), vec4_new(-1, 1, 1, 1), vec4_new(-1, -1, 1, 1)
+	};
+	uint32_t indices[18];
+	for (int i = 0; i < 18; ++i){
+		indices[i] = 17 - i;
+	}
+	if (!mesh_write(MESH_PATH, object, NULL, 18, indices, 18)){
+		printf("Writing the mesh is wrong\n");
+		return;
+	}
+	struct mesh_file m;
+	if (!mesh_open(&m, MESH_PATH, MESH_VERIFY | MESH_WILLNEED)){
+		printf("Opening the mesh is wrong: %s\n", m.error);
+		return;
+	}
+	size_t n_verts, n_normals, n_indices;
+	const vec4_t *pos = mesh_positions(&m, &n_verts);
+	const vec4_t *normals = mesh_normals(&m, &n_normals);
+	const uint32_t *idx = mesh_indices(&m, &n_indices);
+	if (!pos || n_verts != 18 || memcmp(pos, object, sizeof(object))){
+		printf("Mapped positions are wrong\n");
+	}
+	if (normals || n_normals != 0){
+		printf("Missing normals are wrong\n");
+	}
+	if (!idx || n_indices != 18 || memcmp(idx, indices, sizeof(indices))){
+		printf("Mapped indices are wrong\n");
+	}
+	if (((uintptr_t)pos & (MESH_ALIGN - 1)) || ((uintptr_t)idx & (MESH_ALIGN - 1))){
+		printf("Section alignment is wrong\n");
+	}
+	/* The views are aligned so this is fine */
+	vec4_t sum = vec4_new(0, 0, 0, 0);
+	for (size_t i = 0; i < n_verts; ++i){
+		sum.v = _mm_add_ps(sum.v, _mm_load_ps(pos[i].f));
+	}
+	if (!vec4_eq(sum, vec4_new(0, 0, 6, 18))){
+		printf("Summing the mapped positions is wrong\n");
+		vec4_print(sum);
+	}
+	mesh_prefetch(&m, mesh_find_section(&m, MESH_POSITIONS));
+	mesh_close(&m);
+}
+void streaming_test(void){
+	enum { CHUNK = 1000, CHUNKS = 7 };
+	static vec4_t pos[CHUNK], normals[CHUNK];
+	struct mesh_writer w;
+	if (!mesh_writer_open(&w, MESH_PATH)){
+		printf("Opening the writer is wrong\n");
+		return;
+	}
+	/* Positions in chunks, the normals section without a CRC */
+	mesh_writer_begin(&w, MESH_POSITIONS, sizeof(vec4_t), 1);
+	for (int c = 0; c < CHUNKS; ++c){
+		for (int i = 0; i < CHUNK; ++i){
+			pos[i] = vec4_new(c, i, c * CHUNK + i, 1);
+		}
+		mesh_writer_append(&w, pos, CHUNK);
+	}
+	mesh_writer_begin(&w, MESH_NORMALS, sizeof(vec4_t), 0);
+	for (int c = 0; c < CHUNKS; ++c){
+		for (int i = 0; i < CHUNK; ++i){
+			normals[i] = vec4_new(0, 1, 0, 0);
+		}
+		mesh_writer_append(&w, normals, CHUNK);
+	}
+	/* An odd sized section of an unknown type, the next one still has to be aligned */
+	mesh_writer_begin(&w, 100, 3, 1);
+	mesh_writer_append(&w, "abcdefg", 2);
+	uint32_t tri[3] = { 0, 1, CHUNK * CHUNKS - 1 };
+	mesh_writer_begin(&w, MESH_INDICES, sizeof(uint32_t), 1);
+	mesh_writer_append(&w, tri, 3);
+	if (!mesh_writer_close(&w)){
+		printf("Closing the writer is wrong\n");
+		return;
+	}
+	struct mesh_file m;
+	if (!mesh_open(&m, MESH_PATH, MESH_VERIFY | MESH_POPULATE | MESH_SEQUENTIAL)){
+		printf("Opening the streamed mesh is wrong: %s\n", m.error);
+		return;
+	}
+	size_t n_verts, n_normals, n_indices;
+	const vec4_t *p = mesh_positions(&m, &n_verts);
+	const vec4_t *n = mesh_normals(&m, &n_normals);
+	const uint32_t *idx = mesh_indices(&m, &n_indices);
+	if (m.header->n_sections != 4 || n_verts != CHUNK * CHUNKS || n_normals != CHUNK * CHUNKS || n_indices != 3){
+		printf("Streamed section counts are wrong\n");
+	}
+	else {
+		for (size_t i = 0; i < n_verts; ++i){
+			if (!vec4_eq(p[i], vec4_new(i / CHUNK, i % CHUNK, i, 1)) || !vec4_eq(n[i], vec4_new(0, 1, 0, 0))){
+				printf("Streamed data is wrong\n");
+				break;
+			}
+		}
+		if (idx[2] != CHUNK * CHUNKS - 1 || ((uintptr_t)idx & (MESH_ALIGN - 1))){
+			printf("Streamed indices are wrong\n");
+		}
+	}
+	mesh_close(&m);
+}
+void damaged_test(void){
+	const vec4_t pos[3] = { vec4_new(0, 0, 0, 1), vec4_new(1, 0, 0, 1), vec4_new(0, 1, 0, 1) };
+	const uint32_t good[3] = { 0, 1, 2 }, bad[3] = { 0, 1, 3 };
+	struct mesh_file m;
+	if (mesh_open(&m, "no_such_mesh.bin", 0) || !m.error){
+		printf("Opening a missing file is wrong\n");
+	}
+	/* A flipped byte in the data is only caught when verifying */
+	mesh_write(MESH_PATH, pos, NULL, 3, good, 3);
+	corrupt(MESH_PATH, MESH_DATA_OFFSET + 4);
+	if (!mesh_open(&m, MESH_PATH, 0)){
+		printf("Opening without verifying is wrong: %s\n", m.error);
+	}
+	else {
+		if (mesh_verify(&m)){
+			printf("Verifying a damaged section is wrong\n");
+		}
+		mesh_close(&m);
+	}
+	if (mesh_open(&m, MESH_PATH, MESH_VERIFY)){
+		printf("Opening a damaged section with MESH_VERIFY is wrong\n");
+		mesh_close(&m);
+	}
+	/* Damage to the section table always is */
+	mesh_write(MESH_PATH, pos, NULL, 3, good, 3);
+	corrupt(MESH_PATH, sizeof(struct mesh_header) + 8);
+	if (mesh_open(&m, MESH_PATH, 0)){
+		printf("Opening a damaged section table is wrong\n");
+		mesh_close(&m);
+	}
+	mesh_write(MESH_PATH, pos, NULL, 3, bad, 3);
+	if (mesh_open(&m, MESH_PATH, MESH_VERIFY)){
+		printf("Opening a mesh with bad indices is wrong\n");
+		mesh_close(&m);
+	}
+	/* Truncated */
+	mesh_write(MESH_PATH, pos, NULL, 3, good, 3);
+	FILE *fp = fopen(MESH_PATH, "r+b");
+	if (fp){
+		char buf[MESH_DATA_OFFSET + 64];
+		size_t got = fread(buf, 1, sizeof(buf), fp);
+		fclose(fp);
+		fp = fopen(MESH_PATH, "wb");
+		fwrite(buf, 1, got, fp);
+		fclose(fp);
+	}
+	if (mesh_open(&m, MESH_PATH, 0)){
+		printf("Opening a truncated mesh is wrong\n");
+		mesh_close(&m);
+	}
+	else if (!strstr(m.error, "truncated")){
+		printf("Truncated mesh error is wrong: %s\n", m.error);
+	}
+}
@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vec4.h"
+#include "mesh.h"
+#include "mesh_import.h"
+#include "dispatch.h"
+
+/*
+ * Check the float parser and line scanning against the C library, then
+ * import OBJ and PLY files written out here with different thread counts and
+ * block sizes and compare them to what was written
+ */
+#define OBJ_PATH "test_mesh_import.obj"
+#define PLY_PATH "test_mesh_import.ply"
+#define MESH_PATH "test_mesh_import.bin"
+/* Size of the generated grid, big enough that the file is cut into several blocks and parts */
+#define GRID_W 200
+#define GRID_H 1000
+
+void float_test(void);
+void scan_test(void);
+void small_obj_test(void);
+void grid_test(void);
+void ply_test(int binary);
+void error_test(void);
+void write_file(const char *path, const char *text, size_t len);
+int import_check(const char *path, int threads, size_t block, const vec4_t *pos, size_t n_pos,
+	const vec4_t *nrm, size_t n_nrm, const uint32_t *idx, size_t n_idx);
+
+int main(void){
+	float_test();
+	scan_test();
+	small_obj_test();
+	grid_test();
+	ply_test(0);
+	ply_test(1);
+	error_test();
+	remove(OBJ_PATH);
+	remove(PLY_PATH);
+	remove(MESH_PATH);
+
+	return 0;
+}
+void write_file(const char *path, const char *text, size_t len){
+	FILE *fp = fopen(path, "wb");
+	if (!fp || fwrite(text, 1, len, fp) != len){
+		printf("Writing %s is wrong\n", path);
+	}
+	if (fp){
+		fclose(fp);
+	}
+}
+void float_test(void){
+	const char *strs[] = {
+		"0", "-0", "1", "+3", "-2.5", ".5", "5.", "3.14159265", "-0.000123456", "1e10", "1E-5",
+		"6.02214076e23", "1.17549435e-38", "3.40282347e38", "1e-45", "123456789012345678901234",
+		"0.1", "0.3", "16777217", "0.000000000000000000000000001", "inf", "-nan", "2.5e", "7e+2"
+	};
+	for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); ++i){
+		char buf[64];
+		snprintf(buf, sizeof(buf), " %s\n", strs[i]);
+		const char *p = buf;
+		char *e;
+		float f = 0, ref = strtof(buf, &e);
+		if (!mesh_parse_float(&p, &f) || p != e || (f != ref && !(isnan(f) && isnan(ref)))){
+			printf("Parsing float %s is wrong: %g vs. %g\n", strs[i], f, ref);
+		}
+	}
+	/* Random numbers printed with up to 9 digits should come back the same as with strtof */
+	srand(7);
+	int off = 0;
+	for (int i = 0; i < 100000; ++i){
+		char buf[64];
+		double v = (rand() / (double)RAND_MAX - 0.5) * pow(10, rand() % 16 - 8);
+		snprintf(buf, sizeof(buf), i % 2 ? "%.*g\n" : "%.*f\n", 1 + rand() % 9, v);
+		const char *p = buf;
+		float f, ref = strtof(buf, NULL);
+		if (!mesh_parse_float(&p, &f) || *p != '\n'){
+			printf("Parsing float %s is wrong\n", buf);
+			break;
+		}
+		off += f != ref;
+		if (f != ref && fabsf(f - ref) > fabsf(ref) * 1.2e-7f){
+			printf("Parsing float %s is wrong: %.9g vs. %.9g\n", buf, f, ref);
+			break;
+		}
+	}
+	if (off > 10){
+		printf("Float parsing rounds differently from strtof too often: %d\n", off);
+	}
+	const char *bad[] = { "abc\n", "-\n", ".\n", "\n", "+.e5\n" };
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i){
+		const char *p = bad[i];
+		float f;
+		if (mesh_parse_float(&p, &f) || p != bad[i]){
+			printf("Parsing the non-number %s is wrong\n", bad[i]);
+		}
+	}
+}
+void scan_test(void){
+	enum { SIZE = 1000 };
+	static char text[SIZE + 128] __attribute__((aligned(64)));
+	uint32_t ref[SIZE], ends[SIZE];
+	static char long_text[40000] __attribute__((aligned(64)));
+	static size_t long_ref[40000];
+	for (int i = 0; i < SIZE + 128; ++i){
+		text[i] = rand() % 7 == 0 ? '\n' : 'a' + i % 26;
+	}
+	for (size_t i = 0; i < sizeof(long_text); ++i){
+		long_text[i] = rand() % 3 == 0 ? '\n' : ' ';
+	}
+	for (size_t i = 1; i + 5 < sizeof(long_text); ++i){
+		long_ref[i] = long_ref[i - 1] + (long_text[i + 4] == '\n');
+	}
+	for (int t = 0; t < SSE_TIER_COUNT; ++t){
+		const struct sse_kernels *k = sse_kernels_for_tier(t);
+		if (!k){
+			continue;
+		}
+		/* Every start within a cache line and lengths across the 64 byte blocks */
+		for (int start = 0; start < 64; start += 3){
+			for (int len = 0; len < 300; len += 7){
+				size_t n_ref = 0;
+				for (int i = 0; i < len; ++i){
+					if (text[start + i] == '\n'){
+						ref[n_ref++] = i;
+					}
+				}
+				if (k->count_lines(text + start, len) != n_ref){
+					printf("%s count_lines is wrong\n", k->name);
+					return;
+				}
+				size_t n = k->scan_lines(text + start, len, ends, SIZE);
+				if (n != n_ref || memcmp(ends, ref, n * sizeof(uint32_t))){
+					printf("%s scan_lines is wrong\n", k->name);
+					return;
+				}
+				/* Stopping at max in the middle of a block */
+				size_t max = n_ref / 2 + 1;
+				n = k->scan_lines(text + start, len, ends, max);
+				if (n_ref && (n != (max < n_ref ? max : n_ref) || memcmp(ends, ref, n * sizeof(uint32_t)))){
+					printf("%s scan_lines stopping at max is wrong\n", k->name);
+					return;
+				}
+			}
+		}
+		/* Long enough that the per byte counters are flushed a few times */
+		for (size_t len = 8000; len < sizeof(long_text); len += 4321){
+			if (k->count_lines(long_text + 5, len) != long_ref[len]){
+				printf("%s count_lines over a long text is wrong\n", k->name);
+				break;
+			}
+		}
+	}
+}
+/* A sink collecting everything into plain arrays, so the block size can be picked */
+struct collect {
+	vec4_t *pos, *nrm;
+	uint32_t *idx;
+	size_t n_pos, n_nrm, n_idx;
+	/* Stop the import after this many positions */
+	size_t stop;
+};
+int collect_positions(void *user, const vec4_t *p, size_t n){
+	struct collect *c = user;
+	c->pos = realloc(c->pos, (c->n_pos + n) * sizeof(vec4_t));
+	memcpy(c->pos + c->n_pos, p, n * sizeof(vec4_t));
+	c->n_pos += n;
+	return !c->stop || c->n_pos < c->stop;
+}
+int collect_normals(void *user, const vec4_t *nrm, size_t n){
+	struct collect *c = user;
+	c->nrm = realloc(c->nrm, (c->n_nrm + n) * sizeof(vec4_t));
+	memcpy(c->nrm + c->n_nrm, nrm, n * sizeof(vec4_t));
+	c->n_nrm += n;
+	return 1;
+}
+int collect_indices(void *user, const uint32_t *idx, size_t n){
+	struct collect *c = user;
+	c->idx = realloc(c->idx, (c->n_idx + n) * sizeof(uint32_t));
+	memcpy(c->idx + c->n_idx, idx, n * sizeof(uint32_t));
+	c->n_idx += n;
+	return 1;
+}
+int import_check(const char *path, int threads, size_t block, const vec4_t *pos, size_t n_pos,
+	const vec4_t *nrm, size_t n_nrm, const uint32_t *idx, size_t n_idx)
+{
+	struct collect c;
+	memset(&c, 0, sizeof(c));
+	struct mesh_sink sink = { collect_positions, collect_normals, collect_indices, &c };
+	const char *err;
+	int ok = mesh_import(path, &sink, threads, block, &err);
+	if (!ok){
+		printf("Importing %s with %d threads and %zu byte blocks is wrong: %s\n", path, threads, block, err);
+	}
+	else if (c.n_pos != n_pos || c.n_nrm != n_nrm || c.n_idx != n_idx
+		|| (n_pos && memcmp(c.pos, pos, n_pos * sizeof(vec4_t)))
+		|| (n_nrm && memcmp(c.nrm, nrm, n_nrm * sizeof(vec4_t)))
+		|| (n_idx && memcmp(c.idx, idx, n_idx * sizeof(uint32_t))))
+	{
+		printf("Imported %s with %d threads and %zu byte blocks is wrong: %zu positions, %zu normals, %zu indices\n",
+			path, threads, block, c.n_pos, c.n_nrm, c.n_idx);
+		ok = 0;
+	}
+	free(c.pos);
+	free(c.nrm);
+	free(c.idx);
+	return ok;
+}
+void small_obj_test(void){
+	const char *obj =
+		"# a quad and a triangle\r\n"
+		"mtllib thing.mtl\n"
+		"o thing\n"
+		"v 0 0 0\n"
+		"v 1 0 0\r\n"
+		"v 1 1 0 1.0\n"
+		"\tv 0 1 0 0.5 0.5 0.5\n"
+		"vt 0 0\n"
+		"vn 0 0 1\n"
+		"vn 0 0 1\n"
+		"vn 0 0 1\n"
+		"vn 0 0 1\n"
+		"\n"
+		"f 1/1/1 2/2/2 3/3/3 4/4/4\n"
+		"  f -4//1 -2//3 -1//4 # a comment\n"
+		"v 2 0 0\n"
+		"f 2 5 3";
+	const vec4_t pos[5] = {
+		vec4_new(0, 0, 0, 1), vec4_new(1, 0, 0, 1), vec4_new(1, 1, 0, 1), vec4_new(0, 1, 0, 1),
+		vec4_new(2, 0, 0, 1)
+	};
+	const vec4_t nrm[4] = {
+		vec4_new(0, 0, 1, 0), vec4_new(0, 0, 1, 0), vec4_new(0, 0, 1, 0), vec4_new(0, 0, 1, 0)
+	};
+	const uint32_t idx[12] = { 0, 1, 2, 0, 2, 3, 0, 2, 3, 1, 4, 2 };
+	write_file(OBJ_PATH, obj, strlen(obj));
+	import_check(OBJ_PATH, 1, 0, pos, 5, nrm, 4, idx, 12);
+	/* Small enough that lines get carried over between blocks */
+	import_check(OBJ_PATH, 1, 64, pos, 5, nrm, 4, idx, 12);
+	import_check(OBJ_PATH, 3, 64, pos, 5, nrm, 4, idx, 12);
+}
+void grid_test(void){
+	/*
+	 * A grid of quads, each row of vertices followed by the quads joining it to
+	 * the one before. Odd rows use relative indices, so parts have to resolve
+	 * them against the positions in the parts before them
+	 */
+	const size_t n_pos = GRID_W * GRID_H, n_idx = (GRID_W - 1) * (GRID_H - 1) * 6;
+	vec4_t *pos = malloc(n_pos * sizeof(vec4_t));
+	uint32_t *idx = malloc(n_idx * sizeof(uint32_t));
+	FILE *fp = fopen(OBJ_PATH, "wb");
+	size_t k = 0;
+	for (int r = 0; r < GRID_H; ++r){
+		for (int c = 0; c < GRID_W; ++c){
+			vec4_t p = vec4_new(c * 0.125f, (r % 37) * -2.5f, (c * r % 1000) / 64.f, 1);
+			pos[r * GRID_W + c] = p;
+			fprintf(fp, "v %.9g %.9g %.9g\n", p.f[0], p.f[1], p.f[2]);
+		}
+		if (!r){
+			continue;
+		}
+		long count = (r + 1) * GRID_W;
+		for (int c = 0; c < GRID_W - 1; ++c){
+			long q[4] = { (r - 1) * GRID_W + c, (r - 1) * GRID_W + c + 1, r * GRID_W + c + 1, r * GRID_W + c };
+			fputc('f', fp);
+			for (int i = 0; i < 4; ++i){
+				fprintf(fp, r % 2 ? " %ld//%d" : " %ld", r % 2 ? q[i] - count : q[i] + 1, i + 1);
+			}
+			fputc('\n', fp);
+			const int tri[6] = { 0, 1, 2, 0, 2, 3 };
+			for (int i = 0; i < 6; ++i){
+				idx[k++] = q[tri[i]];
+			}
+		}
+	}
+	fclose(fp);
+	import_check(OBJ_PATH, 1, 0, pos, n_pos, NULL, 0, idx, n_idx);
+	import_check(OBJ_PATH, 4, 0, pos, n_pos, NULL, 0, idx, n_idx);
+	import_check(OBJ_PATH, 4, 1 << 20, pos, n_pos, NULL, 0, idx, n_idx);
+	import_check(OBJ_PATH, 2, 4096, pos, n_pos, NULL, 0, idx, n_idx);
+
+	struct mesh_data d;
+	const char *err;
+	if (!mesh_import_data(&d, OBJ_PATH, 4, &err)){
+		printf("Importing the grid into memory is wrong: %s\n", err);
+	}
+	else if (d.n_positions != n_pos || d.n_indices != n_idx || (uintptr_t)d.positions % 64
+		|| memcmp(d.positions, pos, n_pos * sizeof(vec4_t)) || memcmp(d.indices, idx, n_idx * sizeof(uint32_t)))
+	{
+		printf("Grid imported into memory is wrong\n");
+	}
+	mesh_data_free(&d);
+
+	/* Convert to a mesh file and read it back */
+	struct mesh_file m;
+	size_t n_verts, n_indices;
+	if (!mesh_import_file(OBJ_PATH, MESH_PATH, 4, &err)){
+		printf("Converting the grid to a mesh file is wrong: %s\n", err);
+	}
+	else if (!mesh_open(&m, MESH_PATH, MESH_VERIFY)){
+		printf("Opening the converted grid is wrong: %s\n", m.error);
+	}
+	else {
+		const vec4_t *p = mesh_positions(&m, &n_verts);
+		const uint32_t *i = mesh_indices(&m, &n_indices);
+		if (n_verts != n_pos || n_indices != n_idx || mesh_normals(&m, NULL)
+			|| memcmp(p, pos, n_pos * sizeof(vec4_t)) || memcmp(i, idx, n_idx * sizeof(uint32_t)))
+		{
+			printf("Converted grid is wrong\n");
+		}
+		mesh_close(&m);
+	}
+	free(pos);
+	free(idx);
+}
+/* Append a value to a binary PLY being built */
+#define PUT(T, V) do { T v_ = (V); memcpy(buf + len, &v_, sizeof(T)); len += sizeof(T); } while (0)
+void ply_test(int binary){
+	/*
+	 * A strip of quads with normals and extra properties to skip, with an
+	 * element after the faces that's ignored
+	 */
+	enum { N = 20000, ROW = 100, FACES = N - ROW - 1 };
+	vec4_t *pos = malloc(N * sizeof(vec4_t));
+	vec4_t *nrm = malloc(N * sizeof(vec4_t));
+	uint32_t *idx = malloc(FACES * 6 * sizeof(uint32_t));
+	char *buf = malloc(N * 80 + FACES * 40 + 1024);
+	size_t len = sprintf(buf, "ply\nformat %s 1.0\ncomment made by test_mesh_import\n"
+		"element vertex %d\nproperty float x\nproperty float y\nproperty float z\n"
+		"property uchar red\nproperty float nx\nproperty float ny\nproperty float nz\n"
+		"property double confidence\nelement face %d\nproperty list uchar int vertex_indices\n"
+		"property int flags\nelement edge 2\nproperty int vertex1\nproperty int vertex2\nend_header\n",
+		binary ? "binary_little_endian" : "ascii", N, FACES);
+	for (int i = 0; i < N; ++i){
+		pos[i] = vec4_new((i % ROW) * 0.5f, (i / ROW) * 0.25f, i % 7 - 3, 1);
+		nrm[i] = vec4_new(0, i % 3 - 1, i % 2 ? 1 : -1, 0);
+		if (binary){
+			PUT(float, pos[i].f[0]);
+			PUT(float, pos[i].f[1]);
+			PUT(float, pos[i].f[2]);
+			PUT(uint8_t, i % 256);
+			PUT(float, nrm[i].f[0]);
+			PUT(float, nrm[i].f[1]);
+			PUT(float, nrm[i].f[2]);
+			PUT(double, i * 0.125);
+		}
+		else {
+			len += sprintf(buf + len, "%g %g %g %d %g %g %g %g\n", pos[i].f[0], pos[i].f[1], pos[i].f[2],
+				i % 256, nrm[i].f[0], nrm[i].f[1], nrm[i].f[2], i * 0.125);
+		}
+	}
+	for (int j = 0; j < FACES; ++j){
+		const int32_t q[4] = { j, j + 1, j + ROW + 1, j + ROW };
+		const int tri[6] = { 0, 1, 2, 0, 2, 3 };
+		for (int i = 0; i < 6; ++i){
+			idx[j * 6 + i] = q[tri[i]];
+		}
+		if (binary){
+			PUT(uint8_t, 4);
+			for (int i = 0; i < 4; ++i){
+				PUT(int32_t, q[i]);
+			}
+			PUT(int32_t, j);
+		}
+		else {
+			len += sprintf(buf + len, "4 %d %d %d %d %d\n", q[0], q[1], q[2], q[3], j);
+		}
+	}
+	for (int i = 0; i < 2; ++i){
+		if (binary){
+			PUT(int32_t, i);
+			PUT(int32_t, i + 1);
+		}
+		else {
+			len += sprintf(buf + len, "%d %d\n", i, i + 1);
+		}
+	}
+	write_file(PLY_PATH, buf, len);
+	import_check(PLY_PATH, 1, 0, pos, N, nrm, N, idx, FACES * 6);
+	import_check(PLY_PATH, 4, 0, pos, N, nrm, N, idx, FACES * 6);
+	/* Records and lines cut across blocks, and for ASCII several parts a block */
+	import_check(PLY_PATH, 4, 600 * 1024, pos, N, nrm, N, idx, FACES * 6);
+	import_check(PLY_PATH, 2, 4096, pos, N, nrm, N, idx, FACES * 6);
+
+	/* Cutting it off part way through the faces */
+	write_file(PLY_PATH, buf, len * 3 / 4);
+	struct mesh_data d;
+	const char *err;
+	if (mesh_import_data(&d, PLY_PATH, 2, &err)){
+		printf("Importing a truncated %s PLY is wrong\n", binary ? "binary" : "ASCII");
+		mesh_data_free(&d);
+	}
+	free(buf);
+	free(pos);
+	free(nrm);
+	free(idx);
+}
+void error_test(void){
+	const char *bad[] = {
+		"v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n",
+		"v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2\n",
+		"v 0 0 0\nv 1 0 0\nf -1 -2 -3\n",
+		"v 0 0 0\nv 1 0 0\nf 1 2 0\n",
+		"v 0 x 0\n",
+		"ply\nformat binary_big_endian 1.0\nelement vertex 1\nproperty float x\nend_header\n",
+		"ply\nformat ascii 1.0\nelement vertex 1\nproperty float x\nproperty float y\nend_header\n0 0\n",
+		"ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\nproperty float z\n"
+			"element face 1\nproperty list uchar int vertex_indices\nend_header\n0 0 0\n1 0 0\n0 1 0\n3 0 1 3\n"
+	};
+	struct mesh_data d;
+	const char *err;
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i){
+		write_file(OBJ_PATH, bad[i], strlen(bad[i]));
+		if (mesh_import_data(&d, OBJ_PATH, 1, &err) || !err){
+			printf("Importing bad file %zu is wrong\n", i);
+			mesh_data_free(&d);
+		}
+	}
+	/*
+	 * A binary PLY with a negative count on a list that's skipped, which would
+	 * step back before the start of the block
+	 */
+	char buf[256];
+	size_t len = sprintf(buf, "ply\nformat binary_little_endian 1.0\nelement vertex 3\nproperty float x\n"
+		"property float y\nproperty float z\nelement face 1\nproperty list char float uv\n"
+		"property list uchar int vertex_indices\nend_header\n");
+	for (int i = 0; i < 9; ++i){
+		PUT(float, i == 3 || i == 7);
+	}
+	PUT(int8_t, -100);
+	PUT(uint8_t, 3);
+	for (int i = 0; i < 3; ++i){
+		PUT(int32_t, i);
+	}
+	write_file(PLY_PATH, buf, len);
+	if (mesh_import_data(&d, PLY_PATH, 1, &err) || !err || strcmp(err, "negative list count")){
+		printf("Importing a PLY with a negative list count is wrong\n");
+		mesh_data_free(&d);
+	}
+	/* Float counts that are NaN, or far too big to fit in any block */
+	const float counts[] = { NAN, 1e30f, 4e9f };
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i){
+		len = sprintf(buf, "ply\nformat binary_little_endian 1.0\nelement vertex 3\nproperty float x\n"
+			"property float y\nproperty float z\nelement face 1\nproperty list float float uv\n"
+			"property list uchar int vertex_indices\nend_header\n");
+		for (int i = 0; i < 9; ++i){
+			PUT(float, i == 3 || i == 7);
+		}
+		PUT(float, counts[i]);
+		PUT(uint8_t, 3);
+		for (int i = 0; i < 3; ++i){
+			PUT(int32_t, i);
+		}
+		write_file(PLY_PATH, buf, len);
+		if (mesh_import_data(&d, PLY_PATH, 1, &err) || !err || (i == 0 && strcmp(err, "bad list count"))){
+			printf("Importing a PLY with list count %g is wrong\n", counts[i]);
+			mesh_data_free(&d);
+		}
+	}
+	if (mesh_import_data(&d, "no_such_file.obj", 1, &err)){
+		printf("Importing a missing file is wrong\n");
+	}
+	/* A line longer than a block */
+	const char *obj = "v 0.000000000000000000 0.000000000000000000 0.000000000000000000\n";
+	write_file(OBJ_PATH, obj, strlen(obj));
+	struct collect c;
+	memset(&c, 0, sizeof(c));
+	struct mesh_sink sink = { collect_positions, collect_normals, collect_indices, &c };
+	if (mesh_import(OBJ_PATH, &sink, 1, 32, &err)){
+		printf("Importing a line longer than a block is wrong\n");
+	}
+	/* The sink stopping the import */
+	obj = "v 0 0 0\nv 1 0 0\nv 0 1 0\n";
+	write_file(OBJ_PATH, obj, strlen(obj));
+	c.stop = 1;
+	if (mesh_import(OBJ_PATH, &sink, 1, 8, &err)){
+		printf("Stopping an import from the sink is wrong\n");
+	}
+	free(c.pos);
+	free(c.nrm);
+	free(c.idx);
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <math.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "quat.h"
+#include "dispatch.h"
+
+/* Check the quaternion ops against building the same rotations as matrices */
+void basic_test(void);
+void interp_test(void);
+void decompose_test(void);
+int mat4_near(mat4_t a, mat4_t b, float eps);
+int vec4_near(vec4_t a, vec4_t b, float eps);
+
+int main(void){
+	basic_test();
+	interp_test();
+	decompose_test();
+
+	return 0;
+}
+int mat4_near(mat4_t a, mat4_t b, float eps){
+	for (int i = 0; i < 4; ++i){
+		if (!vec4_near(a.col[i], b.col[i], eps)){
+			return 0;
+		}
+	}
+	return 1;
+}
+int vec4_near(vec4_t a, vec4_t b, float eps){
+	for (int i = 0; i < 4; ++i){
+		if (fabsf(a.f[i] - b.f[i]) > eps){
+			return 0;
+		}
+	}
+	return 1;
+}
+void basic_test(void){
+	quat_t a = quat_from_axis_angle(vec4_new(1, 2, 3, 0), 50);
+	quat_t b = quat_from_axis_angle(vec4_new(0, 1, 0, 0), -120);
+	printf("a=");
+	vec4_print(a);
+	if (!mat4_near(quat_to_mat4(a), mat4_rotate(50, vec4_new(1, 2, 3, 0)), 1e-6f)){
+		printf("Quaternion to matrix is wrong\n");
+	}
+	/* Composition should match multiplying the matrices */
+	mat4_t ab = mat4_mult(quat_to_mat4(a), quat_to_mat4(b));
+	if (!mat4_near(quat_to_mat4(quat_mult(a, b)), ab, 1e-6f)){
+		printf("Quaternion multiply is wrong\n");
+	}
+	if (!vec4_near(quat_mult(a, quat_conjugate(a)), quat_identity(), 1e-6f)){
+		printf("Conjugate is wrong\n");
+	}
+	vec4_t v = vec4_new(3, -1, 2, 0);
+	if (!vec4_near(quat_rotate(a, v), mat4_vec_mult(quat_to_mat4(a), v), 1e-5f)){
+		printf("Quaternion rotate is wrong\n");
+	}
+	if (fabsf(vec4_len(quat_normalize(vec4_new(1, 2, 3, 4))) - 1.f) > 1e-6f){
+		printf("Normalize is wrong\n");
+	}
+
+	quat_t qs[5];
+	mat4_t ms[5];
+	for (int i = 0; i < 5; ++i){
+		qs[i] = quat_from_axis_angle(vec4_new(i, 1, -i, 0), i * 40.f);
+	}
+	quat_to_mat4_n(qs, ms, 5);
+	for (int i = 0; i < 5; ++i){
+		if (!mat4_near(ms[i], quat_to_mat4(qs[i]), 1e-6f)){
+			printf("Batched quaternion to matrix is wrong\n");
+		}
+	}
+}
+void interp_test(void){
+	quat_t a = quat_from_axis_angle(vec4_new(0, 0, 1, 0), 10);
+	quat_t b = quat_from_axis_angle(vec4_new(0, 0, 1, 0), 110);
+	/* Slerp about a fixed axis moves the angle linearly */
+	quat_t h = quat_slerp(a, b, 0.25f);
+	if (!vec4_near(h, quat_from_axis_angle(vec4_new(0, 0, 1, 0), 35), 1e-6f)){
+		printf("Slerp is wrong\n");
+	}
+	/* The flipped b is the same rotation, so we should get the same result */
+	if (!vec4_near(quat_slerp(a, vec4_scale(b, -1), 0.25f), h, 1e-6f)){
+		printf("Slerp shortest path is wrong\n");
+	}
+	quat_t n = quat_nlerp(a, b, 0.5f);
+	if (!vec4_near(n, quat_from_axis_angle(vec4_new(0, 0, 1, 0), 60), 1e-6f)){
+		printf("Nlerp is wrong\n");
+	}
+
+	enum { N = 23 };
+	quat_t qa[N], qb[N], res[N];
+	float t[N];
+	for (int i = 0; i < N; ++i){
+		qa[i] = quat_from_axis_angle(vec4_new(1, i, 2, 0), i * 15.f);
+		/* Include some nearly identical and opposite pairs */
+		qb[i] = quat_from_axis_angle(vec4_new(i % 4, 1, 0, 0), i % 3 == 0 ? i * 15.f : 200.f - i * 7.f);
+		if (i % 5 == 0){
+			qb[i] = vec4_scale(qb[i], -1);
+		}
+		t[i] = i / (float)N;
+	}
+	quat_slerp_n(qa, qb, t, res, N);
+	for (int i = 0; i < N; ++i){
+		quat_t e = quat_slerp(qa[i], qb[i], t[i]);
+		if (!vec4_near(res[i], e, 2e-6f)){
+			printf("Batched slerp is wrong\n");
+			vec4_print(res[i]);
+			vec4_print(e);
+		}
+	}
+	/* The wider tiers do the first 16 in the AVX loop */
+	for (int tier = 0; tier < SSE_TIER_COUNT; ++tier){
+		const struct sse_kernels *k = sse_kernels_for_tier(tier);
+		if (!k){
+			continue;
+		}
+		k->slerp_n(qa, qb, t, res, N);
+		for (int i = 0; i < N; ++i){
+			if (!vec4_near(res[i], quat_slerp(qa[i], qb[i], t[i]), 2e-6f)){
+				printf("%s batched slerp is wrong\n", k->name);
+				break;
+			}
+		}
+	}
+}
+void decompose_test(void){
+	vec4_t t = vec4_new(1, -2, 3, 0);
+	quat_t r = quat_from_axis_angle(vec4_new(1, 1, 0, 0), 75);
+	vec4_t s = vec4_new(2, 0.5f, 3, 0);
+	mat4_t m = mat4_mult(mat4_translate(t), mat4_mult(mat4_rotate(75, vec4_new(1, 1, 0, 0)),
+		mat4_scale(2, 0.5f, 3)));
+	if (!mat4_near(mat4_compose(t, r, s), m, 1e-5f)){
+		printf("Compose is wrong\n");
+	}
+	vec4_t dt, ds;
+	quat_t dr;
+	if (!mat4_decompose(m, &dt, &dr, &ds)){
+		printf("Decompose failed\n");
+	}
+	/* q and -q are the same rotation */
+	if (quat_dot(dr, r) < 0){
+		dr = vec4_scale(dr, -1);
+	}
+	if (!vec4_near(dt, t, 1e-5f) || !vec4_near(dr, r, 1e-5f) || !vec4_near(ds, s, 1e-5f)){
+		printf("Decompose is wrong\n");
+	}
+	/* Check each branch of the matrix to quaternion conversion */
+	for (int i = 0; i < 4; ++i){
+		quat_t q = quat_from_axis_angle(vec4_new(i == 1, i == 2, i == 3, 0), i == 0 ? 20 : 170);
+		quat_t e = mat4_to_quat(quat_to_mat4(q));
+		if (quat_dot(e, q) < 0){
+			e = vec4_scale(e, -1);
+		}
+		if (!vec4_near(e, q, 1e-5f)){
+			printf("Matrix to quaternion is wrong\n");
+		}
+	}
+	if (mat4_decompose(mat4_scale(1, 0, 1), &dt, &dr, &ds)){
+		printf("Decompose of a degenerate matrix is wrong\n");
+	}
+}
+
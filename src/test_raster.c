@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "dispatch.h"
+#include "raster.h"
+
+/*
+ * Check the rasterizer's coverage against a scalar version of the same
+ * rules, that meshes are drawn without gaps or overlaps, depth testing,
+ * clipping, that the result is the same for any thread count and tier, and
+ * the occlusion queries. The viewport isn't a multiple of the tile size so
+ * the padding gets exercised too
+ */
+#define WIDTH 150
+#define HEIGHT 100
+#define WHITE RASTER_RGBA(255, 255, 255, 255)
+
+void coverage_test(struct raster *r);
+void mesh_test(struct raster *r);
+void depth_test(struct raster *r);
+void clip_test(struct raster *r);
+void thread_test(void);
+void occlusion_test(struct raster *r);
+void ppm_test(struct raster *r);
+float randf(float lo, float hi);
+/* Check if the pixel center is in the triangle, following the top-left rule */
+int covers(const int32_t x[3], const int32_t y[3], int px, int py);
+int32_t snap_x(float x);
+int32_t snap_y(float y);
+
+int main(void){
+	srand(17);
+	struct raster r;
+	if (!raster_init(&r, WIDTH, HEIGHT, 2)){
+		printf("raster_init is wrong\n");
+		return 1;
+	}
+	coverage_test(&r);
+	mesh_test(&r);
+	depth_test(&r);
+	clip_test(&r);
+	occlusion_test(&r);
+	ppm_test(&r);
+	raster_destroy(&r);
+	thread_test();
+
+	struct raster big;
+	if (raster_init(&big, RASTER_MAX_SIZE + 1, 10, 1)){
+		printf("Creating a raster past the max size is wrong\n");
+		raster_destroy(&big);
+	}
+	return 0;
+}
+float randf(float lo, float hi){
+	return lo + (hi - lo) * rand() / RAND_MAX;
+}
+/* The same snapping as the setup, with w = 1 */
+int32_t snap_x(float x){
+	return lrintf((x * 1.f + 1.f) * (WIDTH * 0.5f * RASTER_SUBPIXEL));
+}
+int32_t snap_y(float y){
+	return lrintf((1.f - y * 1.f) * (HEIGHT * 0.5f * RASTER_SUBPIXEL));
+}
+int covers(const int32_t x[3], const int32_t y[3], int px, int py){
+	int64_t sx = px * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2, sy = py * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2;
+	int64_t area = (int64_t)(x[1] - x[0]) * (y[2] - y[0]) - (int64_t)(y[1] - y[0]) * (x[2] - x[0]);
+	if (area == 0){
+		return 0;
+	}
+	/* Go around the triangle in the direction that puts the inside on the positive side */
+	const int v[3] = { 0, area > 0 ? 1 : 2, area > 0 ? 2 : 1 };
+	for (int k = 0; k < 3; ++k){
+		int i = v[k], j = v[(k + 1) % 3];
+		int64_t e = (int64_t)(x[j] - x[i]) * (sy - y[i]) - (int64_t)(y[j] - y[i]) * (sx - x[i]);
+		/* Centers on an edge are covered for edges going up the screen, or flat ones going right */
+		int top_left = y[j] < y[i] || (y[j] == y[i] && x[j] > x[i]);
+		if (e < 0 || (e == 0 && !top_left)){
+			return 0;
+		}
+	}
+	return 1;
+}
+void coverage_test(struct raster *r){
+	mat4_t id = mat4_new();
+	for (int t = 0; t < 300; ++t){
+		/* Some tiny, some long and thin and some on pixel centers exactly */
+		float size = t % 3 == 0 ? 0.05f : 1.5f;
+		vec4_t v[3];
+		v[0] = vec4_new(randf(-1.2f, 1.2f), randf(-1.2f, 1.2f), randf(-0.9f, 0.9f), 1);
+		for (int k = 1; k < 3; ++k){
+			v[k] = vec4_new(v[0].f[0] + randf(-size, size), v[0].f[1] + randf(-size, size), randf(-0.9f, 0.9f), 1);
+		}
+		if (t % 5 == 0){
+			for (int k = 0; k < 3; ++k){
+				v[k].f[0] = (floorf(v[k].f[0] * WIDTH / 2) + 0.5f) / (WIDTH / 2);
+				v[k].f[1] = (floorf(v[k].f[1] * HEIGHT / 2) + 0.5f) / (HEIGHT / 2);
+			}
+		}
+		int32_t x[3], y[3];
+		for (int k = 0; k < 3; ++k){
+			x[k] = snap_x(v[k].f[0]);
+			y[k] = snap_y(v[k].f[1]);
+		}
+		raster_clear(r, 0, 1);
+		raster_draw(r, &id, v, 3, WHITE, 0);
+		for (int py = 0; py < HEIGHT; ++py){
+			for (int px = 0; px < WIDTH; ++px){
+				if ((raster_pixel(r, px, py) == WHITE) != covers(x, y, px, py)){
+					printf("Coverage of triangle %d at (%d, %d) is wrong\n", t, px, py);
+					px = WIDTH;
+					py = HEIGHT;
+					t = 300;
+				}
+			}
+		}
+	}
+}
+void mesh_test(struct raster *r){
+	/*
+	 * A jittered grid reaching past the edges, drawn one triangle at a time to
+	 * count the coverage. The jitter is small enough to keep every quad convex
+	 */
+	enum { GRID = 9 };
+	static vec4_t grid[GRID + 1][GRID + 1];
+	static int count[HEIGHT][WIDTH];
+	memset(count, 0, sizeof(count));
+	for (int i = 0; i <= GRID; ++i){
+		for (int j = 0; j <= GRID; ++j){
+			float jx = i > 0 && i < GRID ? randf(-0.04f, 0.04f) : 0;
+			float jy = j > 0 && j < GRID ? randf(-0.04f, 0.04f) : 0;
+			grid[i][j] = vec4_new(-1.1f + 2.2f * i / GRID + jx, -1.1f + 2.2f * j / GRID + jy, 0, 1);
+		}
+	}
+	mat4_t id = mat4_new();
+	for (int i = 0; i < GRID; ++i){
+		for (int j = 0; j < GRID; ++j){
+			/* Alternate the diagonals and windings */
+			vec4_t quad[6];
+			if ((i + j) % 2){
+				quad[0] = grid[i][j]; quad[1] = grid[i + 1][j]; quad[2] = grid[i + 1][j + 1];
+				quad[3] = grid[i][j]; quad[4] = grid[i][j + 1]; quad[5] = grid[i + 1][j + 1];
+			}
+			else {
+				quad[0] = grid[i + 1][j]; quad[1] = grid[i][j]; quad[2] = grid[i][j + 1];
+				quad[3] = grid[i + 1][j]; quad[4] = grid[i + 1][j + 1]; quad[5] = grid[i][j + 1];
+			}
+			for (int t = 0; t < 2; ++t){
+				raster_clear(r, 0, 1);
+				raster_draw(r, &id, quad + 3 * t, 3, WHITE, 0);
+				for (int py = 0; py < HEIGHT; ++py){
+					for (int px = 0; px < WIDTH; ++px){
+						count[py][px] += raster_pixel(r, px, py) == WHITE;
+					}
+				}
+			}
+		}
+	}
+	for (int py = 0; py < HEIGHT; ++py){
+		for (int px = 0; px < WIDTH; ++px){
+			if (count[py][px] != 1){
+				printf("Mesh coverage of %d at (%d, %d) is wrong\n", count[py][px], px, py);
+				return;
+			}
+		}
+	}
+}
+void depth_test(struct raster *r){
+	const uint32_t red = RASTER_RGBA(255, 0, 0, 255), blue = RASTER_RGBA(0, 0, 255, 255);
+	/* A near quad over the left half and a far one over everything, drawn near first */
+	const vec4_t near[6] = {
+		vec4_new(-1, -1, -0.5f, 1), vec4_new(0, -1, -0.5f, 1), vec4_new(0, 1, -0.5f, 1),
+		vec4_new(-1, -1, -0.5f, 1), vec4_new(0, 1, -0.5f, 1), vec4_new(-1, 1, -0.5f, 1)
+	};
+	const vec4_t far[6] = {
+		vec4_new(-1, -1, 0.5f, 1), vec4_new(1, -1, 0.5f, 1), vec4_new(1, 1, 0.5f, 1),
+		vec4_new(-1, -1, 0.5f, 1), vec4_new(1, 1, 0.5f, 1), vec4_new(-1, 1, 0.5f, 1)
+	};
+	mat4_t id = mat4_new();
+	raster_clear(r, 0, 1);
+	raster_draw(r, &id, near, 6, red, 0);
+	raster_draw(r, &id, far, 6, blue, 0);
+	if (raster_pixel(r, 10, 50) != red || raster_pixel(r, 140, 50) != blue){
+		printf("Depth testing is wrong\n");
+	}
+	if (raster_depth(r, 10, 50) != 0.25f || raster_depth(r, 140, 50) != 0.75f){
+		printf("Depth values are wrong\n");
+	}
+	/* Depth only draws leave the color alone but still occlude */
+	raster_clear(r, 0, 1);
+	raster_draw(r, &id, near, 6, red, RASTER_DEPTH_ONLY);
+	raster_draw(r, &id, far, 6, blue, 0);
+	if (raster_pixel(r, 10, 50) != 0 || raster_depth(r, 10, 50) != 0.25f || raster_pixel(r, 140, 50) != blue){
+		printf("Depth only drawing is wrong\n");
+	}
+	/* Depth varies across a sloped triangle */
+	const vec4_t slope[3] = { vec4_new(-1, -1, -1, 1), vec4_new(3, -1, 1, 1), vec4_new(-1, 3, -1, 1) };
+	raster_clear(r, 0, 1);
+	raster_draw(r, &id, slope, 3, red, 0);
+	float expect = 0.5f * (((2 * 10.5f / WIDTH - 1) + 1) / 2);
+	if (fabsf(raster_depth(r, 10, 50) - expect) > 1e-4f || !(raster_depth(r, 20, 50) > raster_depth(r, 10, 50))){
+		printf("Interpolated depth is wrong\n");
+	}
+}
+void clip_test(struct raster *r){
+	mat4_t proj = mat4_perspective(75, (float)WIDTH / HEIGHT, 1, 100);
+	mat4_t view = mat4_look_at(vec4_new(0, 1, 0, 1), vec4_new(0, 1, -1, 1), vec4_new(0, 1, 0, 0));
+	mat4_t vp = mat4_mult(proj, view);
+	/* A ground plane reaching behind the camera, all of it below the horizon should be drawn */
+	const vec4_t ground[6] = {
+		vec4_new(-1000, 0, 1000, 1), vec4_new(1000, 0, 1000, 1), vec4_new(1000, 0, -1000, 1),
+		vec4_new(-1000, 0, 1000, 1), vec4_new(1000, 0, -1000, 1), vec4_new(-1000, 0, -1000, 1)
+	};
+	raster_clear(r, 0, 1);
+	raster_draw(r, &vp, ground, 6, WHITE, 0);
+	for (int px = 0; px < WIDTH; ++px){
+		if (raster_pixel(r, px, HEIGHT - 1) != WHITE || raster_pixel(r, px, HEIGHT / 2 + 2) != WHITE
+			|| raster_pixel(r, px, HEIGHT / 2 - 2) != 0 || raster_pixel(r, px, 0) != 0)
+		{
+			printf("Clipping the ground plane at column %d is wrong\n", px);
+			break;
+		}
+	}
+	/* The nearest ground visible is at the bottom of the screen, past the near plane */
+	if (!(raster_depth(r, WIDTH / 2, HEIGHT - 1) >= 0 && raster_depth(r, WIDTH / 2, HEIGHT - 1) < raster_depth(r, WIDTH / 2, HEIGHT / 2 + 2))){
+		printf("Ground plane depth is wrong\n");
+	}
+	/* Entirely behind the camera */
+	const vec4_t behind[3] = { vec4_new(-5, -5, 3, 1), vec4_new(5, -5, 3, 1), vec4_new(0, 5, 3, 1) };
+	raster_clear(r, 0, 1);
+	raster_draw(r, &vp, behind, 3, WHITE, 0);
+	/* A triangle way past the guard band covering the whole screen */
+	mat4_t id = mat4_new();
+	const vec4_t huge[3] = { vec4_new(-1000, -1000, 0, 1), vec4_new(3000, -1000, 0, 1), vec4_new(-1000, 3000, 0, 1) };
+	int drawn = 0;
+	for (int py = 0; py < HEIGHT; ++py){
+		for (int px = 0; px < WIDTH; ++px){
+			drawn += raster_pixel(r, px, py) != 0;
+		}
+	}
+	if (drawn){
+		printf("Drawing a triangle behind the camera is wrong\n");
+	}
+	raster_draw(r, &id, huge, 3, WHITE, 0);
+	for (int py = 0; py < HEIGHT; ++py){
+		for (int px = 0; px < WIDTH; ++px){
+			drawn += raster_pixel(r, px, py) == WHITE;
+		}
+	}
+	if (drawn != WIDTH * HEIGHT){
+		printf("Clipping a huge triangle is wrong\n");
+	}
+	/* Everything past the far plane, or off to one side, is culled */
+	const vec4_t far[3] = { vec4_new(-1, -1, 2, 1), vec4_new(1, -1, 2, 1), vec4_new(0, 1, 2, 1) };
+	const vec4_t side[3] = { vec4_new(1.5f, -1, 0, 1), vec4_new(3, -1, 0, 1), vec4_new(2, 1, 0, 1) };
+	raster_clear(r, 0, 1);
+	raster_draw(r, &id, far, 3, WHITE, 0);
+	raster_draw(r, &id, side, 3, WHITE, 0);
+	for (int py = 0; py < HEIGHT; ++py){
+		for (int px = 0; px < WIDTH; ++px){
+			if (raster_pixel(r, px, py) != 0){
+				printf("Culling triangles outside the view is wrong\n");
+				return;
+			}
+		}
+	}
+}
+void thread_test(void){
+	/* Lots of overlapping triangles around a camera, some crossing the near plane */
+	enum { TRIS = 20000 };
+	vec4_t *verts = malloc(3 * TRIS * sizeof(vec4_t));
+	for (int i = 0; i < TRIS; ++i){
+		vec4_t c = vec4_new(randf(-20, 20), randf(-20, 20), randf(-20, 20), 1);
+		for (int k = 0; k < 3; ++k){
+			verts[3 * i + k] = vec4_add(c, vec4_new(randf(-2, 2), randf(-2, 2), randf(-2, 2), 0));
+		}
+	}
+	mat4_t vp = mat4_mult(mat4_perspective(75, (float)WIDTH / HEIGHT, 1, 100),
+		mat4_look_at(vec4_new(0, 0, 0, 1), vec4_new(0, 0, -1, 1), vec4_new(0, 1, 0, 0)));
+	struct raster ref;
+	raster_init(&ref, WIDTH, HEIGHT, 1);
+	/* Color by draw call so the order of the draws and triangles shows up */
+	for (int d = 0; d < 4; ++d){
+		raster_draw(&ref, &vp, verts + 3 * (TRIS / 4) * d, 3 * (TRIS / 4), RASTER_RGBA(50 * d, 255, 0, 255), 0);
+	}
+	const int threads[] = { 2, 4, 7 };
+	for (int t = 0; t < 3; ++t){
+		for (int tier = 0; tier < SSE_TIER_COUNT; ++tier){
+			if (!sse_kernels_for_tier(tier)){
+				continue;
+			}
+			sse_dispatch_set_tier(tier);
+			struct raster r;
+			raster_init(&r, WIDTH, HEIGHT, threads[t]);
+			for (int d = 0; d < 4; ++d){
+				raster_draw(&r, &vp, verts + 3 * (TRIS / 4) * d, 3 * (TRIS / 4), RASTER_RGBA(50 * d, 255, 0, 255), 0);
+			}
+			for (int py = 0; py < HEIGHT; ++py){
+				if (memcmp(&r.target.depth[py * r.target.pitch], &ref.target.depth[py * ref.target.pitch], WIDTH * sizeof(float))
+					|| memcmp(&r.target.color[py * r.target.pitch], &ref.target.color[py * ref.target.pitch], WIDTH * sizeof(uint32_t)))
+				{
+					printf("Drawing with %d threads and %s kernels is wrong\n", threads[t], sse_tier_name(tier));
+					break;
+				}
+			}
+			raster_destroy(&r);
+		}
+	}
+	sse_dispatch_set_tier(sse_cpu_tier());
+	raster_destroy(&ref);
+	free(verts);
+}
+void occlusion_test(struct raster *r){
+	mat4_t vp = mat4_mult(mat4_perspective(75, (float)WIDTH / HEIGHT, 1, 100),
+		mat4_look_at(vec4_new(0, 0, 0, 1), vec4_new(0, 0, -1, 1), vec4_new(0, 1, 0, 0)));
+	const aabb_t behind_wall = { vec4_new(-1, -1, -12, 1), vec4_new(1, 1, -11, 1) };
+	const aabb_t before_wall = { vec4_new(-1, -1, -8, 1), vec4_new(1, 1, -7, 1) };
+	const aabb_t through_near = { vec4_new(-1, -1, -3, 1), vec4_new(1, 1, 2, 1) };
+	const aabb_t off_screen = { vec4_new(30, -1, -12, 1), vec4_new(31, 1, -11, 1) };
+	raster_clear(r, 0, 1);
+	if (!raster_aabb_visible(r, &vp, &behind_wall)){
+		printf("Occlusion query with nothing drawn is wrong\n");
+	}
+	/* A wall across the whole view at z = -10 */
+	const vec4_t wall[6] = {
+		vec4_new(-50, -50, -10, 1), vec4_new(50, -50, -10, 1), vec4_new(50, 50, -10, 1),
+		vec4_new(-50, -50, -10, 1), vec4_new(50, 50, -10, 1), vec4_new(-50, 50, -10, 1)
+	};
+	raster_draw(r, &vp, wall, 6, WHITE, RASTER_DEPTH_ONLY);
+	if (raster_aabb_visible(r, &vp, &behind_wall)){
+		printf("Occlusion query behind a wall is wrong\n");
+	}
+	if (!raster_aabb_visible(r, &vp, &before_wall)){
+		printf("Occlusion query in front of a wall is wrong\n");
+	}
+	if (!raster_aabb_visible(r, &vp, &through_near)){
+		printf("Occlusion query crossing the near plane is wrong\n");
+	}
+	if (raster_aabb_visible(r, &vp, &off_screen)){
+		printf("Occlusion query off screen is wrong\n");
+	}
+	/* A hole in the wall shows the box behind it, even a box just peeking out at the side */
+	const vec4_t half_wall[3] = { vec4_new(-50, -50, -10, 1), vec4_new(0, -50, -10, 1), vec4_new(0, 50, -10, 1) };
+	raster_clear(r, 0, 1);
+	raster_draw(r, &vp, half_wall, 3, WHITE, RASTER_DEPTH_ONLY);
+	if (!raster_aabb_visible(r, &vp, &behind_wall)){
+		printf("Occlusion query through a hole is wrong\n");
+	}
+}
+void ppm_test(struct raster *r){
+	const char *fname = "test_raster.ppm";
+	raster_clear(r, RASTER_RGBA(10, 20, 30, 255), 1);
+	if (!raster_write_ppm(r, fname)){
+		printf("Writing the PPM is wrong\n");
+		return;
+	}
+	FILE *fp = fopen(fname, "rb");
+	int w = 0, h = 0, max = 0;
+	unsigned char px[3] = { 0 };
+	if (!fp || fscanf(fp, "P6 %d %d %d", &w, &h, &max) != 3 || fgetc(fp) != '\n'
+		|| fread(px, 1, 3, fp) != 3)
+	{
+		printf("Reading back the PPM is wrong\n");
+	}
+	else {
+		fseek(fp, 0, SEEK_END);
+		long size = ftell(fp);
+		if (w != WIDTH || h != HEIGHT || max != 255 || px[0] != 10 || px[1] != 20 || px[2] != 30
+			|| size != (long)(strlen("P6\n150 100\n255\n") + 3 * WIDTH * HEIGHT))
+		{
+			printf("PPM contents are wrong\n");
+		}
+	}
+	if (fp){
+		fclose(fp);
+	}
+	remove(fname);
+}
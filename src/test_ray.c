@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "vec4.h"
+#include "ray.h"
+
+/*
+ * Check the ray/triangle and ray/box tests against a scalar double precision
+ * version of each. Random cases that land too close to an edge for float
+ * rounding to agree are skipped
+ */
+#define N 2000
+
+void tri_test(void);
+void box_test(void);
+void edge_test(void);
+void soup_test(void);
+/*
+ * Reference Moller-Trumbore, returns 1 for a hit at t > 0 and 0 for a miss,
+ * or -1 if the case is too close to call
+ */
+int ref_tri(const ray_t *r, const tri_t *tri, float *t, float *u, float *v);
+/* Reference slab test, returns like ref_tri */
+int ref_box(const ray_t *r, const aabb_t *box, float t_max, float *t_near);
+float randf(float lo, float hi);
+vec4_t random_point(float s);
+ray_t random_ray(void);
+
+int main(void){
+	srand(5);
+	tri_test();
+	box_test();
+	edge_test();
+	soup_test();
+
+	return 0;
+}
+float randf(float lo, float hi){
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+vec4_t random_point(float s){
+	return vec4_new(randf(-s, s), randf(-s, s), randf(-s, s), 1);
+}
+ray_t random_ray(void){
+	vec4_t o = random_point(4);
+	/* Aim roughly at the middle so a good number of them hit */
+	vec4_t d = vec4_normalize(vec4_sub(random_point(1.5f), o));
+	return ray_new(o, d);
+}
+int ref_tri(const ray_t *r, const tri_t *tri, float *t, float *u, float *v){
+	double o[3], d[3], e1[3], e2[3], s[3], p[3], q[3];
+	for (int i = 0; i < 3; ++i){
+		o[i] = r->o.f[i];
+		d[i] = r->d.f[i];
+		e1[i] = (double)tri->v1.f[i] - tri->v0.f[i];
+		e2[i] = (double)tri->v2.f[i] - tri->v0.f[i];
+		s[i] = o[i] - tri->v0.f[i];
+	}
+	p[0] = d[1] * e2[2] - d[2] * e2[1];
+	p[1] = d[2] * e2[0] - d[0] * e2[2];
+	p[2] = d[0] * e2[1] - d[1] * e2[0];
+	q[0] = s[1] * e1[2] - s[2] * e1[1];
+	q[1] = s[2] * e1[0] - s[0] * e1[2];
+	q[2] = s[0] * e1[1] - s[1] * e1[0];
+	double det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (fabs(det) < 1e-4){
+		return -1;
+	}
+	double du = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+	double dv = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / det;
+	double dt = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+	const double eps = 1e-3;
+	if (fabs(du) < eps || fabs(dv) < eps || fabs(du + dv - 1) < eps || fabs(dt) < eps){
+		return -1;
+	}
+	*t = dt;
+	*u = du;
+	*v = dv;
+	return du > 0 && dv > 0 && du + dv < 1 && dt > 0;
+}
+int ref_box(const ray_t *r, const aabb_t *box, float t_max, float *t_near){
+	double tn = 0, tf = t_max;
+	for (int i = 0; i < 3; ++i){
+		double d = r->d.f[i];
+		if (fabs(d) < 1e-4){
+			return -1;
+		}
+		double t0 = (box->min.f[i] - (double)r->o.f[i]) / d;
+		double t1 = (box->max.f[i] - (double)r->o.f[i]) / d;
+		tn = fmax(tn, fmin(t0, t1));
+		tf = fmin(tf, fmax(t0, t1));
+	}
+	if (fabs(tn - tf) < 1e-3 || fabs(tn) < 1e-3){
+		return -1;
+	}
+	*t_near = tn;
+	return tn <= tf;
+}
+int near(float a, float b){
+	return fabsf(a - b) <= 1e-3f * fmaxf(1.f, fabsf(b));
+}
+void tri_test(void){
+	int hits = 0;
+	for (int i = 0; i < N; ++i){
+		ray_t rays[4];
+		tri_t tris[4];
+		for (int j = 0; j < 4; ++j){
+			rays[j] = random_ray();
+			tris[j].v0 = random_point(2);
+			tris[j].v1 = random_point(2);
+			tris[j].v2 = random_point(2);
+		}
+		/* One ray against 4 triangles, only the closest hit should be kept */
+		tri4_t t4 = tri4_new(tris, 4, 10);
+		hit_t hit = hit_new(INFINITY);
+		int mask = ray_intersect_tri4(&rays[0], &t4, &hit);
+		int ref_mask = 0, skip = 0;
+		hit_t ref = hit_new(INFINITY);
+		for (int j = 0; j < 4; ++j){
+			float t, u, v;
+			int r = ref_tri(&rays[0], &tris[j], &t, &u, &v);
+			skip |= r < 0;
+			if (r > 0){
+				ref_mask |= 1 << j;
+				if (t < ref.t){
+					ref.t = t;
+					ref.u = u;
+					ref.v = v;
+					ref.prim = 10 + j;
+				}
+			}
+		}
+		if (!skip){
+			if (mask != ref_mask || hit.prim != ref.prim
+				|| (ref_mask && (!near(hit.t, ref.t) || !near(hit.u, ref.u) || !near(hit.v, ref.v))))
+			{
+				printf("Ray vs tri4 %d is wrong\n", i);
+			}
+			/* A closer hit already in the record should block all of them */
+			if (ref_mask){
+				hit_t closer = hit_new(ref.t * 0.5f);
+				if (ray_intersect_tri4(&rays[0], &t4, &closer) || closer.prim != RAY_MISS){
+					printf("Ray vs tri4 %d max t is wrong\n", i);
+				}
+			}
+		}
+
+		/* 4 rays against one triangle, with the last lane inactive */
+		ray4_t r4 = ray4_load_n(rays, 4);
+		hit_t init[4] = { hit_new(INFINITY), hit_new(INFINITY), hit_new(INFINITY), hit_new(INFINITY) };
+		hit4_t h4 = hit4_load_n(init, 4);
+		int pmask = _mm_movemask_ps(ray4_intersect_tri(&r4, &tris[0], 7, ray4_active(3), &h4));
+		hit_t out[4];
+		hit4_store_n(&h4, out, 4);
+		for (int j = 0; j < 4; ++j){
+			float t, u, v;
+			int r = ref_tri(&rays[j], &tris[0], &t, &u, &v);
+			if (r < 0){
+				continue;
+			}
+			int expect = r && j < 3;
+			hits += expect;
+			if (((pmask >> j) & 1) != expect || (out[j].prim == 7) != expect
+				|| (expect && (!near(out[j].t, t) || !near(out[j].u, u) || !near(out[j].v, v))))
+			{
+				printf("Ray4 vs tri %d lane %d is wrong\n", i, j);
+			}
+		}
+	}
+	if (hits < N / 10){
+		printf("Triangle test hit count %d is wrong\n", hits);
+	}
+}
+void box_test(void){
+	int hits = 0;
+	for (int i = 0; i < N; ++i){
+		ray_t rays[4];
+		aabb_t boxes[4];
+		for (int j = 0; j < 4; ++j){
+			rays[j] = random_ray();
+			vec4_t a = random_point(2), b = random_point(2);
+			boxes[j].min.v = _mm_min_ps(a.v, b.v);
+			boxes[j].max.v = _mm_max_ps(a.v, b.v);
+		}
+		float t_max = randf(2, 8);
+
+		/* One ray against 4 boxes, the last lane is padding */
+		aabb4_t b4 = aabb4_new(boxes, 3);
+		__m128 tn;
+		int mask = ray_intersect_aabb4(&rays[0], &b4, t_max, &tn);
+		float ALIGN_16 t_near[4];
+		_mm_store_ps(t_near, tn);
+		for (int j = 0; j < 4; ++j){
+			float t;
+			int r = j < 3 ? ref_box(&rays[0], &boxes[j], t_max, &t) : 0;
+			if (r < 0){
+				continue;
+			}
+			if (((mask >> j) & 1) != r || (r && !near(t_near[j], t))){
+				printf("Ray vs aabb4 %d lane %d is wrong\n", i, j);
+			}
+		}
+
+		/* 4 rays against one box */
+		ray4_t r4 = ray4_load_n(rays, 4);
+		hit_t init[4] = { hit_new(t_max), hit_new(t_max), hit_new(t_max), hit_new(t_max) };
+		hit4_t h4 = hit4_load_n(init, 4);
+		int pmask = _mm_movemask_ps(ray4_intersect_aabb(&r4, &boxes[0], ray4_active(4), &h4, &tn));
+		_mm_store_ps(t_near, tn);
+		for (int j = 0; j < 4; ++j){
+			float t;
+			int r = ref_box(&rays[j], &boxes[0], t_max, &t);
+			if (r < 0){
+				continue;
+			}
+			hits += r;
+			if (((pmask >> j) & 1) != r || (r && !near(t_near[j], t))){
+				printf("Ray4 vs box %d lane %d is wrong\n", i, j);
+			}
+		}
+	}
+	if (hits < N / 10){
+		printf("Box test hit count %d is wrong\n", hits);
+	}
+}
+void edge_test(void){
+	aabb_t box = { { { 0, 0, 0, 0 } }, { { 1, 1, 1, 0 } } };
+	aabb4_t b4 = aabb4_new(&box, 1);
+	__m128 tn;
+	float ALIGN_16 t_near[4];
+	/* Axis aligned rays have infinite 1 / d, one lies right on the box's face */
+	ray_t rays[4] = {
+		ray_new(vec4_new(0.5f, 0.5f, -1, 1), vec4_new(0, 0, 1, 0)),
+		ray_new(vec4_new(0, 0.5f, -1, 1), vec4_new(0, 0, 1, 0)),
+		/* Starting inside */
+		ray_new(vec4_new(0.5f, 0.5f, 0.5f, 1), vec4_new(0, -1, 0, 0)),
+		/* Pointing away */
+		ray_new(vec4_new(0.5f, 0.5f, 2, 1), vec4_new(0, 0, 1, 0)),
+	};
+	int expect[4] = { 1, 1, 1, 0 };
+	float expect_t[4] = { 1, 1, 0, 0 };
+	for (int i = 0; i < 4; ++i){
+		int mask = ray_intersect_aabb4(&rays[i], &b4, INFINITY, &tn);
+		_mm_store_ps(t_near, tn);
+		if (mask != expect[i] || (expect[i] && t_near[0] != expect_t[i])){
+			printf("Ray vs aabb4 edge case %d is wrong\n", i);
+		}
+	}
+	ray4_t r4 = ray4_load_n(rays, 4);
+	hit_t init[4] = { hit_new(INFINITY), hit_new(INFINITY), hit_new(INFINITY), hit_new(INFINITY) };
+	hit4_t h4 = hit4_load_n(init, 4);
+	if (_mm_movemask_ps(ray4_intersect_aabb(&r4, &box, ray4_active(4), &h4, &tn)) != 7){
+		printf("Ray4 vs box edge cases are wrong\n");
+	}
+	/* The box is 1 away so a max t of 0.5 shouldn't reach it */
+	h4.t = _mm_set1_ps(0.5f);
+	if (_mm_movemask_ps(ray4_intersect_aabb(&r4, &box, ray4_active(4), &h4, &tn)) != 4){
+		printf("Ray4 vs box max t is wrong\n");
+	}
+
+	/* A triangle in the z = 0 plane, rays parallel to it, behind it and hitting v0 side on */
+	tri_t tri = { { { 0, 0, 0, 1 } }, { { 1, 0, 0, 1 } }, { { 0, 1, 0, 1 } } };
+	ray_t tr[4] = {
+		ray_new(vec4_new(-1, 0.2f, 0, 1), vec4_new(1, 0, 0, 0)),
+		ray_new(vec4_new(0.2f, 0.2f, 1, 1), vec4_new(0, 0, 1, 0)),
+		ray_new(vec4_new(0.25f, 0.25f, 1, 1), vec4_new(0, 0, -1, 0)),
+		ray_new(vec4_new(0.8f, 0.8f, 1, 1), vec4_new(0, 0, -1, 0)),
+	};
+	r4 = ray4_load_n(tr, 4);
+	h4 = hit4_load_n(init, 4);
+	if (_mm_movemask_ps(ray4_intersect_tri(&r4, &tri, 0, ray4_active(4), &h4)) != 4){
+		printf("Ray4 vs tri edge cases are wrong\n");
+	}
+	hit_t out[4];
+	hit4_store_n(&h4, out, 4);
+	if (out[2].t != 1 || out[2].u != 0.25f || out[2].v != 0.25f || out[2].prim != 0
+		|| out[0].prim != RAY_MISS)
+	{
+		printf("Ray4 vs tri edge case hit record is wrong\n");
+	}
+	/* Padding lanes of a tri4 never get hit */
+	tri4_t t4 = tri4_new(&tri, 1, 3);
+	for (int i = 0; i < 4; ++i){
+		hit_t h = hit_new(INFINITY);
+		int mask = ray_intersect_tri4(&tr[i], &t4, &h);
+		if (mask != (i == 2) || (i == 2 && h.prim != 3)){
+			printf("Ray vs tri4 edge case %d is wrong\n", i);
+		}
+	}
+}
+void soup_test(void){
+	enum { TRIS = 37, RAYS = 203 };
+	tri_t tris[TRIS];
+	ray_t rays[RAYS];
+	hit_t hits[RAYS];
+	for (int i = 0; i < TRIS; ++i){
+		tris[i].v0 = random_point(2);
+		tris[i].v1 = random_point(2);
+		tris[i].v2 = random_point(2);
+	}
+	for (int i = 0; i < RAYS; ++i){
+		rays[i] = random_ray();
+		hits[i] = hit_new(INFINITY);
+	}
+	ray_intersect_tris(tris, TRIS, rays, hits, RAYS);
+	int hit_count = 0;
+	for (int i = 0; i < RAYS; ++i){
+		hit_t ref = hit_new(INFINITY);
+		int skip = 0;
+		for (int j = 0; j < TRIS; ++j){
+			float t, u, v;
+			int r = ref_tri(&rays[i], &tris[j], &t, &u, &v);
+			skip |= r < 0;
+			if (r > 0 && t < ref.t){
+				ref.t = t;
+				ref.prim = j;
+			}
+		}
+		if (skip){
+			continue;
+		}
+		hit_count += ref.prim != RAY_MISS;
+		if (hits[i].prim != ref.prim || (ref.prim != RAY_MISS && !near(hits[i].t, ref.t))){
+			printf("Triangle soup ray %d is wrong\n", i);
+		}
+	}
+	if (hit_count == 0){
+		printf("Triangle soup hit count is wrong\n");
+	}
+}
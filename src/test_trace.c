@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "trace.h"
+
+/*
+ * Make a known number of traced calls on this thread and another one and
+ * check the counts, the nested cycle accounting and the output formats
+ */
+#define CALLS 1000
+
+void count_test(void);
+void cycles_test(void);
+void write_test(void);
+void* thread_calls(void *arg);
+/* Get the stats for a function, or all zeros if it hasn't been called */
+struct sse_trace_stat find_stat(const char *name);
+
+volatile float sink;
+
+int main(void){
+	count_test();
+	cycles_test();
+	write_test();
+
+	return 0;
+}
+struct sse_trace_stat find_stat(const char *name){
+	struct sse_trace_stat stats[SSE_TRACE_MAX_SITES];
+	size_t n = sse_trace_stats(stats, SSE_TRACE_MAX_SITES);
+	for (size_t i = 0; i < n; ++i){
+		if (!strcmp(stats[i].name, name)){
+			return stats[i];
+		}
+	}
+	struct sse_trace_stat none = { name, 0, 0, 0 };
+	return none;
+}
+void* thread_calls(void *arg){
+	vec4_t a = vec4_new(1, 2, 3, 4);
+	for (int i = 0; i < CALLS; ++i){
+		a = vec4_add(a, a);
+	}
+	sink = a.f[0];
+	(void)arg;
+	return NULL;
+}
+void count_test(void){
+	sse_trace_reset();
+	if (sse_trace_stats(NULL, 0) != 0){
+		printf("sse_trace_stats with no calls is wrong\n");
+	}
+	mat4_t m = mat4_new();
+	vec4_t a = vec4_new(1, 2, 3, 4);
+	for (int i = 0; i < CALLS; ++i){
+		m = mat4_mult(m, m);
+		a = vec4_add(a, a);
+	}
+	sink = m.col[0].f[0] + a.f[0];
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, thread_calls, NULL) || pthread_join(thread, NULL)){
+		printf("Starting the thread is wrong\n");
+		return;
+	}
+	/* mat4_mult does its work in mat4_mult_to, so that's counted too */
+	struct sse_trace_stat s = find_stat("mat4_mult");
+	if (s.calls != CALLS || s.cycles || s.self_cycles){
+		printf("mat4_mult count is wrong\n");
+	}
+	if (find_stat("mat4_mult_to").calls != CALLS){
+		printf("mat4_mult_to count is wrong\n");
+	}
+	/* Both threads' calls are summed, the thread that's gone still counts */
+	if (find_stat("vec4_add").calls != 2 * CALLS){
+		printf("vec4_add count is wrong\n");
+	}
+	/* One from this thread and one from the other */
+	if (find_stat("vec4_new").calls != 2 || find_stat("mat4_new").calls != 1){
+		printf("vec4_new and mat4_new counts are wrong\n");
+	}
+	struct sse_trace_stat stats[SSE_TRACE_MAX_SITES];
+	size_t n = sse_trace_stats(stats, SSE_TRACE_MAX_SITES);
+	for (size_t i = 1; i < n; ++i){
+		if (stats[i].calls > stats[i - 1].calls){
+			printf("sse_trace_stats order is wrong\n");
+			break;
+		}
+	}
+	if (n < 4 || sse_trace_stats(stats, 2) != 2){
+		printf("sse_trace_stats count is wrong\n");
+	}
+	sse_trace_reset();
+	if (find_stat("vec4_add").calls || sse_trace_stats(stats, SSE_TRACE_MAX_SITES)){
+		printf("sse_trace_reset is wrong\n");
+	}
+}
+void cycles_test(void){
+	sse_trace_reset();
+	sse_trace_set_cycles(1);
+	mat4_t m = mat4_rotate(30, vec4_new(0, 1, 0, 0));
+	for (int i = 0; i < CALLS; ++i){
+		m = mat4_mult(m, m);
+	}
+	sink = m.col[0].f[0];
+	sse_trace_set_cycles(0);
+	/*
+	 * mat4_mult only ever calls mat4_mult_to, so the time in it is its own time
+	 * plus all of mat4_mult_to's, to the tick
+	 */
+	struct sse_trace_stat mult = find_stat("mat4_mult"), mult_to = find_stat("mat4_mult_to");
+	if (!mult.cycles || !mult_to.cycles || mult.cycles != mult.self_cycles + mult_to.cycles
+		|| mult_to.self_cycles != mult_to.cycles)
+	{
+		printf("Nested cycles are wrong\n");
+	}
+	struct sse_trace_stat stats[SSE_TRACE_MAX_SITES];
+	size_t n = sse_trace_stats(stats, SSE_TRACE_MAX_SITES);
+	for (size_t i = 1; i < n; ++i){
+		if (stats[i].self_cycles > stats[i - 1].self_cycles){
+			printf("sse_trace_stats cycle order is wrong\n");
+			break;
+		}
+	}
+	/* With cycles off again only the calls go up */
+	m = mat4_mult(m, m);
+	struct sse_trace_stat after = find_stat("mat4_mult");
+	if (after.calls != CALLS + 1 || after.cycles != mult.cycles){
+		printf("Turning cycles off is wrong\n");
+	}
+}
+void write_test(void){
+	FILE *fp = tmpfile();
+	if (!fp){
+		printf("tmpfile is wrong\n");
+		return;
+	}
+	char buf[4096];
+	if (!sse_trace_write(fp, SSE_TRACE_JSON)){
+		printf("sse_trace_write JSON is wrong\n");
+	}
+	rewind(fp);
+	size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+	buf[len] = '\0';
+	if (buf[0] != '[' || !strstr(buf, "{\"name\": \"mat4_mult\", \"calls\": 1001, \"cycles\": ")
+		|| strcmp(buf + len - 2, "]\n"))
+	{
+		printf("sse_trace_write JSON is wrong\n");
+	}
+	rewind(fp);
+	if (!sse_trace_write(fp, SSE_TRACE_TABLE)){
+		printf("sse_trace_write table is wrong\n");
+	}
+	long end = ftell(fp);
+	rewind(fp);
+	len = fread(buf, 1, end < (long)sizeof(buf) - 1 ? (size_t)end : sizeof(buf) - 1, fp);
+	buf[len] = '\0';
+	if (strncmp(buf, "function", 8) || !strstr(buf, "self cycles") || !strstr(buf, "\nmat4_mult ")){
+		printf("sse_trace_write table is wrong\n");
+	}
+	fclose(fp);
+}
@@ -4,9 +4,11 @@
 
 /* Make sure the math is correctly implemented for SSE */
 void basic_test(void);
+void register_test(void);
 
 int main(void){
 	basic_test();
+	register_test();
 
 	return 0;
 }
@@ -80,4 +82,53 @@ void basic_test(void){
 		printf("Normalize is wrong\n");
 	}
 }
+void register_test(void){
+	vec4_t a = vec4_new(1, 2, 3, 4);
+	vec4_t b = vec4_new(4, 3, 2, 1);
+	vec4_t r;
+	r.v = vec4_dot_v(a, b);
+	if (!vec4_eq(r, vec4_new(20, 20, 20, 20))){
+		printf("Splatted dot is wrong\n");
+	}
+	r.v = vec4_dot3_v(a, b);
+	if (!vec4_eq(r, vec4_new(16, 16, 16, 16))){
+		printf("Splatted dot3 is wrong\n");
+	}
+	r.v = vec4_len_v(vec4_new(0, 3, 0, 4));
+	if (!vec4_eq(r, vec4_new(5, 5, 5, 5))){
+		printf("Splatted length is wrong\n");
+	}
+	r = vec4_normalize_fast(a);
+	vec4_t e = vec4_normalize(a);
+	for (int i = 0; i < 4; ++i){
+		if (fabsf(r.f[i] - e.f[i]) > 4e-7f * fabsf(e.f[i])){
+			printf("Fast normalize is wrong\n");
+		}
+	}
+	printf("fast normalize(a)=");
+	vec4_print(r);
+	if (vec4_eq(a, b) || !vec4_eq(a, a)){
+		printf("Equality is wrong\n");
+	}
+	r = a;
+	vec4_set_x(&r, 9);
+	if (!vec4_eq(r, vec4_new(9, 2, 3, 4))){
+		printf("vec4_set_x is wrong\n");
+	}
+	r = a;
+	vec4_set_y(&r, 9);
+	if (!vec4_eq(r, vec4_new(1, 9, 3, 4))){
+		printf("vec4_set_y is wrong\n");
+	}
+	r = a;
+	vec4_set_z(&r, 9);
+	if (!vec4_eq(r, vec4_new(1, 2, 9, 4))){
+		printf("vec4_set_z is wrong\n");
+	}
+	r = a;
+	vec4_set_w(&r, 9);
+	if (!vec4_eq(r, vec4_new(1, 2, 3, 9))){
+		printf("vec4_set_w is wrong\n");
+	}
+}
 
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <math.h>
+#include "vec4.hpp"
+
+/*
+ * Check the C++ vec4 against the C functions, and that sums of products are
+ * fused: built with FMA they should round like fmaf and without it like a
+ * multiply then an add
+ */
+void basic_test();
+void fuse_test();
+/* a * b + c like native_ops::fmadd does it */
+float madd(float a, float b, float c);
+/* Check all four components of v against e exactly */
+void check(const char *what, const sse::vec4 &v, const float *e);
+
+/* Construction and reads are constexpr */
+constexpr sse::vec4 k(1, 2, 3, 4);
+static_assert(k.x() == 1 && k.y() == 2 && k.z() == 3 && k.w() == 4, "constexpr vec4 is wrong");
+static_assert(k[2] == 3 && sse::vec4(5)[3] == 5, "constexpr vec4 is wrong");
+
+int main(){
+	basic_test();
+	fuse_test();
+
+	return 0;
+}
+float madd(float a, float b, float c){
+#ifdef __FMA__
+	return fmaf(a, b, c);
+#else
+	return a * b + c;
+#endif
+}
+void check(const char *what, const sse::vec4 &v, const float *e){
+	for (int i = 0; i < 4; ++i){
+		if (v[i] != e[i]){
+			printf("%s is wrong\n", what);
+			return;
+		}
+	}
+}
+void basic_test(){
+	sse::vec4 a(1, 2, 3, 4), b(4, 3, 2, 1);
+	vec4_t ca = a, cb = b;
+	if (!vec4_eq(ca, vec4_new(1, 2, 3, 4)) || sse::vec4(ca) != a){
+		printf("Converting to and from vec4_t is wrong\n");
+	}
+	if (a + b != sse::vec4(vec4_add(ca, cb)) || a - b != sse::vec4(vec4_sub(ca, cb))
+		|| a * b != sse::vec4(vec4_mult(ca, cb)) || a / b != sse::vec4(0.25f, 2.f / 3, 1.5f, 4))
+	{
+		printf("Vector operators are wrong\n");
+	}
+	if (a * 2.f != sse::vec4(vec4_scale(ca, 2)) || 2.f * a != a * 2.f
+		|| a / 2.f != sse::vec4(0.5f, 1, 1.5f, 2))
+	{
+		printf("Scalar operators are wrong\n");
+	}
+	if (-a != sse::vec4(-1, -2, -3, -4) || -(a - b) != b - a){
+		printf("Negation is wrong\n");
+	}
+	if (a == b || !(a == a) || a != a){
+		printf("Equality is wrong\n");
+	}
+	sse::vec4 r = a;
+	r += b;
+	r -= a * 2.f;
+	r *= b;
+	r /= 2.f;
+	r *= 4.f;
+	r /= sse::vec4(2);
+	if (r != sse::vec4(12, 3, -2, -3)){
+		printf("Compound assignment is wrong\n");
+	}
+	r = a;
+	r.set_x(9);
+	r.set_z(8);
+	r.set(3, 7);
+	if (r != sse::vec4(9, 2, 8, 7)){
+		printf("Setting components is wrong\n");
+	}
+	r.set_y(6);
+	r.set_w(5);
+	if (r.x() != 9 || r.y() != 6 || r.z() != 8 || r.w() != 5){
+		printf("Reading components is wrong\n");
+	}
+	if (sse::dot(a, b) != vec4_dot(ca, cb) || sse::length(a) != vec4_len(ca)
+		|| sse::normalize(a) != sse::vec4(vec4_normalize(ca))
+		|| sse::cross(a, b) != sse::vec4(vec4_cross(ca, cb)))
+	{
+		printf("Geometric functions are wrong\n");
+	}
+	if (sse::min(a, b) != sse::vec4(1, 2, 2, 1) || sse::max(a, b) != sse::vec4(4, 3, 3, 4)){
+		printf("min and max are wrong\n");
+	}
+	/* An expression kept around holds copies, changing a afterwards doesn't change it */
+	auto e = a * b + b;
+	a = b;
+	if (sse::vec4(e) != sse::vec4(8, 9, 8, 5)){
+		printf("Stored expression is wrong\n");
+	}
+}
+void fuse_test(){
+	/*
+	 * a * s is 1 + 2^-11 + 2^-24, which isn't a float, so fused and unfused
+	 * results differ when c cancels the rest of it
+	 */
+	const float h = 1 + 1.f / 4096;
+	const float af[4] = { h, h, 1, -h }, sf[4] = { h, -h, 3, h };
+	const float bf[4] = { 1.f / (1 << 24), 2, h, h }, tf[4] = { 1, 5, h, -h };
+	const float cf[4] = { 1 + 1.f / 2048, -1 - 1.f / 2048, 0.25f, 2 };
+	sse::vec4 a(af[0], af[1], af[2], af[3]), s(sf[0], sf[1], sf[2], sf[3]);
+	sse::vec4 b(bf[0], bf[1], bf[2], bf[3]), t(tf[0], tf[1], tf[2], tf[3]);
+	sse::vec4 c(cf[0], cf[1], cf[2], cf[3]);
+	float e[4];
+
+	for (int i = 0; i < 4; ++i){
+		e[i] = madd(bf[i], tf[i], madd(af[i], sf[i], -cf[i]));
+	}
+	check("a * s + b * t - c", a * s + b * t - c, e);
+	for (int i = 0; i < 4; ++i){
+		e[i] = madd(af[i], sf[i], cf[i]);
+	}
+	check("a * s + c", a * s + c, e);
+	check("c + a * s", c + a * s, e);
+	sse::vec4 r = c;
+	r += a * s;
+	check("r += a * s", r, e);
+	for (int i = 0; i < 4; ++i){
+		e[i] = madd(-af[i], sf[i], cf[i]);
+	}
+	check("c - a * s", c - a * s, e);
+	check("-(a * s) + c", -(a * s) + c, e);
+	for (int i = 0; i < 4; ++i){
+		e[i] = madd(af[i], sf[i], -cf[i]);
+	}
+	check("a * s - c", a * s - c, e);
+	for (int i = 0; i < 4; ++i){
+		e[i] = madd(-bf[i], tf[i], madd(af[i], sf[i], -cf[i]));
+	}
+	check("a * s - c - b * t", a * s - c - b * t, e);
+	/* With the scalar on either side */
+	for (int i = 0; i < 4; ++i){
+		e[i] = madd(bf[i], h, madd(af[i], h, -cf[i]));
+	}
+	check("a * h + h * b - c", a * h + h * b - c, e);
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <math.h>
+#include "vec4.h"
+#include "vec4_math.h"
+
+/* Check the SIMD functions against libm within the documented error */
+void accuracy_test(void);
+void special_test(void);
+/* Error of r in ulps of the correctly rounded float result */
+double ulp_error(float r, double expect);
+
+int main(void){
+	accuracy_test();
+	special_test();
+
+	return 0;
+}
+double ulp_error(float r, double expect){
+	int e;
+	frexp((float)expect, &e);
+	double ulp = ldexp(1.0, e - 24);
+	if (ulp < ldexp(1.0, -149)){
+		ulp = ldexp(1.0, -149);
+	}
+	return fabs(r - expect) / ulp;
+}
+void accuracy_test(void){
+	double sin_err = 0, cos_err = 0, tan_err = 0, exp_err = 0, log_err = 0;
+	double asin_err = 0, acos_err = 0;
+	for (int i = 0; i < 100000; ++i){
+		float x = -3.14159f + 6.28318f * i / 100000.f;
+		vec4_t v = vec4_new(x, x * 0.45f, x + 40.f, x * 10.f);
+		vec4_t s, c;
+		vec4_sincos(v, &s, &c);
+		for (int j = 0; j < 4; ++j){
+			/* Only |x| <= pi is held to the ulp bound, the rest is absolute */
+			if (j < 2){
+				sin_err = fmax(sin_err, ulp_error(s.f[j], sin(v.f[j])));
+				cos_err = fmax(cos_err, ulp_error(c.f[j], cos(v.f[j])));
+			}
+			else if (fabs(s.f[j] - sin(v.f[j])) > 8e-8 || fabs(c.f[j] - cos(v.f[j])) > 8e-8){
+				printf("sin/cos absolute error is wrong at %g\n", v.f[j]);
+			}
+		}
+		vec4_t t = vec4_tan(vec4_new(x * 0.47f, x * 0.3f, x * 0.1f, 0));
+		tan_err = fmax(tan_err, ulp_error(t.f[0], tan(x * 0.47f)));
+		tan_err = fmax(tan_err, ulp_error(t.f[1], tan(x * 0.3f)));
+
+		vec4_t e = vec4_exp(vec4_new(x * 28.f, x, x * 27.5f, -x * 28.f));
+		for (int j = 0; j < 4; ++j){
+			float in = j == 0 ? x * 28.f : j == 1 ? x : j == 2 ? x * 27.5f : -x * 28.f;
+			exp_err = fmax(exp_err, ulp_error(e.f[j], exp(in)));
+		}
+		float l_in[4] = { i + 1.f, (i + 1) * 1e-20f, (i + 1) * 1e25f, 1.f + i * 1e-6f };
+		vec4_t l = vec4_log(vec4_new(l_in[0], l_in[1], l_in[2], l_in[3]));
+		for (int j = 0; j < 4; ++j){
+			log_err = fmax(log_err, ulp_error(l.f[j], log(l_in[j])));
+		}
+		/* All of [-1, 1], and close to +-1 and 0.5 where the half angle identity kicks in */
+		float a_in[4] = { -1.f + 2.f * i / 99999.f, 1.f - i * 1e-10f, -1.f + i * 1e-10f,
+			0.5f + (i - 50000) * 1e-9f };
+		vec4_t as = vec4_asin(vec4_new(a_in[0], a_in[1], a_in[2], a_in[3]));
+		vec4_t ac = vec4_acos(vec4_new(a_in[0], a_in[1], a_in[2], a_in[3]));
+		for (int j = 0; j < 4; ++j){
+			asin_err = fmax(asin_err, ulp_error(as.f[j], asin(a_in[j])));
+			acos_err = fmax(acos_err, ulp_error(ac.f[j], acos(a_in[j])));
+		}
+	}
+	printf("Max error: sin %.2f ulp, cos %.2f ulp, tan %.2f ulp, exp %.2f ulp, log %.2f ulp,"
+		" asin %.2f ulp, acos %.2f ulp\n",
+		sin_err, cos_err, tan_err, exp_err, log_err, asin_err, acos_err);
+	if (sin_err > 1.5 || cos_err > 1.5){
+		printf("sin/cos is wrong\n");
+	}
+	if (tan_err > 3){
+		printf("tan is wrong\n");
+	}
+	if (exp_err > 1.5){
+		printf("exp is wrong\n");
+	}
+	if (log_err > 1){
+		printf("log is wrong\n");
+	}
+	if (asin_err > 2.5){
+		printf("asin is wrong\n");
+	}
+	if (acos_err > 1.5){
+		printf("acos is wrong\n");
+	}
+}
+void special_test(void){
+	vec4_t l = vec4_log(vec4_new(0, -1, INFINITY, 1));
+	if (!isinf(l.f[0]) || l.f[0] > 0 || !isnan(l.f[1]) || !isinf(l.f[2]) || l.f[3] != 0){
+		printf("log special cases are wrong\n");
+	}
+	vec4_t e = vec4_exp(vec4_new(-200, 200, 0, NAN));
+	if (e.f[0] != 0 || !isinf(e.f[1]) || e.f[2] != 1 || !isnan(e.f[3])){
+		printf("exp special cases are wrong\n");
+	}
+	vec4_t s = vec4_sin(vec4_new(0, -0.f, 1.57079633f, -1.57079633f));
+	if (s.f[0] != 0 || s.f[2] != 1 || s.f[3] != -1){
+		printf("sin special cases are wrong\n");
+	}
+	vec4_t as = vec4_asin(vec4_new(1, -1, 1.0001f, -2));
+	vec4_t ac = vec4_acos(vec4_new(1, -1, 1.0001f, NAN));
+	if (as.f[0] != 1.57079633f || as.f[1] != -1.57079633f || !isnan(as.f[2]) || !isnan(as.f[3])
+		|| ac.f[0] != 0 || ac.f[1] != 3.14159265f || !isnan(ac.f[2]) || !isnan(ac.f[3]))
+	{
+		printf("asin/acos special cases are wrong\n");
+	}
+}
+
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include "vec4.h"
+#include "vec4x4.h"
+
+/* Make sure the packet math matches doing each vector with the vec4 functions */
+void basic_test(void);
+void tail_test(void);
+
+int main(void){
+	basic_test();
+	tail_test();
+
+	return 0;
+}
+void basic_test(void){
+	vec4_t a[4], b[4], c[4];
+	for (int i = 0; i < 4; ++i){
+		a[i] = vec4_new(i + 1, 2, 3 - i, 1);
+		b[i] = vec4_new(4, i, 2, i + 1);
+	}
+	vec4x4_t pa = vec4x4_load(a);
+	vec4x4_t pb = vec4x4_load(b);
+	printf("a=\n");
+	vec4x4_print(pa);
+	printf("b=\n");
+	vec4x4_print(pb);
+
+	vec4x4_store(pa, c);
+	for (int i = 0; i < 4; ++i){
+		if (!vec4_eq(a[i], c[i])){
+			printf("Load/store round trip is wrong\n");
+		}
+	}
+
+	float ALIGN_16 d[4];
+	_mm_store_ps(d, vec4x4_dot(pa, pb));
+	for (int i = 0; i < 4; ++i){
+		if (d[i] != vec4_dot(a[i], b[i])){
+			printf("Dot product is wrong\n");
+		}
+	}
+	printf("a dot b = [%.2f, %.2f, %.2f, %.2f]\n", d[0], d[1], d[2], d[3]);
+
+	_mm_store_ps(d, vec4x4_dot3(pa, pb));
+	for (int i = 0; i < 4; ++i){
+		if (d[i] != a[i].f[0] * b[i].f[0] + a[i].f[1] * b[i].f[1] + a[i].f[2] * b[i].f[2]){
+			printf("Dot3 product is wrong\n");
+		}
+	}
+
+	vec4x4_store(vec4x4_cross(pa, pb), c);
+	for (int i = 0; i < 4; ++i){
+		if (!vec4_eq(c[i], vec4_cross(a[i], b[i]))){
+			printf("Cross product is wrong\n");
+		}
+	}
+	printf("a X b=\n");
+	vec4x4_print(vec4x4_cross(pa, pb));
+
+	vec4x4_store(vec4x4_add(pa, pb), c);
+	for (int i = 0; i < 4; ++i){
+		if (!vec4_eq(c[i], vec4_add(a[i], b[i]))){
+			printf("Addition is wrong\n");
+		}
+	}
+	vec4x4_store(vec4x4_sub(pa, pb), c);
+	for (int i = 0; i < 4; ++i){
+		if (!vec4_eq(c[i], vec4_sub(a[i], b[i]))){
+			printf("Subtraction is wrong\n");
+		}
+	}
+	vec4x4_store(vec4x4_mult(pa, pb), c);
+	for (int i = 0; i < 4; ++i){
+		if (!vec4_eq(c[i], vec4_mult(a[i], b[i]))){
+			printf("Vector mult is wrong\n");
+		}
+	}
+	vec4x4_store(vec4x4_scale(pa, 2), c);
+	for (int i = 0; i < 4; ++i){
+		if (!vec4_eq(c[i], vec4_scale(a[i], 2))){
+			printf("Scalar mult is wrong\n");
+		}
+	}
+
+	if (vec4x4_eq(pa, pa) != 0xf || vec4x4_eq(pa, pb) != 0){
+		printf("Equality is wrong\n");
+	}
+
+	vec4x4_t p = vec4x4_splat(vec4_new(5, 0, 0, 0));
+	_mm_store_ps(d, vec4x4_len(p));
+	if (d[0] != 5.f || d[3] != 5.f){
+		printf("Length is wrong\n");
+	}
+	if (vec4x4_eq(vec4x4_normalize(p), vec4x4_splat(vec4_new(1, 0, 0, 0))) != 0xf){
+		printf("Normalize is wrong\n");
+	}
+}
+void tail_test(void){
+	vec4_t a[3], c[4];
+	for (int i = 0; i < 3; ++i){
+		a[i] = vec4_new(i, i, i, i);
+	}
+	c[3] = vec4_new(7, 7, 7, 7);
+	vec4x4_t p = vec4x4_load_n(a, 3);
+	vec4x4_store_n(vec4x4_scale(p, 2), c, 3);
+	for (int i = 0; i < 3; ++i){
+		if (!vec4_eq(c[i], vec4_scale(a[i], 2))){
+			printf("Tail load/store is wrong\n");
+		}
+	}
+	if (!vec4_eq(c[3], vec4_new(7, 7, 7, 7))){
+		printf("Tail store wrote past the end\n");
+	}
+}
+
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include "vec4.h"
+#include "vec4x8.h"
+
+#ifdef __AVX__
+/* Make sure the packet math matches doing each vector with the vec4 functions */
+void basic_test(void);
+
+int main(void){
+	basic_test();
+
+	return 0;
+}
+void basic_test(void){
+	vec4_t a[8], b[8], c[8];
+	for (int i = 0; i < 8; ++i){
+		a[i] = vec4_new(i + 1, 2, 3 - i, 1);
+		b[i] = vec4_new(4, i, 2, i + 1);
+	}
+	vec4x8_t pa = vec4x8_load(a);
+	vec4x8_t pb = vec4x8_load(b);
+
+	vec4x8_store(pa, c);
+	for (int i = 0; i < 8; ++i){
+		if (!vec4_eq(a[i], c[i])){
+			printf("Load/store round trip is wrong\n");
+		}
+	}
+
+	float ALIGN_32 d[8];
+	_mm256_store_ps(d, vec4x8_dot(pa, pb));
+	for (int i = 0; i < 8; ++i){
+		if (d[i] != vec4_dot(a[i], b[i])){
+			printf("Dot product is wrong\n");
+		}
+	}
+
+	_mm256_store_ps(d, vec4x8_dot3(pa, pb));
+	for (int i = 0; i < 8; ++i){
+		if (d[i] != a[i].f[0] * b[i].f[0] + a[i].f[1] * b[i].f[1] + a[i].f[2] * b[i].f[2]){
+			printf("Dot3 product is wrong\n");
+		}
+	}
+
+	vec4x8_store(vec4x8_cross(pa, pb), c);
+	for (int i = 0; i < 8; ++i){
+		if (!vec4_eq(c[i], vec4_cross(a[i], b[i]))){
+			printf("Cross product is wrong\n");
+		}
+	}
+	printf("a X b=\n");
+	vec4x8_print(vec4x8_cross(pa, pb));
+
+	vec4x8_store(vec4x8_sub(vec4x8_add(pa, pb), pb), c);
+	for (int i = 0; i < 8; ++i){
+		if (!vec4_eq(c[i], a[i])){
+			printf("Addition/subtraction is wrong\n");
+		}
+	}
+	vec4x8_store(vec4x8_scale(vec4x8_mult(pa, pb), 2), c);
+	for (int i = 0; i < 8; ++i){
+		if (!vec4_eq(c[i], vec4_scale(vec4_mult(a[i], b[i]), 2))){
+			printf("Multiplication is wrong\n");
+		}
+	}
+
+	if (vec4x8_eq(pa, pa) != 0xff || vec4x8_eq(pa, pb) != 0){
+		printf("Equality is wrong\n");
+	}
+
+	vec4x8_store_n(vec4x8_load_n(b, 5), c, 5);
+	for (int i = 0; i < 5; ++i){
+		if (!vec4_eq(c[i], b[i])){
+			printf("Tail load/store is wrong\n");
+		}
+	}
+
+	vec4x8_t p = vec4x8_splat(vec4_new(0, 3, 4, 0));
+	_mm256_store_ps(d, vec4x8_len(p));
+	if (d[0] != 5.f || d[7] != 5.f){
+		printf("Length is wrong\n");
+	}
+	if (vec4x8_eq(vec4x8_normalize(p), vec4x8_splat(vec4_new(0, 0.6f, 0.8f, 0))) != 0xff){
+		printf("Normalize is wrong\n");
+	}
+}
+#else
+int main(void){
+	printf("vec4x8 requires AVX, skipping\n");
+	return 0;
+}
+#endif
+
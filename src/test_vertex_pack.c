@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "vertex_pack.h"
+#include "dispatch.h"
+
+/*
+ * Check the packed formats against scalar references and their documented
+ * error bounds, then check every tier's kernels give the same results as the
+ * SSE2 versions compiled in here
+ */
+/* Not a multiple of 4 or 8 so every tier's tail loops run */
+#define N 4099
+/* Documented worst case angle between a normal and its decoded octahedral encoding */
+#define OCT_MAX_ERROR 7e-5
+
+void half_test(void);
+void snorm16_test(void);
+void unorm8_test(void);
+void oct_test(void);
+void fused_test(void);
+uint16_t half_ref(float f);
+float randf(float lo, float hi);
+double angle(vec4_t a, vec4_t b);
+
+int main(void){
+	srand(7);
+	half_test();
+	snorm16_test();
+	unorm8_test();
+	oct_test();
+	fused_test();
+
+	return 0;
+}
+float randf(float lo, float hi){
+	return lo + rand() / (float)RAND_MAX * (hi - lo);
+}
+/* Round to the nearest half the slow way, NaNs all come back as 0x7e00 */
+uint16_t half_ref(float f){
+	uint16_t sign = signbit(f) ? 0x8000 : 0;
+	double a = fabs(f);
+	if (isnan(f)){
+		return 0x7e00;
+	}
+	if (a >= 65520){
+		return sign | 0x7c00;
+	}
+	int e;
+	frexp(a, &e);
+	/* The halves around a are spaced 2^(exp - 10) apart, subnormals share the smallest spacing */
+	int exp = a == 0 || e - 1 < -14 ? -14 : e - 1;
+	double q = nearbyint(a / ldexp(1, exp - 10));
+	if (q < 1024){
+		return sign | (uint16_t)q;
+	}
+	if (q == 2048){
+		q = 1024;
+		++exp;
+	}
+	return sign | (uint16_t)((exp + 15) << 10 | ((int)q - 1024));
+}
+/* Pack and unpack every half, and floats spread over the whole range */
+void half_test(void){
+	enum { HALVES = 65536 };
+	uint16_t *h = malloc(HALVES * sizeof(uint16_t)), *back = malloc(HALVES * sizeof(uint16_t));
+	vec4_t *f = malloc(HALVES / 4 * sizeof(vec4_t));
+	for (int i = 0; i < HALVES; ++i){
+		h[i] = i;
+	}
+	vpack_unhalf_n(h, f, HALVES / 4);
+	const float *fl = (const float*)f;
+	for (int i = 0; i < HALVES; ++i){
+		int e = (i >> 10) & 0x1f, m = i & 0x3ff;
+		float ref = e == 31 ? (m ? NAN : INFINITY) : e ? ldexpf(1024 + m, e - 25) : ldexpf(m, -24);
+		ref = i & 0x8000 ? -ref : ref;
+		if (isnan(ref) ? !isnan(fl[i]) : memcmp(&ref, &fl[i], sizeof(float))){
+			printf("vpack_unhalf_n of %04x is wrong\n", i);
+			break;
+		}
+	}
+	vpack_half_n(f, back, HALVES / 4);
+	for (int i = 0; i < HALVES; ++i){
+		if (back[i] != h[i] && !(isnan(fl[i]) && (back[i] & 0x7fff) > 0x7c00)){
+			printf("vpack_half_n round trip of %04x is wrong\n", i);
+			break;
+		}
+	}
+
+	/* Edge cases, then float bit patterns strided over all of them */
+	const float edges[] = {
+		0, -0.f, 1, -1, 65504, 65519.99f, 65520, -65520, 1e10f, INFINITY, -INFINITY, NAN,
+		ldexpf(1, -14), ldexpf(1, -24), ldexpf(1, -25), ldexpf(3, -26), ldexpf(1, -26),
+		1 + ldexpf(1, -11), 1 + ldexpf(3, -11), 1 - ldexpf(1, -12), 2047.5f, 2048.5f, 0.1f, 1e-9f
+	};
+	const size_t n_edges = sizeof(edges) / sizeof(edges[0]);
+	vec4_t *in = malloc(N * sizeof(vec4_t)), *out = malloc(N * sizeof(vec4_t));
+	uint16_t *res = malloc(N * 4 * sizeof(uint16_t)), *tier_res = malloc(N * 4 * sizeof(uint16_t));
+	float *src = (float*)in;
+	for (size_t i = 0; i < 4 * N; ++i){
+		uint32_t bits = (uint32_t)(i * 1048573u);
+		if (i < n_edges){
+			src[i] = edges[i];
+		}
+		else {
+			memcpy(&src[i], &bits, sizeof(float));
+		}
+	}
+	vpack_half_n(in, res, N);
+	for (size_t i = 0; i < 4 * N; ++i){
+		uint16_t ref = half_ref(src[i]);
+		if (res[i] != ref && !(isnan(src[i]) && (res[i] & 0x7fff) > 0x7c00)){
+			printf("vpack_half_n of %.9g is wrong, got %04x not %04x\n", src[i], res[i], ref);
+			break;
+		}
+	}
+	/* The error on the normal range is at most half an ulp */
+	vec4_t *err_in = malloc(N * sizeof(vec4_t));
+	for (int i = 0; i < N; ++i){
+		err_in[i] = vec4_new(randf(-65504, 65504), randf(-1, 1), randf(-1e-3f, 1e-3f), ldexpf(randf(1, 2), -20));
+	}
+	vpack_half_n(err_in, res, N);
+	vpack_unhalf_n(res, out, N);
+	for (int i = 0; i < 4 * N; ++i){
+		float a = err_in[i / 4].f[i % 4], b = out[i / 4].f[i % 4];
+		float bound = fabsf(a) >= ldexpf(1, -14) ? fabsf(a) * ldexpf(1, -11) : ldexpf(1, -25);
+		if (fabsf(a - b) > bound){
+			printf("vpack_half_n error bound is wrong\n");
+			break;
+		}
+	}
+
+	/* Every tier's (F16C or not) conversions have to match bit for bit */
+	vpack_half_n(in, res, N);
+	vpack_unhalf_n(h, f, HALVES / 4);
+	vec4_t *tier_f = malloc(HALVES / 4 * sizeof(vec4_t));
+	for (int t = 0; t < SSE_TIER_COUNT; ++t){
+		const struct sse_kernels *k = sse_kernels_for_tier(t);
+		if (!k){
+			continue;
+		}
+		k->half_n(in, tier_res, N);
+		for (size_t i = 0; i < 4 * N; ++i){
+			if (tier_res[i] != res[i] && !(isnan(src[i]) && (tier_res[i] & 0x7fff) > 0x7c00)){
+				printf("%s half_n is wrong\n", k->name);
+				break;
+			}
+		}
+		k->unhalf_n(h, tier_f, HALVES / 4);
+		const float *tf = (const float*)tier_f;
+		for (int i = 0; i < HALVES; ++i){
+			if (isnan(fl[i]) ? !isnan(tf[i]) : memcmp(&fl[i], &tf[i], sizeof(float))){
+				printf("%s unhalf_n is wrong\n", k->name);
+				break;
+			}
+		}
+	}
+	free(h);
+	free(back);
+	free(f);
+	free(tier_f);
+	free(in);
+	free(out);
+	free(err_in);
+	free(res);
+	free(tier_res);
+}
+void snorm16_test(void){
+	vec4_t in[N], out[N];
+	int16_t packed[4 * N];
+	for (int i = 0; i < N; ++i){
+		in[i] = vec4_new(randf(-1, 1), randf(-1.5f, 1.5f), randf(-1e-4f, 1e-4f), i & 1 ? 1 : -1);
+	}
+	vpack_snorm16_n(in, packed, N);
+	vpack_unsnorm16_n(packed, out, N);
+	for (int i = 0; i < N; ++i){
+		if (packed[4 * i + 3] != (i & 1 ? 32767 : -32767)){
+			printf("vpack_snorm16_n of +-1 is wrong\n");
+			break;
+		}
+	}
+	for (int i = 0; i < 4 * N; ++i){
+		float c = fminf(fmaxf(in[i / 4].f[i % 4], -1), 1);
+		if (fabsf(out[i / 4].f[i % 4] - c) > 0.5f / 32767 + 1e-7f){
+			printf("vpack_snorm16_n error bound is wrong\n");
+			break;
+		}
+	}
+	int16_t lowest[4] = { -32768, -32767, 0, 1 };
+	vpack_unsnorm16_n(lowest, out, 1);
+	if (!vec4_eq(out[0], vec4_new(-1, -1, 0, 1 / 32767.f))){
+		printf("vpack_unsnorm16_n is wrong\n");
+	}
+}
+void unorm8_test(void){
+	vec4_t in[N], out[N];
+	uint8_t packed[4 * N];
+	for (int i = 0; i < N; ++i){
+		in[i] = vec4_new(randf(0, 1), randf(-0.5f, 1.5f), i / (float)N, i & 1);
+	}
+	vpack_unorm8_n(in, packed, N);
+	vpack_ununorm8_n(packed, out, N);
+	for (int i = 0; i < N; ++i){
+		if (packed[4 * i + 3] != (i & 1 ? 255 : 0)){
+			printf("vpack_unorm8_n of 0 and 1 is wrong\n");
+			break;
+		}
+	}
+	for (int i = 0; i < 4 * N; ++i){
+		float c = fminf(fmaxf(in[i / 4].f[i % 4], 0), 1);
+		if (fabsf(out[i / 4].f[i % 4] - c) > 0.5f / 255 + 1e-6f){
+			printf("vpack_unorm8_n error bound is wrong\n");
+			break;
+		}
+	}
+}
+/* Angle between a and b in radians, their lengths don't matter */
+double angle(vec4_t a, vec4_t b){
+	double dot = 0;
+	for (int j = 0; j < 3; ++j){
+		dot += (double)a.f[j] * b.f[j];
+	}
+	/* acos loses too much near 1, get the angle from the cross product instead */
+	double cx = (double)a.f[1] * b.f[2] - (double)a.f[2] * b.f[1];
+	double cy = (double)a.f[2] * b.f[0] - (double)a.f[0] * b.f[2];
+	double cz = (double)a.f[0] * b.f[1] - (double)a.f[1] * b.f[0];
+	return atan2(sqrt(cx * cx + cy * cy + cz * cz), dot);
+}
+void oct_test(void){
+	vec4_t in[N], out[N];
+	int16_t packed[2 * N];
+	const vec4_t axes[] = {
+		vec4_new(1, 0, 0, 0), vec4_new(-1, 0, 0, 0), vec4_new(0, 1, 0, 0), vec4_new(0, -1, 0, 0),
+		vec4_new(0, 0, 1, 0), vec4_new(0, 0, -1, 0), vec4_new(1, 1, 1, 0), vec4_new(-1, -1, -1, 0),
+		vec4_new(1, -1, -1e-8f, 0), vec4_new(0, 0, 0, 0)
+	};
+	const int n_axes = sizeof(axes) / sizeof(axes[0]);
+	for (int i = 0; i < N; ++i){
+		if (i < n_axes){
+			in[i] = axes[i];
+			continue;
+		}
+		/* Scaled too, encoding shouldn't care about the length */
+		vec4_t v;
+		do {
+			v = vec4_new(randf(-1, 1), randf(-1, 1), randf(-1, 1), 1);
+		} while (vec4_dot(v, v) > 2 || vec4_dot(v, v) < 1e-3f);
+		in[i] = vec4_scale(v, randf(0.1f, 10));
+	}
+	vpack_oct_n(in, packed, N);
+	vpack_unoct_n(packed, out, N);
+	double max_err = 0;
+	for (int i = 0; i < N; ++i){
+		if (out[i].f[3] != 0){
+			printf("vpack_unoct_n w is wrong\n");
+			break;
+		}
+		if (i == n_axes - 1){
+			if (!vec4_eq(out[i], vec4_new(0, 0, 1, 0))){
+				printf("vpack_oct_n of a zero vector is wrong\n");
+			}
+			continue;
+		}
+		double err = angle(out[i], in[i]);
+		max_err = err > max_err ? err : max_err;
+	}
+	if (max_err > OCT_MAX_ERROR){
+		printf("vpack_oct_n error bound is wrong, %g radians\n", max_err);
+	}
+	/* The axes are exactly representable so they should come back exactly */
+	for (int i = 0; i < 6; ++i){
+		if (!vec4_eq(out[i], axes[i])){
+			printf("vpack_oct_n of axis %d is wrong\n", i);
+		}
+	}
+}
+/* The fused transform and pack against transforming then packing */
+void fused_test(void){
+	mat4_t m = mat4_mult(mat4_translate(vec4_new(1, -2, 3, 1)),
+		mat4_mult(mat4_rotate(40, vec4_new(1, 1, 0, 0)), mat4_scale(2, 0.5f, 1)));
+	mat4_t nm = mat4_normal_matrix(m);
+	static vec4_t in[N], xf[N], a[N], b[N];
+	static uint16_t half_ref_out[4 * N], half_out[4 * N];
+	static int16_t oct_ref_out[2 * N], oct_out[2 * N];
+	for (int i = 0; i < N; ++i){
+		in[i] = vec4_new(randf(-100, 100), randf(-100, 100), randf(-100, 100), 1);
+	}
+	const enum mat4_xform_mode modes[] = { MAT4_XFORM_FULL, MAT4_XFORM_POINT, MAT4_XFORM_VECTOR };
+	for (int mi = 0; mi < 3; ++mi){
+		mat4_xform_n(&m, in, xf, N, modes[mi]);
+		vpack_half_n(xf, half_ref_out, N);
+		vpack_xform_half_n(&m, in, half_out, N, modes[mi]);
+		if (memcmp(half_out, half_ref_out, sizeof(half_out))){
+			printf("vpack_xform_half_n mode %d is wrong\n", mi);
+		}
+		for (int t = 0; t < SSE_TIER_COUNT; ++t){
+			const struct sse_kernels *k = sse_kernels_for_tier(t);
+			if (!k){
+				continue;
+			}
+			/* FMA can round the transform differently, so allow an ulp of the half */
+			k->xform_half_n(&m, in, half_out, N, modes[mi]);
+			vpack_unhalf_n(half_ref_out, a, N);
+			vpack_unhalf_n(half_out, b, N);
+			for (int i = 0; i < 4 * N; ++i){
+				float x = a[i / 4].f[i % 4], y = b[i / 4].f[i % 4];
+				if (fabsf(x - y) > fmaxf(fabsf(x), 1) * ldexpf(1, -10)){
+					printf("%s xform_half_n mode %d is wrong\n", k->name, mi);
+					break;
+				}
+			}
+		}
+	}
+
+	mat4_transform_vectors(&nm, in, xf, N);
+	vpack_oct_n(xf, oct_ref_out, N);
+	vpack_xform_oct_n(&nm, in, oct_out, N);
+	if (memcmp(oct_out, oct_ref_out, sizeof(oct_out))){
+		printf("vpack_xform_oct_n is wrong\n");
+	}
+	vpack_unoct_n(oct_ref_out, a, N);
+	for (int t = 0; t < SSE_TIER_COUNT; ++t){
+		const struct sse_kernels *k = sse_kernels_for_tier(t);
+		if (!k){
+			continue;
+		}
+		k->xform_oct_n(&nm, in, oct_out, N);
+		vpack_unoct_n(oct_out, b, N);
+		for (int i = 0; i < N; ++i){
+			if (angle(a[i], b[i]) > 2 * OCT_MAX_ERROR){
+				printf("%s xform_oct_n is wrong\n", k->name);
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "vec4.h"
+#include "mat4.h"
+#include "xform.h"
+
+/*
+ * Build random forests and check the world matrices against walking up the
+ * parents with mat4_mult, after adding nodes and after moving some of them
+ */
+#define NODES 12000
+
+void tree_test(int threads);
+/* Compute the reference world matrices by handle, parents always come first */
+void reference(const struct xform_tree *t, mat4_t *world);
+int check(const struct xform_tree *t, const char *what);
+int mat4_near(mat4_t a, mat4_t b, float eps);
+mat4_t random_local(void);
+
+int main(void){
+	tree_test(1);
+	tree_test(4);
+
+	return 0;
+}
+mat4_t random_local(void){
+	float a = rand() % 360;
+	vec4_t t = vec4_new(rand() % 5 - 2, rand() % 3, rand() % 5 - 2, 1);
+	return mat4_mult(mat4_translate(t), mat4_rotate(a, vec4_new(0, 1, 1, 0)));
+}
+void reference(const struct xform_tree *t, mat4_t *world){
+	for (size_t h = 0; h < t->count; ++h){
+		xform_node_t p = t->parent_handle[h];
+		mat4_t local = xform_local(t, h);
+		world[h] = p == XFORM_NONE ? local : mat4_mult(world[p], local);
+	}
+}
+int check(const struct xform_tree *t, const char *what){
+	static mat4_t world[NODES];
+	reference(t, world);
+	for (size_t h = 0; h < t->count; ++h){
+		if (!mat4_near(xform_world(t, h), world[h], 1e-4f)){
+			printf("%s: world matrix of node %zu is wrong\n", what, h);
+			return 0;
+		}
+	}
+	return 1;
+}
+void tree_test(int threads){
+	struct xform_tree t;
+	srand(3);
+	if (!xform_tree_init(&t, NODES, threads)){
+		printf("Tree init is wrong\n");
+		return;
+	}
+	if (xform_add(&t, 5, mat4_new()) != XFORM_NONE){
+		printf("Adding under a missing parent is wrong\n");
+	}
+	if (xform_set_local(&t, 0, mat4_new()) || xform_set_local(&t, XFORM_NONE, mat4_new())){
+		printf("Setting a missing node is wrong\n");
+	}
+	/*
+	 * A few roots with wide levels, so the threaded update gets used, and some
+	 * deep chains. Keep the depth down so the error doesn't build up too much
+	 */
+	for (int i = 0; i < 3; ++i){
+		xform_add(&t, XFORM_NONE, random_local());
+	}
+	for (int i = 3; i < NODES / 2; ++i){
+		xform_node_t p = i < 200 ? rand() % 3 : rand() % i;
+		if (p >= 200 && rand() % 4){
+			p = 3 + rand() % 197;
+		}
+		xform_add(&t, p, random_local());
+	}
+	xform_update(&t);
+	check(&t, "Initial update");
+	size_t n;
+	xform_updated(&t, &n);
+	if (n != t.count){
+		printf("Initial update count is wrong\n");
+	}
+
+	/* Nothing moved so nothing should be recomputed */
+	xform_update(&t);
+	xform_updated(&t, &n);
+	if (n != 0){
+		printf("Update with nothing changed is wrong\n");
+	}
+
+	/* Move a leaf, only it should be updated */
+	xform_node_t leaf = t.count - 1;
+	xform_set_local(&t, leaf, random_local());
+	xform_update(&t);
+	const uint32_t *up = xform_updated(&t, &n);
+	if (n != 1 || xform_slot_node(&t, up[0]) != leaf){
+		printf("Leaf update is wrong\n");
+	}
+	check(&t, "Leaf update");
+
+	/* Move a root, its whole subtree gets updated */
+	xform_set_local(&t, 1, random_local());
+	xform_update(&t);
+	check(&t, "Root update");
+
+	/* Move a bunch of random nodes, some of them in each other's subtrees */
+	for (int i = 0; i < 500; ++i){
+		xform_set_local(&t, rand() % t.count, random_local());
+	}
+	xform_update(&t);
+	check(&t, "Random update");
+
+	/* Adding nodes moves things around, handles should still work */
+	for (int i = NODES / 2; i < NODES; ++i){
+		xform_add(&t, rand() % i, random_local());
+	}
+	xform_set_local(&t, 7, random_local());
+	xform_update(&t);
+	check(&t, "Update after adding");
+	if (xform_add(&t, 0, mat4_new()) != XFORM_NONE){
+		printf("Adding to a full tree is wrong\n");
+	}
+	xform_tree_destroy(&t);
+}
+int mat4_near(mat4_t a, mat4_t b, float eps){
+	for (int i = 0; i < 4; ++i){
+		for (int j = 0; j < 4; ++j){
+			if (fabsf(a.col[i].f[j] - b.col[i].f[j]) > eps * fmaxf(1.f, fabsf(b.col[i].f[j]))){
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
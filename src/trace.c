@@ -0,0 +1,140 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "trace.h"
+
+#ifdef SSE_FIDDLE_TRACE
+
+int sse_trace_timing;
+__thread struct sse_trace_thread *sse_trace_tls;
+
+/* The registered functions and threads, only added to under the lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *site_names[SSE_TRACE_MAX_SITES];
+static int site_count;
+static struct sse_trace_thread *threads;
+
+struct sse_trace_counters* sse_trace_counters_slow(struct sse_trace_site *site){
+	pthread_mutex_lock(&lock);
+	if (!sse_trace_tls){
+		struct sse_trace_thread *t = calloc(1, sizeof(struct sse_trace_thread));
+		if (t){
+			t->next = threads;
+			/* Published with a release store so the readers walking the list see it zeroed */
+			__atomic_store_n(&threads, t, __ATOMIC_RELEASE);
+			sse_trace_tls = t;
+		}
+	}
+	int id = site->id;
+	if (id == -1){
+		/* The same function inlined in another file may have registered already */
+		for (id = 0; id < site_count && strcmp(site_names[id], site->name); ++id){
+		}
+		if (id == site_count){
+			if (site_count == SSE_TRACE_MAX_SITES){
+				id = -2;
+			}
+			else {
+				site_names[site_count] = site->name;
+				__atomic_store_n(&site_count, site_count + 1, __ATOMIC_RELEASE);
+			}
+		}
+		__atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&lock);
+	return sse_trace_tls && id >= 0 ? &sse_trace_tls->counters[id] : NULL;
+}
+void sse_trace_set_cycles(int on){
+	__atomic_store_n(&sse_trace_timing, on, __ATOMIC_RELAXED);
+}
+void sse_trace_reset(void){
+	pthread_mutex_lock(&lock);
+	for (struct sse_trace_thread *t = threads; t; t = t->next){
+		for (int i = 0; i < SSE_TRACE_MAX_SITES; ++i){
+			__atomic_store_n(&t->counters[i].calls, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&t->counters[i].cycles, 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&t->counters[i].self_cycles, 0, __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+}
+static int stat_cmp(const void *pa, const void *pb){
+	const struct sse_trace_stat *a = pa, *b = pb;
+	if (a->self_cycles != b->self_cycles){
+		return a->self_cycles < b->self_cycles ? 1 : -1;
+	}
+	if (a->calls != b->calls){
+		return a->calls < b->calls ? 1 : -1;
+	}
+	return strcmp(a->name, b->name);
+}
+size_t sse_trace_stats(struct sse_trace_stat *out, size_t max){
+	struct sse_trace_stat all[SSE_TRACE_MAX_SITES];
+	pthread_mutex_lock(&lock);
+	int n = site_count;
+	for (int i = 0; i < n; ++i){
+		all[i].name = site_names[i];
+		all[i].calls = all[i].cycles = all[i].self_cycles = 0;
+	}
+	for (struct sse_trace_thread *t = threads; t; t = t->next){
+		for (int i = 0; i < n; ++i){
+			all[i].calls += __atomic_load_n(&t->counters[i].calls, __ATOMIC_RELAXED);
+			all[i].cycles += __atomic_load_n(&t->counters[i].cycles, __ATOMIC_RELAXED);
+			all[i].self_cycles += __atomic_load_n(&t->counters[i].self_cycles, __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	/* Drop the ones that haven't been called since the last reset */
+	size_t count = 0;
+	for (int i = 0; i < n; ++i){
+		if (all[i].calls){
+			all[count++] = all[i];
+		}
+	}
+	qsort(all, count, sizeof(all[0]), stat_cmp);
+	count = count < max ? count : max;
+	if (count){
+		memcpy(out, all, count * sizeof(all[0]));
+	}
+	return count;
+}
+int sse_trace_write(FILE *fp, enum sse_trace_format format){
+	struct sse_trace_stat stats[SSE_TRACE_MAX_SITES];
+	size_t n = sse_trace_stats(stats, SSE_TRACE_MAX_SITES);
+	uint64_t calls = 0, self = 0;
+	for (size_t i = 0; i < n; ++i){
+		calls += stats[i].calls;
+		self += stats[i].self_cycles;
+	}
+	if (format == SSE_TRACE_JSON){
+		fprintf(fp, "[\n");
+		for (size_t i = 0; i < n; ++i){
+			fprintf(fp, "\t{\"name\": \"%s\", \"calls\": %llu, \"cycles\": %llu, \"self_cycles\": %llu}%s\n",
+				stats[i].name, (unsigned long long)stats[i].calls, (unsigned long long)stats[i].cycles,
+				(unsigned long long)stats[i].self_cycles, i + 1 < n ? "," : "");
+		}
+		fprintf(fp, "]\n");
+	}
+	else if (self){
+		fprintf(fp, "%-28s %12s %8s %14s %14s %10s %8s\n", "function", "calls", "calls%", "cycles",
+			"self cycles", "self/call", "self%");
+		for (size_t i = 0; i < n; ++i){
+			const struct sse_trace_stat *s = &stats[i];
+			fprintf(fp, "%-28s %12llu %7.2f%% %14llu %14llu %10.1f %7.2f%%\n", s->name,
+				(unsigned long long)s->calls, 100.0 * s->calls / calls, (unsigned long long)s->cycles,
+				(unsigned long long)s->self_cycles, (double)s->self_cycles / s->calls,
+				100.0 * s->self_cycles / self);
+		}
+	}
+	else {
+		fprintf(fp, "%-28s %12s %8s\n", "function", "calls", "calls%");
+		for (size_t i = 0; i < n; ++i){
+			fprintf(fp, "%-28s %12llu %7.2f%%\n", stats[i].name, (unsigned long long)stats[i].calls,
+				100.0 * stats[i].calls / calls);
+		}
+	}
+	return !ferror(fp);
+}
+
+#endif
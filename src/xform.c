@@ -0,0 +1,333 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "dispatch.h"
+#include "jobs.h"
+#include "xform.h"
+
+/* Matrices gathered from scattered nodes are multiplied this many at a time */
+#define GATHER 32
+
+struct level_args {
+	struct xform_tree *tree;
+	const uint32_t *slots;
+};
+
+static void update_slots(struct xform_tree *t, const uint32_t *slots, size_t n);
+
+static void update_range(void *arg, size_t lo, size_t hi){
+	struct level_args *a = arg;
+	update_slots(a->tree, a->slots + lo, hi - lo);
+}
+/*
+ * Recompute the world matrices of the slots, which are sorted and all on the
+ * same level. Runs of siblings are multiplied by their parent directly, the
+ * stragglers are gathered up and done GATHER at a time
+ */
+static void update_slots(struct xform_tree *t, const uint32_t *slots, size_t n){
+	mat4_t pa[GATHER], la[GATHER], out[GATHER];
+	uint32_t dst[GATHER];
+	size_t g = 0;
+	for (size_t i = 0; i < n;){
+		uint32_t s = slots[i], p = t->parent[s];
+		size_t run = 1;
+		while (i + run < n && slots[i + run] == s + run && t->parent[s + run] == p){
+			++run;
+		}
+		if (p == XFORM_NONE){
+			memcpy(t->world + s, t->local + s, run * sizeof(mat4_t));
+		}
+		else if (run >= 4){
+			sse_kernels->premult_n(t->world + p, t->local + s, t->world + s, run);
+		}
+		else {
+			for (size_t k = 0; k < run; ++k){
+				pa[g] = t->world[p];
+				la[g] = t->local[s + k];
+				dst[g] = s + k;
+				if (++g == GATHER){
+					sse_kernels->mult_n(pa, la, out, g);
+					for (size_t j = 0; j < g; ++j){
+						t->world[dst[j]] = out[j];
+					}
+					g = 0;
+				}
+			}
+		}
+		i += run;
+	}
+	if (g){
+		sse_kernels->mult_n(pa, la, out, g);
+		for (size_t j = 0; j < g; ++j){
+			t->world[dst[j]] = out[j];
+		}
+	}
+}
+
+/*
+ * Scratch arrays used while sorting are allocated after these in the arena
+ * and released once the sort is done
+ */
+static size_t arena_size(size_t capacity){
+	size_t pad = ARENA_CACHE_LINE;
+	size_t mats = capacity * sizeof(mat4_t) + pad;
+	size_t ids = (capacity + 1) * sizeof(uint32_t) + pad;
+	size_t flags = capacity + pad;
+	/* 9 id arrays and the dirty flags persist, sorting needs 3 more id arrays and flags */
+	return 2 * mats + 12 * ids + 2 * flags;
+}
+int xform_tree_init(struct xform_tree *t, size_t capacity, int threads){
+	memset(t, 0, sizeof(*t));
+	if (capacity == 0 || capacity >= XFORM_NONE){
+		return 0;
+	}
+	int flags = capacity * sizeof(mat4_t) >= 16 * 1024 * 1024 ? ARENA_HUGE_PAGES : 0;
+	if (!arena_init(&t->mem, arena_size(capacity), flags)){
+		return 0;
+	}
+	t->capacity = capacity;
+	t->local = arena_alloc_mat4(&t->mem, capacity);
+	t->world = arena_alloc_mat4(&t->mem, capacity);
+	uint32_t **ids[] = { &t->parent, &t->first_child, &t->child_count, &t->slot, &t->handle,
+		&t->parent_handle, &t->pending, &t->updated, &t->level_start };
+	for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); ++i){
+		*ids[i] = arena_alloc(&t->mem, (capacity + 1) * sizeof(uint32_t), ARENA_CACHE_LINE);
+	}
+	t->dirty = arena_alloc(&t->mem, capacity, ARENA_CACHE_LINE);
+	t->sorted = 1;
+	if (threads > 1){
+		t->jobs = jobs_create(threads, 0);
+	}
+	return 1;
+}
+void xform_tree_destroy(struct xform_tree *t){
+	jobs_destroy(t->jobs);
+	arena_destroy(&t->mem);
+	memset(t, 0, sizeof(*t));
+}
+static void mark_dirty(struct xform_tree *t, uint32_t s){
+	if (!t->dirty[s]){
+		t->dirty[s] = 1;
+		t->pending[t->pending_count++] = s;
+	}
+}
+xform_node_t xform_add(struct xform_tree *t, xform_node_t parent, mat4_t local){
+	if (t->count == t->capacity || (parent != XFORM_NONE && parent >= t->count)){
+		return XFORM_NONE;
+	}
+	/* Append it for now, it'll be moved to the right place in the next update */
+	xform_node_t h = t->count++;
+	t->slot[h] = h;
+	t->handle[h] = h;
+	t->parent_handle[h] = parent;
+	t->local[h] = local;
+	t->dirty[h] = 0;
+	t->sorted = 0;
+	mark_dirty(t, h);
+	return h;
+}
+int xform_set_local(struct xform_tree *t, xform_node_t node, mat4_t local){
+	if (node >= t->count){
+		return 0;
+	}
+	uint32_t s = t->slot[node];
+	t->local[s] = local;
+	mark_dirty(t, s);
+	return 1;
+}
+/*
+ * Lay the nodes out in breadth first order, building the child ranges and level
+ * boundaries, and move the matrices and flags to their new slots
+ */
+static void sort_nodes(struct xform_tree *t){
+	const size_t n = t->count;
+	arena_mark_t mark = arena_mark(&t->mem);
+	uint32_t *child_start = arena_alloc(&t->mem, (n + 1) * sizeof(uint32_t), ARENA_CACHE_LINE);
+	uint32_t *children = arena_alloc(&t->mem, (n + 1) * sizeof(uint32_t), ARENA_CACHE_LINE);
+	uint32_t *order = arena_alloc(&t->mem, (n + 1) * sizeof(uint32_t), ARENA_CACHE_LINE);
+	uint8_t *moved = arena_alloc(&t->mem, n, ARENA_CACHE_LINE);
+
+	/* Children of each handle, in the order they were added */
+	memset(child_start, 0, (n + 1) * sizeof(uint32_t));
+	for (size_t h = 0; h < n; ++h){
+		if (t->parent_handle[h] != XFORM_NONE){
+			++child_start[t->parent_handle[h] + 1];
+		}
+	}
+	for (size_t h = 0; h < n; ++h){
+		child_start[h + 1] += child_start[h];
+	}
+	for (size_t h = 0; h < n; ++h){
+		uint32_t p = t->parent_handle[h];
+		if (p != XFORM_NONE){
+			children[child_start[p]++] = h;
+		}
+	}
+	/* child_start[p] now points at the end of p's children, shift it back */
+	for (size_t h = n; h > 0; --h){
+		child_start[h] = child_start[h - 1];
+	}
+	child_start[0] = 0;
+
+	/* Breadth first, the roots are level 0, order maps new slot to handle */
+	size_t len = 0, levels = 0;
+	for (size_t h = 0; h < n; ++h){
+		if (t->parent_handle[h] == XFORM_NONE){
+			order[len++] = h;
+		}
+	}
+	for (size_t q = 0; q < len;){
+		size_t level_end = len;
+		t->level_start[levels++] = q;
+		for (; q < level_end; ++q){
+			uint32_t h = order[q];
+			t->first_child[q] = len;
+			t->child_count[q] = child_start[h + 1] - child_start[h];
+			for (uint32_t c = child_start[h]; c < child_start[h + 1]; ++c){
+				order[len++] = children[c];
+			}
+		}
+	}
+	t->level_start[levels] = n;
+	t->levels = levels;
+
+	/* Move each slot's data to its new place, following the cycles of the permutation */
+	memset(moved, 0, n);
+	for (size_t q = 0; q < n; ++q){
+		if (moved[q]){
+			continue;
+		}
+		/* Walk backwards: the data for slot q is currently at slot[order[q]] */
+		size_t dst = q;
+		mat4_t local = t->local[q], world = t->world[q];
+		uint8_t dirty = t->dirty[q];
+		for (;;){
+			moved[dst] = 1;
+			size_t src = t->slot[order[dst]];
+			if (src == q){
+				t->local[dst] = local;
+				t->world[dst] = world;
+				t->dirty[dst] = dirty;
+				break;
+			}
+			t->local[dst] = t->local[src];
+			t->world[dst] = t->world[src];
+			t->dirty[dst] = t->dirty[src];
+			dst = src;
+		}
+	}
+	/* Pending slots are remapped through the old handles before the map changes */
+	for (size_t i = 0; i < t->pending_count; ++i){
+		t->pending[i] = t->handle[t->pending[i]];
+	}
+	for (size_t q = 0; q < n; ++q){
+		uint32_t h = order[q];
+		t->slot[h] = q;
+		t->handle[q] = h;
+	}
+	for (size_t q = 0; q < n; ++q){
+		uint32_t p = t->parent_handle[t->handle[q]];
+		t->parent[q] = p == XFORM_NONE ? XFORM_NONE : t->slot[p];
+	}
+	for (size_t i = 0; i < t->pending_count; ++i){
+		t->pending[i] = t->slot[t->pending[i]];
+	}
+	arena_reset_to(&t->mem, mark);
+	t->sorted = 1;
+}
+static int cmp_slot(const void *a, const void *b){
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return (x > y) - (x < y);
+}
+/* Find the level containing slot s */
+static size_t level_of(const struct xform_tree *t, uint32_t s){
+	size_t lo = 0, hi = t->levels;
+	while (hi - lo > 1){
+		size_t mid = (lo + hi) / 2;
+		if (t->level_start[mid] <= s){
+			lo = mid;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+void xform_update(struct xform_tree *t){
+	if (!t->sorted){
+		sort_nodes(t);
+	}
+	/* When lots of nodes moved it's cheaper to rebuild the list in order from the flags */
+	if (t->pending_count > t->count / 32){
+		t->pending_count = 0;
+		for (size_t s = 0; s < t->count; ++s){
+			if (t->dirty[s]){
+				t->pending[t->pending_count++] = s;
+			}
+		}
+	}
+	else {
+		qsort(t->pending, t->pending_count, sizeof(uint32_t), cmp_slot);
+	}
+	t->updated_count = 0;
+	/*
+	 * Each level's work is the children of the nodes updated on the level above
+	 * merged with the nodes on this level whose local matrix changed. The lists
+	 * are built in updated, prev is the range of it holding the last level
+	 */
+	size_t prev_lo = 0, prev_hi = 0, pi = 0, level = 0;
+	for (;;){
+		/* If nothing was updated on the level above skip ahead to the next changed node */
+		if (prev_lo == prev_hi || level + 1 == t->levels){
+			if (pi == t->pending_count){
+				break;
+			}
+			level = level_of(t, t->pending[pi]);
+		}
+		else {
+			++level;
+		}
+		uint32_t level_end = t->level_start[level + 1];
+		size_t lo = t->updated_count;
+		size_t p = prev_lo;
+		uint32_t c = 0, c_end = 0;
+		for (;;){
+			/* Next child of the level above not yet taken */
+			while (c == c_end && p < prev_hi){
+				uint32_t s = t->updated[p++];
+				c = t->first_child[s];
+				c_end = c + t->child_count[s];
+			}
+			int have_c = c != c_end;
+			int have_pending = pi < t->pending_count && t->pending[pi] < level_end;
+			if (!have_c && !have_pending){
+				break;
+			}
+			uint32_t next;
+			if (have_pending && (!have_c || t->pending[pi] <= c)){
+				next = t->pending[pi++];
+				if (have_c && next == c){
+					++c;
+				}
+			}
+			else {
+				next = c++;
+			}
+			t->updated[t->updated_count++] = next;
+		}
+		size_t n = t->updated_count - lo;
+		if (t->jobs && n >= XFORM_PARALLEL_MIN){
+			struct level_args a = { t, t->updated + lo };
+			jobs_parallel_for(t->jobs, n, JOBS_GRAIN(mat4_t), update_range, &a);
+		}
+		else {
+			update_slots(t, t->updated + lo, n);
+		}
+		prev_lo = lo;
+		prev_hi = t->updated_count;
+	}
+	for (size_t i = 0; i < t->updated_count; ++i){
+		t->dirty[t->updated[i]] = 0;
+	}
+	t->pending_count = 0;
+}